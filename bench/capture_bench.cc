@@ -0,0 +1,222 @@
+#include <array>
+#include <random>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#include <benchmark/benchmark.h>
+
+#include <X11/Xlib.h>
+
+#include "screen_grabber.h"
+
+namespace {
+/**
+ * @brief Раскладка пикселей XImage
+ */
+struct PixelFormat {
+    const char* name;   ///< Название для вывода
+    int bits_per_pixel; ///< 24 или 32
+    int byte_order;     ///< LSBFirst или MSBFirst
+};
+
+const std::array<PixelFormat, 3> FORMATS{{
+    {"bgra32", 32, LSBFirst},
+    {"argb32", 32, MSBFirst},
+    {"bgr24",  24, LSBFirst},
+}};
+
+/**
+ * @brief Вид синтетического снимка экрана
+ */
+enum Scene {
+    K_DESKTOP,  ///< Однотонный фон, окна с рамками и строками "текста"
+    K_DOCUMENT, ///< Белая страница с плотным текстом
+    K_GRADIENT, ///< Градиентные обои
+    K_PHOTO     ///< Шум (фотография, видео) - худший случай для PNG
+};
+
+const std::array<const char*, 4> SCENE_NAMES{"desktop", "document", "gradient", "photo"};
+
+/**
+ * @brief Сгенерировать RGB-кадр, похожий на снимок экрана
+ * @param scene Вид снимка
+ * @param width Ширина
+ * @param height Высота
+ * @return Пиксели RGB (3 байта на пиксель)
+ */
+std::vector<uint8_t> MakeScene(Scene scene, int width, int height) {
+    std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * 3);
+    std::mt19937 rng(static_cast<uint32_t>(scene) + 1);
+
+    auto put = [&](int x, int y, uint8_t r, uint8_t g, uint8_t b) {
+        size_t idx{(static_cast<size_t>(y) * width + x) * 3};
+
+        pixels[idx + 0] = r;
+        pixels[idx + 1] = g;
+        pixels[idx + 2] = b;
+    };
+
+    for (int y{0}; y < height; ++y) {
+        for (int x{0}; x < width; ++x) {
+            switch (scene) {
+                case K_DESKTOP:
+                    put(x, y, 40, 60, 90);
+                    break;
+                case K_DOCUMENT:
+                    put(x, y, 255, 255, 255);
+                    break;
+                case K_GRADIENT:
+                    put(x, y, static_cast<uint8_t>(x * 255 / width), static_cast<uint8_t>(y * 255 / height), 128);
+                    break;
+                case K_PHOTO:
+                    put(x, y, static_cast<uint8_t>(rng()), static_cast<uint8_t>(rng()), static_cast<uint8_t>(rng()));
+                    break;
+            }
+        }
+    }
+
+    if (scene != K_DESKTOP && scene != K_DOCUMENT) {
+        return pixels;
+    }
+
+    // Окна: светлый фон, заголовок и строки "слов" из глифов 8x10 со случайными темными точками
+    int windows{scene == K_DESKTOP ? 6 : 1};
+
+    for (int w{0}; w < windows; ++w) {
+        int x0{scene == K_DESKTOP ? static_cast<int>(rng() % (width / 2)) : 0};
+        int y0{scene == K_DESKTOP ? static_cast<int>(rng() % (height / 2)) : 0};
+        int x1{scene == K_DESKTOP ? std::min(width, x0 + width / 3 + static_cast<int>(rng() % (width / 3))) : width};
+        int y1{scene == K_DESKTOP ? std::min(height, y0 + height / 3 + static_cast<int>(rng() % (height / 3))) : height};
+
+        for (int y{y0}; y < y1; ++y) {
+            for (int x{x0}; x < x1; ++x) {
+                bool title{scene == K_DESKTOP && y < y0 + 24};
+
+                put(x, y, title ? 70 : 245, title ? 90 : 245, title ? 140 : 245);
+            }
+        }
+
+        for (int y{y0 + 32}; y + 10 < y1; y += 18) {
+            for (int x{x0 + 8}; x + 8 < x1;) {
+                int word{3 + static_cast<int>(rng() % 9)};
+
+                for (int c{0}; c < word && x + 8 < x1; ++c, x += 8) {
+                    for (int gy{0}; gy < 10; ++gy) {
+                        for (int gx{1}; gx < 7; ++gx) {
+                            if ((rng() & 3) == 0) {
+                                put(x + gx, y + gy, 30, 30, 30);
+                            }
+                        }
+                    }
+                }
+
+                x += 8;
+            }
+        }
+    }
+
+    return pixels;
+}
+
+/**
+ * @brief Упаковать RGB в буфер XImage заданного формата
+ * @param rgb Исходные пиксели
+ * @param width Ширина
+ * @param height Высота
+ * @param format Раскладка пикселей
+ * @param[out] data Буфер XImage
+ * @return XImage без дисплея (только поля, которые читает ConvertToRGB)
+ */
+XImage MakeXImage(const std::vector<uint8_t>& rgb, int width, int height, const PixelFormat& format, std::vector<char>& data) {
+    int bytes_pp{format.bits_per_pixel / 8};
+    int bytes_per_line{(width * bytes_pp + 3) & ~3};
+
+    data.assign(static_cast<size_t>(bytes_per_line) * height, 0);
+
+    for (int y{0}; y < height; ++y) {
+        for (int x{0}; x < width; ++x) {
+            const uint8_t* src{rgb.data() + (static_cast<size_t>(y) * width + x) * 3};
+            char* dst{data.data() + static_cast<size_t>(y) * bytes_per_line + x * bytes_pp};
+
+            if (format.byte_order == LSBFirst) {
+                dst[0] = static_cast<char>(src[2]);
+                dst[1] = static_cast<char>(src[1]);
+                dst[2] = static_cast<char>(src[0]);
+            } else {
+                dst[1] = static_cast<char>(src[0]);
+                dst[2] = static_cast<char>(src[1]);
+                dst[3] = static_cast<char>(src[2]);
+            }
+        }
+    }
+
+    XImage img{};
+    img.width = width;
+    img.height = height;
+    img.format = ZPixmap;
+    img.data = data.data();
+    img.byte_order = format.byte_order;
+    img.bitmap_unit = 32;
+    img.bitmap_pad = 32;
+    img.depth = 24;
+    img.bytes_per_line = bytes_per_line;
+    img.bits_per_pixel = format.bits_per_pixel;
+
+    return img;
+}
+
+void BM_ConvertToRGB(benchmark::State& state) {
+    int width{static_cast<int>(state.range(0))};
+    int height{static_cast<int>(state.range(1))};
+    const PixelFormat& format{FORMATS[static_cast<size_t>(state.range(2))]};
+
+    std::vector<char> data;
+    XImage img{MakeXImage(MakeScene(K_DESKTOP, width, height), width, height, format, data)};
+
+    for (auto _ : state) {
+        std::vector<uint8_t> pixels{ScreenGrabber::ConvertToRGB(&img, width, height)};
+
+        benchmark::DoNotOptimize(pixels.data());
+    }
+
+    state.SetLabel(format.name);
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(data.size()));
+    state.counters["pixels"] = benchmark::Counter(
+        static_cast<double>(state.iterations()) * width * height, benchmark::Counter::kIsRate);
+}
+
+void BM_EncodePNG(benchmark::State& state) {
+    Scene scene{static_cast<Scene>(state.range(0))};
+    int width{static_cast<int>(state.range(1))};
+    int height{static_cast<int>(state.range(2))};
+
+    std::vector<uint8_t> pixels{MakeScene(scene, width, height)};
+    std::vector<uint8_t> png;
+
+    for (auto _ : state) {
+        ScreenGrabber::EncodePNG(pixels, width, height, png);
+
+        benchmark::DoNotOptimize(png.data());
+    }
+
+    state.SetLabel(SCENE_NAMES[scene]);
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(pixels.size()));
+    state.counters["ratio"] = static_cast<double>(pixels.size()) / static_cast<double>(png.size());
+}
+}
+
+BENCHMARK(BM_ConvertToRGB)
+    ->ArgNames({"width", "height", "format"})
+    ->ArgsProduct({{1280}, {720}, {0, 1, 2}})
+    ->ArgsProduct({{1920}, {1080}, {0, 1, 2}})
+    ->ArgsProduct({{2560}, {1440}, {0, 1, 2}})
+    ->ArgsProduct({{3840}, {2160}, {0, 1, 2}})
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK(BM_EncodePNG)
+    ->ArgNames({"scene", "width", "height"})
+    ->ArgsProduct({{K_DESKTOP, K_DOCUMENT, K_GRADIENT, K_PHOTO}, {1920}, {1080}})
+    ->Args({K_DESKTOP, 1280, 720})
+    ->Args({K_DESKTOP, 3840, 2160})
+    ->Unit(benchmark::kMillisecond);
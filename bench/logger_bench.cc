@@ -0,0 +1,56 @@
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+#include "logger.h"
+
+namespace {
+/**
+ * @brief Стоимость вызова для потока-источника
+ *
+ * Сообщения уходят в stderr (K_WARNING), чтобы не смешиваться с выводом
+ * бенчмарка в stdout. При переполнении кольцевого буфера записи отбрасываются,
+ * так что измеряется именно цена вызова, а не скорость терминала.
+ */
+void BM_LoggerPrint(benchmark::State& state) {
+    Logger logger;
+    std::string msg{"[client: 127.0.0.1:40000] benchmark message with a typical length"};
+
+    for (auto _ : state) {
+        logger.PrintInTerminal(MessageType::K_WARNING, msg);
+    }
+}
+
+void BM_LoggerFiltered(benchmark::State& state) {
+    Logger logger;
+    std::string msg{"debug message"};
+
+    for (auto _ : state) {
+        logger.PrintInTerminal(MessageType::K_DEBUG, msg);
+    }
+}
+
+void BM_LoggerRateLimited(benchmark::State& state) {
+    static LogRateLimit rate{10};
+
+    Logger logger;
+    std::string msg{"rate limited message"};
+
+    for (auto _ : state) {
+        logger.PrintInTerminal(MessageType::K_WARNING, msg, rate);
+    }
+}
+
+void BM_LoggerTimestamp(benchmark::State& state) {
+    Logger logger;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(logger.GetCurrentTimestamp());
+    }
+}
+}
+
+BENCHMARK(BM_LoggerPrint)->ThreadRange(1, 4);
+BENCHMARK(BM_LoggerFiltered);
+BENCHMARK(BM_LoggerRateLimited)->ThreadRange(1, 4);
+BENCHMARK(BM_LoggerTimestamp);
@@ -0,0 +1,148 @@
+#include <ctime>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+
+#include <benchmark/benchmark.h>
+
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "zerocopy_sender.h"
+#include "resource_factory.h"
+
+namespace {
+constexpr int SEND_BUFFER_SIZE{4 * 1024 * 1024}; // как у клиента
+constexpr int NOTSENT_LOWAT{1024 * 1024};
+constexpr size_t RECV_CHUNK{1024 * 1024};
+
+/**
+ * @brief TCP-соединение через loopback с потоком, вычитывающим все данные
+ */
+class Loopback {
+public:
+    Loopback() {
+        UniqueFD listener{ResourceFactory::MakeUniqueFD(socket(AF_INET, SOCK_STREAM, 0))};
+
+        struct sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        socklen_t len{sizeof(addr)};
+
+        if (bind(listener.Get(), (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listener.Get(), 1) < 0 ||
+            getsockname(listener.Get(), (struct sockaddr*)&addr, &len) < 0) {
+            throw std::runtime_error("loopback listener error");
+        }
+
+        _sender = ResourceFactory::MakeUniqueFD(socket(AF_INET, SOCK_STREAM, 0));
+
+        int one{1};
+        int send_buffer{SEND_BUFFER_SIZE};
+        int lowat{NOTSENT_LOWAT};
+
+        setsockopt(_sender.Get(), IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        setsockopt(_sender.Get(), SOL_SOCKET, SO_SNDBUF, &send_buffer, sizeof(send_buffer));
+        setsockopt(_sender.Get(), IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat, sizeof(lowat));
+
+        if (connect(_sender.Get(), (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            throw std::runtime_error("loopback connect error");
+        }
+
+        _receiver = ResourceFactory::MakeUniqueFD(accept(listener.Get(), nullptr, nullptr));
+
+        _drain = std::thread([fd = _receiver.Get()] {
+            std::vector<uint8_t> buffer(RECV_CHUNK);
+
+            while (recv(fd, buffer.data(), buffer.size(), 0) > 0) {}
+        });
+    }
+
+    ~Loopback() {
+        shutdown(_sender.Get(), SHUT_WR);
+
+        _drain.join();
+    }
+
+public:
+    int GetSender() const noexcept {
+        return _sender.Get();
+    }
+
+private:
+    UniqueFD _sender;   ///< Сторона клиента
+    UniqueFD _receiver; ///< Сторона сервера
+    std::thread _drain; ///< Вычитывает _receiver до EOF
+};
+
+double ThreadCpuSeconds() {
+    struct timespec ts{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+    return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) / 1e9;
+}
+
+void SendCopy(int fd, const std::vector<uint8_t>& message) {
+    size_t total_sent{0};
+
+    while (total_sent < message.size()) {
+        ssize_t sent{send(fd, message.data() + total_sent, message.size() - total_sent, MSG_NOSIGNAL)};
+
+        if (sent <= 0) {
+            throw std::runtime_error("send() error");
+        }
+
+        total_sent += static_cast<size_t>(sent);
+    }
+}
+
+/**
+ * @brief Отправка кадров так, как это делает клиент: сборка сообщения в буфере и send()
+ *
+ * Счетчик cpu_ms_per_GB - процессорное время отправляющего потока на гигабайт.
+ * Через loopback ядро обрабатывает прием в контексте отправителя и копирует данные
+ * при доставке (уведомления MSG_ZEROCOPY приходят с флагом COPIED), поэтому здесь
+ * видна только цена закрепления страниц и уведомлений; экономия на копировании
+ * проявляется на настоящей сетевой карте.
+ */
+void BM_Send(benchmark::State& state) {
+    size_t size{static_cast<size_t>(state.range(0))};
+    bool zerocopy{state.range(1) != 0};
+
+    const std::vector<uint8_t> frame(size, 0x5a);
+    std::vector<uint8_t> message;
+
+    Loopback link;
+    ZeroCopySender sender(link.GetSender());
+
+    double cpu_start{ThreadCpuSeconds()};
+
+    for (auto _ : state) {
+        if (zerocopy) {
+            std::vector<uint8_t>& buffer{sender.Acquire()};
+
+            buffer.assign(frame.begin(), frame.end());
+            sender.Send(buffer);
+        } else {
+            message.assign(frame.begin(), frame.end());
+            SendCopy(link.GetSender(), message);
+        }
+    }
+
+    sender.Flush(1000);
+
+    double cpu_seconds{ThreadCpuSeconds() - cpu_start};
+    double gigabytes{static_cast<double>(state.iterations()) * static_cast<double>(size) / 1e9};
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(size));
+    state.counters["cpu_ms_per_GB"] = gigabytes > 0 ? cpu_seconds * 1000.0 / gigabytes : 0.0;
+}
+}
+
+BENCHMARK(BM_Send)
+    ->ArgNames({"size", "zerocopy"})
+    ->ArgsProduct({{256 << 10, 4 << 20}, {0, 1}})
+    ->UseRealTime();
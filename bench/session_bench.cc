@@ -0,0 +1,108 @@
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#include <benchmark/benchmark.h>
+
+#include <arpa/inet.h>
+
+#include "session.h"
+
+namespace {
+constexpr size_t MESSAGES_PER_STREAM{8};
+
+/**
+ * @brief Сформировать поток одинаковых сообщений 'I'
+ * @param payload Размер данных одного сообщения
+ * @return Байты потока
+ */
+std::vector<uint8_t> MakeStream(size_t payload) {
+    std::vector<uint8_t> stream;
+    uint32_t net_size{htonl(static_cast<uint32_t>(payload))};
+    auto size_bytes{reinterpret_cast<const uint8_t*>(&net_size)};
+
+    for (size_t i{0}; i < MESSAGES_PER_STREAM; ++i) {
+        stream.push_back('I');
+        stream.insert(stream.end(), size_bytes, size_bytes + sizeof(net_size));
+        stream.insert(stream.end(), payload, static_cast<uint8_t>(i));
+    }
+
+    return stream;
+}
+
+/**
+ * @brief Разбор потока, приходящего кусками заданного размера (как из recv())
+ */
+void BM_ParseMessage(benchmark::State& state) {
+    size_t payload{static_cast<size_t>(state.range(0))};
+    size_t chunk{static_cast<size_t>(state.range(1))};
+
+    std::vector<uint8_t> stream{MakeStream(payload)};
+    Session session(UniqueFD(), 0, 0, 0);
+
+    for (auto _ : state) {
+        for (size_t offset{0}; offset < stream.size(); offset += chunk) {
+            session.FeedRequest(stream.data() + offset, std::min(chunk, stream.size() - offset));
+            session.ParseMessage();
+        }
+
+        if (session.DiscardMessages() != MESSAGES_PER_STREAM) {
+            state.SkipWithError("incomplete parse");
+
+            break;
+        }
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(stream.size()));
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * MESSAGES_PER_STREAM));
+}
+
+void BM_PeekUint32(benchmark::State& state) {
+    std::vector<uint8_t> buffer(static_cast<size_t>(state.range(0)), 0x5a);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Session::PeekUint32(buffer));
+    }
+}
+
+/**
+ * @brief Извлечение из начала буфера; размер буфера держится постоянным
+ *
+ * Pop* сдвигают весь оставшийся буфер, поэтому стоимость растет с его размером.
+ */
+void BM_PopUint32(benchmark::State& state) {
+    std::vector<uint8_t> buffer(static_cast<size_t>(state.range(0)), 0x5a);
+    const uint8_t refill[sizeof(uint32_t)]{1, 2, 3, 4};
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Session::PopUint32(buffer));
+
+        buffer.insert(buffer.end(), refill, refill + sizeof(refill));
+    }
+}
+
+void BM_PopString(benchmark::State& state) {
+    constexpr uint16_t LENGTH{32};
+
+    std::vector<uint8_t> buffer(static_cast<size_t>(state.range(0)), 'a');
+    const std::vector<uint8_t> refill(LENGTH, 'b');
+
+    for (auto _ : state) {
+        std::string value{Session::PopString(buffer, LENGTH)};
+
+        benchmark::DoNotOptimize(value.data());
+
+        buffer.insert(buffer.end(), refill.begin(), refill.end());
+    }
+}
+}
+
+BENCHMARK(BM_ParseMessage)
+    ->ArgNames({"payload", "chunk"})
+    ->ArgsProduct({{64, 4096}, {1, 64, 1460, 16384}})
+    ->ArgsProduct({{262144}, {1460, 16384, 1 << 22}})
+    ->ArgsProduct({{2 << 20}, {16384, 1 << 22}});
+
+BENCHMARK(BM_PeekUint32)->Arg(4);
+BENCHMARK(BM_PopUint32)->Arg(64)->Arg(4096)->Arg(262144);
+BENCHMARK(BM_PopString)->Arg(64)->Arg(4096)->Arg(262144);
@@ -0,0 +1,158 @@
+#include <random>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#include <benchmark/benchmark.h>
+
+#include "png_codec.h"
+#include "thumbnail_pool.h"
+#include "image_resampler.h"
+
+namespace {
+/**
+ * @brief Сгенерировать RGB-кадр, похожий на рабочий стол: фон, окна и строки "текста"
+ * @param width Ширина
+ * @param height Высота
+ * @return Пиксели RGB (3 байта на пиксель)
+ */
+std::vector<uint8_t> MakeDesktop(int width, int height) {
+    std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * 3);
+    std::mt19937 rng(1);
+
+    auto fill = [&](int x0, int y0, int x1, int y1, uint8_t r, uint8_t g, uint8_t b) {
+        for (int y{std::max(y0, 0)}; y < std::min(y1, height); ++y) {
+            for (int x{std::max(x0, 0)}; x < std::min(x1, width); ++x) {
+                size_t idx{(static_cast<size_t>(y) * width + x) * 3};
+
+                pixels[idx + 0] = r;
+                pixels[idx + 1] = g;
+                pixels[idx + 2] = b;
+            }
+        }
+    };
+
+    fill(0, 0, width, height, 32, 96, 160);
+
+    for (int window{0}; window < 6; ++window) {
+        int x0{static_cast<int>(rng() % static_cast<unsigned>(width * 3 / 4))};
+        int y0{static_cast<int>(rng() % static_cast<unsigned>(height * 3 / 4))};
+        int x1{x0 + width / 3};
+        int y1{y0 + height / 3};
+
+        fill(x0, y0, x1, y1, 200, 200, 200);
+        fill(x0 + 2, y0 + 24, x1 - 2, y1 - 2, 250, 250, 250);
+
+        for (int line{y0 + 32}; line + 8 < y1; line += 14) {
+            for (int word{x0 + 8}; word + 40 < x1; word += 48) {
+                fill(word, line, word + 8 + static_cast<int>(rng() % 32), line + 8, 20, 20, 20);
+            }
+        }
+    }
+
+    return pixels;
+}
+
+/**
+ * @brief Уменьшение кадра: векторный путь против скалярного
+ *
+ * bytes_per_second - по исходному кадру, frames - кадров в секунду на одно ядро.
+ */
+void BM_Downscale(benchmark::State& state) {
+    int width{static_cast<int>(state.range(0))};
+    int height{static_cast<int>(state.range(1))};
+    unsigned factor{static_cast<unsigned>(state.range(2))};
+    bool vector{state.range(3) != 0};
+
+    std::vector<uint8_t> pixels{MakeDesktop(width, height)};
+    std::vector<uint8_t> scaled;
+    std::vector<uint8_t> reference;
+
+    auto w{static_cast<uint16_t>(width)};
+    auto h{static_cast<uint16_t>(height)};
+
+    ImageResampler::Downscale(pixels.data(), w, h, factor, scaled);
+    ImageResampler::DownscaleScalar(pixels.data(), w, h, factor, reference);
+
+    if (scaled != reference) {
+        state.SkipWithError("vector and scalar results differ");
+        return;
+    }
+
+    for (auto _ : state) {
+        if (vector) {
+            ImageResampler::Downscale(pixels.data(), w, h, factor, scaled);
+        } else {
+            ImageResampler::DownscaleScalar(pixels.data(), w, h, factor, scaled);
+        }
+
+        benchmark::DoNotOptimize(scaled.data());
+    }
+
+    state.SetLabel(vector && ImageResampler::IsVectorized() ? "sse2" : "scalar");
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(pixels.size()));
+    state.counters["frames"] = benchmark::Counter(static_cast<double>(state.iterations()), benchmark::Counter::kIsRate);
+}
+
+/**
+ * @brief Полная работа потока ThumbnailPool над одним кадром, кроме записи на диск
+ *
+ * Разбор PNG, миниатюры всех масштабов ThumbnailPool::FACTORS и их кодирование.
+ * frames - сколько кадров в секунду одно ядро снабжает миниатюрами.
+ */
+void BM_Thumbnails(benchmark::State& state) {
+    int width{static_cast<int>(state.range(0))};
+    int height{static_cast<int>(state.range(1))};
+
+    std::vector<uint8_t> frame;
+    PngCodec::Encode(MakeDesktop(width, height).data(), static_cast<uint16_t>(width), static_cast<uint16_t>(height), frame);
+
+    std::vector<uint8_t> pixels;
+    std::vector<uint8_t> scaled;
+    std::vector<uint8_t> png;
+
+    for (auto _ : state) {
+        uint16_t w{};
+        uint16_t h{};
+
+        if (!PngCodec::Decode(frame.data(), frame.size(), pixels, w, h)) {
+            state.SkipWithError("decode failed");
+            return;
+        }
+
+        unsigned done_factor{1};
+
+        for (unsigned factor : ThumbnailPool::FACTORS) {
+            unsigned step{factor / done_factor};
+
+            ImageResampler::Downscale(pixels.data(), w, h, step, scaled);
+
+            w = ImageResampler::ScaledSize(w, step);
+            h = ImageResampler::ScaledSize(h, step);
+
+            PngCodec::Encode(scaled.data(), w, h, png);
+
+            benchmark::DoNotOptimize(png.data());
+
+            pixels.swap(scaled);
+            done_factor = factor;
+        }
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(frame.size()));
+    state.counters["frames"] = benchmark::Counter(static_cast<double>(state.iterations()), benchmark::Counter::kIsRate);
+}
+}
+
+BENCHMARK(BM_Downscale)
+    ->ArgNames({"width", "height", "factor", "vector"})
+    ->ArgsProduct({{1920}, {1080}, {4, 16}, {0, 1}})
+    ->ArgsProduct({{3840}, {2160}, {4}, {0, 1}})
+    ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(BM_Thumbnails)
+    ->ArgNames({"width", "height"})
+    ->Args({1280, 720})
+    ->Args({1920, 1080})
+    ->Args({3840, 2160})
+    ->Unit(benchmark::kMillisecond);
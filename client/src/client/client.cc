@@ -6,26 +6,126 @@
 #include <vector>
 #include <chrono>
 #include <thread>
+#include <algorithm>
 
 #include <pwd.h>
+#include <poll.h>
+#include <endian.h>
 #include <unistd.h>
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
 #include <sys/socket.h>
 
 #include "client.h"
+#include "metrics.h"
+
+namespace {
+Metrics::Histogram& send_time{Metrics::MetricsRegistry::Global().AddHistogram(
+    "client_send_seconds", "Time to send one frame to the server")};
+Metrics::Counter& frames_sent{Metrics::MetricsRegistry::Global().AddCounter(
+    "client_frames_sent_total", "Frames sent to the server")};
+Metrics::Counter& bytes_sent{Metrics::MetricsRegistry::Global().AddCounter(
+    "client_bytes_sent_total", "Bytes sent to the server")};
+Metrics::Counter& grab_errors{Metrics::MetricsRegistry::Global().AddCounter(
+    "client_grab_errors_total", "Failed screen grabs")};
+Metrics::Counter& credit_stalls{Metrics::MetricsRegistry::Global().AddCounter(
+    "client_credit_stalls_total", "Capture periods skipped because the server granted no credit")};
+Metrics::Counter& credit_drops{Metrics::MetricsRegistry::Global().AddCounter(
+    "client_credit_drops_total", "Captured frames dropped because they exceeded the remaining byte credit")};
+Metrics::Gauge& credit_frames{Metrics::MetricsRegistry::Global().AddGauge(
+    "client_credit_frames", "Frames the client may still send under the granted credit")};
+Metrics::Counter& failovers{Metrics::MetricsRegistry::Global().AddCounter(
+    "client_failovers_total", "Collector connections abandoned after a connect, authentication or send failure")};
+Metrics::Counter& rebalances{Metrics::MetricsRegistry::Global().AddCounter(
+    "client_rebalances_total", "Reconnections to a preferred collector after it recovered")};
+Metrics::Gauge& collector_position{Metrics::MetricsRegistry::Global().AddGauge(
+    "client_collector_position", "Position of the connected collector in the client's preference order (0 - primary)")};
+}
 
 std::atomic<bool> stop_flag{false};
 
+namespace {
+constexpr int SEND_BUFFER_SIZE{4 * 1024 * 1024};
+constexpr int NOTSENT_LOWAT{1024 * 1024};
+constexpr time_t CONNECT_TIMEOUT_SEC{3};
+constexpr unsigned USER_TIMEOUT_MS{10000};                  // Неподтвержденные данные дольше - ошибка send()
+constexpr int PROBE_TIMEOUT_MS{500};
+constexpr int64_t HEALTH_INTERVAL_MS{5000};
+constexpr auto RETRY_INTERVAL{std::chrono::seconds(1)};     // Пауза, когда недоступны все коллекторы
+constexpr int FLUSH_TIMEOUT_MS{1000};
+constexpr size_t MAX_RAW_FRAME_SIZE{1024 * 1024 * 9};       // С запасом до Limit::MAX_MESSAGE_SIZE сервера (10 Мб)
+
+uint64_t NowUs() {
+    auto now{std::chrono::system_clock::now().time_since_epoch()};
+
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now).count());
+}
+
+int64_t SteadyMs() {
+    auto now{std::chrono::steady_clock::now().time_since_epoch()};
+
+    return static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(now).count());
+}
+
+std::string ToString(const ServerAddress& server) {
+    return server.host + ":" + std::to_string(server.port);
+}
+
+/**
+ * @brief Проверить, принимает ли коллектор соединения
+ * @param server Адрес коллектора
+ * @return true если TCP-соединение установлено за PROBE_TIMEOUT_MS
+ */
+bool ProbeCollector(const ServerAddress& server) {
+    UniqueFD fd{ResourceFactory::MakeUniqueFD(socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0))};
+
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(server.port);
+
+    if (!fd.Valid() || inet_pton(AF_INET, server.host.c_str(), &addr.sin_addr) != 1) {
+        return false;
+    }
+
+    if (connect(fd.Get(), (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+        return true;
+    } else if (errno != EINPROGRESS) {
+        return false;
+    }
+
+    struct pollfd pfd{fd.Get(), POLLOUT, 0};
+
+    if (poll(&pfd, 1, PROBE_TIMEOUT_MS) != 1) {
+        return false;
+    }
+
+    int error{0};
+    socklen_t len{sizeof(error)};
+
+    return getsockopt(fd.Get(), SOL_SOCKET, SO_ERROR, &error, &len) == 0 && error == 0;
+}
+
+void InsertUint64(std::vector<uint8_t>& buffer, uint64_t num) {
+    uint64_t net_num{htobe64(num)};
+    auto bytes{reinterpret_cast<const uint8_t*>(&net_num)};
+
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(net_num));
+}
+}
+
 void signal_handler(int sig) {
     if (sig == SIGINT) {
         stop_flag.store(true, std::memory_order_relaxed);
     }
 }
 
-Client::Client(const std::string& s_host, uint16_t s_port, unsigned timeout_sec) :
-    _server_host(s_host),
-    _server_port(s_port),
-    _timeout_sec(timeout_sec)
+Client::Client(std::vector<ServerAddress> servers, unsigned timeout_sec, uint16_t metrics_port, SendMode send_mode,
+               UploadMode upload_mode) :
+    _ring(std::move(servers)),
+    _timeout_sec(timeout_sec),
+    _metrics_port(metrics_port),
+    _send_mode(send_mode),
+    _upload_mode(upload_mode)
 {}
 
 void Client::SetupHostname() {
@@ -48,7 +148,7 @@ void Client::SetupUsername() {
     }
 }
 
-void Client::SetupSocket() {
+void Client::SetupSocket(const ServerAddress& server) {
     _server_fd = ResourceFactory::MakeUniqueFD(socket(AF_INET, SOCK_STREAM, 0));
 
     if (!_server_fd.Valid()) {
@@ -57,17 +157,52 @@ void Client::SetupSocket() {
 
     struct sockaddr_in addr{};
     addr.sin_family = AF_INET;
-    addr.sin_port = htons(_server_port);
+    addr.sin_port = htons(server.port);
 
-    if (inet_pton(AF_INET, _server_host.c_str(), &addr.sin_addr) != 1) {
+    if (inet_pton(AF_INET, server.host.c_str(), &addr.sin_addr) != 1) {
         throw std::runtime_error("inet_pton() error.");
     }
 
+    // Кадр уходит одним сообщением, и его хвосту незачем ждать ACK (Nagle). Буфер отправки
+    // вмещает кадр, чтобы send() не дробился: с MSG_ZEROCOPY каждый вызов - отдельное уведомление.
+    // TCP_NOTSENT_LOWAT не дает копить в ядре неотправленное: send() возвращается, когда кадр
+    // почти ушел в сеть, и client_send_seconds отражает сеть, а не заполнение буфера
+    // TCP_USER_TIMEOUT обрывает соединение с зависшим коллектором, чтобы клиент переключился на следующий
+    int one{1};
+    int send_buffer{SEND_BUFFER_SIZE};
+    int lowat{NOTSENT_LOWAT};
+    unsigned user_timeout{USER_TIMEOUT_MS};
+
+    if (setsockopt(_server_fd.Get(), IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) < 0 ||
+        setsockopt(_server_fd.Get(), SOL_SOCKET, SO_SNDBUF, &send_buffer, sizeof(send_buffer)) < 0 ||
+        setsockopt(_server_fd.Get(), IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat, sizeof(lowat)) < 0 ||
+        setsockopt(_server_fd.Get(), IPPROTO_TCP, TCP_USER_TIMEOUT, &user_timeout, sizeof(user_timeout)) < 0) {
+        _logger.PrintInTerminal(MessageType::K_WARNING, "setsockopt() error: " + std::string(strerror(errno)));
+    }
+
+    // connect() учитывает SO_SNDTIMEO: недоступный узел не задерживает переключение на минуты
+    struct timeval connect_timeout{CONNECT_TIMEOUT_SEC, 0};
+    struct timeval no_timeout{};
+
+    setsockopt(_server_fd.Get(), SOL_SOCKET, SO_SNDTIMEO, &connect_timeout, sizeof(connect_timeout));
+
     if (connect(_server_fd.Get(), (struct sockaddr*)&addr, sizeof(addr)) < 0) {
         throw std::runtime_error("connect(): " + std::string(strerror(errno)));
     }
 
-    _logger.PrintInTerminal(MessageType::K_INFO, "Connected! (server: " + _server_host + ":" + std::to_string(_server_port) + ")");
+    setsockopt(_server_fd.Get(), SOL_SOCKET, SO_SNDTIMEO, &no_timeout, sizeof(no_timeout));
+
+    _logger.PrintInTerminal(MessageType::K_INFO, "Connected! (server: " + ToString(server) + ")");
+
+    if (_send_mode == SendMode::K_ZEROCOPY) {
+        try {
+            _zerocopy = std::make_unique<ZeroCopySender>(_server_fd.Get());
+
+            _logger.PrintInTerminal(MessageType::K_INFO, "Frames are sent with MSG_ZEROCOPY.");
+        } catch (const std::runtime_error& ex) {
+            _logger.PrintInTerminal(MessageType::K_WARNING, std::string(ex.what()) + ", falling back to copying send().");
+        }
+    }
 }
 
 template<typename T>
@@ -101,6 +236,7 @@ std::vector<uint8_t> Client::CreateAuthenticationRequest() {
     buffer.insert(buffer.end(), _hostname.begin(), _hostname.end());
     InsertToVector<uint16_t>(buffer, _username.size());
     buffer.insert(buffer.end(), _username.begin(), _username.end());
+    InsertToVector<uint16_t>(buffer, Protocol::MAX_VERSION);
 
     constexpr uint32_t TYPE_SIZE{1};
     constexpr uint32_t LEN_SIZE{4};
@@ -113,21 +249,101 @@ std::vector<uint8_t> Client::CreateAuthenticationRequest() {
     return buffer;
 }
 
-std::vector<uint8_t> Client::CreateImgMessage() {
+void Client::GrabFrame(std::vector<uint8_t>& img_bytes, int& width, int& height, uint8_t& codec) {
+    codec = Protocol::CODEC_PNG;
+
+    if (_protocol < Protocol::VERSION_4 || _upload_mode == UploadMode::K_CLIENT_PNG) {
+        _screen_grabber.GrabAsPNG(img_bytes, width, height);
+
+        return;
+    }
+
+    std::vector<uint8_t> pixels;
+
+    _screen_grabber.GrabAsRGB(pixels, width, height);
+
+    if (_upload_mode == UploadMode::K_RAW_RGB_ZLIB) {
+        ScreenGrabber::CompressZlib(pixels, img_bytes);
+
+        if (img_bytes.size() <= MAX_RAW_FRAME_SIZE) {
+            codec = Protocol::CODEC_RAW_RGB_ZLIB;
+
+            return;
+        }
+    } else if (pixels.size() <= MAX_RAW_FRAME_SIZE) {
+        img_bytes = std::move(pixels);
+        codec = Protocol::CODEC_RAW_RGB;
+
+        return;
+    }
+
+    // Кадр, который сервер не примет одним сообщением, клиент кодирует сам
+    ScreenGrabber::EncodePNG(pixels, width, height, img_bytes);
+}
+
+void Client::CreateImgMessage(std::vector<uint8_t>& buffer) {
     int width{};
     int height{};
+    uint8_t codec{};
     std::vector<uint8_t> img_bytes;
 
-    _screen_grabber.GrabAsPNG(img_bytes, width, height);
+    uint64_t capture_start_us{NowUs()};
+
+    GrabFrame(img_bytes, width, height, codec);
+
+    uint64_t encode_done_us{NowUs()};
+
+    _last_frame_size = img_bytes.size();
+
+    buffer.clear();
+
+    if (_protocol >= Protocol::VERSION_2) {
+        Protocol::FrameHeader header;
+        header.seq = ++_frame_seq;
+        header.capture_us = capture_start_us;
+        header.length = static_cast<uint32_t>(img_bytes.size());
+        header.width = static_cast<uint16_t>(width);
+        header.height = static_cast<uint16_t>(height);
+        header.codec = codec;
+        header.flags = Protocol::FLAG_TRACE;
+
+        size_t payload{sizeof(uint16_t) + Protocol::FRAME_HEADER_SIZE + Protocol::FRAME_TRACE_SIZE + img_bytes.size()};
+
+        buffer.reserve(Protocol::MESSAGE_HEADER_SIZE + payload);
+
+        InsertToVector<uint8_t>(buffer, 'F');
+        InsertToVector<uint32_t>(buffer, payload);
+        InsertToVector<uint16_t>(buffer, 1);
+        Protocol::AppendFrameHeader(buffer, header);
+        InsertUint64(buffer, encode_done_us);
+        InsertUint64(buffer, 0); // начало отправки, см. StampSendStart()
+        buffer.insert(buffer.end(), img_bytes.begin(), img_bytes.end());
+
+        return;
+    }
+
+    // Сервер без согласования версий понимает только 'I': отметки времени ему не отправить
+    ++_frame_seq;
 
-    std::vector<uint8_t> buffer;
     buffer.reserve(sizeof(uint8_t) + sizeof(uint32_t) + img_bytes.size());
 
     InsertToVector<uint8_t>(buffer, 'I');
     InsertToVector<uint32_t>(buffer, img_bytes.size());
     buffer.insert(buffer.end(), img_bytes.begin(), img_bytes.end());
+}
 
-    return buffer;
+void Client::StampSendStart(std::vector<uint8_t>& message) {
+    // В 'I' отметок нет
+    if (_protocol < Protocol::VERSION_2) {
+        return;
+    }
+
+    uint64_t net_now{htobe64(NowUs())};
+
+    // 'F' из одного кадра: отметка идет второй после заголовка кадра
+    size_t offset{Protocol::MESSAGE_HEADER_SIZE + sizeof(uint16_t) + Protocol::FRAME_HEADER_SIZE + sizeof(uint64_t)};
+
+    std::memcpy(message.data() + offset, &net_now, sizeof(net_now));
 }
 
 ssize_t Client::SendAll(const std::vector<uint8_t>& data) {
@@ -177,6 +393,96 @@ ssize_t Client::RecvAll(uint8_t* buffer, size_t total_bytes) {
     return static_cast<ssize_t>(bytes_read);
 }
 
+void Client::HandleServerMessage(uint8_t type, const uint8_t* payload, size_t size) {
+    if (type == 'D' && size == 2 * sizeof(uint64_t)) {
+        uint64_t first_seq;
+        uint64_t last_seq;
+
+        std::memcpy(&first_seq, payload, sizeof(first_seq));
+        std::memcpy(&last_seq, payload + sizeof(first_seq), sizeof(last_seq));
+
+        _logger.PrintInTerminal(
+            MessageType::K_INFO,
+            "Frames " + std::to_string(be64toh(first_seq)) + ".." + std::to_string(be64toh(last_seq)) + " durably stored."
+        );
+    } else if (type == 'C' && size == 2 * sizeof(uint64_t)) {
+        uint64_t frames;
+        uint64_t bytes;
+
+        std::memcpy(&frames, payload, sizeof(frames));
+        std::memcpy(&bytes, payload + sizeof(frames), sizeof(bytes));
+
+        _credit_frames = be64toh(frames);
+        _credit_bytes = be64toh(bytes);
+
+        credit_frames.Set(static_cast<int64_t>(_credit_frames - std::min(_credit_frames, _sent_frames)));
+    } else if (type == 'P' && size == 2 * sizeof(uint32_t)) {
+        uint32_t period_ms;
+        uint32_t phase_ms;
+
+        std::memcpy(&period_ms, payload, sizeof(period_ms));
+        std::memcpy(&phase_ms, payload + sizeof(period_ms), sizeof(phase_ms));
+
+        _schedule_period_ms = ntohl(period_ms);
+        _schedule_phase_ms = _schedule_period_ms != 0 ? ntohl(phase_ms) % _schedule_period_ms : 0;
+
+        _logger.PrintInTerminal(
+            MessageType::K_INFO,
+            "Capture schedule from server: every " + std::to_string(_schedule_period_ms) + " ms at phase " + std::to_string(_schedule_phase_ms) + " ms."
+        );
+    }
+}
+
+bool Client::HasCredit(size_t frame_size) const noexcept {
+    if (_credit_frames == 0) {
+        return true;
+    }
+
+    return _sent_frames < _credit_frames && _sent_bytes + frame_size <= _credit_bytes;
+}
+
+void Client::DrainServerMessages() {
+    constexpr size_t BUFFER_SIZE{4096};
+    constexpr size_t HEADER_SIZE{sizeof(uint8_t) + sizeof(uint32_t)};
+
+    while (true) {
+        uint8_t temp[BUFFER_SIZE];
+
+        ssize_t n{recv(_server_fd.Get(), temp, sizeof(temp), MSG_DONTWAIT)};
+
+        if (n > 0) {
+            _inbox.insert(_inbox.end(), temp, temp + n);
+        } else if (n == 0) {
+            throw std::runtime_error("recv() error: connection closed by peer");
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        } else {
+            throw std::runtime_error("recv() error: " + std::string(strerror(errno)));
+        }
+    }
+
+    size_t pos{0};
+
+    while (_inbox.size() - pos >= HEADER_SIZE) {
+        uint32_t net_size;
+        std::memcpy(&net_size, _inbox.data() + pos + 1, sizeof(net_size));
+
+        size_t size{ntohl(net_size)};
+
+        if (_inbox.size() - pos - HEADER_SIZE < size) {
+            break;
+        }
+
+        HandleServerMessage(_inbox[pos], _inbox.data() + pos + HEADER_SIZE, size);
+
+        pos += HEADER_SIZE + size;
+    }
+
+    _inbox.erase(_inbox.begin(), _inbox.begin() + pos);
+}
+
 bool Client::TryAuthenticate() {
     std::vector<uint8_t> auth_req(CreateAuthenticationRequest());
 
@@ -186,8 +492,27 @@ bool Client::TryAuthenticate() {
         SendAll(auth_req);
         RecvAll(&auth_resp, sizeof(auth_resp));
 
+        if (auth_resp == 'V') {
+            uint8_t reply[sizeof(uint32_t) + sizeof(uint16_t)];
+            RecvAll(reply, sizeof(reply));
+
+            uint32_t net_size;
+            uint16_t net_version;
+            std::memcpy(&net_size, reply, sizeof(net_size));
+            std::memcpy(&net_version, reply + sizeof(net_size), sizeof(net_version));
+
+            uint16_t version{ntohs(net_version)};
+
+            if (ntohl(net_size) != sizeof(uint16_t) || version < Protocol::VERSION_1 || version > Protocol::MAX_VERSION) {
+                throw std::runtime_error("invalid protocol version from server: " + std::to_string(version));
+            }
+
+            _protocol = version;
+            auth_resp = 'Y';
+        }
+
         if (auth_resp == 'Y') {
-            _logger.PrintInTerminal(MessageType::K_INFO, "Authentication was successful!");
+            _logger.PrintInTerminal(MessageType::K_INFO, "Authentication was successful! (protocol v" + std::to_string(_protocol) + ")");
 
             return true;
         }
@@ -199,24 +524,106 @@ bool Client::TryAuthenticate() {
 }
 
 void Client::WaitLoop() {
-    for (unsigned i{0}; i < _timeout_sec; ++i) {
-        if (stop_flag.load(std::memory_order_relaxed)) {
+    using Clock = std::chrono::system_clock;
+
+    auto now{Clock::now()};
+    auto deadline{now + std::chrono::seconds(_timeout_sec)};
+
+    if (_schedule_period_ms != 0) {
+        // Следующий момент t > now, для которого (t - фаза) кратно периоду
+        uint64_t now_ms{static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count())};
+        uint64_t since_phase{(now_ms + _schedule_period_ms - _schedule_phase_ms) % _schedule_period_ms};
+
+        deadline = now + std::chrono::milliseconds(_schedule_period_ms - since_phase);
+    }
+
+    SleepUntil(deadline);
+}
+
+void Client::SleepUntil(std::chrono::system_clock::time_point deadline) {
+    using Clock = std::chrono::system_clock;
+
+    while (!stop_flag.load(std::memory_order_relaxed)) {
+        auto left{deadline - Clock::now()};
+
+        if (left <= Clock::duration::zero()) {
             break;
         }
 
-        std::this_thread::sleep_for(std::chrono::seconds(1));
+        std::this_thread::sleep_for(std::min<Clock::duration>(left, std::chrono::seconds(1)));
     }
 }
 
 void Client::SendLoop() {
+    // Расписание приходит сразу за ответом на аутентификацию: первый кадр уже снимается в свой слот
+    DrainServerMessages();
+
+    if (_schedule_period_ms != 0) {
+        WaitLoop();
+    }
+
     while (!stop_flag.load(std::memory_order_relaxed)) {
+        if (RebalanceDue()) {
+            return;
+        }
+
         try {
-            std::vector<uint8_t> bytes(CreateImgMessage());
-            
-            ssize_t sent{SendAll(bytes)};
-                
+            DrainServerMessages();
+
+            // Без кредита кадр не захватывается вовсе: работа не копится ни у клиента, ни в буферах ядра.
+            // Объем следующего кадра оценивается по предыдущему
+            if (!HasCredit(_last_frame_size)) {
+                static LogRateLimit rate{1};
+
+                credit_stalls.Inc();
+
+                _logger.PrintInTerminal(MessageType::K_WARNING, "Out of server credit, capture skipped.", rate);
+
+                WaitLoop();
+
+                continue;
+            }
+
+            // С MSG_ZEROCOPY кадр собирается сразу в буфере, который ядро отправит без копирования
+            std::vector<uint8_t>& bytes{_zerocopy ? _zerocopy->Acquire() : _message};
+
+            CreateImgMessage(bytes);
+
+            if (!HasCredit(_last_frame_size)) {
+                static LogRateLimit rate{1};
+
+                credit_drops.Inc();
+
+                _logger.PrintInTerminal(MessageType::K_WARNING, "Frame exceeds remaining server credit, dropped.", rate);
+
+                WaitLoop();
+
+                continue;
+            }
+
+            auto start{std::chrono::steady_clock::now()};
+
+            StampSendStart(bytes);
+
+            ssize_t sent{_zerocopy ? _zerocopy->Send(bytes) : SendAll(bytes)};
+
+            send_time.ObserveSince(start);
+            frames_sent.Inc();
+            bytes_sent.Inc(static_cast<uint64_t>(sent));
+
+            _sent_frames += 1;
+            _sent_bytes += _last_frame_size;
+
+            if (_credit_frames != 0) {
+                credit_frames.Set(static_cast<int64_t>(_credit_frames - std::min(_credit_frames, _sent_frames)));
+            }
+
             _logger.PrintInTerminal(MessageType::K_INFO, "Image sent to server.");
+
+            DrainServerMessages();
         } catch (const grabber_error& ex) {
+            grab_errors.Inc();
+
             _logger.PrintInTerminal(MessageType::K_WARNING, ex.what());
         }
 
@@ -224,6 +631,52 @@ void Client::SendLoop() {
     }
 }
 
+void Client::ConnectTo(size_t position) {
+    // Уведомления MSG_ZEROCOPY и состояние протокола относятся к прежнему сокету
+    _zerocopy.reset();
+    _server_fd = UniqueFD();
+    _inbox.clear();
+    _frame_seq = 0;
+    _protocol = Protocol::VERSION_1;
+    _credit_frames = 0;
+    _credit_bytes = 0;
+    _sent_frames = 0;
+    _sent_bytes = 0;
+    _schedule_period_ms = 0;
+    _schedule_phase_ms = 0;
+
+    _current = position;
+    _next_health_check_ms = SteadyMs() + HEALTH_INTERVAL_MS;
+
+    collector_position.Set(static_cast<int64_t>(position));
+
+    SetupSocket(_ring.Get(_preference[position]));
+}
+
+bool Client::RebalanceDue() {
+    if (_current == 0 || SteadyMs() < _next_health_check_ms) {
+        return false;
+    }
+
+    _next_health_check_ms = SteadyMs() + HEALTH_INTERVAL_MS;
+
+    for (size_t position{0}; position < _current; ++position) {
+        const ServerAddress& server{_ring.Get(_preference[position])};
+
+        if (ProbeCollector(server)) {
+            _collector_up[position] = true;
+
+            rebalances.Inc();
+
+            _logger.PrintInTerminal(MessageType::K_INFO, "Collector " + ToString(server) + " is back, reconnecting to it.");
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
 void Client::Run() {
     std::signal(SIGINT, signal_handler);
 
@@ -231,12 +684,57 @@ void Client::Run() {
     SetupUsername();
 
     try {
-        SetupSocket();
-
-        if (TryAuthenticate()) {
-            SendLoop();
+        if (_metrics_port != 0) {
+            _metrics = std::make_unique<MetricsServer>(_metrics_port);
+            _metrics->Start();
         }
     } catch (const std::runtime_error& ex) {
         _logger.PrintInTerminal(MessageType::K_ERROR, ex.what());
+
+        return;
+    }
+
+    // Порядок зависит только от имени хоста: все кадры хоста собираются на одном коллекторе
+    _preference = _ring.Preference(_hostname);
+    _collector_up.assign(_preference.size(), true);
+
+    while (!stop_flag.load(std::memory_order_relaxed)) {
+        auto up{std::find(_collector_up.begin(), _collector_up.end(), true)};
+
+        if (up == _collector_up.end()) {
+            static LogRateLimit rate{1};
+
+            _logger.PrintInTerminal(MessageType::K_WARNING, "All collectors are unavailable, retrying.", rate);
+
+            _collector_up.assign(_preference.size(), true);
+
+            SleepUntil(std::chrono::system_clock::now() + RETRY_INTERVAL);
+
+            continue;
+        }
+
+        size_t position{static_cast<size_t>(up - _collector_up.begin())};
+        std::string name{ToString(_ring.Get(_preference[position]))};
+
+        try {
+            ConnectTo(position);
+
+            if (!TryAuthenticate()) {
+                throw std::runtime_error("authentication failed");
+            }
+
+            SendLoop();
+
+            // Возврат на восстановленный узел: кадры прежнего соединения должны уйти до закрытия сокета
+            if (_zerocopy) {
+                _zerocopy->Flush(FLUSH_TIMEOUT_MS);
+            }
+        } catch (const std::runtime_error& ex) {
+            _collector_up[position] = false;
+
+            failovers.Inc();
+
+            _logger.PrintInTerminal(MessageType::K_ERROR, "Collector " + name + ": " + ex.what());
+        }
     }
 }
@@ -1,36 +1,54 @@
 #ifndef CLIENT_CLIENT_CLIENT_H
 #define CLIENT_CLIENT_CLIENT_H
 
+#include <memory>
 #include <string>
+#include <vector>
+#include <chrono>
 #include <cstdint>
 
 #include "resource_factory.h"
 #include "screen_grabber.h"
+#include "zerocopy_sender.h"
+#include "collector_ring.h"
+#include "input_parser.h"
 #include "logger.h"
+#include "protocol.h"
+#include "metrics_server.h"
 
 /**
  * @brief Клиент для отправки скриншотов на сервер.
  * 
  * Класс реализует:
- * - Подключение к серверу по TCP/IP
+ * - Подключение к серверу по TCP/IP; при нескольких серверах (коллекторах) -
+ *   выбор по согласованному хешу имени хоста, переключение на следующий узел
+ *   при ошибке соединения и возврат на основной узел после его восстановления
  * - Аутентификацию (с передачей имени хоста и пользователя)
  * - Периодический захват экрана и отправку изображений
+ * - Отправку кадров обычным send() или через MSG_ZEROCOPY (ZeroCopySender)
  * - Обработку сигнала SIGINT для корректного завершения
  */
 class Client {
 public:
     /**
      * @brief Конструктор клиента
-     * @param s_host IP-адрес или доменное имя сервера
-     * @param s_port Порт сервера
+     * @param servers Адреса серверов (коллекторов), не пустой список
      * @param timeout_sec Интервал между отправкой скриншотов (по умолчанию 10 сек)
+     * @param metrics_port Порт выдачи метрик на 127.0.0.1 (0 - выдача выключена)
+     * @param send_mode Способ отправки кадров
+     * @param upload_mode Формат отправки кадров (без PNG - только серверу с протоколом v4)
      */
-    Client(const std::string& s_host, uint16_t s_port, unsigned timeout_sec = 10);
+    Client(std::vector<ServerAddress> servers, unsigned timeout_sec = 10, uint16_t metrics_port = 0,
+           SendMode send_mode = SendMode::K_COPY, UploadMode upload_mode = UploadMode::K_CLIENT_PNG);
 
 public:
     /**
      * @brief Запуск основного цикла работы клиента
-     * @throws std::runtime_error при критических ошибках подключения
+     *
+     * Подключается к первому доступному коллектору в порядке предпочтения и
+     * отправляет кадры до SIGINT. Ошибка соединения помечает узел недоступным и
+     * переключает клиента на следующий; если недоступны все, попытки повторяются
+     * по кругу с паузой.
      */
     void Run();
 
@@ -43,23 +61,62 @@ private:
 
 private:
     /**
-     * @brief Ожидание с проверкой флага остановки
+     * @brief Ожидание следующего захвата с проверкой флага остановки
      * @note Выполняет sleep с проверкой stop_flag каждую секунду
+     *
+     * Без расписания от сервера ждет _timeout_sec, с расписанием ('P') -
+     * до ближайшего момента своей фазы.
      */
     void WaitLoop();
+
+    /**
+     * @brief Сон до заданного момента с проверкой флага остановки
+     * @param deadline Момент пробуждения
+     */
+    void SleepUntil(std::chrono::system_clock::time_point deadline);
     
-    /// Основной цикл отправки скриншотов
+    /**
+     * @brief Основной цикл отправки скриншотов
+     * @throws std::runtime_error при ошибках соединения
+     *
+     * Возвращается при остановке или когда пора вернуться на более
+     * предпочтительный коллектор (RebalanceDue()).
+     */
     void SendLoop();
+
+    /**
+     * @brief Подключиться к коллектору и сбросить состояние прежнего соединения
+     * @param position Позиция коллектора в порядке предпочтения
+     * @throws std::runtime_error при ошибках socket()/connect()
+     */
+    void ConnectTo(size_t position);
+
+    /**
+     * @brief Проверить более предпочтительные коллекторы
+     * @return true если один из них снова доступен и нужно переподключиться
+     *
+     * Не чаще раза в HEALTH_INTERVAL пробует установить TCP-соединение с
+     * коллекторами, стоящими в порядке перед текущим.
+     */
+    bool RebalanceDue();
     
     /**
      * @brief Установка соединения с сервером
+     * @param server Адрес сервера
      * @throws std::runtime_error при ошибках socket()/connect()
+     *
+     * Настраивает сокет под отправку крупных кадров (TCP_NODELAY, SO_SNDBUF,
+     * TCP_NOTSENT_LOWAT) и при K_ZEROCOPY включает ZeroCopySender; если ядро
+     * не поддерживает SO_ZEROCOPY, кадры отправляются обычным send().
      */
-    void SetupSocket();
+    void SetupSocket(const ServerAddress& server);
     
     /**
      * @brief Попытка аутентификации на сервере
      * @return true если аутентификация прошла успешно
+     *
+     * Запрашивает Protocol::MAX_VERSION; сервер первой версии отвечает 'Y',
+     * и клиент продолжает по протоколу v1.
      */
     bool TryAuthenticate();
 
@@ -72,8 +129,32 @@ private:
     template<typename T>
     void InsertToVector(std::vector<uint8_t>& buffer, T num);
     
-    /// Создает сообщение с изображением экрана
-    std::vector<uint8_t> CreateImgMessage();
+    /**
+     * @brief Захватить кадр в формате отправки
+     * @param[out] img_bytes Данные кадра
+     * @param[out] width Ширина кадра
+     * @param[out] height Высота кадра
+     * @param[out] codec Формат данных (Protocol::CODEC_*)
+     *
+     * Без протокола v4 или при --upload png кадр кодируется в PNG. Кадр без PNG,
+     * не помещающийся в сообщение сервера, тоже кодируется в PNG на месте.
+     */
+    void GrabFrame(std::vector<uint8_t>& img_bytes, int& width, int& height, uint8_t& codec);
+
+    /**
+     * @brief Создает сообщение с изображением экрана
+     * @param[out] buffer Буфер сообщения (прежнее содержимое отбрасывается, емкость сохраняется).
+     *             Для протокола v2 - пачка 'F' из одного кадра с заголовком и отметками
+     *             времени; для v1 (сервер без согласования версий) - сообщение 'I' только
+     *             с изображением
+     */
+    void CreateImgMessage(std::vector<uint8_t>& buffer);
+
+    /**
+     * @brief Записать в сообщение время начала отправки
+     * @param message Сообщение из CreateImgMessage() (в 'I' протокола v1 записывать некуда)
+     */
+    void StampSendStart(std::vector<uint8_t>& message);
     
     /// Формирует запрос аутентификации
     std::vector<uint8_t> CreateAuthenticationRequest();
@@ -94,20 +175,66 @@ private:
      * @throws std::runtime_error при ошибках recv()
      */
     ssize_t RecvAll(uint8_t* buffer, size_t total_bytes);
+
+    /**
+     * @brief Прочитать без блокировки все пришедшие от сервера сообщения
+     * @throws std::runtime_error при ошибках recv() или разрыве соединения
+     *
+     * Сообщения имеют формат [1 байт: тип][4 байта: размер][данные].
+     * Подтверждения сохранности ('D') логируются, выдачи кредита ('C') обновляют
+     * границы отправки, расписание ('P') заменяет собственный период клиента,
+     * неизвестные типы пропускаются.
+     */
+    void DrainServerMessages();
+
+    /**
+     * @brief Обработать одно сообщение сервера
+     * @param type Тип сообщения
+     * @param payload Данные сообщения
+     * @param size Размер данных
+     */
+    void HandleServerMessage(uint8_t type, const uint8_t* payload, size_t size);
+
+    /**
+     * @brief Проверить, хватает ли выданного сервером кредита на кадр
+     * @param frame_size Размер данных кадра
+     * @return true если кадр можно отправить (или сервер не выдает кредит)
+     */
+    bool HasCredit(size_t frame_size) const noexcept;
     
 private:
-    std::string _server_host;      ///< Адрес сервера
-    uint16_t _server_port;         ///< Порт сервера
-    unsigned _timeout_sec;         ///< Таймаут между отправками (в секундах)
+    CollectorRing _ring;                       ///< Коллекторы и их кольцо хешей
+    std::vector<size_t> _preference;           ///< Индексы коллекторов в порядке предпочтения для хоста
+    std::vector<bool> _collector_up;           ///< Доступность коллекторов (по позиции в _preference)
+    size_t _current{0};                        ///< Позиция текущего коллектора в _preference
+    int64_t _next_health_check_ms{0};          ///< Время следующей проверки коллекторов (steady_clock, мс)
+    unsigned _timeout_sec;                     ///< Таймаут между отправками (в секундах)
+    uint16_t _metrics_port;                    ///< Порт выдачи метрик (0 - выключена)
+    SendMode _send_mode;                       ///< Способ отправки кадров
+    UploadMode _upload_mode;                   ///< Формат отправки кадров
+
+    std::string _hostname;                     ///< Имя текущего хоста
+    std::string _username;                     ///< Имя текущего пользователя
 
-    std::string _hostname;         ///< Имя текущего хоста
-    std::string _username;         ///< Имя текущего пользователя
+    Logger _logger;                            ///< Логгер для вывода сообщений
 
-    Logger _logger;                ///< Логгер для вывода сообщений
+    UniqueFD _server_fd;                       ///< Дескриптор сокета сервера
+    std::unique_ptr<ZeroCopySender> _zerocopy; ///< Отправка через MSG_ZEROCOPY (если включена)
+    std::vector<uint8_t> _message;             ///< Буфер сообщения для обычной отправки
+    std::vector<uint8_t> _inbox;               ///< Непрочитанные байты сообщений сервера
+    uint64_t _frame_seq{0};                    ///< Номер последнего отправленного кадра
+    uint16_t _protocol{Protocol::VERSION_1};   ///< Версия протокола, согласованная с сервером
+    uint64_t _credit_frames{0};                ///< Граница кадров от сервера (0 - кредит не выдавался)
+    uint64_t _credit_bytes{0};                 ///< Граница байт данных кадров от сервера
+    uint64_t _sent_frames{0};                  ///< Отправлено кадров за соединение
+    uint64_t _sent_bytes{0};                   ///< Отправлено байт данных кадров за соединение
+    size_t _last_frame_size{0};                ///< Размер данных последнего захваченного кадра
+    uint32_t _schedule_period_ms{0};           ///< Период захвата от сервера (0 - свой _timeout_sec)
+    uint32_t _schedule_phase_ms{0};            ///< Фаза захвата от сервера
 
-    UniqueFD _server_fd;           ///< Дескриптор сокета сервера
+    ScreenGrabber _screen_grabber;             ///< Захватчик экрана
 
-    ScreenGrabber _screen_grabber; ///< Захватчик экрана
+    std::unique_ptr<MetricsServer> _metrics;   ///< Выдача метрик (если задан порт)
 };
 
 #endif // CLIENT_CLIENT_CLIENT_H
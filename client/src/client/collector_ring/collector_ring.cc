@@ -0,0 +1,69 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "collector_ring.h"
+
+CollectorRing::CollectorRing(std::vector<ServerAddress> collectors) :
+    _collectors(std::move(collectors))
+{
+    if (_collectors.empty()) {
+        throw std::invalid_argument("CollectorRing: no collectors");
+    }
+
+    _ring.reserve(_collectors.size() * VIRTUAL_NODES);
+
+    for (size_t index{0}; index < _collectors.size(); ++index) {
+        std::string name{_collectors[index].host + ":" + std::to_string(_collectors[index].port) + "#"};
+
+        for (size_t i{0}; i < VIRTUAL_NODES; ++i) {
+            _ring.emplace_back(Hash(name + std::to_string(i)), index);
+        }
+    }
+
+    std::sort(_ring.begin(), _ring.end());
+}
+
+std::vector<size_t> CollectorRing::Preference(const std::string& key) const {
+    std::vector<size_t> order;
+    std::vector<bool> seen(_collectors.size(), false);
+
+    auto start{std::lower_bound(_ring.begin(), _ring.end(), std::make_pair(Hash(key), size_t{0}))};
+    size_t offset{static_cast<size_t>(start - _ring.begin())};
+
+    for (size_t i{0}; i < _ring.size() && order.size() < _collectors.size(); ++i) {
+        size_t index{_ring[(offset + i) % _ring.size()].second};
+
+        if (!seen[index]) {
+            seen[index] = true;
+            order.push_back(index);
+        }
+    }
+
+    return order;
+}
+
+const ServerAddress& CollectorRing::Get(size_t index) const noexcept {
+    return _collectors[index];
+}
+
+size_t CollectorRing::Size() const noexcept {
+    return _collectors.size();
+}
+
+uint64_t CollectorRing::Hash(const std::string& value) noexcept {
+    uint64_t hash{14695981039346656037ULL};
+
+    for (unsigned char c : value) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+
+    // У FNV-1a близкие строки ("...#1", "...#2") дают близкие хеши: перемешивание разносит их по кольцу
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebULL;
+    hash ^= hash >> 31;
+
+    return hash;
+}
@@ -0,0 +1,68 @@
+#ifndef CLIENT_CLIENT_COLLECTOR_RING_COLLECTOR_RING_H
+#define CLIENT_CLIENT_COLLECTOR_RING_COLLECTOR_RING_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <utility>
+
+#include "input_parser.h"
+
+/**
+ * @brief Кольцо согласованного хеширования коллекторов (серверов)
+ *
+ * Каждый коллектор занимает VIRTUAL_NODES точек кольца (хеш "ip:порт#i"),
+ * ключ клиента (имя хоста) - одну точку. Порядок предпочтения для ключа -
+ * коллекторы в порядке обхода кольца по часовой стрелке от точки ключа.
+ * Первый в порядке - основной узел клиента, следующие - узлы для переключения.
+ *
+ * Порядок зависит только от ключа и набора коллекторов, поэтому кадры хоста
+ * всегда собираются на одном узле, а при выходе узла из строя его клиенты
+ * расходятся по остальным, не сдвигая клиентов других узлов.
+ */
+class CollectorRing {
+public:
+    static constexpr size_t VIRTUAL_NODES{128}; ///< Точек кольца на коллектор
+
+    /**
+     * @brief Конструктор
+     * @param collectors Адреса коллекторов (без повторов)
+     * @throws std::invalid_argument если список пуст
+     */
+    explicit CollectorRing(std::vector<ServerAddress> collectors);
+
+public:
+    /**
+     * @brief Получить порядок предпочтения коллекторов для ключа
+     * @param key Ключ клиента (имя хоста)
+     * @return Индексы всех коллекторов, начиная с основного
+     */
+    std::vector<size_t> Preference(const std::string& key) const;
+
+    /**
+     * @brief Получить адрес коллектора
+     * @param index Индекс коллектора
+     * @return Адрес
+     */
+    const ServerAddress& Get(size_t index) const noexcept;
+
+    /**
+     * @brief Получить число коллекторов
+     * @return Число коллекторов
+     */
+    size_t Size() const noexcept;
+
+private:
+    /**
+     * @brief Хеш строки (FNV-1a с перемешиванием splitmix64)
+     * @param value Строка
+     * @return 64-битный хеш
+     */
+    static uint64_t Hash(const std::string& value) noexcept;
+
+private:
+    std::vector<ServerAddress> _collectors;         ///< Адреса коллекторов
+    std::vector<std::pair<uint64_t, size_t>> _ring; ///< Точки кольца (хеш, индекс), по возрастанию хеша
+};
+
+#endif // CLIENT_CLIENT_COLLECTOR_RING_COLLECTOR_RING_H
@@ -3,11 +3,25 @@
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 
+#include <zlib.h>
+
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
 
+#include "metrics.h"
 #include "screen_grabber.h"
 
+namespace {
+Metrics::Histogram& capture_time{Metrics::MetricsRegistry::Global().AddHistogram(
+    "client_capture_seconds", "Time to open the display and capture the root window")};
+Metrics::Histogram& convert_time{Metrics::MetricsRegistry::Global().AddHistogram(
+    "client_convert_seconds", "Time to convert the captured image to RGB")};
+Metrics::Histogram& encode_time{Metrics::MetricsRegistry::Global().AddHistogram(
+    "client_encode_seconds", "Time to encode the frame as PNG")};
+Metrics::Histogram& compress_time{Metrics::MetricsRegistry::Global().AddHistogram(
+    "client_compress_seconds", "Time to compress the raw frame with zlib")};
+}
+
 UniqueDisplay ScreenGrabber::OpenDisplay() {
     UniqueDisplay u_disp(ResourceFactory::MakeUniqueDisplay(XOpenDisplay(nullptr)));
 
@@ -110,7 +124,33 @@ void ScreenGrabber::EncodePNG(const std::vector<uint8_t>& pixels, int width, int
     stbi_write_png_to_func(MemWriter::write, &out_png, width, height, 3, pixels.data(), width * 3);
 }
 
+void ScreenGrabber::CompressZlib(const std::vector<uint8_t>& pixels, std::vector<uint8_t>& out_data) {
+    Metrics::ScopedTimer timer(compress_time);
+
+    uLongf size{compressBound(static_cast<uLong>(pixels.size()))};
+
+    out_data.resize(size);
+
+    if (compress2(out_data.data(), &size, pixels.data(), static_cast<uLong>(pixels.size()), Z_BEST_SPEED) != Z_OK) {
+        throw grabber_error("compress2() failed.");
+    }
+
+    out_data.resize(size);
+}
+
 void ScreenGrabber::GrabAsPNG(std::vector<uint8_t>& out_png, int& out_w, int& out_h) {
+    std::vector<uint8_t> pixels;
+
+    GrabAsRGB(pixels, out_w, out_h);
+
+    Metrics::ScopedTimer timer(encode_time);
+
+    EncodePNG(pixels, out_w, out_h, out_png);
+}
+
+void ScreenGrabber::GrabAsRGB(std::vector<uint8_t>& out_rgb, int& out_w, int& out_h) {
+    auto start{std::chrono::steady_clock::now()};
+
     UniqueDisplay disp(OpenDisplay());
     XWindowAttributes gwa;
 
@@ -125,9 +165,13 @@ void ScreenGrabber::GrabAsPNG(std::vector<uint8_t>& out_png, int& out_w, int& ou
 
     Window root{gwa.root};
     UniqueXImage img(CaptureImage(disp.Get(), root, width, height));
-    std::vector<uint8_t> pixels(ConvertToRGB(img.Get(), width, height));
 
-    EncodePNG(pixels, width, height, out_png);
+    capture_time.ObserveSince(start);
+    start = std::chrono::steady_clock::now();
+
+    out_rgb = ConvertToRGB(img.Get(), width, height);
+
+    convert_time.ObserveSince(start);
 
     out_w = width;
     out_h = height;
@@ -62,6 +62,51 @@ public:
      */
     void GrabAsPNG(std::vector<uint8_t>& out_png, int& out_w, int& out_h);
 
+    /**
+     * @brief Захватывает экран без кодирования.
+     *
+     * @param[out] out_rgb Пиксельные данные в RGB (3 байта на пиксель, строки подряд).
+     * @param[out] out_w Ширина захваченного изображения.
+     * @param[out] out_h Высота захваченного изображения.
+     * @throw grabber_error При ошибках в процессе захвата.
+     *
+     * Шаги 1-4 GrabAsPNG(): кадр кодирует сервер (протокол v4, --upload raw).
+     */
+    void GrabAsRGB(std::vector<uint8_t>& out_rgb, int& out_w, int& out_h);
+
+    /**
+     * @brief Конвертирует XImage в RGB пиксельные данные.
+     * @param[in] img Исходное XImage для конвертации.
+     * @param[in] width Ширина изображения.
+     * @param[in] height Высота изображения.
+     * @return std::vector<uint8_t> Пиксельные данные в RGB (3 байта на пиксель).
+     * @throw grabber_error При неподдерживаемом формате пикселей.
+     *
+     * Не обращается к X-серверу: достаточно заполненных полей data, bytes_per_line,
+     * bits_per_pixel и byte_order (так XImage собирается в бенчмарках).
+     */
+    static std::vector<uint8_t> ConvertToRGB(XImage* img, int width, int height);
+    
+    /**
+     * @brief Кодирует RGB данные в PNG формат.
+     * @param[in] pixels RGB пиксельные данные.
+     * @param[in] width Ширина изображения.
+     * @param[in] height Высота изображения.
+     * @param[out] out_png Результирующие PNG данные.
+     */
+    static void EncodePNG(const std::vector<uint8_t>& pixels, int width, int height, std::vector<uint8_t>& out_png);
+
+    /**
+     * @brief Сжимает RGB данные zlib (Protocol::CODEC_RAW_RGB_ZLIB).
+     * @param[in] pixels RGB пиксельные данные.
+     * @param[out] out_data Сжатые данные.
+     * @throw grabber_error При ошибке сжатия.
+     *
+     * Используется самый быстрый уровень: сжатие лишь снимает с сети однотонные
+     * области экрана, а плотно кадр сожмет сервер в PNG.
+     */
+    static void CompressZlib(const std::vector<uint8_t>& pixels, std::vector<uint8_t>& out_data);
+
 private:
     /**
      * @brief Устанавливает соединение с X11 дисплеем.
@@ -88,26 +133,7 @@ private:
      * @throw grabber_error При ошибке захвата изображения.
      */
     UniqueXImage CaptureImage(Display* disp, Window root, int width, int height);
-    
-    /**
-     * @brief Конвертирует XImage в RGB пиксельные данные.
-     * @param[in] img Исходное XImage для конвертации.
-     * @param[in] width Ширина изображения.
-     * @param[in] height Высота изображения.
-     * @return std::vector<uint8_t> Пиксельные данные в RGB (3 байта на пиксель).
-     * @throw grabber_error При неподдерживаемом формате пикселей.
-     */
-    std::vector<uint8_t> ConvertToRGB(XImage* img, int width, int height);
-    
-    /**
-     * @brief Кодирует RGB данные в PNG формат.
-     * @param[in] pixels RGB пиксельные данные.
-     * @param[in] width Ширина изображения.
-     * @param[in] height Высота изображения.
-     * @param[out] out_png Результирующие PNG данные.
-     */
-    void EncodePNG(const std::vector<uint8_t>& pixels, int width, int height, std::vector<uint8_t>& out_png);
-    
+
 private:
     Logger _logger; ///< Экземпляр логгера для записи ошибок.
 };
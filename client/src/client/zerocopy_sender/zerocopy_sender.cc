@@ -0,0 +1,219 @@
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <poll.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <linux/errqueue.h>
+
+#include "zerocopy_sender.h"
+#include "metrics.h"
+
+namespace {
+Metrics::Counter& zerocopy_sends{Metrics::MetricsRegistry::Global().AddCounter(
+    "client_zerocopy_sends_total", "send() calls made with MSG_ZEROCOPY")};
+Metrics::Counter& zerocopy_copied{Metrics::MetricsRegistry::Global().AddCounter(
+    "client_zerocopy_copied_total", "MSG_ZEROCOPY sends the kernel completed by copying the data")};
+Metrics::Counter& zerocopy_waits{Metrics::MetricsRegistry::Global().AddCounter(
+    "client_zerocopy_buffer_waits_total", "Times a frame waited for the kernel to release a send buffer")};
+}
+
+ZeroCopySender::ZeroCopySender(int fd) :
+    _fd(fd)
+{
+    int one{1};
+
+    if (setsockopt(_fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) < 0) {
+        throw std::runtime_error("setsockopt(SO_ZEROCOPY) error: " + std::string(strerror(errno)));
+    }
+}
+
+std::vector<uint8_t>& ZeroCopySender::Acquire() {
+    Reap(0);
+
+    while (true) {
+        for (Slot& slot : _slots) {
+            if (slot.pending == 0) {
+                slot.data.clear();
+
+                return slot.data;
+            }
+        }
+
+        zerocopy_waits.Inc();
+
+        Reap(-1);
+    }
+}
+
+ssize_t ZeroCopySender::Send(std::vector<uint8_t>& buffer) {
+    Slot* slot{nullptr};
+
+    for (Slot& candidate : _slots) {
+        if (&candidate.data == &buffer) {
+            slot = &candidate;
+        }
+    }
+
+    if (slot == nullptr) {
+        throw std::logic_error("ZeroCopySender::Send(): buffer is not from Acquire()");
+    }
+
+    bool zerocopy{buffer.size() >= MIN_SIZE};
+    size_t total_sent{0};
+
+    slot->first_id = _next_id;
+    slot->issued = 0;
+
+    while (total_sent < buffer.size()) {
+        int flags{MSG_NOSIGNAL | (zerocopy ? MSG_ZEROCOPY : 0)};
+        ssize_t sent{send(_fd, buffer.data() + total_sent, buffer.size() - total_sent, flags)};
+
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            } else if (errno == ENOBUFS && zerocopy) {
+                // Исчерпан лимит памяти на уведомления (optmem_max): дождаться части из них,
+                // а если ждать нечего - досылать сообщение копированием
+                if (!HasPending() || !Reap(1000)) {
+                    zerocopy = false;
+                }
+
+                continue;
+            } else if (errno == EPIPE) {
+                throw std::runtime_error("send() error: broken pipe (connection closed by server)");
+            }
+
+            throw std::runtime_error("send() error: " + std::string(strerror(errno)));
+        } else if (sent == 0) {
+            throw std::runtime_error("send() error: connection closed by peer");
+        }
+
+        if (zerocopy) {
+            ++_next_id;
+            ++slot->issued;
+            ++slot->pending;
+
+            zerocopy_sends.Inc();
+        }
+
+        total_sent += static_cast<size_t>(sent);
+    }
+
+    return static_cast<ssize_t>(total_sent);
+}
+
+bool ZeroCopySender::Flush(int timeout_ms) {
+    auto deadline{std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms)};
+
+    while (HasPending()) {
+        auto left{std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now())};
+
+        if (left.count() <= 0) {
+            return false;
+        }
+
+        Reap(static_cast<int>(left.count()));
+    }
+
+    return true;
+}
+
+bool ZeroCopySender::Reap(int timeout_ms) {
+    struct pollfd pfd{_fd, 0, 0};
+
+    // Непустая очередь ошибок сообщается как POLLERR даже без запрошенных событий
+    if (timeout_ms != 0) {
+        int ret{poll(&pfd, 1, timeout_ms)};
+
+        if (ret < 0 && errno != EINTR) {
+            throw std::runtime_error("poll() error: " + std::string(strerror(errno)));
+        } else if (ret <= 0) {
+            return false;
+        }
+    }
+
+    bool reaped{false};
+
+    while (true) {
+        alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(struct sock_extended_err)) + CMSG_SPACE(sizeof(struct sockaddr_in6))];
+
+        struct msghdr msg{};
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (recvmsg(_fd, &msg, MSG_ERRQUEUE) < 0) {
+            if (errno == EINTR) {
+                continue;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+
+            throw std::runtime_error("recvmsg(MSG_ERRQUEUE) error: " + std::string(strerror(errno)));
+        }
+
+        for (struct cmsghdr* cmsg{CMSG_FIRSTHDR(&msg)}; cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            bool ip_error{(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) ||
+                          (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)};
+
+            if (!ip_error) {
+                continue;
+            }
+
+            struct sock_extended_err err;
+            std::memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+
+            if (err.ee_origin != SO_EE_ORIGIN_ZEROCOPY || err.ee_errno != 0) {
+                continue;
+            }
+
+            // Ядро не смогло сослаться на страницы (например, loopback или устройство без scatter-gather)
+            if (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                zerocopy_copied.Inc(err.ee_data - err.ee_info + 1);
+            }
+
+            Complete(err.ee_info, err.ee_data);
+
+            reaped = true;
+        }
+    }
+
+    // Сигнал без уведомлений - ошибка самого соединения, иначе ожидание зациклится
+    if (!reaped && timeout_ms != 0) {
+        int error{0};
+        socklen_t len{sizeof(error)};
+
+        if (getsockopt(_fd, SOL_SOCKET, SO_ERROR, &error, &len) == 0 && error != 0) {
+            throw std::runtime_error("send() error: " + std::string(strerror(error)));
+        } else if (pfd.revents & POLLHUP) {
+            throw std::runtime_error("send() error: connection closed by peer");
+        }
+    }
+
+    return reaped;
+}
+
+void ZeroCopySender::Complete(uint32_t lo, uint32_t hi) noexcept {
+    // Номера 32-битные и идут по кругу: сравнение по модулю
+    for (Slot& slot : _slots) {
+        for (uint32_t i{0}; i < slot.issued && slot.pending != 0; ++i) {
+            uint32_t id{slot.first_id + i};
+
+            if (static_cast<uint32_t>(id - lo) <= static_cast<uint32_t>(hi - lo)) {
+                --slot.pending;
+            }
+        }
+    }
+}
+
+bool ZeroCopySender::HasPending() const noexcept {
+    for (const Slot& slot : _slots) {
+        if (slot.pending != 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
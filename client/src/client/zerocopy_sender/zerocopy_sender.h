@@ -0,0 +1,103 @@
+#ifndef CLIENT_CLIENT_ZEROCOPY_SENDER_ZEROCOPY_SENDER_H
+#define CLIENT_CLIENT_ZEROCOPY_SENDER_ZEROCOPY_SENDER_H
+
+#include <array>
+#include <vector>
+#include <cstdint>
+
+#include <sys/types.h>
+
+/**
+ * @brief Отправка кадров через MSG_ZEROCOPY из пула закрепленных буферов
+ *
+ * При send() с MSG_ZEROCOPY ядро не копирует данные в буферы сокета, а
+ * ссылается на страницы пользователя до подтверждения приема. Поэтому буфер
+ * нельзя ни менять, ни освобождать, пока ядро не сообщит о завершении через
+ * очередь ошибок сокета (MSG_ERRQUEUE). Каждый успешный send() с флагом получает
+ * очередной номер; уведомление содержит диапазон завершенных номеров.
+ *
+ * Кадр формируется прямо в буфере из Acquire() и отправляется Send(); буфер
+ * возвращается в пул, когда завершены все его send(). Если свободных буферов нет,
+ * Acquire() ждет уведомлений. Сообщения меньше MIN_SIZE отправляются обычным
+ * send(): для них учет страниц дороже копирования.
+ *
+ * Сокет должен быть блокирующим. Используется одним потоком.
+ */
+class ZeroCopySender {
+public:
+    static constexpr size_t BUFFERS{4};          ///< Буферов в пуле
+    static constexpr size_t MIN_SIZE{64 * 1024}; ///< Меньшие сообщения копируются
+
+    /**
+     * @brief Конструктор
+     * @param fd Подключенный TCP-сокет (владение не передается)
+     * @throws std::runtime_error если ядро не поддерживает SO_ZEROCOPY
+     */
+    explicit ZeroCopySender(int fd);
+
+    ZeroCopySender(const ZeroCopySender&) = delete;
+    ZeroCopySender& operator=(const ZeroCopySender&) = delete;
+
+public:
+    /**
+     * @brief Получить свободный буфер для следующего сообщения
+     * @return Пустой буфер (емкость сохраняется между кадрами)
+     * @throws std::runtime_error при ошибках чтения очереди ошибок сокета
+     *
+     * Буфер остается свободным, пока не передан в Send().
+     */
+    std::vector<uint8_t>& Acquire();
+
+    /**
+     * @brief Отправить буфер целиком
+     * @param buffer Буфер из Acquire()
+     * @return Количество отправленных байт
+     * @throws std::runtime_error при ошибках send()
+     */
+    ssize_t Send(std::vector<uint8_t>& buffer);
+
+    /**
+     * @brief Дождаться освобождения всех буферов ядром
+     * @param timeout_ms Максимальное время ожидания
+     * @return true если все буферы свободны
+     */
+    bool Flush(int timeout_ms);
+
+private:
+    /// Буфер пула и номера его send() с MSG_ZEROCOPY
+    struct Slot {
+        std::vector<uint8_t> data; ///< Данные сообщения
+        uint32_t first_id{0};      ///< Номер первого send() буфера с MSG_ZEROCOPY
+        uint32_t issued{0};        ///< Сколько send() с MSG_ZEROCOPY сделано из буфера
+        uint32_t pending{0};       ///< Из них незавершенных (0 - буфер свободен)
+    };
+
+private:
+    /**
+     * @brief Прочитать уведомления о завершении из очереди ошибок сокета
+     * @param timeout_ms Время ожидания первого уведомления (0 - не ждать, -1 - без ограничения)
+     * @return true если получено хотя бы одно уведомление
+     * @throws std::runtime_error при ошибках poll()/recvmsg() и ошибке соединения
+     */
+    bool Reap(int timeout_ms);
+
+    /**
+     * @brief Отметить завершение диапазона номеров send()
+     * @param lo Первый номер (включительно)
+     * @param hi Последний номер (включительно)
+     */
+    void Complete(uint32_t lo, uint32_t hi) noexcept;
+
+    /**
+     * @brief Проверить, есть ли буферы, ожидающие ядра
+     * @return true если хотя бы один буфер занят
+     */
+    bool HasPending() const noexcept;
+
+private:
+    int _fd;                          ///< Сокет сервера
+    std::array<Slot, BUFFERS> _slots; ///< Пул буферов
+    uint32_t _next_id{0};             ///< Номер следующего send() с MSG_ZEROCOPY
+};
+
+#endif // CLIENT_CLIENT_ZEROCOPY_SENDER_ZEROCOPY_SENDER_H
@@ -8,11 +8,15 @@ int main(int argc, char* argv[]) {
         InputParser parser(ProgramType::K_CLIENT);
         parser.Parse(argc, argv);
 
-        std::string host{parser.GetHost()};
-        uint16_t port{parser.GetPort()};
+        Logger::SetLevel(parser.GetLogLevel());
+
+        std::vector<ServerAddress> servers{parser.GetServers()};
         unsigned period{parser.GetPeriod()};
+        uint16_t metrics_port{parser.GetMetricsPort()};
+        SendMode send_mode{parser.GetSendMode()};
+        UploadMode upload_mode{parser.GetUploadMode()};
 
-        Client client(host, port, period);
+        Client client(servers, period, metrics_port, send_mode, upload_mode);
         client.Run();
     } catch (const std::invalid_argument& ex) {
         std::cerr << ex.what() << '\n';
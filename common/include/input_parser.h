@@ -5,8 +5,11 @@
 #include <string>
 #include <cstdint>
 #include <getopt.h>
+#include <unordered_set>
 #include <unordered_map>
 
+#include "logger.h"
+
 /**
  * @brief Тип программы (сервер или клиент)
  */
@@ -15,11 +18,80 @@ enum ProgramType {
     K_CLIENT  ///< Клиентская часть приложения
 };
 
+/**
+ * @brief Движок хранения скриншотов на сервере
+ */
+enum StorageEngine {
+    K_FILES,    ///< Каждый кадр - отдельный файл (screenshots/<host>/<user>/*.png)
+    K_SEGMENTS, ///< Кадры дописываются в сегментные файлы клиента с индексом
+    K_DEDUP     ///< Одинаковые кадры хранятся один раз (адресация по содержимому)
+};
+
+/**
+ * @brief Гарантия сохранности записанных скриншотов
+ */
+enum DurabilityMode {
+    K_NONE,     ///< Данные сбрасываются на диск по усмотрению ОС
+    K_PERIODIC, ///< fdatasync всех измененных файлов раз в интервал
+    K_GROUP     ///< Групповая фиксация: один fdatasync на пачку накопившихся кадров
+};
+
+/**
+ * @brief Поведение сервера при перегрузке для новых соединений
+ */
+enum AdmissionMode {
+    K_REJECT, ///< Соединение принимается и сразу закрывается
+    K_DEFER   ///< Прием приостанавливается, соединения ждут в очереди listen()
+};
+
+/**
+ * @brief Способ отправки кадров клиентом
+ */
+enum SendMode {
+    K_COPY,    ///< Обычный send(): ядро копирует кадр в буферы сокета
+    K_ZEROCOPY ///< send() с MSG_ZEROCOPY из закрепленных буферов
+};
+
+/**
+ * @brief Формат кадров, в котором их отправляет клиент
+ */
+enum UploadMode {
+    K_CLIENT_PNG,  ///< Клиент сам кодирует кадр в PNG
+    K_RAW_RGB,     ///< Пиксели RGB без сжатия, PNG кодирует сервер (протокол v4)
+    K_RAW_RGB_ZLIB ///< Пиксели RGB, сжатые zlib, PNG кодирует сервер (протокол v4)
+};
+
+/**
+ * @brief Адрес сервера (коллектора) из --srv клиента или --upstream сервера
+ */
+struct ServerAddress {
+    std::string host; ///< IP-адрес
+    uint16_t port{};  ///< Порт
+};
+
+/**
+ * @brief Диапазон IPv4-адресов из --accept-relays сервера
+ */
+struct AddressRange {
+    uint32_t network{}; ///< Адрес сети (сетевой порядок байт)
+    uint32_t mask{};    ///< Маска сети (сетевой порядок байт)
+
+    /**
+     * @brief Проверить, входит ли адрес в диапазон
+     * @param addr IPv4-адрес (сетевой порядок байт)
+     * @return true если адрес в диапазоне
+     */
+    bool Contains(uint32_t addr) const noexcept {
+        return (addr & mask) == network;
+    }
+};
+
 /**
  * @brief Класс для разбора аргументов командной строки
  *
  * Парсит входные аргументы в зависимости от типа программы (сервер/клиент).
  * Для сервера обязателен параметр --port, для клиента --srv и --period.
+ * Остальные параметры необязательны и имеют значения по умолчанию.
  * Выбрасывает исключения при невалидных аргументах или отсутствии обязательных параметров.
  */
 class InputParser {
@@ -33,10 +105,16 @@ public:
 public:
     /**
      * @brief Получить хост сервера (только для клиента)
-     * @return IP-адрес сервера в строковом формате
+     * @return IP-адрес первого сервера из --srv в строковом формате
      */
     std::string GetHost() const noexcept;
 
+    /**
+     * @brief Получить список серверов (только для клиента)
+     * @return Адреса из --srv в порядке указания
+     */
+    std::vector<ServerAddress> GetServers() const;
+
     /**
      * @brief Получить порт (для сервера - порт прослушивания, для клиента - порт сервера)
      * @return Номер порта
@@ -49,6 +127,216 @@ public:
      */
     unsigned GetPeriod() const noexcept;
 
+    /**
+     * @brief Получить движок хранения (только для сервера)
+     * @return Движок хранения скриншотов
+     */
+    StorageEngine GetStorageEngine() const noexcept;
+
+    /**
+     * @brief Получить максимальный размер сегмента (только для сервера)
+     * @return Размер сегмента в байтах
+     */
+    uint64_t GetSegmentSize() const noexcept;
+
+    /**
+     * @brief Получить максимальный возраст сегмента (только для сервера)
+     * @return Возраст сегмента в секундах
+     */
+    unsigned GetSegmentAge() const noexcept;
+
+    /**
+     * @brief Получить режим сохранности (только для сервера)
+     * @return Режим сохранности скриншотов
+     */
+    DurabilityMode GetDurabilityMode() const noexcept;
+
+    /**
+     * @brief Получить интервал синхронизации для K_PERIODIC (только для сервера)
+     * @return Интервал в миллисекундах
+     */
+    unsigned GetSyncInterval() const noexcept;
+
+    /**
+     * @brief Получить квоту на клиента (только для сервера)
+     * @return Квота в байтах (0 - без ограничения)
+     */
+    uint64_t GetClientQuota() const noexcept;
+
+    /**
+     * @brief Получить квоту на пользователя (только для сервера)
+     * @return Квота в байтах (0 - без ограничения)
+     */
+    uint64_t GetUserQuota() const noexcept;
+
+    /**
+     * @brief Получить общую квоту (только для сервера)
+     * @return Квота в байтах (0 - без ограничения)
+     */
+    uint64_t GetTotalQuota() const noexcept;
+
+    /**
+     * @brief Получить максимальный возраст кадров (только для сервера)
+     * @return Возраст в секундах (0 - без ограничения)
+     */
+    unsigned GetMaxAge() const noexcept;
+
+    /**
+     * @brief Получить минимум свободного места на диске (только для сервера)
+     * @return Объем в байтах (0 - без ограничения)
+     */
+    uint64_t GetMinFree() const noexcept;
+
+    /**
+     * @brief Получить скорость фонового удаления (только для сервера)
+     * @return Скорость в байтах в секунду
+     */
+    uint64_t GetEvictRate() const noexcept;
+
+    /**
+     * @brief Получить порт выборки кадров (только для сервера)
+     * @return Порт на 127.0.0.1 (0 - выборка выключена)
+     */
+    uint16_t GetQueryPort() const noexcept;
+
+    /**
+     * @brief Получить объем кэша горячих кадров (только для сервера)
+     * @return Объем в байтах (0 - кэш выключен)
+     */
+    uint64_t GetCacheSize() const noexcept;
+
+    /**
+     * @brief Получить максимум кадров клиента в кэше (только для сервера)
+     * @return Число кадров
+     */
+    size_t GetCacheFrames() const noexcept;
+
+    /**
+     * @brief Получить порт выдачи метрик
+     * @return Порт на 127.0.0.1 (0 - выдача выключена)
+     */
+    uint16_t GetMetricsPort() const noexcept;
+
+    /**
+     * @brief Получить минимальный уровень логирования
+     * @return Уровень (по умолчанию K_INFO)
+     */
+    MessageType GetLogLevel() const noexcept;
+
+    /**
+     * @brief Получить путь к файлу трассировки кадров (только для сервера)
+     * @return Путь (пустой - трассировка выключена)
+     */
+    std::string GetTraceFile() const noexcept;
+
+    /**
+     * @brief Получить окно кредита в кадрах (только для сервера)
+     * @return Число кадров (0 - управление потоком выключено)
+     */
+    uint64_t GetCreditFrames() const noexcept;
+
+    /**
+     * @brief Получить окно кредита в байтах (только для сервера)
+     * @return Объем в байтах
+     */
+    uint64_t GetCreditSize() const noexcept;
+
+    /**
+     * @brief Получить максимум одновременных соединений (только для сервера)
+     * @return Число соединений (0 - без ограничения)
+     */
+    size_t GetMaxConnections() const noexcept;
+
+    /**
+     * @brief Получить поведение при перегрузке (только для сервера)
+     * @return Режим допуска (по умолчанию K_REJECT)
+     */
+    AdmissionMode GetAdmissionMode() const noexcept;
+
+    /**
+     * @brief Получить ограничение скорости клиента (только для сервера)
+     * @return Кадров в секунду на hostname/username (0 - без ограничения)
+     */
+    uint64_t GetClientRate() const noexcept;
+
+    /**
+     * @brief Получить ограничение скорости IP-адреса (только для сервера)
+     * @return Байт данных кадров в секунду на адрес (0 - без ограничения)
+     */
+    uint64_t GetAddressRate() const noexcept;
+
+    /**
+     * @brief Получить период захвата, назначаемый клиентам (только для сервера)
+     * @return Период в секундах (0 - клиенты снимают по своему --period)
+     */
+    unsigned GetCapturePeriod() const noexcept;
+
+    /**
+     * @brief Получить вышестоящий сервер для ретрансляции (только для сервера)
+     * @return Адрес из --upstream (порт 0 - ретрансляция выключена)
+     */
+    ServerAddress GetUpstream() const;
+
+    /**
+     * @brief Получить число соединений с вышестоящим сервером (только для сервера)
+     * @return Число соединений (по умолчанию 2)
+     */
+    size_t GetUpstreamConnections() const noexcept;
+
+    /**
+     * @brief Получить объем очереди ретрансляции на диске (только для сервера)
+     * @return Объем в байтах (0 - кадры сверх очереди в памяти отбрасываются)
+     */
+    uint64_t GetSpillSize() const noexcept;
+
+    /**
+     * @brief Получить адреса, с которых принимаются пачки ретрансляторов (только для сервера)
+     * @return Диапазоны адресов (пусто - пачки ретрансляторов не принимаются)
+     */
+    const std::vector<AddressRange>& GetRelaySources() const noexcept;
+
+    /**
+     * @brief Получить путь к сокету передачи работы новому процессу (только для сервера)
+     * @return Путь (пустой - передача выключена)
+     */
+    std::string GetHandoffPath() const noexcept;
+
+    /**
+     * @brief Получить число потоков кодирования кадров без PNG (только для сервера)
+     * @return Число потоков (по умолчанию - число ядер; 0 - прием таких кадров выключен)
+     */
+    size_t GetEncodeWorkers() const noexcept;
+
+    /**
+     * @brief Получить возраст кадров для компактизации (только для сервера)
+     * @return Возраст в секундах (0 - компактизация выключена)
+     */
+    unsigned GetCompactAfter() const noexcept;
+
+    /**
+     * @brief Получить интервал опорных кадров в архивах компактизации (только для сервера)
+     * @return Интервал в кадрах
+     */
+    unsigned GetCompactKeyframes() const noexcept;
+
+    /**
+     * @brief Получить число потоков построения миниатюр (только для сервера)
+     * @return Число потоков (0 - миниатюры не строятся)
+     */
+    size_t GetThumbnailWorkers() const noexcept;
+
+    /**
+     * @brief Получить способ отправки кадров (только для клиента)
+     * @return Способ отправки (по умолчанию K_COPY)
+     */
+    SendMode GetSendMode() const noexcept;
+
+    /**
+     * @brief Получить формат отправки кадров (только для клиента)
+     * @return Формат (по умолчанию K_CLIENT_PNG)
+     */
+    UploadMode GetUploadMode() const noexcept;
+
     /**
      * @brief Разобрать аргументы командной строки
      * @param argc Количество аргументов
@@ -57,7 +345,22 @@ public:
      *
      * @note Форматы аргументов:
      *       Для сервера: --port <номер_порта>
-     *       Для клиента: --srv <ip:порт> --period <интервал_сек>
+     *                    [--storage files|segments|dedup] [--segment-size <МБ>] [--segment-age <сек>]
+     *                    [--durability none|periodic|group] [--sync-interval <мс>]
+     *                    [--quota-client <МБ>] [--quota-user <МБ>] [--quota-total <МБ>]
+     *                    [--max-age <сек>] [--min-free <МБ>] [--evict-rate <МБ/с>]
+     *                    [--query-port <номер_порта>] [--cache-size <МБ>] [--cache-frames <кадров>]
+     *                    [--metrics-port <номер_порта>] [--log-level debug|info|warning|error]
+     *                    [--trace-file <путь>] [--credit-frames <кадров>] [--credit-size <МБ>]
+     *                    [--max-connections <число>] [--admission reject|defer]
+     *                    [--rate-client <кадров/с>] [--rate-ip <МБ/с>] [--capture-period <сек>]
+     *                    [--upstream <ip:порт>] [--upstream-connections <число>] [--spill-size <МБ>]
+     *                    [--accept-relays <ip>[/<бит>][,<ip>[/<бит>]...]]
+     *                    [--handoff <путь>] [--encode-workers <число>]
+     *                    [--compact-after <сек>] [--compact-keyframes <кадров>] [--thumbnails <потоков>]
+     *       Для клиента: --srv <ip:порт>[,<ip:порт>...] --period <интервал_сек> [--metrics-port <номер_порта>]
+     *                    [--log-level debug|info|warning|error] [--send copy|zerocopy]
+     *                    [--upload png|raw|raw-zlib]
      */
     void Parse(int argc, char *argv[]);
 
@@ -74,8 +377,8 @@ private:
 
     /**
      * @brief Разобрать аргумент --srv (только для клиента)
-     * @param arg Аргумент в формате "ip:port"
-     * @throw std::invalid_argument При невалидном формате
+     * @param arg Аргумент в формате "ip:port" или список "ip:port,ip:port,..."
+     * @throw std::invalid_argument При невалидном формате или повторе адреса
      */
     void ParseSrv(char* arg);
 
@@ -107,6 +410,231 @@ private:
      */
     void ParsePeriod(char* arg);
 
+    /**
+     * @brief Разобрать аргумент --storage (только для сервера)
+     * @param arg Название движка ("files", "segments" или "dedup")
+     * @throw std::invalid_argument При неизвестном движке
+     */
+    void ParseStorage(char* arg);
+
+    /**
+     * @brief Разобрать аргумент --segment-size (только для сервера)
+     * @param arg Размер сегмента в мегабайтах (1-65536)
+     * @throw std::invalid_argument При невалидном размере
+     */
+    void ParseSegmentSize(char* arg);
+
+    /**
+     * @brief Разобрать аргумент --segment-age (только для сервера)
+     * @param arg Возраст сегмента в секундах (1-604800)
+     * @throw std::invalid_argument При невалидном возрасте
+     */
+    void ParseSegmentAge(char* arg);
+
+    /**
+     * @brief Разобрать аргумент --durability (только для сервера)
+     * @param arg Режим ("none", "periodic" или "group")
+     * @throw std::invalid_argument При неизвестном режиме
+     */
+    void ParseDurability(char* arg);
+
+    /**
+     * @brief Разобрать аргумент --sync-interval (только для сервера)
+     * @param arg Интервал в миллисекундах (1-60000)
+     * @throw std::invalid_argument При невалидном интервале
+     */
+    void ParseSyncInterval(char* arg);
+
+    /**
+     * @brief Разобрать аргумент квоты --quota-client, --quota-user, --quota-total или --min-free (только для сервера)
+     * @param arg Объем в мегабайтах (0-16777216)
+     * @return Объем в байтах
+     * @throw std::invalid_argument При невалидном объеме
+     */
+    uint64_t ParseQuota(char* arg);
+
+    /**
+     * @brief Разобрать аргумент --max-age (только для сервера)
+     * @param arg Возраст в секундах (0-315360000)
+     * @throw std::invalid_argument При невалидном возрасте
+     */
+    void ParseMaxAge(char* arg);
+
+    /**
+     * @brief Разобрать аргумент --evict-rate (только для сервера)
+     * @param arg Скорость в мегабайтах в секунду (1-65536)
+     * @throw std::invalid_argument При невалидной скорости
+     */
+    void ParseEvictRate(char* arg);
+
+    /**
+     * @brief Разобрать аргумент --query-port (только для сервера)
+     * @param arg Номер порта (1-65535)
+     * @throw std::invalid_argument При невалидном порте
+     */
+    void ParseQueryPort(char* arg);
+
+    /**
+     * @brief Разобрать аргумент --cache-size (только для сервера)
+     * @param arg Объем в мегабайтах (0-65536)
+     * @throw std::invalid_argument При невалидном объеме
+     */
+    void ParseCacheSize(char* arg);
+
+    /**
+     * @brief Разобрать аргумент --cache-frames (только для сервера)
+     * @param arg Число кадров (1-1024)
+     * @throw std::invalid_argument При невалидном числе
+     */
+    void ParseCacheFrames(char* arg);
+
+    /**
+     * @brief Разобрать аргумент --metrics-port
+     * @param arg Номер порта (1-65535)
+     * @throw std::invalid_argument При невалидном порте
+     */
+    void ParseMetricsPort(char* arg);
+
+    /**
+     * @brief Разобрать аргумент --log-level
+     * @param arg Уровень ("debug", "info", "warning" или "error")
+     * @throw std::invalid_argument При неизвестном уровне
+     */
+    void ParseLogLevel(char* arg);
+
+    /**
+     * @brief Разобрать аргумент --trace-file (только для сервера)
+     * @param arg Путь к файлу
+     * @throw std::invalid_argument При пустом пути
+     */
+    void ParseTraceFile(char* arg);
+
+    /**
+     * @brief Разобрать аргумент --credit-frames (только для сервера)
+     * @param arg Число кадров (0-4096, 0 - управление потоком выключено)
+     * @throw std::invalid_argument При невалидном числе
+     */
+    void ParseCreditFrames(char* arg);
+
+    /**
+     * @brief Разобрать аргумент --credit-size (только для сервера)
+     * @param arg Объем в мегабайтах (16-4096)
+     * @throw std::invalid_argument При невалидном объеме
+     */
+    void ParseCreditSize(char* arg);
+
+    /**
+     * @brief Разобрать аргумент --max-connections (только для сервера)
+     * @param arg Число соединений (0-1000000, 0 - без ограничения)
+     * @throw std::invalid_argument При невалидном числе
+     */
+    void ParseMaxConnections(char* arg);
+
+    /**
+     * @brief Разобрать аргумент --admission (только для сервера)
+     * @param arg Режим ("reject" или "defer")
+     * @throw std::invalid_argument При неизвестном режиме
+     */
+    void ParseAdmission(char* arg);
+
+    /**
+     * @brief Разобрать аргумент --rate-client (только для сервера)
+     * @param arg Кадров в секунду (0-10000, 0 - без ограничения)
+     * @throw std::invalid_argument При невалидной скорости
+     */
+    void ParseClientRate(char* arg);
+
+    /**
+     * @brief Разобрать аргумент --rate-ip (только для сервера)
+     * @param arg Скорость в мегабайтах в секунду (0-65536, 0 - без ограничения)
+     * @throw std::invalid_argument При невалидной скорости
+     */
+    void ParseAddressRate(char* arg);
+
+    /**
+     * @brief Разобрать аргумент --capture-period (только для сервера)
+     * @param arg Период в секундах (0-86400, 0 - расписание не назначается)
+     * @throw std::invalid_argument При невалидном периоде
+     */
+    void ParseCapturePeriod(char* arg);
+
+    /**
+     * @brief Разобрать аргумент --upstream (только для сервера)
+     * @param arg Адрес в формате "ip:port"
+     * @throw std::invalid_argument При невалидном адресе
+     */
+    void ParseUpstream(char* arg);
+
+    /**
+     * @brief Разобрать аргумент --upstream-connections (только для сервера)
+     * @param arg Число соединений (1-64)
+     * @throw std::invalid_argument При невалидном числе
+     */
+    void ParseUpstreamConnections(char* arg);
+
+    /**
+     * @brief Разобрать аргумент --spill-size (только для сервера)
+     * @param arg Объем в мегабайтах (0-1048576, 0 - без очереди на диске)
+     * @throw std::invalid_argument При невалидном объеме
+     */
+    void ParseSpillSize(char* arg);
+
+    /**
+     * @brief Разобрать аргумент --accept-relays (только для сервера)
+     * @param arg Список через запятую: IPv4-адрес или сеть в записи CIDR (10.0.0.0/8)
+     * @throw std::invalid_argument При невалидном адресе или длине префикса
+     */
+    void ParseAcceptRelays(char* arg);
+
+    /**
+     * @brief Разобрать аргумент --handoff (только для сервера)
+     * @param arg Путь к Unix-сокету
+     * @throw std::invalid_argument При пустом или слишком длинном пути
+     */
+    void ParseHandoffPath(char* arg);
+
+    /**
+     * @brief Разобрать аргумент --encode-workers (только для сервера)
+     * @param arg Число потоков (0-256, 0 - прием кадров без PNG выключен)
+     * @throw std::invalid_argument При невалидном числе
+     */
+    void ParseEncodeWorkers(char* arg);
+
+    /**
+     * @brief Разобрать аргумент --compact-after (только для сервера)
+     * @param arg Возраст кадров в секундах (0-315360000, 0 - компактизация выключена)
+     * @throw std::invalid_argument При невалидном возрасте
+     */
+    void ParseCompactAfter(char* arg);
+
+    /**
+     * @brief Разобрать аргумент --compact-keyframes (только для сервера)
+     * @param arg Интервал опорных кадров (1-1000)
+     * @throw std::invalid_argument При невалидном интервале
+     */
+    void ParseCompactKeyframes(char* arg);
+
+    /**
+     * @brief Разобрать аргумент --thumbnails (только для сервера)
+     * @param arg Число потоков (0-256, 0 - миниатюры не строятся)
+     * @throw std::invalid_argument При невалидном числе
+     */
+    void ParseThumbnailWorkers(char* arg);
+
+    /**
+     * @brief Разобрать аргумент --send (только для клиента)
+     * @param arg Способ ("copy" или "zerocopy")
+     * @throw std::invalid_argument При неизвестном способе
+     */
+    void ParseSendMode(char* arg);
+
+    /**
+     * @brief Разобрать аргумент --upload (только для клиента)
+     * @param arg Формат ("png", "raw" или "raw-zlib")
+     * @throw std::invalid_argument При неизвестном формате
+     */
+    void ParseUploadMode(char* arg);
+
     /**
      * @brief Обработать опцию сервера
      * @param opt_index Индекс обрабатываемой опции
@@ -120,12 +648,49 @@ private:
     void HandleClientOption(int opt_index);
 
 private:
-    ProgramType _prog_type;                                    ///< Тип программы (сервер/клиент)
-    std::string _host;                                         ///< Хост сервера (для клиента)
-    uint16_t _port;                                            ///< Порт
-    unsigned _period;                                          ///< Период (для клиента)
-    std::vector<option> _long_options;                         ///< Структуры long options для getopt_long
-    std::unordered_map<std::string, bool> _option_enabled_ht;  ///< Хеш-таблица обработанных опций
+    ProgramType _prog_type;                                   ///< Тип программы (сервер/клиент)
+    std::string _host;                                        ///< Хост сервера (для клиента)
+    uint16_t _port;                                           ///< Порт
+    std::vector<ServerAddress> _servers;                      ///< Серверы из --srv (для клиента)
+    unsigned _period;                                         ///< Период (для клиента)
+    StorageEngine _storage_engine{StorageEngine::K_FILES};    ///< Движок хранения (для сервера)
+    uint64_t _segment_size{256ULL * 1024 * 1024};             ///< Размер сегмента в байтах (для сервера)
+    unsigned _segment_age{3600};                              ///< Возраст сегмента в секундах (для сервера)
+    DurabilityMode _durability{DurabilityMode::K_NONE};       ///< Режим сохранности (для сервера)
+    unsigned _sync_interval{1000};                            ///< Интервал синхронизации в мс (для сервера)
+    uint64_t _client_quota{0};                                ///< Квота на клиента в байтах (для сервера)
+    uint64_t _user_quota{0};                                  ///< Квота на пользователя в байтах (для сервера)
+    uint64_t _total_quota{0};                                 ///< Общая квота в байтах (для сервера)
+    unsigned _max_age{0};                                     ///< Максимальный возраст кадров в секундах (для сервера)
+    uint64_t _min_free{0};                                    ///< Минимум свободного места в байтах (для сервера)
+    uint64_t _evict_rate{64ULL * 1024 * 1024};                ///< Скорость удаления в байтах/с (для сервера)
+    uint16_t _query_port{0};                                  ///< Порт выборки кадров (для сервера)
+    uint64_t _cache_size{128ULL * 1024 * 1024};               ///< Объем кэша горячих кадров в байтах (для сервера)
+    size_t _cache_frames{8};                                  ///< Максимум кадров клиента в кэше (для сервера)
+    uint16_t _metrics_port{0};                                ///< Порт выдачи метрик
+    MessageType _log_level{MessageType::K_INFO};              ///< Минимальный уровень логирования
+    std::string _trace_file;                                  ///< Файл трассировки кадров (для сервера)
+    uint64_t _credit_frames{8};                               ///< Окно кредита в кадрах (для сервера)
+    uint64_t _credit_size{64ULL * 1024 * 1024};               ///< Окно кредита в байтах (для сервера)
+    size_t _max_connections{0};                               ///< Максимум одновременных соединений (для сервера)
+    AdmissionMode _admission{AdmissionMode::K_REJECT};        ///< Поведение при перегрузке (для сервера)
+    uint64_t _client_rate{0};                                 ///< Кадров в секунду на клиента (для сервера)
+    uint64_t _address_rate{0};                                ///< Байт в секунду на IP-адрес (для сервера)
+    unsigned _capture_period{0};                              ///< Период захвата клиентов, сек (для сервера)
+    ServerAddress _upstream;                                  ///< Вышестоящий сервер ретрансляции (для сервера)
+    size_t _upstream_connections{2};                          ///< Соединений с вышестоящим сервером (для сервера)
+    uint64_t _spill_size{1024ULL * 1024 * 1024};              ///< Объем очереди ретрансляции на диске (для сервера)
+    std::vector<AddressRange> _relay_sources;                 ///< Адреса допущенных ретрансляторов (для сервера)
+    std::string _handoff_path;                                ///< Сокет передачи работы новому процессу (для сервера)
+    size_t _encode_workers{0};                                ///< Потоки кодирования кадров без PNG (для сервера)
+    unsigned _compact_after{0};                               ///< Возраст кадров для компактизации, сек (для сервера)
+    unsigned _compact_keyframes{30};                          ///< Интервал опорных кадров компактизации (для сервера)
+    size_t _thumbnail_workers{0};                             ///< Потоки построения миниатюр (для сервера)
+    SendMode _send_mode{SendMode::K_COPY};                    ///< Способ отправки кадров (для клиента)
+    UploadMode _upload_mode{UploadMode::K_CLIENT_PNG};        ///< Формат отправки кадров (для клиента)
+    std::vector<option> _long_options;                        ///< Структуры long options для getopt_long
+    std::unordered_map<std::string, bool> _option_enabled_ht; ///< Хеш-таблица обработанных опций
+    std::unordered_set<std::string> _optional_options;        ///< Необязательные опции
 };
 
 #endif // COMMON_INCLUDE_INPUT_PARSER_H
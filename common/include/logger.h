@@ -1,22 +1,63 @@
 #ifndef COMMON_INCLUDE_LOGGER_H
 #define COMMON_INCLUDE_LOGGER_H
 
+#include <atomic>
 #include <string>
+#include <cstdint>
 
 /**
  * @brief Типы сообщений для логирования
  */
 enum MessageType {
-    K_INFO,   ///< Информационное сообщение
-    K_ERROR,  ///< Сообщение об ошибке
-    K_WARNING ///< Предупреждение
+    K_INFO,    ///< Информационное сообщение
+    K_ERROR,   ///< Сообщение об ошибке
+    K_WARNING, ///< Предупреждение
+    K_DEBUG    ///< Отладочное сообщение (по умолчанию не выводится)
+};
+
+/**
+ * @brief Ограничение частоты сообщений одного места в коде
+ *
+ * Объявляется статическим рядом с вызовом логгера. Пропускает не больше
+ * per_second сообщений в секунду, остальные отбрасываются, а их число
+ * дописывается к первому сообщению следующей секунды. Безопасно для
+ * вызова из нескольких потоков.
+ */
+class LogRateLimit {
+public:
+    /**
+     * @brief Конструктор
+     * @param per_second Максимум сообщений в секунду
+     */
+    explicit LogRateLimit(unsigned per_second) noexcept :
+        _per_second(per_second)
+    {}
+
+    /**
+     * @brief Проверить, можно ли вывести сообщение
+     * @param suppressed Число отброшенных перед ним сообщений (заполняется при успехе)
+     * @return true, если сообщение укладывается в лимит
+     */
+    bool Acquire(uint64_t& suppressed) noexcept;
+
+private:
+    unsigned _per_second;                 ///< Максимум сообщений в секунду
+    std::atomic<int64_t> _window{-1};     ///< Текущая секунда
+    std::atomic<unsigned> _count{0};      ///< Сообщений в текущей секунде
+    std::atomic<uint64_t> _suppressed{0}; ///< Отброшено с последнего выведенного сообщения
 };
 
 /**
  * @brief Класс для логирования сообщений с временными метками
- * 
+ *
  * Обеспечивает вывод форматированных сообщений в соответствующие потоки вывода
  * с указанием типа сообщения и временной метки.
+ *
+ * Вывод асинхронный: вызывающий поток только форматирует запись в свободную ячейку
+ * общего кольцевого буфера (без блокировок и выделения памяти), а запись в терминал
+ * пачками выполняет фоновый поток. При переполнении буфера записи отбрасываются,
+ * их число выводится отдельным предупреждением и учитывается в метрике
+ * log_records_dropped_total. Оставшиеся записи выводятся при завершении процесса.
  */
 class Logger {
 public:
@@ -24,37 +65,46 @@ public:
      * @brief Выводит сообщение в терминал с форматированием
      * @param type Тип сообщения (из перечисления MessageType)
      * @param msg Текст сообщения
-     * 
+     *
      * Формат вывода: [TYPE] [TIMESTAMP] message
-     * 
+     *
      * @note Для разных типов сообщений используются разные потоки:
-     *       - INFO -> std::cout
-     *       - ERROR -> std::cerr
-     *       - WARNING -> std::clog
+     *       - INFO, DEBUG -> stdout
+     *       - ERROR, WARNING -> stderr
+     *       Сообщения ниже уровня SetLevel() не форматируются.
+     *       Слишком длинные сообщения обрезаются.
      */
     void PrintInTerminal(MessageType type, const std::string& msg);
-    
+
+    /**
+     * @brief Выводит сообщение с ограничением частоты
+     * @param type Тип сообщения
+     * @param msg Текст сообщения
+     * @param rate Ограничение места вызова
+     */
+    void PrintInTerminal(MessageType type, const std::string& msg, LogRateLimit& rate);
+
     /**
      * @brief Генерирует текущую временную метку
      * @param mask Формат строки времени (по умолчанию "%Y-%m-%d %H:%M:%S")
      * @return Строка с отформатированным временем
+     *
+     * @note Для формата по умолчанию строка кэшируется в потоке и пересчитывается раз в секунду.
      */
     std::string GetCurrentTimestamp(const char* mask = "%Y-%m-%d %H:%M:%S");
 
-private:
     /**
-     * @brief Преобразует тип сообщения в строку
-     * @param type Тип сообщения
-     * @return Строковое представление типа
+     * @brief Установить минимальный выводимый уровень (для всего процесса)
+     * @param level K_DEBUG, K_INFO, K_WARNING или K_ERROR
      */
-    std::string TypeToString(MessageType type);
-    
+    static void SetLevel(MessageType level) noexcept;
+
     /**
-     * @brief Возвращает поток вывода для типа сообщения
+     * @brief Проверить, выводится ли уровень
      * @param type Тип сообщения
-     * @return Ссылка на соответствующий поток вывода
+     * @return true, если сообщения этого типа выводятся
      */
-    std::ostream& TypeToStream(MessageType type);
+    static bool IsEnabled(MessageType type) noexcept;
 };
 
 #endif // COMMON_INCLUDE_LOGGER_H
@@ -0,0 +1,266 @@
+#ifndef COMMON_INCLUDE_METRICS_H
+#define COMMON_INCLUDE_METRICS_H
+
+#include <array>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <cstdint>
+
+/**
+ * @brief Метрики процесса в формате Prometheus
+ *
+ * Счетчики и гистограммы разбиты на ячейки по потокам: каждый поток пишет
+ * в свою ячейку (отдельная кэш-линия) атомарным сложением без блокировок,
+ * ячейки суммируются только при выдаче (MetricsRegistry::Render()).
+ */
+namespace Metrics {
+
+constexpr size_t SLOTS{16}; ///< Число ячеек (потоки распределяются по ним по кругу)
+
+/**
+ * @brief Получить ячейку текущего потока
+ * @return Индекс ячейки (постоянен для потока)
+ */
+size_t ThreadSlot() noexcept;
+
+/**
+ * @brief Монотонно растущий счетчик
+ */
+class Counter {
+public:
+    /**
+     * @brief Увеличить счетчик
+     * @param value Приращение
+     */
+    void Inc(uint64_t value = 1) noexcept {
+        _slots[ThreadSlot()].value.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Получить текущее значение
+     * @return Сумма по всем ячейкам
+     */
+    uint64_t Value() const noexcept;
+
+private:
+    /**
+     * @brief Ячейка одного потока
+     */
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> value{0}; ///< Значение
+    };
+
+    std::array<Slot, SLOTS> _slots; ///< Ячейки
+};
+
+/**
+ * @brief Текущее значение (может уменьшаться)
+ */
+class Gauge {
+public:
+    /**
+     * @brief Установить значение
+     * @param value Новое значение
+     */
+    void Set(int64_t value) noexcept {
+        _value.store(value, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Изменить значение
+     * @param delta Приращение (может быть отрицательным)
+     */
+    void Add(int64_t delta) noexcept {
+        _value.fetch_add(delta, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Получить текущее значение
+     * @return Значение
+     */
+    int64_t Value() const noexcept {
+        return _value.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<int64_t> _value{0}; ///< Значение
+};
+
+/**
+ * @brief Гистограмма длительностей с фиксированными границами корзин
+ *
+ * Границы одинаковы для всех гистограмм: от 50 мкс до 10 с.
+ */
+class Histogram {
+public:
+    /// Верхние границы корзин в микросекундах (плюс корзина +Inf)
+    static constexpr std::array<uint64_t, 17> BOUNDS_US{
+        50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000,
+        100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000
+    };
+
+    /**
+     * @brief Учесть наблюдение
+     * @param value_us Длительность в микросекундах
+     */
+    void Observe(uint64_t value_us) noexcept;
+
+    /**
+     * @brief Учесть время, прошедшее с момента start
+     * @param start Начало измеряемого интервала
+     */
+    void ObserveSince(std::chrono::steady_clock::time_point start) noexcept {
+        auto elapsed{std::chrono::steady_clock::now() - start};
+
+        Observe(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()));
+    }
+
+    /**
+     * @brief Сводка по всем ячейкам
+     */
+    struct Snapshot {
+        std::array<uint64_t, BOUNDS_US.size() + 1> buckets{}; ///< Число наблюдений по корзинам (не накопительно)
+        uint64_t sum_us{};                                    ///< Сумма наблюдений
+        uint64_t count{};                                     ///< Число наблюдений
+    };
+
+    /**
+     * @brief Собрать сводку
+     * @return Сумма ячеек всех потоков
+     */
+    Snapshot Collect() const noexcept;
+
+private:
+    /**
+     * @brief Ячейка одного потока
+     */
+    struct alignas(64) Slot {
+        std::array<std::atomic<uint64_t>, BOUNDS_US.size() + 1> buckets{}; ///< Корзины
+        std::atomic<uint64_t> sum_us{0};                                   ///< Сумма наблюдений
+    };
+
+    std::array<Slot, SLOTS> _slots; ///< Ячейки
+};
+
+/**
+ * @brief Замер длительности области видимости
+ */
+class ScopedTimer {
+public:
+    /**
+     * @brief Начать замер
+     * @param histogram Гистограмма, в которую попадет длительность
+     */
+    explicit ScopedTimer(Histogram& histogram) noexcept :
+        _histogram(histogram),
+        _start(std::chrono::steady_clock::now())
+    {}
+
+    /**
+     * @brief Деструктор - учитывает длительность
+     */
+    ~ScopedTimer() {
+        _histogram.ObserveSince(_start);
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    Histogram& _histogram;                        ///< Гистограмма
+    std::chrono::steady_clock::time_point _start; ///< Начало замера
+};
+
+/**
+ * @brief Реестр метрик процесса
+ *
+ * Метрики регистрируются один раз (обычно при статической инициализации
+ * единицы трансляции) и живут до конца процесса, поэтому ссылки на них
+ * можно хранить без проверок. Повторная регистрация имени возвращает
+ * ту же метрику.
+ */
+class MetricsRegistry {
+public:
+    /**
+     * @brief Получить реестр процесса
+     * @return Единственный экземпляр
+     */
+    static MetricsRegistry& Global();
+
+    /**
+     * @brief Зарегистрировать счетчик
+     * @param name Имя (рекомендуется суффикс _total)
+     * @param help Описание
+     * @return Счетчик
+     */
+    Counter& AddCounter(const std::string& name, const std::string& help);
+
+    /**
+     * @brief Зарегистрировать показатель
+     * @param name Имя
+     * @param help Описание
+     * @return Показатель
+     */
+    Gauge& AddGauge(const std::string& name, const std::string& help);
+
+    /**
+     * @brief Зарегистрировать гистограмму длительностей
+     * @param name Имя (рекомендуется суффикс _seconds)
+     * @param help Описание
+     * @return Гистограмма
+     */
+    Histogram& AddHistogram(const std::string& name, const std::string& help);
+
+    /**
+     * @brief Выдать все метрики в текстовом формате Prometheus
+     * @return Текст для ответа на GET /metrics
+     */
+    std::string Render() const;
+
+private:
+    MetricsRegistry() = default;
+
+    /**
+     * @brief Тип метрики
+     */
+    enum class Kind {
+        K_COUNTER,  ///< Счетчик
+        K_GAUGE,    ///< Показатель
+        K_HISTOGRAM ///< Гистограмма
+    };
+
+    /**
+     * @brief Зарегистрированная метрика
+     */
+    struct Entry {
+        std::string name;       ///< Имя
+        std::string help;       ///< Описание
+        Kind kind{};            ///< Тип
+        Counter* counter{};     ///< Счетчик (для K_COUNTER)
+        Gauge* gauge{};         ///< Показатель (для K_GAUGE)
+        Histogram* histogram{}; ///< Гистограмма (для K_HISTOGRAM)
+    };
+
+    /**
+     * @brief Найти или создать метрику (под _mutex)
+     * @param name Имя
+     * @param help Описание
+     * @param kind Тип
+     * @return Запись реестра
+     */
+    Entry& Find(const std::string& name, const std::string& help, Kind kind);
+
+private:
+    mutable std::mutex _mutex;         ///< Защищает список метрик (не сами значения)
+    std::deque<Entry> _entries;        ///< Метрики в порядке регистрации
+    std::deque<Counter> _counters;     ///< Хранилище счетчиков (адреса стабильны)
+    std::deque<Gauge> _gauges;         ///< Хранилище показателей
+    std::deque<Histogram> _histograms; ///< Хранилище гистограмм
+};
+
+}
+
+#endif // COMMON_INCLUDE_METRICS_H
@@ -0,0 +1,62 @@
+#ifndef COMMON_INCLUDE_METRICS_SERVER_H
+#define COMMON_INCLUDE_METRICS_SERVER_H
+
+#include <thread>
+#include <cstdint>
+
+#include "logger.h"
+#include "resource_factory.h"
+
+/**
+ * @brief HTTP-выдача метрик для Prometheus
+ *
+ * Слушает 127.0.0.1:port в собственном потоке и на GET /metrics отвечает
+ * текстом MetricsRegistry::Global().Render(). Соединения обслуживаются
+ * по одному и закрываются после ответа (HTTP/1.0) - этого хватает для
+ * периодического опроса и не трогает рабочие потоки.
+ */
+class MetricsServer {
+public:
+    /**
+     * @brief Конструктор
+     * @param port Порт прослушивания (на 127.0.0.1)
+     */
+    explicit MetricsServer(uint16_t port);
+
+    /**
+     * @brief Деструктор - останавливает поток
+     */
+    ~MetricsServer();
+
+    MetricsServer(const MetricsServer&) = delete;
+    MetricsServer& operator=(const MetricsServer&) = delete;
+
+public:
+    /**
+     * @brief Открыть порт и запустить поток
+     * @throw std::runtime_error При ошибке создания сокета или eventfd
+     */
+    void Start();
+
+private:
+    /// Основной цикл потока
+    void ServeLoop();
+
+    /**
+     * @brief Прочитать запрос и отправить ответ
+     * @param fd Сокет клиента
+     */
+    void HandleConnection(int fd);
+
+private:
+    uint16_t _port;      ///< Порт прослушивания
+
+    UniqueFD _listen_fd; ///< Слушающий сокет
+    UniqueFD _stop_fd;   ///< eventfd остановки
+
+    std::thread _worker; ///< Поток выдачи
+
+    Logger _logger;      ///< Логгер
+};
+
+#endif // COMMON_INCLUDE_METRICS_SERVER_H
@@ -0,0 +1,65 @@
+#ifndef COMMON_INCLUDE_PROTOCOL_H
+#define COMMON_INCLUDE_PROTOCOL_H
+
+#include <vector>
+#include <cstdint>
+
+/**
+ * @brief Общие для клиента и сервера константы и структуры протокола
+ *
+ * Полное описание сообщений - в документации класса Server.
+ */
+namespace Protocol {
+constexpr uint16_t VERSION_1{1};                                          ///< Исходный протокол: кадры 'I' и 'T'
+constexpr uint16_t VERSION_2{2};                                          ///< Пачки кадров 'F' с заголовком кадра
+constexpr uint16_t VERSION_3{3};                                          ///< Пачки ретранслятора 'R' с данными клиента у каждого кадра
+constexpr uint16_t VERSION_4{4};                                          ///< Кадры без PNG (CODEC_RAW_*) в 'F', кодирует сервер
+constexpr uint16_t MAX_VERSION{VERSION_4};                                ///< Старшая версия, которую понимает эта сборка
+
+constexpr size_t MESSAGE_HEADER_SIZE{sizeof(uint8_t) + sizeof(uint32_t)}; ///< [1: тип][4: размер данных]
+constexpr size_t FRAME_HEADER_SIZE{32};                                   ///< Размер FrameHeader на проводе
+constexpr size_t FRAME_TRACE_SIZE{2 * sizeof(uint64_t)};                  ///< Размер отметок времени при FLAG_TRACE
+
+constexpr uint8_t CODEC_PNG{0};                                           ///< Кадр в формате PNG (FrameCodec::K_PNG сервера)
+constexpr uint8_t CODEC_RAW_RGB{1};                                       ///< Строки пикселей RGB подряд (3 байта на пиксель)
+constexpr uint8_t CODEC_RAW_RGB_ZLIB{2};                                  ///< CODEC_RAW_RGB, сжатый zlib
+
+constexpr uint16_t FLAG_TRACE{1 << 0};                                    ///< За заголовком идут отметки времени клиента
+
+constexpr uint16_t AUTH_FLAG_RELAY{1 << 0};                               ///< В 'A': соединение - ретранслятор, будет слать пачки 'R'
+
+/**
+ * @brief Заголовок кадра в пачке 'F' (протокол v2)
+ *
+ * На проводе поля идут в этом порядке в сетевом порядке байт, после
+ * них 4 нулевых байта резерва. Если в flags есть FLAG_TRACE, за заголовком
+ * следуют отметки времени клиента (encode_done_us, send_start_us), затем
+ * length байт данных кадра.
+ */
+struct FrameHeader {
+    uint64_t seq{};        ///< Номер кадра у клиента (с 1 в пределах соединения)
+    uint64_t capture_us{}; ///< Начало захвата, мкс с начала эпохи
+    uint32_t length{};     ///< Размер данных кадра
+    uint16_t width{};      ///< Ширина изображения
+    uint16_t height{};     ///< Высота изображения
+    uint8_t codec{};       ///< Формат данных (CODEC_*)
+    uint8_t monitor{};     ///< Номер монитора (0 - весь экран)
+    uint16_t flags{};      ///< Флаги FLAG_*
+};
+
+/**
+ * @brief Дописать заголовок кадра в буфер в формате провода
+ * @param buffer Буфер сообщения
+ * @param header Заголовок
+ */
+void AppendFrameHeader(std::vector<uint8_t>& buffer, const FrameHeader& header);
+
+/**
+ * @brief Прочитать заголовок кадра в формате провода
+ * @param data Не меньше FRAME_HEADER_SIZE байт
+ * @return Заголовок в порядке байт хоста
+ */
+FrameHeader ReadFrameHeader(const uint8_t* data) noexcept;
+}
+
+#endif // COMMON_INCLUDE_PROTOCOL_H
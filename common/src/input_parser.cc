@@ -1,4 +1,6 @@
+#include <thread>
 #include <iostream>
+#include <algorithm>
 
 #include <arpa/inet.h>
 
@@ -17,24 +19,143 @@ InputParser::InputParser(ProgramType type) :
 void InputParser::InitServerStructs() {
     _long_options = {
         {"port", required_argument, nullptr, 0},
+        {"storage", required_argument, nullptr, 0},
+        {"segment-size", required_argument, nullptr, 0},
+        {"segment-age", required_argument, nullptr, 0},
+        {"durability", required_argument, nullptr, 0},
+        {"sync-interval", required_argument, nullptr, 0},
+        {"quota-client", required_argument, nullptr, 0},
+        {"quota-user", required_argument, nullptr, 0},
+        {"quota-total", required_argument, nullptr, 0},
+        {"max-age", required_argument, nullptr, 0},
+        {"min-free", required_argument, nullptr, 0},
+        {"evict-rate", required_argument, nullptr, 0},
+        {"query-port", required_argument, nullptr, 0},
+        {"cache-size", required_argument, nullptr, 0},
+        {"cache-frames", required_argument, nullptr, 0},
+        {"metrics-port", required_argument, nullptr, 0},
+        {"log-level", required_argument, nullptr, 0},
+        {"trace-file", required_argument, nullptr, 0},
+        {"credit-frames", required_argument, nullptr, 0},
+        {"credit-size", required_argument, nullptr, 0},
+        {"max-connections", required_argument, nullptr, 0},
+        {"admission", required_argument, nullptr, 0},
+        {"rate-client", required_argument, nullptr, 0},
+        {"rate-ip", required_argument, nullptr, 0},
+        {"capture-period", required_argument, nullptr, 0},
+        {"upstream", required_argument, nullptr, 0},
+        {"upstream-connections", required_argument, nullptr, 0},
+        {"spill-size", required_argument, nullptr, 0},
+        {"handoff", required_argument, nullptr, 0},
+        {"encode-workers", required_argument, nullptr, 0},
+        {"compact-after", required_argument, nullptr, 0},
+        {"compact-keyframes", required_argument, nullptr, 0},
+        {"thumbnails", required_argument, nullptr, 0},
+        {"accept-relays", required_argument, nullptr, 0},
         {nullptr, 0, nullptr, 0}
     };
 
     _option_enabled_ht = {
-        { "--port", false }
+        { "--port", false },
+        { "--storage", false },
+        { "--segment-size", false },
+        { "--segment-age", false },
+        { "--durability", false },
+        { "--sync-interval", false },
+        { "--quota-client", false },
+        { "--quota-user", false },
+        { "--quota-total", false },
+        { "--max-age", false },
+        { "--min-free", false },
+        { "--evict-rate", false },
+        { "--query-port", false },
+        { "--cache-size", false },
+        { "--cache-frames", false },
+        { "--metrics-port", false },
+        { "--log-level", false },
+        { "--trace-file", false },
+        { "--credit-frames", false },
+        { "--credit-size", false },
+        { "--max-connections", false },
+        { "--admission", false },
+        { "--rate-client", false },
+        { "--rate-ip", false },
+        { "--capture-period", false },
+        { "--upstream", false },
+        { "--upstream-connections", false },
+        { "--spill-size", false },
+        { "--handoff", false },
+        { "--encode-workers", false },
+        { "--compact-after", false },
+        { "--compact-keyframes", false },
+        { "--thumbnails", false },
+        { "--accept-relays", false }
     };
+
+    _optional_options = {
+        "--storage",
+        "--segment-size",
+        "--segment-age",
+        "--durability",
+        "--sync-interval",
+        "--quota-client",
+        "--quota-user",
+        "--quota-total",
+        "--max-age",
+        "--min-free",
+        "--evict-rate",
+        "--query-port",
+        "--cache-size",
+        "--cache-frames",
+        "--metrics-port",
+        "--log-level",
+        "--trace-file",
+        "--credit-frames",
+        "--credit-size",
+        "--max-connections",
+        "--admission",
+        "--rate-client",
+        "--rate-ip",
+        "--capture-period",
+        "--upstream",
+        "--upstream-connections",
+        "--spill-size",
+        "--handoff",
+        "--encode-workers",
+        "--compact-after",
+        "--compact-keyframes",
+        "--thumbnails",
+        "--accept-relays"
+    };
+
+    _encode_workers = std::max(1u, std::thread::hardware_concurrency());
 }
 
 void InputParser::InitClientStructs() {
     _long_options = {
         {"srv", required_argument, nullptr, 0},
         {"period", required_argument, nullptr, 0},
+        {"metrics-port", required_argument, nullptr, 0},
+        {"log-level", required_argument, nullptr, 0},
+        {"send", required_argument, nullptr, 0},
+        {"upload", required_argument, nullptr, 0},
         {nullptr, 0, nullptr, 0}
     };
 
     _option_enabled_ht = {
         { "--srv", false },
-        { "--period", false }
+        { "--period", false },
+        { "--metrics-port", false },
+        { "--log-level", false },
+        { "--send", false },
+        { "--upload", false }
+    };
+
+    _optional_options = {
+        "--metrics-port",
+        "--log-level",
+        "--send",
+        "--upload"
     };
 }
 
@@ -42,6 +163,10 @@ std::string InputParser::GetHost() const noexcept {
     return _host;
 }
 
+std::vector<ServerAddress> InputParser::GetServers() const {
+    return _servers;
+}
+
 uint16_t InputParser::GetPort() const noexcept {
     return _port;
 }
@@ -50,23 +175,187 @@ unsigned InputParser::GetPeriod() const noexcept {
     return _period;
 }
 
+StorageEngine InputParser::GetStorageEngine() const noexcept {
+    return _storage_engine;
+}
+
+uint64_t InputParser::GetSegmentSize() const noexcept {
+    return _segment_size;
+}
+
+unsigned InputParser::GetSegmentAge() const noexcept {
+    return _segment_age;
+}
+
+DurabilityMode InputParser::GetDurabilityMode() const noexcept {
+    return _durability;
+}
+
+unsigned InputParser::GetSyncInterval() const noexcept {
+    return _sync_interval;
+}
+
+uint64_t InputParser::GetClientQuota() const noexcept {
+    return _client_quota;
+}
+
+uint64_t InputParser::GetUserQuota() const noexcept {
+    return _user_quota;
+}
+
+uint64_t InputParser::GetTotalQuota() const noexcept {
+    return _total_quota;
+}
+
+unsigned InputParser::GetMaxAge() const noexcept {
+    return _max_age;
+}
+
+uint64_t InputParser::GetMinFree() const noexcept {
+    return _min_free;
+}
+
+uint64_t InputParser::GetEvictRate() const noexcept {
+    return _evict_rate;
+}
+
+uint16_t InputParser::GetQueryPort() const noexcept {
+    return _query_port;
+}
+
+uint64_t InputParser::GetCacheSize() const noexcept {
+    return _cache_size;
+}
+
+size_t InputParser::GetCacheFrames() const noexcept {
+    return _cache_frames;
+}
+
+uint16_t InputParser::GetMetricsPort() const noexcept {
+    return _metrics_port;
+}
+
+MessageType InputParser::GetLogLevel() const noexcept {
+    return _log_level;
+}
+
+std::string InputParser::GetTraceFile() const noexcept {
+    return _trace_file;
+}
+
+uint64_t InputParser::GetCreditFrames() const noexcept {
+    return _credit_frames;
+}
+
+uint64_t InputParser::GetCreditSize() const noexcept {
+    return _credit_size;
+}
+
+size_t InputParser::GetMaxConnections() const noexcept {
+    return _max_connections;
+}
+
+AdmissionMode InputParser::GetAdmissionMode() const noexcept {
+    return _admission;
+}
+
+uint64_t InputParser::GetClientRate() const noexcept {
+    return _client_rate;
+}
+
+uint64_t InputParser::GetAddressRate() const noexcept {
+    return _address_rate;
+}
+
+unsigned InputParser::GetCapturePeriod() const noexcept {
+    return _capture_period;
+}
+
+ServerAddress InputParser::GetUpstream() const {
+    return _upstream;
+}
+
+size_t InputParser::GetUpstreamConnections() const noexcept {
+    return _upstream_connections;
+}
+
+uint64_t InputParser::GetSpillSize() const noexcept {
+    return _spill_size;
+}
+
+const std::vector<AddressRange>& InputParser::GetRelaySources() const noexcept {
+    return _relay_sources;
+}
+
+std::string InputParser::GetHandoffPath() const noexcept {
+    return _handoff_path;
+}
+
+size_t InputParser::GetEncodeWorkers() const noexcept {
+    return _encode_workers;
+}
+
+unsigned InputParser::GetCompactAfter() const noexcept {
+    return _compact_after;
+}
+
+unsigned InputParser::GetCompactKeyframes() const noexcept {
+    return _compact_keyframes;
+}
+
+size_t InputParser::GetThumbnailWorkers() const noexcept {
+    return _thumbnail_workers;
+}
+
+SendMode InputParser::GetSendMode() const noexcept {
+    return _send_mode;
+}
+
+UploadMode InputParser::GetUploadMode() const noexcept {
+    return _upload_mode;
+}
+
 void InputParser::ParseSrv(char* arg) {    
-    std::string host_port(arg);
+    std::string list(arg);
+    size_t begin{0};
 
-    auto pos{host_port.find(":")};
-    
-    if (pos == std::string::npos) {
-        throw std::invalid_argument("Invalid host or port: " + host_port);
-    }
+    while (true) {
+        size_t end{list.find(',', begin)};
+        std::string host_port(list, begin, end == std::string::npos ? std::string::npos : end - begin);
+
+        auto pos{host_port.find(":")};
+
+        if (pos == std::string::npos) {
+            throw std::invalid_argument("Invalid host or port: " + host_port);
+        }
+
+        auto host_end_it{host_port.begin() + pos};
+        auto port_beg_it{host_port.begin() + pos + 1};
 
-    auto host_end_it{host_port.begin() + pos};
-    auto port_beg_it{host_port.begin() + pos + 1};
+        std::string host_str(host_port.begin(), host_end_it);
+        std::string port_str(port_beg_it, host_port.end());
 
-    std::string host_str(host_port.begin(), host_end_it);
-    std::string port_str(port_beg_it, host_port.end());
+        ParseHost(host_str.data());
+        ParsePort(port_str.data());
 
-    ParseHost(host_str.data());
-    ParsePort(port_str.data());
+        for (const ServerAddress& server : _servers) {
+            if (server.host == _host && server.port == _port) {
+                throw std::invalid_argument("Duplicate server: " + host_port);
+            }
+        }
+
+        _servers.push_back(ServerAddress{_host, _port});
+
+        if (end == std::string::npos) {
+            break;
+        }
+
+        begin = end + 1;
+    }
+
+    // GetHost()/GetPort() возвращают первый сервер списка
+    _host = _servers.front().host;
+    _port = _servers.front().port;
 }
 
 void InputParser::ParseHost(char* arg) {
@@ -116,11 +405,544 @@ void InputParser::ParsePeriod(char* arg) {
     _period = period;
 }
 
+void InputParser::ParseStorage(char* arg) {
+    std::string storage_str(arg);
+
+    if (storage_str == "files") {
+        _storage_engine = StorageEngine::K_FILES;
+    } else if (storage_str == "segments") {
+        _storage_engine = StorageEngine::K_SEGMENTS;
+    } else if (storage_str == "dedup") {
+        _storage_engine = StorageEngine::K_DEDUP;
+    } else {
+        throw std::invalid_argument("Invalid storage: " + storage_str);
+    }
+}
+
+void InputParser::ParseSegmentSize(char* arg) {
+    std::string size_str(arg);
+
+    int size_mb{ParseNum(size_str)};
+
+    if (size_mb <= 0 || size_mb > 65536) {
+        throw std::invalid_argument("Invalid segment size.");
+    }
+
+    _segment_size = static_cast<uint64_t>(size_mb) * 1024 * 1024;
+}
+
+void InputParser::ParseSegmentAge(char* arg) {
+    std::string age_str(arg);
+
+    int age{ParseNum(age_str)};
+
+    if (age <= 0 || age > 604800) {
+        throw std::invalid_argument("Invalid segment age.");
+    }
+
+    _segment_age = age;
+}
+
+void InputParser::ParseDurability(char* arg) {
+    std::string mode_str(arg);
+
+    if (mode_str == "none") {
+        _durability = DurabilityMode::K_NONE;
+    } else if (mode_str == "periodic") {
+        _durability = DurabilityMode::K_PERIODIC;
+    } else if (mode_str == "group") {
+        _durability = DurabilityMode::K_GROUP;
+    } else {
+        throw std::invalid_argument("Invalid durability: " + mode_str);
+    }
+}
+
+void InputParser::ParseSyncInterval(char* arg) {
+    std::string interval_str(arg);
+
+    int interval{ParseNum(interval_str)};
+
+    if (interval <= 0 || interval > 60000) {
+        throw std::invalid_argument("Invalid sync interval.");
+    }
+
+    _sync_interval = interval;
+}
+
+uint64_t InputParser::ParseQuota(char* arg) {
+    std::string quota_str(arg);
+
+    int quota_mb{ParseNum(quota_str)};
+
+    if (quota_mb < 0 || quota_mb > 16777216) {
+        throw std::invalid_argument("Invalid quota.");
+    }
+
+    return static_cast<uint64_t>(quota_mb) * 1024 * 1024;
+}
+
+void InputParser::ParseMaxAge(char* arg) {
+    std::string age_str(arg);
+
+    int age{ParseNum(age_str)};
+
+    if (age < 0 || age > 315360000) {
+        throw std::invalid_argument("Invalid max age.");
+    }
+
+    _max_age = age;
+}
+
+void InputParser::ParseEvictRate(char* arg) {
+    std::string rate_str(arg);
+
+    int rate_mb{ParseNum(rate_str)};
+
+    if (rate_mb <= 0 || rate_mb > 65536) {
+        throw std::invalid_argument("Invalid evict rate.");
+    }
+
+    _evict_rate = static_cast<uint64_t>(rate_mb) * 1024 * 1024;
+}
+
+void InputParser::ParseQueryPort(char* arg) {
+    std::string port_str(arg);
+
+    int port{ParseNum(port_str)};
+
+    if (port <= 0 || port > 65535) {
+        throw std::invalid_argument("Invalid query port.");
+    }
+
+    _query_port = static_cast<uint16_t>(port);
+}
+
+void InputParser::ParseCacheSize(char* arg) {
+    std::string size_str(arg);
+
+    int size_mb{ParseNum(size_str)};
+
+    if (size_mb < 0 || size_mb > 65536) {
+        throw std::invalid_argument("Invalid cache size.");
+    }
+
+    _cache_size = static_cast<uint64_t>(size_mb) * 1024 * 1024;
+}
+
+void InputParser::ParseCacheFrames(char* arg) {
+    std::string frames_str(arg);
+
+    int frames{ParseNum(frames_str)};
+
+    if (frames <= 0 || frames > 1024) {
+        throw std::invalid_argument("Invalid cache frames.");
+    }
+
+    _cache_frames = static_cast<size_t>(frames);
+}
+
+void InputParser::ParseMetricsPort(char* arg) {
+    std::string port_str(arg);
+
+    int port{ParseNum(port_str)};
+
+    if (port <= 0 || port > 65535) {
+        throw std::invalid_argument("Invalid metrics port.");
+    }
+
+    _metrics_port = static_cast<uint16_t>(port);
+}
+
+void InputParser::ParseLogLevel(char* arg) {
+    std::string level_str(arg);
+
+    if (level_str == "debug") {
+        _log_level = MessageType::K_DEBUG;
+    } else if (level_str == "info") {
+        _log_level = MessageType::K_INFO;
+    } else if (level_str == "warning") {
+        _log_level = MessageType::K_WARNING;
+    } else if (level_str == "error") {
+        _log_level = MessageType::K_ERROR;
+    } else {
+        throw std::invalid_argument("Invalid log level: " + level_str);
+    }
+}
+
+void InputParser::ParseTraceFile(char* arg) {
+    std::string path_str(arg);
+
+    if (path_str.empty()) {
+        throw std::invalid_argument("Invalid trace file.");
+    }
+
+    _trace_file = path_str;
+}
+
+void InputParser::ParseCreditFrames(char* arg) {
+    std::string frames_str(arg);
+
+    int frames{ParseNum(frames_str)};
+
+    if (frames < 0 || frames > 4096) {
+        throw std::invalid_argument("Invalid credit frames.");
+    }
+
+    _credit_frames = static_cast<uint64_t>(frames);
+}
+
+void InputParser::ParseCreditSize(char* arg) {
+    std::string size_str(arg);
+
+    int size_mb{ParseNum(size_str)};
+
+    // Окно меньше максимального сообщения (10 Мб) не пропустит крупный кадр никогда
+    if (size_mb < 16 || size_mb > 4096) {
+        throw std::invalid_argument("Invalid credit size.");
+    }
+
+    _credit_size = static_cast<uint64_t>(size_mb) * 1024 * 1024;
+}
+
+void InputParser::ParseMaxConnections(char* arg) {
+    std::string count_str(arg);
+
+    int count{ParseNum(count_str)};
+
+    if (count < 0 || count > 1000000) {
+        throw std::invalid_argument("Invalid max connections.");
+    }
+
+    _max_connections = static_cast<size_t>(count);
+}
+
+void InputParser::ParseAdmission(char* arg) {
+    std::string mode_str(arg);
+
+    if (mode_str == "reject") {
+        _admission = AdmissionMode::K_REJECT;
+    } else if (mode_str == "defer") {
+        _admission = AdmissionMode::K_DEFER;
+    } else {
+        throw std::invalid_argument("Invalid admission: " + mode_str);
+    }
+}
+
+void InputParser::ParseClientRate(char* arg) {
+    std::string rate_str(arg);
+
+    int rate{ParseNum(rate_str)};
+
+    if (rate < 0 || rate > 10000) {
+        throw std::invalid_argument("Invalid client rate.");
+    }
+
+    _client_rate = static_cast<uint64_t>(rate);
+}
+
+void InputParser::ParseAddressRate(char* arg) {
+    std::string rate_str(arg);
+
+    int rate_mb{ParseNum(rate_str)};
+
+    if (rate_mb < 0 || rate_mb > 65536) {
+        throw std::invalid_argument("Invalid address rate.");
+    }
+
+    _address_rate = static_cast<uint64_t>(rate_mb) * 1024 * 1024;
+}
+
+void InputParser::ParseCapturePeriod(char* arg) {
+    std::string period_str(arg);
+
+    int period{ParseNum(period_str)};
+
+    if (period < 0 || period > 86400) {
+        throw std::invalid_argument("Invalid capture period.");
+    }
+
+    _capture_period = static_cast<unsigned>(period);
+}
+
+void InputParser::ParseUpstream(char* arg) {
+    std::string host_port(arg);
+
+    auto pos{host_port.find(":")};
+
+    if (pos == std::string::npos) {
+        throw std::invalid_argument("Invalid upstream: " + host_port);
+    }
+
+    std::string host_str(host_port, 0, pos);
+    std::string port_str(host_port, pos + 1);
+
+    struct in_addr addr;
+
+    if (inet_pton(AF_INET, host_str.c_str(), &addr) != 1) {
+        throw std::invalid_argument("Invalid upstream host.");
+    }
+
+    int port{ParseNum(port_str)};
+
+    if (port <= 0 || port > 65535) {
+        throw std::invalid_argument("Invalid upstream port.");
+    }
+
+    _upstream = ServerAddress{host_str, static_cast<uint16_t>(port)};
+}
+
+void InputParser::ParseUpstreamConnections(char* arg) {
+    std::string count_str(arg);
+
+    int count{ParseNum(count_str)};
+
+    if (count < 1 || count > 64) {
+        throw std::invalid_argument("Invalid upstream connections.");
+    }
+
+    _upstream_connections = static_cast<size_t>(count);
+}
+
+void InputParser::ParseSpillSize(char* arg) {
+    std::string size_str(arg);
+
+    int size_mb{ParseNum(size_str)};
+
+    if (size_mb < 0 || size_mb > 1048576) {
+        throw std::invalid_argument("Invalid spill size.");
+    }
+
+    _spill_size = static_cast<uint64_t>(size_mb) * 1024 * 1024;
+}
+
+void InputParser::ParseAcceptRelays(char* arg) {
+    std::string list(arg);
+    size_t begin{0};
+
+    while (true) {
+        size_t end{list.find(',', begin)};
+        std::string range_str(list, begin, end == std::string::npos ? std::string::npos : end - begin);
+
+        auto pos{range_str.find('/')};
+        std::string host_str(range_str, 0, pos);
+
+        struct in_addr addr;
+
+        if (inet_pton(AF_INET, host_str.c_str(), &addr) != 1) {
+            throw std::invalid_argument("Invalid relay address: " + range_str);
+        }
+
+        int bits{32};
+
+        if (pos != std::string::npos) {
+            bits = ParseNum(range_str.substr(pos + 1));
+
+            if (bits < 0 || bits > 32) {
+                throw std::invalid_argument("Invalid relay prefix length: " + range_str);
+            }
+        }
+
+        uint32_t mask{bits == 0 ? 0 : htonl(~uint32_t{0} << (32 - bits))};
+
+        _relay_sources.push_back(AddressRange{addr.s_addr & mask, mask});
+
+        if (end == std::string::npos) {
+            break;
+        }
+
+        begin = end + 1;
+    }
+}
+
+void InputParser::ParseHandoffPath(char* arg) {
+    std::string path_str(arg);
+
+    // sockaddr_un::sun_path - 108 байт вместе с завершающим нулем
+    if (path_str.empty() || path_str.size() > 107) {
+        throw std::invalid_argument("Invalid handoff path.");
+    }
+
+    _handoff_path = path_str;
+}
+
+void InputParser::ParseEncodeWorkers(char* arg) {
+    std::string count_str(arg);
+
+    int count{ParseNum(count_str)};
+
+    if (count < 0 || count > 256) {
+        throw std::invalid_argument("Invalid encode workers.");
+    }
+
+    _encode_workers = static_cast<size_t>(count);
+}
+
+void InputParser::ParseCompactAfter(char* arg) {
+    std::string age_str(arg);
+
+    int age{ParseNum(age_str)};
+
+    if (age < 0 || age > 315360000) {
+        throw std::invalid_argument("Invalid compaction age.");
+    }
+
+    _compact_after = age;
+}
+
+void InputParser::ParseCompactKeyframes(char* arg) {
+    std::string interval_str(arg);
+
+    int interval{ParseNum(interval_str)};
+
+    if (interval <= 0 || interval > 1000) {
+        throw std::invalid_argument("Invalid keyframe interval.");
+    }
+
+    _compact_keyframes = interval;
+}
+
+void InputParser::ParseThumbnailWorkers(char* arg) {
+    std::string count_str(arg);
+
+    int count{ParseNum(count_str)};
+
+    if (count < 0 || count > 256) {
+        throw std::invalid_argument("Invalid thumbnail workers.");
+    }
+
+    _thumbnail_workers = static_cast<size_t>(count);
+}
+
+void InputParser::ParseSendMode(char* arg) {
+    std::string mode_str(arg);
+
+    if (mode_str == "copy") {
+        _send_mode = SendMode::K_COPY;
+    } else if (mode_str == "zerocopy") {
+        _send_mode = SendMode::K_ZEROCOPY;
+    } else {
+        throw std::invalid_argument("Invalid send mode: " + mode_str);
+    }
+}
+
+void InputParser::ParseUploadMode(char* arg) {
+    std::string mode_str(arg);
+
+    if (mode_str == "png") {
+        _upload_mode = UploadMode::K_CLIENT_PNG;
+    } else if (mode_str == "raw") {
+        _upload_mode = UploadMode::K_RAW_RGB;
+    } else if (mode_str == "raw-zlib") {
+        _upload_mode = UploadMode::K_RAW_RGB_ZLIB;
+    } else {
+        throw std::invalid_argument("Invalid upload mode: " + mode_str);
+    }
+}
+
 void InputParser::HandleServerOption(int opt_index) {
     switch (opt_index) {
         case 0:
             ParsePort(optarg);
             break;
+        case 1:
+            ParseStorage(optarg);
+            break;
+        case 2:
+            ParseSegmentSize(optarg);
+            break;
+        case 3:
+            ParseSegmentAge(optarg);
+            break;
+        case 4:
+            ParseDurability(optarg);
+            break;
+        case 5:
+            ParseSyncInterval(optarg);
+            break;
+        case 6:
+            _client_quota = ParseQuota(optarg);
+            break;
+        case 7:
+            _user_quota = ParseQuota(optarg);
+            break;
+        case 8:
+            _total_quota = ParseQuota(optarg);
+            break;
+        case 9:
+            ParseMaxAge(optarg);
+            break;
+        case 10:
+            _min_free = ParseQuota(optarg);
+            break;
+        case 11:
+            ParseEvictRate(optarg);
+            break;
+        case 12:
+            ParseQueryPort(optarg);
+            break;
+        case 13:
+            ParseCacheSize(optarg);
+            break;
+        case 14:
+            ParseCacheFrames(optarg);
+            break;
+        case 15:
+            ParseMetricsPort(optarg);
+            break;
+        case 16:
+            ParseLogLevel(optarg);
+            break;
+        case 17:
+            ParseTraceFile(optarg);
+            break;
+        case 18:
+            ParseCreditFrames(optarg);
+            break;
+        case 19:
+            ParseCreditSize(optarg);
+            break;
+        case 20:
+            ParseMaxConnections(optarg);
+            break;
+        case 21:
+            ParseAdmission(optarg);
+            break;
+        case 22:
+            ParseClientRate(optarg);
+            break;
+        case 23:
+            ParseAddressRate(optarg);
+            break;
+        case 24:
+            ParseCapturePeriod(optarg);
+            break;
+        case 25:
+            ParseUpstream(optarg);
+            break;
+        case 26:
+            ParseUpstreamConnections(optarg);
+            break;
+        case 27:
+            ParseSpillSize(optarg);
+            break;
+        case 28:
+            ParseHandoffPath(optarg);
+            break;
+        case 29:
+            ParseEncodeWorkers(optarg);
+            break;
+        case 30:
+            ParseCompactAfter(optarg);
+            break;
+        case 31:
+            ParseCompactKeyframes(optarg);
+            break;
+        case 32:
+            ParseThumbnailWorkers(optarg);
+            break;
+        case 33:
+            ParseAcceptRelays(optarg);
+            break;
         default:
             return;
     }
@@ -134,6 +956,18 @@ void InputParser::HandleClientOption(int opt_index) {
         case 1:
             ParsePeriod(optarg);
             break;
+        case 2:
+            ParseMetricsPort(optarg);
+            break;
+        case 3:
+            ParseLogLevel(optarg);
+            break;
+        case 4:
+            ParseSendMode(optarg);
+            break;
+        case 5:
+            ParseUploadMode(optarg);
+            break;
         default:
             return;
     }
@@ -166,7 +1000,7 @@ void InputParser::Parse(int argc, char* argv[]) {
     std::string missing_options;
 
     for (const auto& [opt, enabled] : _option_enabled_ht) {
-        if (!enabled) {
+        if (!enabled && _optional_options.count(opt) == 0) {
             missing_options += opt + " ";
         }
     }
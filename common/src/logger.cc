@@ -1,47 +1,406 @@
-#include <iostream>
-#include <sstream>
-#include <iomanip>
-#include <chrono>
 #include <ctime>
+#include <cerrno>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <cstring>
+#include <algorithm>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 
 #include "logger.h"
+#include "metrics.h"
+
+namespace {
+constexpr size_t RING_SIZE{4096};       ///< Ячеек в кольцевом буфере (степень двойки)
+constexpr size_t RECORD_SIZE{496};      ///< Максимальная длина записи с префиксом и переводом строки
+constexpr size_t BATCH_SIZE{64 * 1024}; ///< Объем, после которого пачка пишется не дожидаясь конца
+constexpr int IDLE_TIMEOUT_MS{100};     ///< Максимальный сон потока записи без пробуждения
 
-std::ostream& Logger::TypeToStream(MessageType type) {
+std::atomic<int> min_severity{1};
+
+int Severity(MessageType type) noexcept {
     switch (type) {
-        case MessageType::K_INFO:    return std::cout;
-        case MessageType::K_ERROR:   return std::cerr;
-        case MessageType::K_WARNING: return std::clog;
-        default:                     return std::cout;
+        case MessageType::K_DEBUG:   return 0;
+        case MessageType::K_INFO:    return 1;
+        case MessageType::K_WARNING: return 2;
+        case MessageType::K_ERROR:   return 3;
+        default:                     return 1;
     }
 }
 
-std::string Logger::TypeToString(MessageType type) {
+const char* TypeToString(MessageType type) noexcept {
     switch (type) {
         case MessageType::K_INFO:    return "INFO";
         case MessageType::K_ERROR:   return "ERROR";
         case MessageType::K_WARNING: return "WARNING";
+        case MessageType::K_DEBUG:   return "DEBUG";
         default:                     return "UNKNOWN";
     }
 }
 
+int TypeToFD(MessageType type) noexcept {
+    return (type == MessageType::K_ERROR || type == MessageType::K_WARNING) ? STDERR_FILENO : STDOUT_FILENO;
+}
+
+/**
+ * @brief Временная метка текущей секунды, кэшированная в потоке
+ */
+struct TimestampCache {
+    time_t second{-1}; ///< Секунда, для которой сформирована строка
+    char text[32]{};   ///< Строка "%Y-%m-%d %H:%M:%S"
+    size_t length{0};  ///< Длина строки
+};
+
+const TimestampCache& CurrentTimestamp() noexcept {
+    thread_local TimestampCache cache;
+
+    time_t now{std::time(nullptr)};
+
+    if (now != cache.second) {
+        std::tm local_time{};
+        localtime_r(&now, &local_time);
+
+        cache.length = std::strftime(cache.text, sizeof(cache.text), "%Y-%m-%d %H:%M:%S", &local_time);
+        cache.second = now;
+    }
+
+    return cache;
+}
+
+/**
+ * @brief Общий для процесса приемник записей лога
+ *
+ * Ограниченная очередь MPSC на последовательностях ячеек: производитель
+ * занимает номер CAS-ом, пишет запись в ячейку и публикует ее номером
+ * последовательности; единственный потребитель - поток записи.
+ */
+class LogSink {
+public:
+    static LogSink& Instance() {
+        static LogSink sink;
+
+        return sink;
+    }
+
+    ~LogSink() {
+        _stopping.store(true, std::memory_order_release);
+        Wake();
+
+        if (_writer.joinable()) {
+            _writer.join();
+        }
+    }
+
+    /**
+     * @brief Поставить запись в очередь
+     * @param type Тип сообщения
+     * @param msg Текст сообщения
+     * @param suppressed Число отброшенных ограничением частоты сообщений (0 - не указывать)
+     */
+    void Push(MessageType type, const std::string& msg, uint64_t suppressed) noexcept {
+        uint64_t pos{_enqueue_pos.load(std::memory_order_relaxed)};
+        Slot* slot{nullptr};
+
+        while (true) {
+            slot = &_slots[pos & (RING_SIZE - 1)];
+
+            uint64_t seq{slot->seq.load(std::memory_order_acquire)};
+            int64_t diff{static_cast<int64_t>(seq) - static_cast<int64_t>(pos)};
+
+            if (diff == 0) {
+                if (_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                _dropped.fetch_add(1, std::memory_order_relaxed);
+                _dropped_metric.Inc();
+
+                return;
+            } else {
+                pos = _enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        Format(*slot, type, msg, suppressed);
+
+        slot->seq.store(pos + 1, std::memory_order_release);
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (_sleeping.load(std::memory_order_relaxed) && _sleeping.exchange(false, std::memory_order_relaxed)) {
+            Wake();
+        }
+    }
+
+    /**
+     * @brief Учесть сообщение, отброшенное ограничением частоты
+     */
+    void CountSuppressed() noexcept {
+        _suppressed_metric.Inc();
+    }
+
+private:
+    /**
+     * @brief Ячейка кольцевого буфера
+     */
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> seq{0}; ///< Номер последовательности
+        uint16_t length{0};           ///< Длина записи
+        int fd{STDOUT_FILENO};        ///< Куда выводить
+        char text[RECORD_SIZE];       ///< Отформатированная запись
+    };
+
+    LogSink() :
+        _slots(new Slot[RING_SIZE]),
+        _dropped_metric(Metrics::MetricsRegistry::Global().AddCounter(
+            "log_records_dropped_total", "Log records dropped because the log ring was full")),
+        _suppressed_metric(Metrics::MetricsRegistry::Global().AddCounter(
+            "log_records_suppressed_total", "Log records suppressed by per-site rate limits"))
+    {
+        for (size_t i{0}; i < RING_SIZE; ++i) {
+            _slots[i].seq.store(i, std::memory_order_relaxed);
+        }
+
+        _wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        _writer = std::thread(&LogSink::WriterLoop, this);
+    }
+
+    static void Format(Slot& slot, MessageType type, const std::string& msg, uint64_t suppressed) noexcept {
+        const TimestampCache& timestamp{CurrentTimestamp()};
+
+        char* out{slot.text};
+        char* end{slot.text + RECORD_SIZE - 1};
+
+        auto append{[&out, end](const char* data, size_t size) {
+            size_t n{std::min(size, static_cast<size_t>(end - out))};
+
+            std::memcpy(out, data, n);
+            out += n;
+        }};
+
+        const char* type_str{TypeToString(type)};
+
+        append("[", 1);
+        append(type_str, std::strlen(type_str));
+        append("] [", 3);
+        append(timestamp.text, timestamp.length);
+        append("] ", 2);
+        append(msg.data(), msg.size());
+
+        if (suppressed > 0) {
+            char note[64];
+            int n{std::snprintf(note, sizeof(note), " (%llu similar messages suppressed)", static_cast<unsigned long long>(suppressed))};
+
+            append(note, static_cast<size_t>(n));
+        }
+
+        if (out == end && msg.size() > 3) {
+            std::memcpy(end - 3, "...", 3);
+        }
+
+        *out++ = '\n';
+
+        slot.length = static_cast<uint16_t>(out - slot.text);
+        slot.fd = TypeToFD(type);
+    }
+
+    static void WriteAll(int fd, const std::string& data) noexcept {
+        size_t written{0};
+
+        while (written < data.size()) {
+            ssize_t n{write(fd, data.data() + written, data.size() - written)};
+
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+
+            if (n <= 0) {
+                return;
+            }
+
+            written += static_cast<size_t>(n);
+        }
+    }
+
+    void Wake() noexcept {
+        uint64_t one{1};
+
+        while (write(_wake_fd, &one, sizeof(one)) == -1 && errno == EINTR) {}
+    }
+
+    /**
+     * @brief Вывести все опубликованные записи
+     * @return Число выведенных записей
+     *
+     * Подряд идущие записи одного потока вывода склеиваются в один write().
+     */
+    size_t Drain() {
+        size_t count{0};
+        int fd{STDOUT_FILENO};
+
+        while (true) {
+            Slot& slot{_slots[_dequeue_pos & (RING_SIZE - 1)]};
+
+            if (slot.seq.load(std::memory_order_acquire) != _dequeue_pos + 1) {
+                break;
+            }
+
+            if (slot.fd != fd || _batch.size() >= BATCH_SIZE) {
+                WriteAll(fd, _batch);
+                _batch.clear();
+                fd = slot.fd;
+            }
+
+            _batch.append(slot.text, slot.length);
+
+            slot.seq.store(_dequeue_pos + RING_SIZE, std::memory_order_release);
+            ++_dequeue_pos;
+            ++count;
+        }
+
+        WriteAll(fd, _batch);
+        _batch.clear();
+
+        return count;
+    }
+
+    void ReportDropped() {
+        uint64_t dropped{_dropped.exchange(0, std::memory_order_relaxed)};
+
+        if (dropped > 0) {
+            const TimestampCache& timestamp{CurrentTimestamp()};
+
+            WriteAll(
+                STDERR_FILENO,
+                "[WARNING] [" + std::string(timestamp.text, timestamp.length) + "] " +
+                std::to_string(dropped) + " log records dropped (log ring full)\n"
+            );
+        }
+    }
+
+    void WriterLoop() {
+        _batch.reserve(BATCH_SIZE + RECORD_SIZE);
+
+        while (true) {
+            bool stopping{_stopping.load(std::memory_order_acquire)};
+
+            size_t count{Drain()};
+
+            ReportDropped();
+
+            if (stopping) {
+                return;
+            }
+
+            if (count > 0) {
+                continue;
+            }
+
+            _sleeping.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            const Slot& next{_slots[_dequeue_pos & (RING_SIZE - 1)]};
+
+            if (next.seq.load(std::memory_order_acquire) != _dequeue_pos + 1) {
+                pollfd pfd{_wake_fd, POLLIN, 0};
+
+                poll(&pfd, 1, IDLE_TIMEOUT_MS);
+
+                uint64_t value;
+
+                while (read(_wake_fd, &value, sizeof(value)) == -1 && errno == EINTR) {}
+            }
+
+            _sleeping.store(false, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    std::unique_ptr<Slot[]> _slots;                    ///< Кольцевой буфер
+    alignas(64) std::atomic<uint64_t> _enqueue_pos{0}; ///< Следующий номер для производителей
+    alignas(64) uint64_t _dequeue_pos{0};              ///< Следующий номер для потока записи
+    std::string _batch;                                ///< Пачка записей одного потока вывода
+
+    std::atomic<bool> _sleeping{false};                ///< Поток записи ждет пробуждения
+    std::atomic<bool> _stopping{false};                ///< Процесс завершается
+    std::atomic<uint64_t> _dropped{0};                 ///< Отброшено с последнего предупреждения
+    int _wake_fd{-1};                                  ///< eventfd пробуждения потока записи
+
+    Metrics::Counter& _dropped_metric;                 ///< Всего отброшено при переполнении
+    Metrics::Counter& _suppressed_metric;              ///< Всего отброшено ограничением частоты
+
+    std::thread _writer;                               ///< Поток записи
+};
+}
+
+bool LogRateLimit::Acquire(uint64_t& suppressed) noexcept {
+    int64_t now{static_cast<int64_t>(std::time(nullptr))};
+    int64_t window{_window.load(std::memory_order_relaxed)};
+
+    if (window != now && _window.compare_exchange_strong(window, now, std::memory_order_relaxed)) {
+        _count.store(0, std::memory_order_relaxed);
+    }
+
+    if (_count.fetch_add(1, std::memory_order_relaxed) < _per_second) {
+        suppressed = _suppressed.exchange(0, std::memory_order_relaxed);
+
+        return true;
+    }
+
+    _suppressed.fetch_add(1, std::memory_order_relaxed);
+
+    return false;
+}
+
 std::string Logger::GetCurrentTimestamp(const char* mask) {
-    auto now{std::chrono::system_clock::now()};
-    std::time_t now_time{std::chrono::system_clock::to_time_t(now)};
+    if (std::strcmp(mask, "%Y-%m-%d %H:%M:%S") == 0) {
+        const TimestampCache& timestamp{CurrentTimestamp()};
+
+        return std::string(timestamp.text, timestamp.length);
+    }
+
+    time_t now{std::time(nullptr)};
 
     std::tm local_time{};
-    localtime_r(&now_time, &local_time);
+    localtime_r(&now, &local_time);
 
-    std::ostringstream oss;
-    oss << std::put_time(&local_time, mask);
+    char buffer[128];
+    size_t length{std::strftime(buffer, sizeof(buffer), mask, &local_time)};
+
+    return std::string(buffer, length);
+}
 
-    return oss.str();
+void Logger::SetLevel(MessageType level) noexcept {
+    min_severity.store(Severity(level), std::memory_order_relaxed);
+}
+
+bool Logger::IsEnabled(MessageType type) noexcept {
+    return Severity(type) >= min_severity.load(std::memory_order_relaxed);
 }
 
 void Logger::PrintInTerminal(MessageType type, const std::string& msg) {
-    std::string type_str{TypeToString(type)};
-    std::ostream& stream{TypeToStream(type)};
+    if (!IsEnabled(type)) {
+        return;
+    }
 
-    std::string result_msg{"[" + type_str + "] [" + GetCurrentTimestamp() + "] " + msg};
+    LogSink::Instance().Push(type, msg, 0);
+}
+
+void Logger::PrintInTerminal(MessageType type, const std::string& msg, LogRateLimit& rate) {
+    if (!IsEnabled(type)) {
+        return;
+    }
+
+    uint64_t suppressed{0};
+
+    if (!rate.Acquire(suppressed)) {
+        LogSink::Instance().CountSuppressed();
+
+        return;
+    }
 
-    stream << result_msg << std::endl;
+    LogSink::Instance().Push(type, msg, suppressed);
 }
@@ -0,0 +1,166 @@
+#include <cstdio>
+#include <stdexcept>
+#include <algorithm>
+
+#include "metrics.h"
+
+namespace Metrics {
+
+namespace {
+std::atomic<size_t> next_slot{0};
+
+void AppendSeconds(std::string& out, uint64_t value_us) {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.6f", static_cast<double>(value_us) / 1000000.0);
+
+    out += buffer;
+}
+}
+
+size_t ThreadSlot() noexcept {
+    thread_local const size_t slot{next_slot.fetch_add(1, std::memory_order_relaxed) % SLOTS};
+
+    return slot;
+}
+
+uint64_t Counter::Value() const noexcept {
+    uint64_t total{0};
+
+    for (const auto& slot : _slots) {
+        total += slot.value.load(std::memory_order_relaxed);
+    }
+
+    return total;
+}
+
+void Histogram::Observe(uint64_t value_us) noexcept {
+    Slot& slot{_slots[ThreadSlot()]};
+
+    size_t bucket{static_cast<size_t>(std::lower_bound(BOUNDS_US.begin(), BOUNDS_US.end(), value_us) - BOUNDS_US.begin())};
+
+    slot.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    slot.sum_us.fetch_add(value_us, std::memory_order_relaxed);
+}
+
+Histogram::Snapshot Histogram::Collect() const noexcept {
+    Snapshot snapshot;
+
+    for (const auto& slot : _slots) {
+        for (size_t i{0}; i < slot.buckets.size(); ++i) {
+            uint64_t count{slot.buckets[i].load(std::memory_order_relaxed)};
+
+            snapshot.buckets[i] += count;
+            snapshot.count += count;
+        }
+
+        snapshot.sum_us += slot.sum_us.load(std::memory_order_relaxed);
+    }
+
+    return snapshot;
+}
+
+MetricsRegistry& MetricsRegistry::Global() {
+    static MetricsRegistry registry;
+
+    return registry;
+}
+
+MetricsRegistry::Entry& MetricsRegistry::Find(const std::string& name, const std::string& help, Kind kind) {
+    for (auto& entry : _entries) {
+        if (entry.name == name) {
+            if (entry.kind != kind) {
+                throw std::logic_error("metric registered with another type: " + name);
+            }
+
+            return entry;
+        }
+    }
+
+    Entry& entry{_entries.emplace_back()};
+    entry.name = name;
+    entry.help = help;
+    entry.kind = kind;
+
+    return entry;
+}
+
+Counter& MetricsRegistry::AddCounter(const std::string& name, const std::string& help) {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    Entry& entry{Find(name, help, Kind::K_COUNTER)};
+
+    if (!entry.counter) {
+        entry.counter = &_counters.emplace_back();
+    }
+
+    return *entry.counter;
+}
+
+Gauge& MetricsRegistry::AddGauge(const std::string& name, const std::string& help) {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    Entry& entry{Find(name, help, Kind::K_GAUGE)};
+
+    if (!entry.gauge) {
+        entry.gauge = &_gauges.emplace_back();
+    }
+
+    return *entry.gauge;
+}
+
+Histogram& MetricsRegistry::AddHistogram(const std::string& name, const std::string& help) {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    Entry& entry{Find(name, help, Kind::K_HISTOGRAM)};
+
+    if (!entry.histogram) {
+        entry.histogram = &_histograms.emplace_back();
+    }
+
+    return *entry.histogram;
+}
+
+std::string MetricsRegistry::Render() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    std::string out;
+
+    for (const auto& entry : _entries) {
+        out += "# HELP " + entry.name + " " + entry.help + "\n";
+
+        switch (entry.kind) {
+            case Kind::K_COUNTER:
+                out += "# TYPE " + entry.name + " counter\n";
+                out += entry.name + " " + std::to_string(entry.counter->Value()) + "\n";
+                break;
+            case Kind::K_GAUGE:
+                out += "# TYPE " + entry.name + " gauge\n";
+                out += entry.name + " " + std::to_string(entry.gauge->Value()) + "\n";
+                break;
+            case Kind::K_HISTOGRAM: {
+                out += "# TYPE " + entry.name + " histogram\n";
+
+                Histogram::Snapshot snapshot{entry.histogram->Collect()};
+                uint64_t cumulative{0};
+
+                for (size_t i{0}; i < Histogram::BOUNDS_US.size(); ++i) {
+                    cumulative += snapshot.buckets[i];
+
+                    out += entry.name + "_bucket{le=\"";
+                    AppendSeconds(out, Histogram::BOUNDS_US[i]);
+                    out += "\"} " + std::to_string(cumulative) + "\n";
+                }
+
+                out += entry.name + "_bucket{le=\"+Inf\"} " + std::to_string(snapshot.count) + "\n";
+                out += entry.name + "_sum ";
+                AppendSeconds(out, snapshot.sum_us);
+                out += "\n" + entry.name + "_count " + std::to_string(snapshot.count) + "\n";
+                break;
+            }
+        }
+    }
+
+    return out;
+}
+
+}
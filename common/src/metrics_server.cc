@@ -0,0 +1,151 @@
+#include <cerrno>
+#include <string>
+#include <cstring>
+#include <stdexcept>
+
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+
+#include "metrics.h"
+#include "metrics_server.h"
+
+namespace Limit {
+constexpr size_t MAX_REQUEST_SIZE{8192};
+constexpr time_t IO_TIMEOUT_SEC{2};
+}
+
+MetricsServer::MetricsServer(uint16_t port) :
+    _port(port)
+{}
+
+MetricsServer::~MetricsServer() {
+    if (_worker.joinable()) {
+        uint64_t one{1};
+
+        while (write(_stop_fd.Get(), &one, sizeof(one)) == -1 && errno == EINTR) {}
+
+        _worker.join();
+    }
+}
+
+void MetricsServer::Start() {
+    _listen_fd = ResourceFactory::MakeUniqueFD(socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0));
+    _stop_fd = ResourceFactory::MakeUniqueFD(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+
+    if (!_listen_fd.Valid() || !_stop_fd.Valid()) {
+        throw std::runtime_error("metrics socket/eventfd: " + std::string(strerror(errno)));
+    }
+
+    int opt{1};
+    setsockopt(_listen_fd.Get(), SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(_port);
+
+    if (bind(_listen_fd.Get(), reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == -1) {
+        throw std::runtime_error("metrics bind(): " + std::string(strerror(errno)));
+    }
+
+    if (listen(_listen_fd.Get(), 16) == -1) {
+        throw std::runtime_error("metrics listen(): " + std::string(strerror(errno)));
+    }
+
+    _worker = std::thread(&MetricsServer::ServeLoop, this);
+
+    _logger.PrintInTerminal(MessageType::K_INFO, "Metrics on http://127.0.0.1:" + std::to_string(_port) + "/metrics");
+}
+
+void MetricsServer::HandleConnection(int fd) {
+    struct timeval timeout{};
+    timeout.tv_sec = Limit::IO_TIMEOUT_SEC;
+
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    std::string request;
+    char buffer[1024];
+
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < Limit::MAX_REQUEST_SIZE) {
+        ssize_t n{recv(fd, buffer, sizeof(buffer), 0)};
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (n <= 0) {
+            return;
+        }
+
+        request.append(buffer, static_cast<size_t>(n));
+    }
+
+    std::string status{"200 OK"};
+    std::string body;
+
+    if (request.compare(0, 13, "GET /metrics ") == 0 || request.compare(0, 6, "GET / ") == 0) {
+        body = Metrics::MetricsRegistry::Global().Render();
+    } else {
+        status = "404 Not Found";
+        body = "not found\n";
+    }
+
+    std::string response{
+        "HTTP/1.0 " + status + "\r\n"
+        "Content-Type: text/plain; version=0.0.4\r\n"
+        "Content-Length: " + std::to_string(body.size()) + "\r\n"
+        "Connection: close\r\n\r\n" + body
+    };
+
+    size_t sent{0};
+
+    while (sent < response.size()) {
+        ssize_t n{send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL)};
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (n <= 0) {
+            return;
+        }
+
+        sent += static_cast<size_t>(n);
+    }
+}
+
+void MetricsServer::ServeLoop() {
+    pollfd fds[2]{};
+    fds[0].fd = _listen_fd.Get();
+    fds[0].events = POLLIN;
+    fds[1].fd = _stop_fd.Get();
+    fds[1].events = POLLIN;
+
+    while (true) {
+        if (poll(fds, 2, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            _logger.PrintInTerminal(MessageType::K_ERROR, "metrics poll() error: " + std::string(strerror(errno)));
+
+            return;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            return;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            UniqueFD client(ResourceFactory::MakeUniqueFD(accept4(_listen_fd.Get(), nullptr, nullptr, SOCK_CLOEXEC)));
+
+            if (client.Valid()) {
+                HandleConnection(client.Get());
+            }
+        }
+    }
+}
@@ -0,0 +1,69 @@
+#include <cstring>
+
+#include <endian.h>
+
+#include "protocol.h"
+
+namespace {
+template<typename T>
+void AppendBig(std::vector<uint8_t>& buffer, T value) {
+    if constexpr (sizeof(T) == 2) {
+        value = htobe16(value);
+    } else if constexpr (sizeof(T) == 4) {
+        value = htobe32(value);
+    } else if constexpr (sizeof(T) == 8) {
+        value = htobe64(value);
+    }
+
+    auto bytes{reinterpret_cast<const uint8_t*>(&value)};
+
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+template<typename T>
+T ReadBig(const uint8_t*& data) noexcept {
+    T value;
+    std::memcpy(&value, data, sizeof(T));
+
+    data += sizeof(T);
+
+    if constexpr (sizeof(T) == 2) {
+        return be16toh(value);
+    } else if constexpr (sizeof(T) == 4) {
+        return be32toh(value);
+    } else if constexpr (sizeof(T) == 8) {
+        return be64toh(value);
+    } else {
+        return value;
+    }
+}
+}
+
+namespace Protocol {
+void AppendFrameHeader(std::vector<uint8_t>& buffer, const FrameHeader& header) {
+    AppendBig(buffer, header.seq);
+    AppendBig(buffer, header.capture_us);
+    AppendBig(buffer, header.length);
+    AppendBig(buffer, header.width);
+    AppendBig(buffer, header.height);
+    AppendBig(buffer, header.codec);
+    AppendBig(buffer, header.monitor);
+    AppendBig(buffer, header.flags);
+    AppendBig(buffer, uint32_t{0});
+}
+
+FrameHeader ReadFrameHeader(const uint8_t* data) noexcept {
+    FrameHeader header;
+
+    header.seq = ReadBig<uint64_t>(data);
+    header.capture_us = ReadBig<uint64_t>(data);
+    header.length = ReadBig<uint32_t>(data);
+    header.width = ReadBig<uint16_t>(data);
+    header.height = ReadBig<uint16_t>(data);
+    header.codec = ReadBig<uint8_t>(data);
+    header.monitor = ReadBig<uint8_t>(data);
+    header.flags = ReadBig<uint16_t>(data);
+
+    return header;
+}
+}
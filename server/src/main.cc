@@ -8,9 +8,44 @@ int main(int argc, char* argv[]) {
         InputParser parser(ProgramType::K_SERVER);
         parser.Parse(argc, argv);
 
-        uint16_t port{parser.GetPort()};
+        Logger::SetLevel(parser.GetLogLevel());
 
-        Server server(port);
+        ServerConfig config;
+        config.listen_port = parser.GetPort();
+        config.storage_engine = parser.GetStorageEngine();
+        config.segment_size = parser.GetSegmentSize();
+        config.segment_age_sec = parser.GetSegmentAge();
+        config.durability = parser.GetDurabilityMode();
+        config.sync_interval_ms = parser.GetSyncInterval();
+        config.retention.client_bytes = parser.GetClientQuota();
+        config.retention.user_bytes = parser.GetUserQuota();
+        config.retention.total_bytes = parser.GetTotalQuota();
+        config.retention.max_age_sec = parser.GetMaxAge();
+        config.retention.min_free_bytes = parser.GetMinFree();
+        config.retention.evict_rate = parser.GetEvictRate();
+        config.query_port = parser.GetQueryPort();
+        config.cache_bytes = parser.GetCacheSize();
+        config.cache_frames = parser.GetCacheFrames();
+        config.metrics_port = parser.GetMetricsPort();
+        config.trace_path = parser.GetTraceFile();
+        config.credit_frames = parser.GetCreditFrames();
+        config.credit_bytes = parser.GetCreditSize();
+        config.admission.max_connections = parser.GetMaxConnections();
+        config.admission.mode = parser.GetAdmissionMode();
+        config.admission.client_rate = parser.GetClientRate();
+        config.admission.address_rate = parser.GetAddressRate();
+        config.admission.relay_sources = parser.GetRelaySources();
+        config.capture_period_ms = parser.GetCapturePeriod() * 1000;
+        config.relay.upstream = parser.GetUpstream();
+        config.relay.connections = parser.GetUpstreamConnections();
+        config.relay.spill_bytes = parser.GetSpillSize();
+        config.handoff_path = parser.GetHandoffPath();
+        config.encode_workers = parser.GetEncodeWorkers();
+        config.compaction.min_age_sec = parser.GetCompactAfter();
+        config.compaction.keyframe_interval = parser.GetCompactKeyframes();
+        config.thumbnail_workers = parser.GetThumbnailWorkers();
+
+        Server server(config);
         server.Run();
     } catch (const std::invalid_argument& ex) {
         std::cerr << ex.what() << '\n';
@@ -0,0 +1,101 @@
+#include <algorithm>
+
+#include "admission_control.h"
+
+namespace Limit {
+constexpr double BURST_SECONDS{2.0};
+constexpr double MIN_ADDRESS_BURST{1024.0 * 1024 * 10}; // 10 Mb - максимальное сообщение, иначе крупный кадр не пройдет никогда
+constexpr size_t MIN_SWEEP_SIZE{64};
+}
+
+TokenBucket::TokenBucket(double rate, double burst) noexcept :
+    _rate(rate),
+    _burst(burst),
+    _tokens(burst),
+    _last(Clock::now())
+{}
+
+bool TokenBucket::Has(double cost) noexcept {
+    auto now{Clock::now()};
+    double elapsed{std::chrono::duration<double>(now - _last).count()};
+
+    _tokens = std::min(_burst, _tokens + elapsed * _rate);
+    _last = now;
+
+    return _tokens >= cost;
+}
+
+void TokenBucket::Take(double cost) noexcept {
+    _tokens -= cost;
+}
+
+AdmissionControl::AdmissionControl(const AdmissionPolicy& policy) :
+    _policy(policy)
+{}
+
+bool AdmissionControl::Admit(size_t sessions, bool backlogged) const noexcept {
+    if (backlogged) {
+        return false;
+    }
+
+    return _policy.max_connections == 0 || sessions < _policy.max_connections;
+}
+
+AdmissionMode AdmissionControl::GetMode() const noexcept {
+    return _policy.mode;
+}
+
+IngestLimit AdmissionControl::AcquireClient(const std::string& client) {
+    if (_policy.client_rate == 0) {
+        return nullptr;
+    }
+
+    double rate{static_cast<double>(_policy.client_rate)};
+
+    return Acquire(_clients, _clients_sweep_at, client, rate, std::max(1.0, rate * Limit::BURST_SECONDS));
+}
+
+IngestLimit AdmissionControl::AcquireAddress(uint32_t addr) {
+    if (_policy.address_rate == 0) {
+        return nullptr;
+    }
+
+    double rate{static_cast<double>(_policy.address_rate)};
+
+    return Acquire(_addresses, _addresses_sweep_at, addr, rate, std::max(Limit::MIN_ADDRESS_BURST, rate * Limit::BURST_SECONDS));
+}
+
+bool AdmissionControl::AcceptsRelay(uint32_t addr) const noexcept {
+    for (const AddressRange& range : _policy.relay_sources) {
+        if (range.Contains(addr)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+template<typename Key>
+IngestLimit AdmissionControl::Acquire(std::unordered_map<Key, std::weak_ptr<TokenBucket>>& buckets, size_t& sweep_at,
+                                      const Key& key, double rate, double burst) {
+    auto& slot{buckets[key]};
+    IngestLimit bucket{slot.lock()};
+
+    if (bucket) {
+        return bucket;
+    }
+
+    bucket = std::make_shared<TokenBucket>(rate, burst);
+    slot = bucket;
+
+    // Мертвые записи убираются, когда таблица выросла вдвое с прошлой очистки: амортизированно O(1) на вызов
+    if (buckets.size() >= sweep_at) {
+        for (auto it{buckets.begin()}; it != buckets.end();) {
+            it = it->second.expired() ? buckets.erase(it) : std::next(it);
+        }
+
+        sweep_at = std::max(Limit::MIN_SWEEP_SIZE, buckets.size() * 2);
+    }
+
+    return bucket;
+}
@@ -0,0 +1,144 @@
+#ifndef SERVER_SERVER_ADMISSION_ADMISSION_CONTROL_H
+#define SERVER_SERVER_ADMISSION_ADMISSION_CONTROL_H
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+
+#include "input_parser.h"
+
+/**
+ * @brief Политика допуска соединений и ограничения скорости приема
+ *
+ * Нулевое значение означает отсутствие ограничения.
+ */
+struct AdmissionPolicy {
+    size_t max_connections{};                    ///< Максимум одновременных соединений
+    AdmissionMode mode{AdmissionMode::K_REJECT}; ///< Поведение при перегрузке
+    uint64_t client_rate{};                      ///< Кадров в секунду на клиента (hostname/username)
+    uint64_t address_rate{};                     ///< Байт данных кадров в секунду на IP-адрес
+    std::vector<AddressRange> relay_sources;     ///< Адреса, с которых принимаются пачки 'R' (пусто - ни с каких)
+};
+
+/**
+ * @brief Корзина токенов
+ *
+ * Токены пополняются лениво при обращении, поэтому проверка - O(1)
+ * без таймеров и фоновых потоков. Используется только потоком событий.
+ */
+class TokenBucket {
+public:
+    /**
+     * @brief Конструктор (корзина создается полной)
+     * @param rate Пополнение, токенов в секунду
+     * @param burst Емкость корзины
+     */
+    TokenBucket(double rate, double burst) noexcept;
+
+public:
+    /**
+     * @brief Пополнить корзину и проверить наличие токенов
+     * @param cost Требуемое число токенов
+     * @return true если токенов хватает
+     */
+    bool Has(double cost) noexcept;
+
+    /**
+     * @brief Списать токены (после успешной проверки Has())
+     * @param cost Число токенов
+     */
+    void Take(double cost) noexcept;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    double _rate;            ///< Пополнение, токенов в секунду
+    double _burst;           ///< Емкость корзины
+    double _tokens;          ///< Текущее число токенов
+    Clock::time_point _last; ///< Время последнего пополнения
+};
+
+/**
+ * @brief Ограничение скорости, разделяемое сессиями одного ключа
+ */
+using IngestLimit = std::shared_ptr<TokenBucket>;
+
+/**
+ * @brief Допуск соединений и выдача корзин ограничения скорости
+ *
+ * Сервер перегружен, если открыто max_connections соединений или очередь
+ * потока записи почти заполнена. Корзины клиента и IP-адреса общие для всех
+ * сессий ключа: сессия держит ссылку на корзину, и проверка кадра не ищет
+ * ее в таблице. Корзина живет, пока жива хоть одна ее сессия; таблица
+ * хранит слабые ссылки и очищается от мертвых записей по мере роста.
+ */
+class AdmissionControl {
+public:
+    /**
+     * @brief Конструктор
+     * @param policy Политика допуска
+     */
+    explicit AdmissionControl(const AdmissionPolicy& policy);
+
+public:
+    /**
+     * @brief Проверить, можно ли принять новое соединение
+     * @param sessions Число открытых соединений
+     * @param backlogged Очередь потока записи почти заполнена
+     * @return true если сервер не перегружен
+     */
+    bool Admit(size_t sessions, bool backlogged) const noexcept;
+
+    /**
+     * @brief Получить поведение при перегрузке
+     * @return Режим допуска
+     */
+    AdmissionMode GetMode() const noexcept;
+
+    /**
+     * @brief Получить корзину клиента
+     * @param client Ключ клиента ("hostname/username")
+     * @return Корзина в кадрах (nullptr, если ограничение выключено)
+     */
+    IngestLimit AcquireClient(const std::string& client);
+
+    /**
+     * @brief Получить корзину IP-адреса
+     * @param addr IPv4-адрес (в сетевом порядке байт)
+     * @return Корзина в байтах (nullptr, если ограничение выключено)
+     */
+    IngestLimit AcquireAddress(uint32_t addr);
+
+    /**
+     * @brief Проверить, можно ли принимать пачки ретранслятора с адреса
+     * @param addr IPv4-адрес (в сетевом порядке байт)
+     * @return true если адрес входит в --accept-relays
+     */
+    bool AcceptsRelay(uint32_t addr) const noexcept;
+
+private:
+    /**
+     * @brief Найти или создать корзину ключа
+     * @param buckets Таблица корзин
+     * @param[in,out] sweep_at Размер таблицы, при котором убираются мертвые записи
+     * @param key Ключ
+     * @param rate Пополнение, токенов в секунду
+     * @param burst Емкость корзины
+     * @return Корзина
+     */
+    template<typename Key>
+    static IngestLimit Acquire(std::unordered_map<Key, std::weak_ptr<TokenBucket>>& buckets, size_t& sweep_at,
+                               const Key& key, double rate, double burst);
+
+private:
+    AdmissionPolicy _policy;                                              ///< Политика допуска
+    std::unordered_map<std::string, std::weak_ptr<TokenBucket>> _clients; ///< Корзины клиентов
+    std::unordered_map<uint32_t, std::weak_ptr<TokenBucket>> _addresses;  ///< Корзины IP-адресов
+    size_t _clients_sweep_at{64};                                         ///< Порог очистки _clients
+    size_t _addresses_sweep_at{64};                                       ///< Порог очистки _addresses
+};
+
+#endif // SERVER_SERVER_ADMISSION_ADMISSION_CONTROL_H
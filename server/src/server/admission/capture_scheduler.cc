@@ -0,0 +1,65 @@
+#include "capture_scheduler.h"
+
+CaptureScheduler::CaptureScheduler(uint32_t period_ms) noexcept :
+    _period_ms(period_ms)
+{}
+
+uint32_t CaptureScheduler::GetPeriod() const noexcept {
+    return _period_ms;
+}
+
+uint32_t CaptureScheduler::Assign() noexcept {
+    while (_load[Reverse(_cursor)] > _min_load) {
+        if (++_cursor == SLOTS) {
+            _cursor = 0;
+            ++_min_load;
+        }
+    }
+
+    uint32_t slot{Reverse(_cursor)};
+
+    ++_load[slot];
+
+    return slot;
+}
+
+void CaptureScheduler::Release(uint32_t slot) noexcept {
+    if (slot >= SLOTS || _load[slot] == 0) {
+        return;
+    }
+
+    --_load[slot];
+
+    // Освободившийся слот заполняется первым
+    if (_load[slot] < _min_load) {
+        _min_load = _load[slot];
+        _cursor = 0;
+    } else if (_load[slot] == _min_load) {
+        _cursor = 0;
+    }
+}
+
+bool CaptureScheduler::Claim(uint32_t slot) noexcept {
+    if (slot >= SLOTS) {
+        return false;
+    }
+
+    // Слоты до курсора остаются занятыми больше _min_load: обход не сбивается
+    ++_load[slot];
+
+    return true;
+}
+
+uint32_t CaptureScheduler::GetPhase(uint32_t slot) const noexcept {
+    return static_cast<uint32_t>(static_cast<uint64_t>(slot) * _period_ms / SLOTS);
+}
+
+uint32_t CaptureScheduler::Reverse(uint32_t position) noexcept {
+    uint32_t slot{0};
+
+    for (uint32_t bit{1}; bit < SLOTS; bit <<= 1) {
+        slot = (slot << 1) | ((position & bit) ? 1 : 0);
+    }
+
+    return slot;
+}
@@ -0,0 +1,76 @@
+#ifndef SERVER_SERVER_ADMISSION_CAPTURE_SCHEDULER_H
+#define SERVER_SERVER_ADMISSION_CAPTURE_SCHEDULER_H
+
+#include <array>
+#include <cstdint>
+
+/**
+ * @brief Распределение фаз захвата клиентов по периоду
+ *
+ * Период делится на SLOTS равных слотов. Каждому клиенту выдается слот
+ * с наименьшим числом клиентов; среди равных - первый в порядке обращения
+ * битов номера (0, 512, 256, 768, ...), поэтому уже первые клиенты ложатся
+ * по периоду равномерно, а не подряд. Выдача обходит слоты с позиции курсора,
+ * то есть стоит не больше SLOTS шагов; при росте числа клиентов - O(1) в среднем.
+ *
+ * Используется только потоком событий.
+ */
+class CaptureScheduler {
+public:
+    static constexpr uint32_t SLOTS{1024}; ///< Число слотов в периоде (степень двойки)
+
+    /**
+     * @brief Конструктор
+     * @param period_ms Период захвата
+     */
+    explicit CaptureScheduler(uint32_t period_ms) noexcept;
+
+public:
+    /**
+     * @brief Получить период захвата
+     * @return Период, мс
+     */
+    uint32_t GetPeriod() const noexcept;
+
+    /**
+     * @brief Выдать слот новому клиенту
+     * @return Номер слота
+     */
+    uint32_t Assign() noexcept;
+
+    /**
+     * @brief Вернуть слот отключившегося клиента
+     * @param slot Номер слота из Assign()
+     */
+    void Release(uint32_t slot) noexcept;
+
+    /**
+     * @brief Занять известный слот (клиент, принятый от старого процесса)
+     * @param slot Номер слота
+     * @return false если номер вне диапазона
+     */
+    bool Claim(uint32_t slot) noexcept;
+
+    /**
+     * @brief Получить фазу слота
+     * @param slot Номер слота
+     * @return Смещение от начала периода, мс
+     */
+    uint32_t GetPhase(uint32_t slot) const noexcept;
+
+private:
+    /**
+     * @brief Обратить порядок бит номера позиции
+     * @param position Позиция в порядке обхода (0..SLOTS-1)
+     * @return Номер слота
+     */
+    static uint32_t Reverse(uint32_t position) noexcept;
+
+private:
+    uint32_t _period_ms;                 ///< Период захвата
+    std::array<uint32_t, SLOTS> _load{}; ///< Число клиентов в слоте
+    uint32_t _min_load{0};               ///< Ни в одном слоте нет меньше клиентов
+    uint32_t _cursor{0};                 ///< Позиция обхода: до нее все слоты заняты больше _min_load
+};
+
+#endif // SERVER_SERVER_ADMISSION_CAPTURE_SCHEDULER_H
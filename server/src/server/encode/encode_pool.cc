@@ -0,0 +1,310 @@
+#include <chrono>
+#include <utility>
+#include <algorithm>
+
+#include <zlib.h>
+
+#include "metrics.h"
+#include "png_codec.h"
+#include "encode_pool.h"
+
+namespace Limit {
+constexpr size_t MAX_QUEUE_BYTES{256 * 1024 * 1024}; // 256 Mb
+constexpr size_t MAX_RAW_BYTES{64 * 1024 * 1024};    // 64 Mb, с запасом для 4K RGB
+}
+
+namespace {
+Metrics::Counter& frames_encoded{Metrics::MetricsRegistry::Global().AddCounter(
+    "server_encode_frames_total", "Raw frames encoded to PNG by the encode pool")};
+Metrics::Counter& encode_failures{Metrics::MetricsRegistry::Global().AddCounter(
+    "server_encode_failures_total", "Raw frames dropped because they could not be decoded or encoded")};
+Metrics::Counter& strands_stolen{Metrics::MetricsRegistry::Global().AddCounter(
+    "server_encode_steals_total", "Session queues taken by an idle encode worker from another worker")};
+Metrics::Gauge& queued_bytes{Metrics::MetricsRegistry::Global().AddGauge(
+    "server_encode_queue_bytes", "Frame bytes waiting in the encode pool")};
+Metrics::Histogram& encode_seconds{Metrics::MetricsRegistry::Global().AddHistogram(
+    "server_encode_seconds", "Time to decode one raw frame and encode it as PNG")};
+}
+
+/**
+ * @brief Очередь кадров одной сессии
+ */
+class EncodePool::Strand {
+public:
+    explicit Strand(size_t home) noexcept :
+        home(home)
+    {}
+
+public:
+    const size_t home;          ///< Поток, в дек которого ставится очередь
+
+    std::mutex mutex;           ///< Защищает jobs и scheduled
+    std::deque<EncodeJob> jobs; ///< Кадры в порядке поступления
+    bool scheduled{false};      ///< Очередь стоит в деке или обрабатывается
+};
+
+EncodePool::EncodePool(size_t workers, StorageWriter& writer, ViewerHub& viewers, HotFrameCache* cache,
+                       UpstreamRelay* relay) :
+    _writer(writer),
+    _viewers(viewers),
+    _cache(cache),
+    _relay(relay)
+{
+    for (size_t i{0}; i < std::max<size_t>(workers, 1); ++i) {
+        _workers.push_back(std::make_unique<Worker>());
+    }
+}
+
+EncodePool::~EncodePool() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+
+    _has_work.notify_all();
+
+    for (auto& worker : _workers) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+}
+
+void EncodePool::Start() {
+    for (size_t i{0}; i < _workers.size(); ++i) {
+        _workers[i]->thread = std::thread(&EncodePool::WorkerLoop, this, i);
+    }
+}
+
+EncodePool::StrandHandle EncodePool::OpenStrand() {
+    return std::make_shared<Strand>(_next_home.fetch_add(1, std::memory_order_relaxed) % _workers.size());
+}
+
+void EncodePool::Submit(const StrandHandle& strand, EncodeJob&& job) {
+    size_t size{job.job.data->size()};
+
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        _has_space.wait(lock, [&] {
+            return _queued_bytes == 0 || _queued_bytes + size <= Limit::MAX_QUEUE_BYTES;
+        });
+
+        _queued_bytes += size;
+
+        queued_bytes.Set(static_cast<int64_t>(_queued_bytes));
+    }
+
+    bool schedule;
+
+    {
+        std::lock_guard<std::mutex> lock(strand->mutex);
+
+        strand->jobs.push_back(std::move(job));
+        schedule = !std::exchange(strand->scheduled, true);
+    }
+
+    if (schedule) {
+        Schedule(strand, strand->home);
+    }
+}
+
+bool EncodePool::IsBacklogged() {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    return _queued_bytes > Limit::MAX_QUEUE_BYTES / 4 * 3;
+}
+
+size_t EncodePool::GetWorkers() const noexcept {
+    return _workers.size();
+}
+
+bool EncodePool::EncodePNG(const Protocol::FrameHeader& header, const std::vector<uint8_t>& data, std::vector<uint8_t>& png) {
+    size_t raw_size{static_cast<size_t>(header.width) * header.height * 3};
+
+    if (raw_size == 0 || raw_size > Limit::MAX_RAW_BYTES) {
+        return false;
+    }
+
+    const uint8_t* pixels{data.data()};
+
+    // Буфер распаковки живет в потоке пула и переиспользуется между кадрами
+    thread_local std::vector<uint8_t> inflated;
+
+    if (header.codec == Protocol::CODEC_RAW_RGB) {
+        if (data.size() != raw_size) {
+            return false;
+        }
+    } else if (header.codec == Protocol::CODEC_RAW_RGB_ZLIB) {
+        inflated.resize(raw_size);
+
+        uLongf inflated_size{static_cast<uLongf>(raw_size)};
+
+        if (uncompress(inflated.data(), &inflated_size, data.data(), static_cast<uLong>(data.size())) != Z_OK ||
+            inflated_size != raw_size) {
+            return false;
+        }
+
+        pixels = inflated.data();
+    } else {
+        return false;
+    }
+
+    return PngCodec::Encode(pixels, header.width, header.height, png);
+}
+
+void EncodePool::WorkerLoop(size_t index) {
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+
+            _has_work.wait(lock, [&] { return _stop || _ready > 0; });
+
+            // При остановке поток выходит только когда разобраны все очереди
+            if (_ready == 0) {
+                return;
+            }
+
+            --_ready;
+        }
+
+        StrandHandle strand{TakeStrand(index)};
+        EncodeJob job;
+
+        {
+            std::lock_guard<std::mutex> lock(strand->mutex);
+
+            job = std::move(strand->jobs.front());
+            strand->jobs.pop_front();
+        }
+
+        size_t size{job.job.data->size()};
+
+        Process(job);
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+
+            _queued_bytes -= size;
+
+            queued_bytes.Set(static_cast<int64_t>(_queued_bytes));
+        }
+
+        _has_space.notify_all();
+
+        bool more;
+
+        {
+            std::lock_guard<std::mutex> lock(strand->mutex);
+
+            more = !strand->jobs.empty();
+            strand->scheduled = more;
+        }
+
+        // По одному кадру за раз: очередь встает в конец дека, пропуская вперед другие сессии
+        if (more) {
+            Schedule(strand, index);
+        }
+    }
+}
+
+void EncodePool::Schedule(const StrandHandle& strand, size_t index) {
+    {
+        std::lock_guard<std::mutex> lock(_workers[index]->mutex);
+
+        _workers[index]->ready.push_back(strand);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        ++_ready;
+    }
+
+    _has_work.notify_one();
+}
+
+EncodePool::StrandHandle EncodePool::TakeStrand(size_t index) {
+    // Занятое в _ready место гарантирует, что хотя бы в одном деке есть очередь
+    for (;;) {
+        {
+            Worker& own{*_workers[index]};
+            std::lock_guard<std::mutex> lock(own.mutex);
+
+            if (!own.ready.empty()) {
+                StrandHandle strand{std::move(own.ready.front())};
+                own.ready.pop_front();
+
+                return strand;
+            }
+        }
+
+        for (size_t i{1}; i < _workers.size(); ++i) {
+            Worker& victim{*_workers[(index + i) % _workers.size()]};
+            std::lock_guard<std::mutex> lock(victim.mutex);
+
+            if (!victim.ready.empty()) {
+                StrandHandle strand{std::move(victim.ready.back())};
+                victim.ready.pop_back();
+
+                strands_stolen.Inc();
+
+                return strand;
+            }
+        }
+    }
+}
+
+void EncodePool::Process(EncodeJob& job) {
+    FrameBuffer data{job.job.data};
+    uint64_t wire_bytes{data->size()};
+
+    if (job.header.codec != Protocol::CODEC_PNG) {
+        auto start{std::chrono::steady_clock::now()};
+        auto png{std::make_shared<std::vector<uint8_t>>()};
+
+        if (!EncodePNG(job.header, *data, *png)) {
+            static LogRateLimit rate{10};
+
+            encode_failures.Inc();
+
+            _logger.PrintInTerminal(MessageType::K_WARNING, "[client: " + job.job.frame.hostname + "/" +
+                                    job.job.frame.username + "] raw frame does not match its header, dropped", rate);
+
+            // Номер кадра уже занят сессией, поэтому кредит возвращается тем же путем, что и после записи
+            if (!job.forward) {
+                _writer.Release(StorageRelease{job.job.owner, 1, wire_bytes});
+            }
+
+            return;
+        }
+
+        encode_seconds.ObserveSince(start);
+        frames_encoded.Inc();
+
+        data = std::move(png);
+
+        job.header.codec = Protocol::CODEC_PNG;
+        job.header.length = static_cast<uint32_t>(data->size());
+    }
+
+    const FrameRecord& frame{job.job.frame};
+    std::string client{frame.hostname + "/" + frame.username};
+    uint64_t timestamp_ms{frame.timestamp_ms};
+
+    _viewers.Publish(frame.hostname, frame.username, timestamp_ms, data);
+
+    if (job.forward && _relay) {
+        _relay->Forward(frame.hostname, frame.username, timestamp_ms, job.header, data);
+    } else if (!job.forward) {
+        job.job.frame.codec = FrameCodec::K_PNG;
+        job.job.data = data;
+        job.job.wire_bytes = wire_bytes;
+
+        _writer.Submit(std::move(job.job));
+    }
+
+    if (_cache) {
+        _cache->Put(client, timestamp_ms, std::move(data));
+    }
+}
@@ -0,0 +1,166 @@
+#ifndef SERVER_SERVER_ENCODE_ENCODE_POOL_H
+#define SERVER_SERVER_ENCODE_ENCODE_POOL_H
+
+#include <mutex>
+#include <deque>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <condition_variable>
+
+#include "logger.h"
+#include "protocol.h"
+#include "viewer_hub.h"
+#include "upstream_relay.h"
+#include "storage_writer.h"
+#include "hot_frame_cache.h"
+
+/**
+ * @brief Кадр, ожидающий кодирования
+ */
+struct EncodeJob {
+    StorageJob job;               ///< Кадр в формате клиента и его место в нумерации сессии
+    Protocol::FrameHeader header; ///< Заголовок кадра (кодек и размеры в пикселях)
+    bool forward{false};          ///< Ретранслировать вместо сохранения (кредит уже возвращен)
+};
+
+/**
+ * @brief Пул потоков, кодирующих в PNG кадры без сжатия (протокол v4)
+ *
+ * Клиент с --upload raw присылает пиксели RGB (CODEC_RAW_RGB или CODEC_RAW_RGB_ZLIB),
+ * а PNG получают уже потоки пула: дальше кадр идет зрителям, в кэш и на запись
+ * (или вышестоящему серверу) как обычно.
+ *
+ * Кадры одной сессии образуют очередь (Strand) и кодируются строго по порядку,
+ * чтобы подтверждения 'D' не опережали нумерацию. Очередь с работой стоит в деке
+ * одного из потоков; свободный поток берет очереди из своего дека спереди, а когда
+ * он пуст - забирает сзади из чужого. Так одна тяжелая сессия не простаивает за
+ * другой, а потоков ровно столько, сколько задано (по умолчанию - по числу ядер).
+ *
+ * Объем ожидающих кадров ограничен: Submit() при переполнении блокирует поток
+ * событий, как StorageWriter::Submit().
+ */
+class EncodePool {
+public:
+    class Strand;
+
+    using StrandHandle = std::shared_ptr<Strand>;
+
+    /**
+     * @brief Конструктор
+     * @param workers Число потоков кодирования (не меньше 1)
+     * @param writer Поток записи, принимающий закодированные кадры
+     * @param viewers Живые зрители
+     * @param cache Кэш последних кадров (может отсутствовать)
+     * @param relay Вышестоящий сервер для EncodeJob::forward (может отсутствовать)
+     */
+    EncodePool(size_t workers, StorageWriter& writer, ViewerHub& viewers, HotFrameCache* cache, UpstreamRelay* relay);
+
+    /**
+     * @brief Деструктор - кодирует оставшиеся кадры и останавливает потоки
+     */
+    ~EncodePool();
+
+    EncodePool(const EncodePool&) = delete;
+    EncodePool& operator=(const EncodePool&) = delete;
+
+public:
+    /**
+     * @brief Запустить потоки кодирования
+     */
+    void Start();
+
+    /**
+     * @brief Завести очередь кадров для новой сессии
+     * @return Очередь, закрепленная за одним из потоков по кругу
+     */
+    StrandHandle OpenStrand();
+
+    /**
+     * @brief Поставить кадр в очередь сессии
+     * @param strand Очередь сессии
+     * @param job Кадр (данные перемещаются)
+     *
+     * Если пул переполнен, блокирует вызывающий поток до освобождения места.
+     */
+    void Submit(const StrandHandle& strand, EncodeJob&& job);
+
+    /**
+     * @brief Проверить, почти ли заполнен пул
+     * @return true если ожидающих кадров больше 3/4 допустимого объема
+     */
+    bool IsBacklogged();
+
+    /**
+     * @brief Получить число потоков кодирования
+     * @return Число потоков
+     */
+    size_t GetWorkers() const noexcept;
+
+    /**
+     * @brief Перекодировать кадр без сжатия в PNG
+     * @param header Заголовок кадра (кодек CODEC_RAW_*, ширина и высота)
+     * @param data Данные кадра
+     * @param[out] png Кадр в PNG
+     * @return false если данные не соответствуют заголовку или кодек неизвестен
+     */
+    static bool EncodePNG(const Protocol::FrameHeader& header, const std::vector<uint8_t>& data, std::vector<uint8_t>& png);
+
+private:
+    /**
+     * @brief Дек очередей, ждущих потока
+     */
+    struct Worker {
+        std::mutex mutex;                ///< Защищает ready
+        std::deque<StrandHandle> ready;  ///< Очереди с работой
+        std::thread thread;              ///< Поток кодирования
+    };
+
+    /**
+     * @brief Основной цикл потока кодирования
+     * @param index Номер потока
+     */
+    void WorkerLoop(size_t index);
+
+    /**
+     * @brief Поставить очередь в дек потока
+     * @param strand Очередь с работой
+     * @param index Номер потока
+     */
+    void Schedule(const StrandHandle& strand, size_t index);
+
+    /**
+     * @brief Взять очередь: свою спереди или чужую сзади
+     * @param index Номер потока
+     * @return Очередь (вызывающий уже занял ее в _ready)
+     */
+    StrandHandle TakeStrand(size_t index);
+
+    /**
+     * @brief Закодировать кадр и передать его дальше
+     * @param job Кадр
+     */
+    void Process(EncodeJob& job);
+
+private:
+    StorageWriter& _writer;                        ///< Поток записи
+    ViewerHub& _viewers;                           ///< Живые зрители
+    HotFrameCache* _cache;                         ///< Кэш последних кадров (может отсутствовать)
+    UpstreamRelay* _relay;                         ///< Вышестоящий сервер (может отсутствовать)
+
+    std::vector<std::unique_ptr<Worker>> _workers; ///< Потоки и их деки
+    std::atomic<size_t> _next_home{0};             ///< Поток для следующей новой очереди
+
+    std::mutex _mutex;                             ///< Защищает счетчики ниже и флаг остановки
+    std::condition_variable _has_work;             ///< Появилась очередь с работой или остановка
+    std::condition_variable _has_space;            ///< В пуле освободилось место
+    size_t _ready{0};                              ///< Очереди в деках, еще не занятые потоками
+    size_t _queued_bytes{0};                       ///< Объем ожидающих кадров
+    bool _stop{false};                             ///< Флаг остановки
+
+    Logger _logger;                                ///< Логгер
+};
+
+#endif // SERVER_SERVER_ENCODE_ENCODE_POOL_H
@@ -0,0 +1,337 @@
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <endian.h>
+#include <unistd.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+
+#include "handoff_channel.h"
+
+namespace Limit {
+constexpr size_t RECORD_HEADER_SIZE{sizeof(uint8_t) + sizeof(uint32_t)};
+constexpr uint32_t MAX_PAYLOAD_SIZE{64 * 1024 * 1024}; // 64 Mb
+}
+
+namespace {
+bool FillAddress(const std::string& path, struct sockaddr_un& addr) {
+    addr = {};
+    addr.sun_family = AF_UNIX;
+
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+        return false;
+    }
+
+    std::memcpy(addr.sun_path, path.data(), path.size());
+
+    return true;
+}
+
+bool RecvAll(int fd, void* data, size_t size) {
+    auto bytes{static_cast<uint8_t*>(data)};
+    size_t done{0};
+
+    while (done < size) {
+        ssize_t n{recv(fd, bytes + done, size - done, 0)};
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (n <= 0) {
+            return false;
+        }
+
+        done += static_cast<size_t>(n);
+    }
+
+    return true;
+}
+
+bool SendAll(int fd, const uint8_t* data, size_t size) {
+    while (size > 0) {
+        ssize_t n{send(fd, data, size, MSG_NOSIGNAL)};
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (n <= 0) {
+            return false;
+        }
+
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+
+    return true;
+}
+
+template <typename T>
+void Put(std::vector<uint8_t>& out, T value) {
+    auto bytes{reinterpret_cast<const uint8_t*>(&value)};
+    out.insert(out.end(), bytes, bytes + sizeof(value));
+}
+
+void PutBytes(std::vector<uint8_t>& out, const void* data, uint32_t size) {
+    Put(out, htobe32(size));
+
+    auto bytes{static_cast<const uint8_t*>(data)};
+    out.insert(out.end(), bytes, bytes + size);
+}
+
+/**
+ * @brief Последовательное чтение полей записи с проверкой границ
+ */
+class Reader {
+public:
+    explicit Reader(const std::vector<uint8_t>& data) noexcept :
+        _data(data)
+    {}
+
+public:
+    template <typename T>
+    bool Get(T& value) noexcept {
+        if (_data.size() - _offset < sizeof(value)) {
+            return false;
+        }
+
+        std::memcpy(&value, _data.data() + _offset, sizeof(value));
+        _offset += sizeof(value);
+
+        return true;
+    }
+
+    template <typename Container>
+    bool GetBytes(Container& value) {
+        uint32_t net_size{0};
+
+        if (!Get(net_size)) {
+            return false;
+        }
+
+        uint32_t size{be32toh(net_size)};
+
+        if (_data.size() - _offset < size) {
+            return false;
+        }
+
+        value.assign(_data.begin() + _offset, _data.begin() + _offset + size);
+        _offset += size;
+
+        return true;
+    }
+
+    bool AtEnd() const noexcept {
+        return _offset == _data.size();
+    }
+
+private:
+    const std::vector<uint8_t>& _data; ///< Данные записи
+    size_t _offset{0};                 ///< Позиция чтения
+};
+}
+
+UniqueFD HandoffChannel::Listen(const std::string& path) {
+    struct sockaddr_un addr;
+
+    if (!FillAddress(path, addr)) {
+        throw std::runtime_error("handoff path is empty or too long: " + path);
+    }
+
+    UniqueFD fd{ResourceFactory::MakeUniqueFD(socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0))};
+
+    if (!fd.Valid()) {
+        throw std::runtime_error("socket(): " + std::string(strerror(errno)));
+    }
+
+    // Файл сокета предыдущего процесса: его слушатель уже закрыт или передал все
+    unlink(path.c_str());
+
+    if (bind(fd.Get(), reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == -1) {
+        throw std::runtime_error("bind(" + path + "): " + std::string(strerror(errno)));
+    }
+
+    // Сокеты клиентов может забрать только владелец сервера
+    chmod(path.c_str(), S_IRUSR | S_IWUSR);
+
+    if (listen(fd.Get(), 1) == -1) {
+        throw std::runtime_error("listen(" + path + "): " + std::string(strerror(errno)));
+    }
+
+    return fd;
+}
+
+UniqueFD HandoffChannel::Connect(const std::string& path, unsigned timeout_ms) {
+    struct sockaddr_un addr;
+
+    if (!FillAddress(path, addr)) {
+        return UniqueFD();
+    }
+
+    UniqueFD fd{ResourceFactory::MakeUniqueFD(socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0))};
+
+    if (!fd.Valid() || connect(fd.Get(), reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == -1) {
+        return UniqueFD();
+    }
+
+    struct timeval timeout{};
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_usec = static_cast<suseconds_t>(timeout_ms % 1000) * 1000;
+
+    setsockopt(fd.Get(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    return fd;
+}
+
+bool HandoffChannel::Send(int fd, uint8_t type, const std::vector<uint8_t>& payload, int pass_fd) {
+    if (payload.size() > Limit::MAX_PAYLOAD_SIZE) {
+        errno = EMSGSIZE;
+
+        return false;
+    }
+
+    uint8_t header[Limit::RECORD_HEADER_SIZE];
+    uint32_t net_size{htobe32(static_cast<uint32_t>(payload.size()))};
+
+    header[0] = type;
+    std::memcpy(header + 1, &net_size, sizeof(net_size));
+
+    // Дескриптор приезжает вместе с первым байтом заголовка, поэтому заголовок
+    // всегда уходит отдельным sendmsg(), а данные - следом
+    struct iovec iov{header, sizeof(header)};
+
+    struct msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    alignas(struct cmsghdr) uint8_t control[CMSG_SPACE(sizeof(int))]{};
+
+    if (pass_fd >= 0) {
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        struct cmsghdr* cmsg{CMSG_FIRSTHDR(&msg)};
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+
+        std::memcpy(CMSG_DATA(cmsg), &pass_fd, sizeof(int));
+    }
+
+    ssize_t sent;
+
+    do {
+        sent = sendmsg(fd, &msg, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+
+    if (sent <= 0) {
+        return false;
+    }
+
+    return SendAll(fd, header + sent, sizeof(header) - static_cast<size_t>(sent)) &&
+           SendAll(fd, payload.data(), payload.size());
+}
+
+bool HandoffChannel::Receive(int fd, uint8_t& type, std::vector<uint8_t>& payload, UniqueFD& passed) {
+    uint8_t header[Limit::RECORD_HEADER_SIZE];
+    struct iovec iov{header, sizeof(header)};
+
+    struct msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    alignas(struct cmsghdr) uint8_t control[CMSG_SPACE(sizeof(int))]{};
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    passed = UniqueFD();
+
+    ssize_t received;
+
+    do {
+        received = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    } while (received < 0 && errno == EINTR);
+
+    if (received <= 0) {
+        return false;
+    }
+
+    for (struct cmsghdr* cmsg{CMSG_FIRSTHDR(&msg)}; cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS && cmsg->cmsg_len >= CMSG_LEN(sizeof(int))) {
+            int received_fd;
+            std::memcpy(&received_fd, CMSG_DATA(cmsg), sizeof(int));
+
+            passed = ResourceFactory::MakeUniqueFD(received_fd);
+        }
+    }
+
+    if ((msg.msg_flags & MSG_CTRUNC) ||
+        !RecvAll(fd, header + received, sizeof(header) - static_cast<size_t>(received))) {
+        return false;
+    }
+
+    uint32_t net_size;
+    std::memcpy(&net_size, header + 1, sizeof(net_size));
+
+    uint32_t size{be32toh(net_size)};
+
+    if (size > Limit::MAX_PAYLOAD_SIZE) {
+        return false;
+    }
+
+    type = header[0];
+    payload.resize(size);
+
+    return RecvAll(fd, payload.data(), payload.size());
+}
+
+std::vector<uint8_t> HandoffChannel::EncodeSession(const SessionState& state) {
+    std::vector<uint8_t> out;
+    out.reserve(128 + state.unsent.size() + state.unparsed.size());
+
+    Put(out, state.addr);
+    Put(out, htobe16(state.port));
+    Put(out, htobe16(state.protocol));
+    PutBytes(out, state.hostname.data(), static_cast<uint32_t>(state.hostname.size()));
+    PutBytes(out, state.username.data(), static_cast<uint32_t>(state.username.size()));
+    Put(out, htobe64(state.frame_seq));
+    Put(out, htobe64(state.credit_frames));
+    Put(out, htobe64(state.credit_bytes));
+    Put(out, htobe64(state.received_frames));
+    Put(out, htobe64(state.received_bytes));
+    Put(out, htobe32(state.capture_slot));
+    Put(out, static_cast<uint8_t>(state.is_relay ? 1 : 0));
+    PutBytes(out, state.unsent.data(), static_cast<uint32_t>(state.unsent.size()));
+    PutBytes(out, state.unparsed.data(), static_cast<uint32_t>(state.unparsed.size()));
+
+    return out;
+}
+
+bool HandoffChannel::DecodeSession(const std::vector<uint8_t>& payload, SessionState& state) {
+    Reader reader(payload);
+    uint8_t is_relay{0};
+
+    if (!reader.Get(state.addr) || !reader.Get(state.port) || !reader.Get(state.protocol) ||
+        !reader.GetBytes(state.hostname) || !reader.GetBytes(state.username) ||
+        !reader.Get(state.frame_seq) || !reader.Get(state.credit_frames) || !reader.Get(state.credit_bytes) ||
+        !reader.Get(state.received_frames) || !reader.Get(state.received_bytes) ||
+        !reader.Get(state.capture_slot) || !reader.Get(is_relay) ||
+        !reader.GetBytes(state.unsent) || !reader.GetBytes(state.unparsed) || !reader.AtEnd()) {
+        return false;
+    }
+
+    state.port = be16toh(state.port);
+    state.protocol = be16toh(state.protocol);
+    state.frame_seq = be64toh(state.frame_seq);
+    state.credit_frames = be64toh(state.credit_frames);
+    state.credit_bytes = be64toh(state.credit_bytes);
+    state.received_frames = be64toh(state.received_frames);
+    state.received_bytes = be64toh(state.received_bytes);
+    state.capture_slot = be32toh(state.capture_slot);
+    state.is_relay = is_relay != 0;
+
+    return true;
+}
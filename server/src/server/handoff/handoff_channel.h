@@ -0,0 +1,84 @@
+#ifndef SERVER_SERVER_HANDOFF_HANDOFF_CHANNEL_H
+#define SERVER_SERVER_HANDOFF_HANDOFF_CHANNEL_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "session.h"
+#include "resource_factory.h"
+
+/**
+ * @brief Канал передачи сокетов и состояния между старым и новым процессом сервера
+ *
+ * Старый процесс слушает Unix-сокет по пути --handoff. Новый процесс при
+ * запуске подключается к нему и первым отправляет запись 'R' (без данных):
+ * пока она не пришла, старый ничего не останавливает. Затем старый передает
+ * по соединению записи [1 байт: тип][4 байта: длина][данные], к записи может
+ * быть приложен дескриптор (SCM_RIGHTS):
+ * - 'L' - серверный сокет (без данных);
+ * - 'S' - сокет клиента и состояние его сессии (см. EncodeSession());
+ * - 'E' - конец передачи, данные - состояние хранилища (см. FrameStorage::SaveHandoffState()).
+ *
+ * Соединение блокирующее: оба процесса на время передачи не обслуживают клиентов.
+ */
+class HandoffChannel {
+public:
+    static constexpr uint8_t RECORD_READY{'R'};      ///< Новый процесс жив и готов принимать (от нового к старому)
+    static constexpr uint8_t RECORD_LISTENER{'L'};   ///< Серверный сокет
+    static constexpr uint8_t RECORD_SESSION{'S'};    ///< Сокет и состояние сессии
+    static constexpr uint8_t RECORD_END{'E'};        ///< Конец передачи и состояние хранилища
+
+    /**
+     * @brief Начать прием подключений нового процесса
+     * @param path Путь к Unix-сокету (оставшийся от прошлого запуска файл удаляется)
+     * @return Неблокирующий слушающий сокет
+     * @throw std::runtime_error При ошибках socket/bind/listen
+     */
+    static UniqueFD Listen(const std::string& path);
+
+    /**
+     * @brief Подключиться к старому процессу
+     * @param path Путь к Unix-сокету
+     * @param timeout_ms Таймаут каждой операции чтения
+     * @return Сокет или невалидный UniqueFD, если старого процесса нет
+     */
+    static UniqueFD Connect(const std::string& path, unsigned timeout_ms);
+
+    /**
+     * @brief Отправить запись
+     * @param fd Сокет канала
+     * @param type Тип записи
+     * @param payload Данные
+     * @param pass_fd Передаваемый дескриптор (-1 - без дескриптора)
+     * @return true если запись отправлена целиком, иначе errno содержит причину
+     */
+    static bool Send(int fd, uint8_t type, const std::vector<uint8_t>& payload, int pass_fd = -1);
+
+    /**
+     * @brief Принять запись
+     * @param fd Сокет канала
+     * @param[out] type Тип записи
+     * @param[out] payload Данные
+     * @param[out] passed Переданный дескриптор (невалидный, если его нет)
+     * @return false при разрыве, таймауте или ошибке разметки
+     */
+    static bool Receive(int fd, uint8_t& type, std::vector<uint8_t>& payload, UniqueFD& passed);
+
+    /**
+     * @brief Упаковать состояние сессии
+     * @param state Состояние
+     * @return Данные записи 'S'
+     */
+    static std::vector<uint8_t> EncodeSession(const SessionState& state);
+
+    /**
+     * @brief Распаковать состояние сессии
+     * @param payload Данные записи 'S'
+     * @param[out] state Состояние
+     * @return false при ошибке разметки
+     */
+    static bool DecodeSession(const std::vector<uint8_t>& payload, SessionState& state);
+};
+
+#endif // SERVER_SERVER_HANDOFF_HANDOFF_CHANNEL_H
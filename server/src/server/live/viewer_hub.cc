@@ -0,0 +1,445 @@
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#include <endian.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/uio.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+
+#include "metrics.h"
+#include "viewer_hub.h"
+
+namespace Limit {
+constexpr int MAX_EVENTS{256};
+constexpr size_t DRAIN_BUFFER_SIZE{4096};
+}
+
+namespace {
+Metrics::Gauge& viewers_active{Metrics::MetricsRegistry::Global().AddGauge(
+    "server_viewers_active", "Connected live viewers")};
+Metrics::Counter& viewer_frames_sent{Metrics::MetricsRegistry::Global().AddCounter(
+    "server_viewer_frames_sent_total", "Live frames fully sent to viewers")};
+Metrics::Counter& viewer_frames_skipped{Metrics::MetricsRegistry::Global().AddCounter(
+    "server_viewer_frames_skipped_total", "Live frames replaced by a newer one before a slow viewer got them")};
+
+void PutUint16(std::vector<uint8_t>& out, uint16_t value) {
+    value = htons(value);
+    out.insert(out.end(), reinterpret_cast<uint8_t*>(&value), reinterpret_cast<uint8_t*>(&value) + sizeof(value));
+}
+
+void PutUint32(std::vector<uint8_t>& out, uint32_t value) {
+    value = htonl(value);
+    out.insert(out.end(), reinterpret_cast<uint8_t*>(&value), reinterpret_cast<uint8_t*>(&value) + sizeof(value));
+}
+
+void PutUint64(std::vector<uint8_t>& out, uint64_t value) {
+    value = htobe64(value);
+    out.insert(out.end(), reinterpret_cast<uint8_t*>(&value), reinterpret_cast<uint8_t*>(&value) + sizeof(value));
+}
+}
+
+ViewerHub::~ViewerHub() {
+    if (_worker.joinable()) {
+        uint64_t one{1};
+
+        while (write(_stop_fd.Get(), &one, sizeof(one)) == -1 && errno == EINTR) {}
+
+        _worker.join();
+    }
+}
+
+void ViewerHub::Start() {
+    _epoll_fd = UniqueFD(ResourceFactory::MakeUniqueFD(epoll_create1(EPOLL_CLOEXEC)));
+    _wake_fd = UniqueFD(ResourceFactory::MakeUniqueFD(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)));
+    _stop_fd = UniqueFD(ResourceFactory::MakeUniqueFD(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)));
+
+    if (!_epoll_fd.Valid() || !_wake_fd.Valid() || !_stop_fd.Valid()) {
+        throw std::runtime_error("viewer hub epoll/eventfd: " + std::string(strerror(errno)));
+    }
+
+    for (int fd : {_wake_fd.Get(), _stop_fd.Get()}) {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+
+        if (epoll_ctl(_epoll_fd.Get(), EPOLL_CTL_ADD, fd, &event) == -1) {
+            throw std::runtime_error("viewer hub epoll_ctl(): " + std::string(strerror(errno)));
+        }
+    }
+
+    _worker = std::thread(&ViewerHub::EventLoop, this);
+}
+
+void ViewerHub::Wake() {
+    uint64_t one{1};
+
+    while (write(_wake_fd.Get(), &one, sizeof(one)) == -1 && errno == EINTR) {}
+}
+
+void ViewerHub::Attach(UniqueFD&& fd, const std::string& hostname, const std::string& address, std::vector<uint8_t> unsent) {
+    auto viewer{std::make_unique<Viewer>()};
+    viewer->fd = std::move(fd);
+    viewer->hostname = hostname;
+    viewer->address = address;
+    viewer->prefix = std::move(unsent);
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        Channel& channel{_channels[hostname]};
+
+        if (channel.viewers++ == 0) {
+            ++_channel_count;
+        }
+
+        // Новый зритель сразу получает последний кадр, если он есть
+        viewer->pending = channel.latest;
+
+        _incoming.push_back(std::move(viewer));
+    }
+
+    Wake();
+}
+
+void ViewerHub::Publish(const std::string& hostname, const std::string& username, uint64_t timestamp_ms, const FrameBuffer& data) {
+    if (_channel_count.load(std::memory_order_relaxed) == 0) {
+        return;
+    }
+
+    bool wake{false};
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        auto it{_channels.find(hostname)};
+
+        if (it == _channels.end()) {
+            return;
+        }
+
+        auto frame{std::make_shared<LiveFrame>()};
+        frame->header.reserve(sizeof(uint8_t) + sizeof(uint32_t) + sizeof(uint64_t) + sizeof(uint16_t) + username.size());
+        frame->header.push_back('L');
+        PutUint32(frame->header, static_cast<uint32_t>(sizeof(uint64_t) + sizeof(uint16_t) + username.size() + data->size()));
+        PutUint64(frame->header, timestamp_ms);
+        PutUint16(frame->header, static_cast<uint16_t>(username.size()));
+        frame->header.insert(frame->header.end(), username.begin(), username.end());
+        frame->data = data;
+
+        it->second.latest = std::move(frame);
+        ++it->second.version;
+
+        // Пока поток хаба не забрал предыдущие кадры, будить его повторно не нужно
+        wake = _dirty.empty();
+        _dirty.insert(hostname);
+    }
+
+    if (wake) {
+        Wake();
+    }
+}
+
+void ViewerHub::Offer(Viewer& viewer, const std::shared_ptr<const LiveFrame>& frame) {
+    if (viewer.current == frame || viewer.pending == frame) {
+        return;
+    }
+
+    if (viewer.pending) {
+        ++viewer.skipped;
+        viewer_frames_skipped.Inc();
+    }
+
+    viewer.pending = frame;
+}
+
+void ViewerHub::HandleWake() {
+    uint64_t counter{};
+
+    while (read(_wake_fd.Get(), &counter, sizeof(counter)) == -1 && errno == EINTR) {}
+
+    std::vector<std::unique_ptr<Viewer>> incoming;
+    std::vector<std::pair<std::string, Channel>> updates;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        incoming.swap(_incoming);
+
+        for (const auto& hostname : _dirty) {
+            auto it{_channels.find(hostname)};
+
+            if (it != _channels.end()) {
+                updates.emplace_back(hostname, it->second);
+            }
+        }
+
+        _dirty.clear();
+    }
+
+    std::vector<int> to_flush;
+
+    for (auto& viewer : incoming) {
+        int fd{viewer->fd.Get()};
+
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.fd = fd;
+
+        _subscribers[viewer->hostname].fds.push_back(fd);
+        _viewers[fd] = std::move(viewer);
+        viewers_active.Add(1);
+
+        if (epoll_ctl(_epoll_fd.Get(), EPOLL_CTL_ADD, fd, &event) == -1) {
+            static LogRateLimit rate{10};
+
+            _logger.PrintInTerminal(MessageType::K_WARNING, "viewer hub epoll_ctl() error: " + std::string(strerror(errno)), rate);
+
+            CloseViewer(fd);
+
+            continue;
+        }
+
+        static LogRateLimit rate{50};
+
+        _logger.PrintInTerminal(
+            MessageType::K_INFO,
+            "Viewer subscribed to " + _viewers[fd]->hostname + " (client: " + _viewers[fd]->address + ")",
+            rate
+        );
+
+        to_flush.push_back(fd);
+    }
+
+    for (const auto& [hostname, channel] : updates) {
+        auto it{_subscribers.find(hostname)};
+
+        if (it == _subscribers.end() || it->second.version == channel.version) {
+            continue;
+        }
+
+        it->second.version = channel.version;
+
+        for (int fd : it->second.fds) {
+            Viewer& viewer{*_viewers[fd]};
+
+            Offer(viewer, channel.latest);
+
+            if (!viewer.blocked) {
+                to_flush.push_back(fd);
+            }
+        }
+    }
+
+    // Закрытие меняет списки подписчиков, поэтому отправка - отдельным проходом
+    for (int fd : to_flush) {
+        auto it{_viewers.find(fd)};
+
+        if (it != _viewers.end() && !Flush(*it->second)) {
+            CloseViewer(fd);
+        }
+    }
+}
+
+bool ViewerHub::Flush(Viewer& viewer) {
+    while (true) {
+        if (!viewer.current && viewer.pending) {
+            viewer.current = std::move(viewer.pending);
+            viewer.pending.reset();
+            viewer.sent = 0;
+        }
+
+        if (!viewer.current && viewer.prefix.empty()) {
+            return true;
+        }
+
+        // Недоотправленные ответы основного протокола уходят раньше первого кадра
+        iovec iov[3];
+        size_t count{0};
+
+        if (!viewer.prefix.empty()) {
+            iov[count++] = {viewer.prefix.data(), viewer.prefix.size()};
+        }
+
+        if (viewer.current) {
+            const std::vector<uint8_t>& header{viewer.current->header};
+            const std::vector<uint8_t>& data{*viewer.current->data};
+
+            if (viewer.sent < header.size()) {
+                iov[count++] = {const_cast<uint8_t*>(header.data()) + viewer.sent, header.size() - viewer.sent};
+            }
+
+            size_t data_sent{viewer.sent > header.size() ? viewer.sent - header.size() : 0};
+
+            iov[count++] = {const_cast<uint8_t*>(data.data()) + data_sent, data.size() - data_sent};
+        }
+
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+
+        ssize_t n{sendmsg(viewer.fd.Get(), &msg, MSG_NOSIGNAL)};
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                viewer.blocked = true;
+
+                return true;
+            }
+
+            return false;
+        }
+
+        size_t written{static_cast<size_t>(n)};
+        size_t from_prefix{std::min(written, viewer.prefix.size())};
+
+        viewer.prefix.erase(viewer.prefix.begin(), viewer.prefix.begin() + from_prefix);
+        written -= from_prefix;
+
+        if (!viewer.current) {
+            continue;
+        }
+
+        viewer.sent += written;
+
+        if (viewer.sent == viewer.current->header.size() + viewer.current->data->size()) {
+            viewer.current.reset();
+            ++viewer.frames;
+            viewer_frames_sent.Inc();
+        }
+    }
+}
+
+bool ViewerHub::Drain(Viewer& viewer) {
+    uint8_t buffer[Limit::DRAIN_BUFFER_SIZE];
+
+    while (true) {
+        ssize_t n{recv(viewer.fd.Get(), buffer, sizeof(buffer), 0)};
+
+        if (n > 0) {
+            continue;
+        }
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+
+        return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    }
+}
+
+void ViewerHub::CloseViewer(int fd) {
+    auto it{_viewers.find(fd)};
+
+    if (it == _viewers.end()) {
+        return;
+    }
+
+    const Viewer& viewer{*it->second};
+
+    viewers_active.Add(-1);
+
+    auto subs{_subscribers.find(viewer.hostname)};
+
+    if (subs != _subscribers.end()) {
+        auto& fds{subs->second.fds};
+
+        fds.erase(std::remove(fds.begin(), fds.end(), fd), fds.end());
+
+        if (fds.empty()) {
+            _subscribers.erase(subs);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        auto channel{_channels.find(viewer.hostname)};
+
+        if (channel != _channels.end() && --channel->second.viewers == 0) {
+            _channels.erase(channel);
+            --_channel_count;
+        }
+    }
+
+    static LogRateLimit rate{50};
+
+    _logger.PrintInTerminal(
+        MessageType::K_INFO,
+        "Viewer left " + viewer.hostname + " (client: " + viewer.address + "), frames sent: " +
+        std::to_string(viewer.frames) + ", skipped: " + std::to_string(viewer.skipped),
+        rate
+    );
+
+    epoll_ctl(_epoll_fd.Get(), EPOLL_CTL_DEL, fd, nullptr);
+
+    _viewers.erase(it);
+}
+
+void ViewerHub::EventLoop() {
+    epoll_event events[Limit::MAX_EVENTS];
+
+    while (true) {
+        int n{epoll_wait(_epoll_fd.Get(), events, Limit::MAX_EVENTS, -1)};
+
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            _logger.PrintInTerminal(MessageType::K_ERROR, "viewer hub epoll_wait() error: " + std::string(strerror(errno)));
+
+            return;
+        }
+
+        for (int i{0}; i < n; ++i) {
+            int fd{events[i].data.fd};
+
+            if (fd == _stop_fd.Get()) {
+                return;
+            }
+
+            if (fd == _wake_fd.Get()) {
+                HandleWake();
+
+                continue;
+            }
+
+            auto it{_viewers.find(fd)};
+
+            if (it == _viewers.end()) {
+                continue;
+            }
+
+            Viewer& viewer{*it->second};
+
+            if (events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
+                CloseViewer(fd);
+
+                continue;
+            }
+
+            if ((events[i].events & EPOLLIN) && !Drain(viewer)) {
+                CloseViewer(fd);
+
+                continue;
+            }
+
+            if (events[i].events & EPOLLOUT) {
+                viewer.blocked = false;
+
+                if (!Flush(viewer)) {
+                    CloseViewer(fd);
+                }
+            }
+        }
+    }
+}
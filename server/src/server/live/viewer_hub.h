@@ -0,0 +1,177 @@
+#ifndef SERVER_SERVER_LIVE_VIEWER_HUB_H
+#define SERVER_SERVER_LIVE_VIEWER_HUB_H
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "logger.h"
+#include "frame_storage.h"
+#include "resource_factory.h"
+
+/**
+ * @brief Кадр для живых зрителей
+ *
+ * Заголовок сообщения 'L' строится один раз на кадр; данные - тот же буфер,
+ * что ушел в поток записи. Все зрители хоста держат ссылку на один объект.
+ */
+struct LiveFrame {
+    std::vector<uint8_t> header; ///< Заголовок сообщения 'L' (тип, размер, время, имя пользователя)
+    FrameBuffer data;            ///< Данные кадра
+};
+
+/**
+ * @brief Рассылка новых кадров живым зрителям
+ *
+ * Зритель - обычное соединение основного порта, которое после аутентификации
+ * подписалось на hostname (сообщение 'S'). Поток событий передает сокет зрителя
+ * сюда (Attach()) и больше его не обслуживает.
+ *
+ * У хаба свой поток со своим epoll, поэтому отправка сотням зрителей не задерживает
+ * прием кадров: Publish() из потока событий только заменяет последний кадр канала
+ * и будит поток хаба. Каждый зритель отправляет не больше одного кадра за раз; если
+ * пока он отправлял, пришло несколько кадров, он получит только самый новый
+ * (промежуточные пропускаются, очередь не растет).
+ */
+class ViewerHub {
+public:
+    /**
+     * @brief Конструктор
+     */
+    ViewerHub() = default;
+
+    /**
+     * @brief Деструктор - останавливает поток и закрывает соединения зрителей
+     */
+    ~ViewerHub();
+
+    ViewerHub(const ViewerHub&) = delete;
+    ViewerHub& operator=(const ViewerHub&) = delete;
+
+public:
+    /**
+     * @brief Запустить поток рассылки
+     * @throw std::runtime_error При ошибке создания epoll или eventfd
+     */
+    void Start();
+
+    /**
+     * @brief Передать соединение зрителя хабу (вызывается из потока событий)
+     * @param fd Сокет зрителя (неблокирующий, уже удален из epoll потока событий)
+     * @param hostname Хост, на который подписан зритель
+     * @param address Адрес зрителя для логов
+     * @param unsent Недоотправленные байты основного протокола (ответы 'Y' и т.п.)
+     */
+    void Attach(UniqueFD&& fd, const std::string& hostname, const std::string& address, std::vector<uint8_t> unsent);
+
+    /**
+     * @brief Опубликовать новый кадр хоста (вызывается из потока событий)
+     * @param hostname Имя хоста
+     * @param username Имя пользователя
+     * @param timestamp_ms Время получения кадра
+     * @param data Данные кадра
+     *
+     * Если на хост никто не подписан, ничего не делает.
+     */
+    void Publish(const std::string& hostname, const std::string& username, uint64_t timestamp_ms, const FrameBuffer& data);
+
+private:
+    /**
+     * @brief Соединение зрителя (только поток хаба)
+     */
+    struct Viewer {
+        UniqueFD fd;                              ///< Сокет
+        std::string hostname;                     ///< Хост подписки
+        std::string address;                      ///< Адрес для логов
+        std::vector<uint8_t> prefix;              ///< Байты основного протокола перед первым кадром
+        std::shared_ptr<const LiveFrame> current; ///< Отправляемый кадр
+        size_t sent{0};                           ///< Отправлено байт текущего кадра
+        std::shared_ptr<const LiveFrame> pending; ///< Самый новый кадр, ждущий отправки
+        bool blocked{false};                      ///< Сокет переполнен: ждем EPOLLOUT
+        uint64_t frames{0};                       ///< Отправлено кадров
+        uint64_t skipped{0};                      ///< Пропущено кадров (зритель не успевал)
+    };
+
+    /**
+     * @brief Канал хоста (общий с потоком событий, под _mutex)
+     */
+    struct Channel {
+        std::shared_ptr<const LiveFrame> latest; ///< Последний кадр
+        uint64_t version{0};                     ///< Номер последнего кадра
+        size_t viewers{0};                       ///< Число подписанных зрителей
+    };
+
+    /**
+     * @brief Зрители хоста (только поток хаба)
+     */
+    struct Subscribers {
+        std::vector<int> fds; ///< Сокеты зрителей
+        uint64_t version{0};  ///< Номер последнего разосланного кадра
+    };
+
+    /// Основной цикл потока
+    void EventLoop();
+
+    /**
+     * @brief Забрать новых зрителей и новые кадры
+     */
+    void HandleWake();
+
+    /**
+     * @brief Поставить кадр зрителю, вытеснив ждущий
+     * @param viewer Зритель
+     * @param frame Кадр
+     */
+    void Offer(Viewer& viewer, const std::shared_ptr<const LiveFrame>& frame);
+
+    /**
+     * @brief Отправлять кадры, пока сокет принимает данные
+     * @param viewer Зритель
+     * @return false если соединение нужно закрыть
+     */
+    bool Flush(Viewer& viewer);
+
+    /**
+     * @brief Прочитать и отбросить входящие данные зрителя
+     * @param viewer Зритель
+     * @return false если зритель закрыл соединение
+     */
+    bool Drain(Viewer& viewer);
+
+    /**
+     * @brief Закрыть соединение зрителя
+     * @param fd Сокет зрителя
+     */
+    void CloseViewer(int fd);
+
+    /**
+     * @brief Разбудить поток хаба
+     */
+    void Wake();
+
+private:
+    UniqueFD _epoll_fd;                                        ///< Дескриптор epoll
+    UniqueFD _wake_fd;                                         ///< eventfd: новые зрители или кадры
+    UniqueFD _stop_fd;                                         ///< eventfd остановки
+
+    std::mutex _mutex;                                         ///< Защищает поля ниже
+    std::unordered_map<std::string, Channel> _channels;        ///< Каналы хостов с зрителями
+    std::unordered_set<std::string> _dirty;                    ///< Хосты с неразосланными кадрами
+    std::vector<std::unique_ptr<Viewer>> _incoming;            ///< Переданные, но еще не принятые зрители
+    std::atomic<size_t> _channel_count{0};                     ///< Число каналов (проверка без блокировки)
+
+    std::unordered_map<int, std::unique_ptr<Viewer>> _viewers; ///< Зрители по сокету (только поток хаба)
+    std::unordered_map<std::string, Subscribers> _subscribers; ///< Зрители по хосту (только поток хаба)
+
+    std::thread _worker;                                       ///< Поток рассылки
+
+    Logger _logger;                                            ///< Логгер
+};
+
+#endif // SERVER_SERVER_LIVE_VIEWER_HUB_H
@@ -0,0 +1,715 @@
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#include <endian.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+
+#include "session.h"
+#include "query_server.h"
+#include "frame_archive.h"
+
+namespace Limit {
+constexpr size_t MAX_REQUEST_SIZE{4096};
+constexpr size_t MAX_FRAMES_PER_REQUEST{100000};
+constexpr size_t MAX_QUEUED_RESPONSES{4}; // найденных кадров в очереди - до 4 * MAX_FRAMES_PER_REQUEST
+constexpr size_t SEND_BUDGET_PER_TURN{1024 * 1024}; // 1 Mb
+constexpr int MAX_EVENTS{64};
+constexpr size_t ARCHIVE_DECODERS{2}; // потоков восстановления кадров из архивов
+}
+
+namespace {
+void PutUint32(std::vector<uint8_t>& out, uint32_t value) {
+    value = htonl(value);
+    out.insert(out.end(), reinterpret_cast<uint8_t*>(&value), reinterpret_cast<uint8_t*>(&value) + sizeof(value));
+}
+
+void PutUint64(std::vector<uint8_t>& out, uint64_t value) {
+    value = htobe64(value);
+    out.insert(out.end(), reinterpret_cast<uint8_t*>(&value), reinterpret_cast<uint8_t*>(&value) + sizeof(value));
+}
+
+/**
+ * @brief Последовательное чтение полей запроса с проверкой границ
+ */
+class RequestReader {
+public:
+    RequestReader(const uint8_t* data, size_t size) :
+        _data(data),
+        _size(size)
+    {}
+
+    bool ReadUint16(uint16_t& value) {
+        return Read(&value, sizeof(value)) && (value = ntohs(value), true);
+    }
+
+    bool ReadUint32(uint32_t& value) {
+        return Read(&value, sizeof(value)) && (value = ntohl(value), true);
+    }
+
+    bool ReadUint64(uint64_t& value) {
+        return Read(&value, sizeof(value)) && (value = be64toh(value), true);
+    }
+
+    bool ReadString(std::string& value) {
+        uint16_t len{};
+
+        if (!ReadUint16(len) || _size - _pos < len) {
+            return false;
+        }
+
+        value.assign(reinterpret_cast<const char*>(_data + _pos), len);
+        _pos += len;
+
+        return true;
+    }
+
+    bool AtEnd() const noexcept {
+        return _pos == _size;
+    }
+
+private:
+    bool Read(void* out, size_t len) {
+        if (_size - _pos < len) {
+            return false;
+        }
+
+        std::memcpy(out, _data + _pos, len);
+        _pos += len;
+
+        return true;
+    }
+
+private:
+    const uint8_t* _data;
+    size_t _size;
+    size_t _pos{0};
+};
+}
+
+QueryServer::QueryServer(uint16_t port, FrameIndex& index, HotFrameCache* cache) :
+    _port(port),
+    _index(index),
+    _cache(cache)
+{}
+
+QueryServer::~QueryServer() {
+    if (_worker.joinable()) {
+        uint64_t one{1};
+
+        while (write(_stop_fd.Get(), &one, sizeof(one)) == -1 && errno == EINTR) {}
+
+        _worker.join();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_decode_mutex);
+        _decode_stop = true;
+    }
+
+    _has_decode.notify_all();
+
+    for (auto& decoder : _decoders) {
+        decoder.join();
+    }
+}
+
+void QueryServer::Start() {
+    _listen_fd = UniqueFD(ResourceFactory::MakeUniqueFD(socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)));
+
+    if (!_listen_fd.Valid()) {
+        throw std::runtime_error("query socket(): " + std::string(strerror(errno)));
+    }
+
+    int opt{1};
+    setsockopt(_listen_fd.Get(), SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(_port);
+
+    if (bind(_listen_fd.Get(), reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == -1) {
+        throw std::runtime_error("query bind(): " + std::string(strerror(errno)));
+    }
+
+    if (listen(_listen_fd.Get(), SOMAXCONN) == -1) {
+        throw std::runtime_error("query listen(): " + std::string(strerror(errno)));
+    }
+
+    _epoll_fd = UniqueFD(ResourceFactory::MakeUniqueFD(epoll_create1(EPOLL_CLOEXEC)));
+    _stop_fd = UniqueFD(ResourceFactory::MakeUniqueFD(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)));
+    _decoded_fd = UniqueFD(ResourceFactory::MakeUniqueFD(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)));
+
+    if (!_epoll_fd.Valid() || !_stop_fd.Valid() || !_decoded_fd.Valid()) {
+        throw std::runtime_error("query epoll/eventfd: " + std::string(strerror(errno)));
+    }
+
+    for (int fd : {_listen_fd.Get(), _stop_fd.Get(), _decoded_fd.Get()}) {
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLET;
+        event.data.fd = fd;
+
+        if (epoll_ctl(_epoll_fd.Get(), EPOLL_CTL_ADD, fd, &event) == -1) {
+            throw std::runtime_error("query epoll_ctl(): " + std::string(strerror(errno)));
+        }
+    }
+
+    for (size_t i{0}; i < Limit::ARCHIVE_DECODERS; ++i) {
+        _decoders.emplace_back(&QueryServer::DecodeLoop, this);
+    }
+
+    _worker = std::thread(&QueryServer::EventLoop, this);
+
+    _logger.PrintInTerminal(MessageType::K_INFO, "Query port 127.0.0.1:" + std::to_string(_port));
+}
+
+void QueryServer::AcceptConnections() {
+    while (true) {
+        UniqueFD fd(ResourceFactory::MakeUniqueFD(accept4(_listen_fd.Get(), nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)));
+
+        if (!fd.Valid()) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                static LogRateLimit rate{10};
+
+                _logger.PrintInTerminal(MessageType::K_WARNING, "query accept() error: " + std::string(strerror(errno)), rate);
+            }
+
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return;
+        }
+
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.fd = fd.Get();
+
+        if (epoll_ctl(_epoll_fd.Get(), EPOLL_CTL_ADD, fd.Get(), &event) == -1) {
+            static LogRateLimit rate{10};
+
+            _logger.PrintInTerminal(MessageType::K_WARNING, "query epoll_ctl() error: " + std::string(strerror(errno)), rate);
+
+            continue;
+        }
+
+        auto conn{std::make_unique<Connection>()};
+        int key{fd.Get()};
+        conn->id = _next_connection_id++;
+        conn->fd = std::move(fd);
+
+        _connections[key] = std::move(conn);
+    }
+}
+
+void QueryServer::CloseConnection(int fd) {
+    epoll_ctl(_epoll_fd.Get(), EPOLL_CTL_DEL, fd, nullptr);
+
+    _connections.erase(fd);
+
+    if (_cache) {
+        static LogRateLimit rate{10};
+
+        _logger.PrintInTerminal(MessageType::K_INFO, "query: connection closed, " + _cache->Describe(), rate);
+    }
+}
+
+bool QueryServer::HandleRequest(Connection& conn, const uint8_t* payload, size_t size) {
+    RequestReader reader(payload, size);
+
+    std::string hostname;
+    std::string username;
+    uint64_t from_ms{};
+    uint64_t to_ms{};
+    uint32_t max_frames{};
+
+    if (!reader.ReadString(hostname) || !reader.ReadString(username) ||
+        !reader.ReadUint64(from_ms) || !reader.ReadUint64(to_ms) || !reader.ReadUint32(max_frames) || !reader.AtEnd()) {
+        return false;
+    }
+
+    if (!Session::IsValidName(hostname) || !Session::IsValidName(username)) {
+        return false;
+    }
+
+    size_t limit{max_frames == 0 ? Limit::MAX_FRAMES_PER_REQUEST : std::min<size_t>(max_frames, Limit::MAX_FRAMES_PER_REQUEST)};
+
+    Response response;
+    response.client = hostname + "/" + username;
+    response.frames = _index.Lookup(hostname, username, from_ms, to_ms, limit);
+
+    conn.responses.push_back(std::move(response));
+
+    return true;
+}
+
+bool QueryServer::ReadRequests(Connection& conn) {
+    uint8_t buffer[4096];
+
+    conn.read_paused = false;
+
+    for (;;) {
+        if (!ParseRequests(conn)) {
+            return false;
+        }
+
+        // Сокет не читается, пока ответы не уйдут: новые запросы ждут в буфере ядра, а клиент - в TCP-окне
+        if (conn.responses.size() >= Limit::MAX_QUEUED_RESPONSES) {
+            conn.read_paused = true;
+
+            return true;
+        }
+
+        if (conn.inbox.size() > Limit::MAX_REQUEST_SIZE + 5) {
+            return false;
+        }
+
+        if (conn.closing) {
+            return true;
+        }
+
+        ssize_t n{recv(conn.fd.Get(), buffer, sizeof(buffer), 0)};
+
+        if (n > 0) {
+            conn.inbox.insert(conn.inbox.end(), buffer, buffer + n);
+
+            continue;
+        }
+
+        if (n == 0) {
+            // Клиент закрыл свою сторону - дослать ответы на уже полученные запросы
+            conn.closing = true;
+
+            continue;
+        }
+
+        if (errno == EINTR) {
+            continue;
+        }
+
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+}
+
+bool QueryServer::ParseRequests(Connection& conn) {
+    size_t pos{0};
+
+    while (conn.inbox.size() - pos >= 5 && conn.responses.size() < Limit::MAX_QUEUED_RESPONSES) {
+        uint8_t type{conn.inbox[pos]};
+        uint32_t len{};
+        std::memcpy(&len, conn.inbox.data() + pos + 1, sizeof(len));
+        len = ntohl(len);
+
+        if (type != 'R' || len > Limit::MAX_REQUEST_SIZE) {
+            static LogRateLimit rate{10};
+
+            _logger.PrintInTerminal(MessageType::K_WARNING, "query: bad request, closing connection", rate);
+
+            return false;
+        }
+
+        if (conn.inbox.size() - pos - 5 < len) {
+            break;
+        }
+
+        if (!HandleRequest(conn, conn.inbox.data() + pos + 5, len)) {
+            static LogRateLimit rate{10};
+
+            _logger.PrintInTerminal(MessageType::K_WARNING, "query: malformed range request, closing connection", rate);
+
+            return false;
+        }
+
+        pos += 5 + len;
+    }
+
+    conn.inbox.erase(conn.inbox.begin(), conn.inbox.begin() + pos);
+
+    return true;
+}
+
+bool QueryServer::OpenFrameFile(Connection& conn, const IndexedFrame& frame) {
+    if (!conn.file_path || *conn.file_path != *frame.path) {
+        conn.file = UniqueFD(ResourceFactory::MakeUniqueFD(open(frame.path->c_str(), O_RDONLY | O_CLOEXEC)));
+        conn.file_path.reset();
+        conn.file_size = 0;
+
+        if (!conn.file.Valid()) {
+            return false;
+        }
+
+        conn.file_path = frame.path;
+    }
+
+    // Открытый сегмент растет, поэтому размер перепроверяется, если кадр не помещается
+    if (frame.offset + frame.length > conn.file_size) {
+        struct stat st{};
+
+        if (fstat(conn.file.Get(), &st) == -1) {
+            return false;
+        }
+
+        conn.file_size = static_cast<uint64_t>(st.st_size);
+    }
+
+    return frame.offset + frame.length <= conn.file_size;
+}
+
+FrameBuffer QueryServer::LoadArchivedFrame(std::unique_ptr<ArchiveReader>& archive, const IndexedFrame& frame) {
+    try {
+        // Читатель остается открытым: соседние кадры архива восстанавливаются по одной разности
+        if (!archive || archive->GetPath() != *frame.path) {
+            archive.reset();
+            archive = std::make_unique<ArchiveReader>(*frame.path);
+        }
+
+        size_t index{};
+
+        if (!archive->Find(frame.offset, index)) {
+            return nullptr;
+        }
+
+        auto png{std::make_shared<std::vector<uint8_t>>()};
+
+        archive->ReadFrame(index, *png);
+
+        return png;
+    } catch (const std::exception&) {
+        // Архив мог удалить очиститель - как и с пропавшим файлом, кадр просто пропускается
+        archive.reset();
+
+        return nullptr;
+    }
+}
+
+void QueryServer::SubmitDecode(Connection& conn, const IndexedFrame& frame) {
+    DecodeJob job;
+    job.fd = conn.fd.Get();
+    job.connection_id = conn.id;
+    job.frame = frame;
+    job.archive = std::move(conn.archive);
+
+    conn.decoding = true;
+
+    {
+        std::lock_guard<std::mutex> lock(_decode_mutex);
+        _decode_queue.push_back(std::move(job));
+    }
+
+    _has_decode.notify_one();
+}
+
+void QueryServer::DecodeLoop() {
+    for (;;) {
+        DecodeJob job;
+
+        {
+            std::unique_lock<std::mutex> lock(_decode_mutex);
+
+            _has_decode.wait(lock, [&] { return _decode_stop || !_decode_queue.empty(); });
+
+            if (_decode_stop) {
+                return;
+            }
+
+            job = std::move(_decode_queue.front());
+            _decode_queue.pop_front();
+        }
+
+        job.png = LoadArchivedFrame(job.archive, job.frame);
+
+        {
+            std::lock_guard<std::mutex> lock(_decode_mutex);
+            _decoded.push_back(std::move(job));
+        }
+
+        uint64_t one{1};
+
+        while (write(_decoded_fd.Get(), &one, sizeof(one)) == -1 && errno == EINTR) {}
+    }
+}
+
+void QueryServer::CompleteDecodes() {
+    uint64_t count{};
+
+    while (read(_decoded_fd.Get(), &count, sizeof(count)) == -1 && errno == EINTR) {}
+
+    std::deque<DecodeJob> done;
+
+    {
+        std::lock_guard<std::mutex> lock(_decode_mutex);
+        done.swap(_decoded);
+    }
+
+    for (auto& job : done) {
+        auto it{_connections.find(job.fd)};
+
+        // Соединение закрылось, пока кадр восстанавливался
+        if (it == _connections.end() || it->second->id != job.connection_id) {
+            continue;
+        }
+
+        Connection& conn{*it->second};
+
+        conn.archive = std::move(job.archive);
+        conn.body_cached = std::move(job.png);
+        conn.decoding = false;
+        conn.decoded = true;
+
+        if (!conn.scheduled && !Flush(conn)) {
+            CloseConnection(job.fd);
+        }
+    }
+}
+
+bool QueryServer::PrepareNext(Connection& conn) {
+    conn.head.clear();
+    conn.head_sent = 0;
+
+    while (!conn.responses.empty()) {
+        Response& response{conn.responses.front()};
+
+        if (response.next == response.frames.size()) {
+            conn.head.push_back('E');
+            PutUint32(conn.head, 2 * sizeof(uint32_t));
+            PutUint32(conn.head, response.sent);
+            PutUint32(conn.head, response.missing);
+
+            conn.responses.pop_front();
+
+            return true;
+        }
+
+        const IndexedFrame& frame{response.frames[response.next]};
+        uint64_t length{frame.length};
+        FrameCodec codec{frame.codec};
+
+        if (frame.codec == FrameCodec::K_ARCHIVED) {
+            // Кадр восстанавливается в другом потоке: отправка продолжится из CompleteDecodes()
+            if (!conn.decoded) {
+                if (!conn.decoding) {
+                    SubmitDecode(conn, frame);
+                }
+
+                return false;
+            }
+
+            conn.decoded = false;
+            ++response.next;
+
+            if (!conn.body_cached) {
+                ++response.missing;
+
+                continue;
+            }
+
+            length = conn.body_cached->size();
+            codec = FrameCodec::K_PNG;
+        } else {
+            ++response.next;
+
+            if (_cache) {
+                conn.body_cached = _cache->Get(response.client, frame.timestamp_ms, frame.length);
+            }
+
+            if (!conn.body_cached && !OpenFrameFile(conn, frame)) {
+                ++response.missing;
+
+                continue;
+            }
+        }
+
+        conn.head.push_back('F');
+        PutUint32(conn.head, static_cast<uint32_t>(sizeof(uint64_t) + 1 + length));
+        PutUint64(conn.head, frame.timestamp_ms);
+        conn.head.push_back(codec);
+
+        conn.body_offset = static_cast<off_t>(frame.offset);
+        conn.body_left = length;
+
+        ++response.sent;
+
+        return true;
+    }
+
+    return false;
+}
+
+bool QueryServer::Flush(Connection& conn) {
+    size_t budget{Limit::SEND_BUDGET_PER_TURN};
+
+    while (budget > 0) {
+        if (conn.head_sent < conn.head.size()) {
+            int flags{MSG_NOSIGNAL | (conn.body_left > 0 ? MSG_MORE : 0)};
+            ssize_t n{send(conn.fd.Get(), conn.head.data() + conn.head_sent, conn.head.size() - conn.head_sent, flags)};
+
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+
+            conn.head_sent += static_cast<size_t>(n);
+            budget -= std::min(budget, static_cast<size_t>(n));
+
+            continue;
+        }
+
+        if (conn.body_left > 0 && conn.body_cached) {
+            const uint8_t* body{conn.body_cached->data() + conn.body_cached->size() - conn.body_left};
+            size_t chunk{static_cast<size_t>(std::min<uint64_t>(conn.body_left, budget))};
+            ssize_t n{send(conn.fd.Get(), body, chunk, MSG_NOSIGNAL)};
+
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+
+            conn.body_left -= static_cast<uint64_t>(n);
+            budget -= std::min(budget, static_cast<size_t>(n));
+
+            if (conn.body_left == 0) {
+                conn.body_cached.reset();
+            }
+
+            continue;
+        }
+
+        if (conn.body_left > 0) {
+            size_t chunk{static_cast<size_t>(std::min<uint64_t>(conn.body_left, budget))};
+            ssize_t n{sendfile(conn.fd.Get(), conn.file.Get(), &conn.body_offset, chunk)};
+
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+
+            if (n == 0) {
+                // Файл укоротили после проверки: заголовок уже ушел, продолжить поток нельзя
+                static LogRateLimit rate{10};
+
+                _logger.PrintInTerminal(MessageType::K_WARNING, "query: frame file truncated: " + *conn.file_path, rate);
+
+                return false;
+            }
+
+            conn.body_left -= static_cast<uint64_t>(n);
+            budget -= std::min(budget, static_cast<size_t>(n));
+
+            continue;
+        }
+
+        // В очереди ответов освободилось место - дочитать отложенные запросы
+        if (conn.read_paused && conn.responses.size() < Limit::MAX_QUEUED_RESPONSES && !ReadRequests(conn)) {
+            return false;
+        }
+
+        if (!PrepareNext(conn)) {
+            return !conn.closing || conn.decoding;
+        }
+    }
+
+    // Бюджет исчерпан - продолжим на следующем ходу, дав очередь другим соединениям
+    if (!conn.scheduled) {
+        conn.scheduled = true;
+        _ready.push_back(conn.fd.Get());
+    }
+
+    return true;
+}
+
+void QueryServer::EventLoop() {
+    epoll_event events[Limit::MAX_EVENTS];
+
+    while (true) {
+        int n{epoll_wait(_epoll_fd.Get(), events, Limit::MAX_EVENTS, _ready.empty() ? -1 : 0)};
+
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            _logger.PrintInTerminal(MessageType::K_ERROR, "query epoll_wait() error: " + std::string(strerror(errno)));
+
+            return;
+        }
+
+        for (int i{0}; i < n; ++i) {
+            int fd{events[i].data.fd};
+
+            if (fd == _stop_fd.Get()) {
+                return;
+            }
+
+            if (fd == _listen_fd.Get()) {
+                AcceptConnections();
+
+                continue;
+            }
+
+            if (fd == _decoded_fd.Get()) {
+                CompleteDecodes();
+
+                continue;
+            }
+
+            auto it{_connections.find(fd)};
+
+            if (it == _connections.end()) {
+                continue;
+            }
+
+            Connection& conn{*it->second};
+
+            if (events[i].events & EPOLLERR) {
+                CloseConnection(fd);
+
+                continue;
+            }
+
+            if ((events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) && !ReadRequests(conn)) {
+                CloseConnection(fd);
+
+                continue;
+            }
+
+            if (!conn.scheduled && !Flush(conn)) {
+                CloseConnection(fd);
+            }
+        }
+
+        for (size_t count{_ready.size()}; count > 0; --count) {
+            int fd{_ready.front()};
+            _ready.pop_front();
+
+            auto it{_connections.find(fd)};
+
+            if (it == _connections.end() || !it->second->scheduled) {
+                continue;
+            }
+
+            it->second->scheduled = false;
+
+            if (!Flush(*it->second)) {
+                CloseConnection(fd);
+            }
+        }
+    }
+}
@@ -0,0 +1,222 @@
+#ifndef SERVER_SERVER_QUERY_QUERY_SERVER_H
+#define SERVER_SERVER_QUERY_QUERY_SERVER_H
+
+#include <mutex>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+#include <condition_variable>
+
+#include "logger.h"
+#include "frame_index.h"
+#include "frame_archive.h"
+#include "hot_frame_cache.h"
+#include "resource_factory.h"
+
+/**
+ * @brief Сервер выборки сохраненных кадров по времени
+ *
+ * Слушает отдельный порт только на 127.0.0.1 и работает в собственном потоке
+ * со своим epoll, поэтому чтение с диска и отправка не задерживают прием кадров.
+ *
+ * @section query_protocol Протокол (формат сообщений как у основного сервера):
+ * - Запрос 'R': [u16 len][hostname][u16 len][username][u64 from_ms][u64 to_ms][u32 max_frames]
+ *   (max_frames = 0 - без ограничения, сверх внутреннего предела)
+ * - Ответ на каждый найденный кадр 'F': [u64 timestamp_ms][u8 codec][данные кадра]
+ * - Конец ответа 'E': [u32 отправлено кадров][u32 пропущено (удалены очисткой)]
+ *
+ * Запросы одного соединения обслуживаются по очереди; некорректный запрос
+ * закрывает соединение. Очередь ответов соединения ограничена: пока она полна,
+ * следующие запросы не читаются из сокета. Недавние кадры отправляются из кэша горячих кадров
+ * (если он включен), остальные - через sendfile() прямо из файлов хранилища.
+ * Кадры из архивов компактизации восстанавливаются и отправляются в PNG. Это сотни
+ * миллисекунд на кадр, поэтому восстановлением заняты отдельные потоки: соединение
+ * ждет свой кадр, а поток обслуживания тем временем отправляет ответы остальным.
+ */
+class QueryServer {
+public:
+    /**
+     * @brief Конструктор
+     * @param port Порт прослушивания (на 127.0.0.1)
+     * @param index Индекс кадров
+     * @param cache Кэш горячих кадров (может отсутствовать)
+     */
+    QueryServer(uint16_t port, FrameIndex& index, HotFrameCache* cache);
+
+    /**
+     * @brief Деструктор - останавливает поток
+     */
+    ~QueryServer();
+
+    QueryServer(const QueryServer&) = delete;
+    QueryServer& operator=(const QueryServer&) = delete;
+
+public:
+    /**
+     * @brief Открыть порт и запустить поток обслуживания
+     * @throw std::runtime_error При ошибке создания сокета, epoll или eventfd
+     */
+    void Start();
+
+private:
+    /**
+     * @brief Ответ на один запрос
+     */
+    struct Response {
+        std::string client;               ///< Ключ клиента ("hostname/username")
+        std::vector<IndexedFrame> frames; ///< Найденные кадры
+        size_t next{0};                   ///< Следующий кадр к отправке
+        uint32_t sent{0};                 ///< Отправлено кадров
+        uint32_t missing{0};              ///< Пропущено кадров (файл удален)
+    };
+
+    /**
+     * @brief Кадр архива, восстанавливаемый вне потока обслуживания
+     */
+    struct DecodeJob {
+        int fd{-1};                             ///< Сокет соединения
+        uint64_t connection_id{0};              ///< Номер соединения (сокет мог достаться новому)
+        IndexedFrame frame;                     ///< Кадр с кодеком K_ARCHIVED
+        std::unique_ptr<ArchiveReader> archive; ///< Открытый архив соединения (может отсутствовать)
+        FrameBuffer png;                        ///< Восстановленный кадр (пусто - не удалось)
+    };
+
+    /**
+     * @brief Соединение клиента выборки
+     */
+    struct Connection {
+        uint64_t id{0};                               ///< Номер соединения
+        UniqueFD fd;                                  ///< Сокет
+        std::vector<uint8_t> inbox;                   ///< Непрочитанные байты запросов
+        std::deque<Response> responses;               ///< Ответы в порядке запросов
+        std::vector<uint8_t> head;                    ///< Заголовок сообщения к отправке
+        size_t head_sent{0};                          ///< Отправлено байт заголовка
+        UniqueFD file;                                ///< Открытый файл кадров
+        std::shared_ptr<const std::string> file_path; ///< Путь к открытому файлу
+        uint64_t file_size{0};                        ///< Размер открытого файла
+        off_t body_offset{0};                         ///< Текущее смещение данных кадра в файле
+        uint64_t body_left{0};                        ///< Осталось отправить байт данных кадра
+        FrameBuffer body_cached;                      ///< Данные кадра из кэша или архива (тогда файл не читается)
+        std::unique_ptr<ArchiveReader> archive;       ///< Открытый архив компактизации (на время восстановления - у потока)
+        bool decoding{false};                         ///< Кадр из архива восстанавливается: отправка ждет его
+        bool decoded{false};                          ///< Кадр из архива восстановлен в body_cached (пусто - не удалось)
+        bool closing{false};                          ///< Клиент закончил запросы: закрыть после ответов
+        bool read_paused{false};                      ///< Очередь ответов полна: запросы не читаются до ее освобождения
+        bool scheduled{false};                        ///< Стоит в очереди готовых
+    };
+
+    /// Основной цикл потока
+    void EventLoop();
+
+    /// Принять новые соединения
+    void AcceptConnections();
+
+    /**
+     * @brief Прочитать и разобрать запросы
+     *
+     * Если в очереди MAX_QUEUED_RESPONSES ответов, чтение откладывается (read_paused)
+     * и возобновляется из Flush(), когда ответ отправлен целиком.
+     *
+     * @param conn Соединение
+     * @return false если соединение нужно закрыть
+     */
+    bool ReadRequests(Connection& conn);
+
+    /**
+     * @brief Разобрать полученные запросы, пока в очереди ответов есть место
+     * @param conn Соединение
+     * @return false если запрос некорректен
+     */
+    bool ParseRequests(Connection& conn);
+
+    /**
+     * @brief Разобрать запрос 'R' и поставить ответ в очередь
+     * @param conn Соединение
+     * @param payload Данные запроса
+     * @param size Размер данных
+     * @return false если запрос некорректен
+     */
+    bool HandleRequest(Connection& conn, const uint8_t* payload, size_t size);
+
+    /**
+     * @brief Отправлять ответы, пока сокет принимает данные и не исчерпан бюджет
+     * @param conn Соединение
+     * @return false если соединение нужно закрыть
+     */
+    bool Flush(Connection& conn);
+
+    /**
+     * @brief Подготовить заголовок следующего кадра или конца ответа
+     * @param conn Соединение
+     * @return false если отправлять больше нечего
+     */
+    bool PrepareNext(Connection& conn);
+
+    /**
+     * @brief Открыть файл кадра (или оставить уже открытый)
+     * @param conn Соединение
+     * @param frame Кадр
+     * @return true если файл открыт и кадр в нем целиком
+     */
+    bool OpenFrameFile(Connection& conn, const IndexedFrame& frame);
+
+    /**
+     * @brief Отдать кадр из архива на восстановление
+     * @param conn Соединение (его архив переходит к потоку восстановления)
+     * @param frame Кадр с кодеком K_ARCHIVED
+     */
+    void SubmitDecode(Connection& conn, const IndexedFrame& frame);
+
+    /**
+     * @brief Вернуть восстановленные кадры соединениям и продолжить отправку
+     */
+    void CompleteDecodes();
+
+    /// Основной цикл потока восстановления кадров из архивов
+    void DecodeLoop();
+
+    /**
+     * @brief Восстановить кадр из архива компактизации
+     * @param[in,out] archive Открытый архив (открывается или заменяется при необходимости)
+     * @param frame Кадр с кодеком K_ARCHIVED
+     * @return Кадр в PNG или пустой указатель, если восстановить не удалось
+     */
+    static FrameBuffer LoadArchivedFrame(std::unique_ptr<ArchiveReader>& archive, const IndexedFrame& frame);
+
+    /**
+     * @brief Закрыть соединение
+     * @param fd Сокет соединения
+     */
+    void CloseConnection(int fd);
+
+private:
+    uint16_t _port;                                                    ///< Порт прослушивания
+    FrameIndex& _index;                                                ///< Индекс кадров
+    HotFrameCache* _cache;                                             ///< Кэш горячих кадров (может отсутствовать)
+
+    UniqueFD _listen_fd;                                               ///< Слушающий сокет
+    UniqueFD _epoll_fd;                                                ///< Дескриптор epoll
+    UniqueFD _stop_fd;                                                 ///< eventfd остановки
+    UniqueFD _decoded_fd;                                              ///< eventfd: в _decoded появились кадры
+
+    std::unordered_map<int, std::unique_ptr<Connection>> _connections; ///< Соединения по сокету
+    std::deque<int> _ready;                                            ///< Соединения, не исчерпавшие данные за ход
+    uint64_t _next_connection_id{0};                                   ///< Номер следующего соединения
+
+    std::mutex _decode_mutex;                                          ///< Защищает очереди восстановления и _decode_stop
+    std::condition_variable _has_decode;                               ///< Появился кадр на восстановление или остановка
+    std::deque<DecodeJob> _decode_queue;                               ///< Кадры на восстановление (не больше одного на соединение)
+    std::deque<DecodeJob> _decoded;                                    ///< Восстановленные кадры для потока обслуживания
+    bool _decode_stop{false};                                          ///< Флаг остановки потоков восстановления
+
+    std::thread _worker;                                               ///< Поток обслуживания
+    std::vector<std::thread> _decoders;                                ///< Потоки восстановления кадров из архивов
+
+    Logger _logger;                                                    ///< Логгер
+};
+
+#endif // SERVER_SERVER_QUERY_QUERY_SERVER_H
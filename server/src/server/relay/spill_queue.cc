@@ -0,0 +1,241 @@
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <endian.h>
+
+#include "storage_io.h"
+#include "spill_queue.h"
+
+namespace Limit {
+constexpr size_t RECORD_HEADER_SIZE{sizeof(uint32_t)};
+}
+
+namespace fs = std::filesystem;
+
+namespace {
+bool ReadAt(int fd, void* data, size_t size, uint64_t offset) {
+    auto bytes{static_cast<uint8_t*>(data)};
+    size_t done{0};
+
+    while (done < size) {
+        ssize_t n{pread(fd, bytes + done, size - done, static_cast<off_t>(offset + done))};
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (n <= 0) {
+            return false;
+        }
+
+        done += static_cast<size_t>(n);
+    }
+
+    return true;
+}
+}
+
+SpillQueue::SpillQueue(fs::path dir, uint64_t limit) :
+    _dir(std::move(dir)),
+    _limit(limit)
+{
+    std::error_code ec;
+    fs::create_directories(_dir, ec);
+
+    if (ec) {
+        throw std::runtime_error("create_directories(" + _dir.string() + "): " + ec.message());
+    }
+
+    for (const auto& entry : fs::directory_iterator(_dir, ec)) {
+        const fs::path& path{entry.path()};
+        std::error_code entry_ec;
+
+        if (path.extension() != ".spill" || !entry.is_regular_file(entry_ec)) {
+            continue;
+        }
+
+        uint64_t number{0};
+
+        try {
+            number = std::stoull(path.stem().string());
+        } catch (const std::exception&) {
+            continue;
+        }
+
+        uint64_t size{entry.file_size(entry_ec)};
+
+        if (entry_ec || size == 0) {
+            StorageIO::RemoveFile(path.string());
+
+            continue;
+        }
+
+        _segments.push_back(Segment{number, size});
+        _bytes += size;
+    }
+
+    if (ec) {
+        throw std::runtime_error("directory_iterator(" + _dir.string() + "): " + ec.message());
+    }
+
+    std::sort(_segments.begin(), _segments.end(), [](const Segment& lhs, const Segment& rhs) {
+        return lhs.number < rhs.number;
+    });
+
+    // Хвост прошлого запуска не дописывается: новые записи идут в новый сегмент
+    if (!_segments.empty()) {
+        _next_number = _segments.back().number + 1;
+
+        _logger.PrintInTerminal(MessageType::K_INFO, "Spill queue recovered " + std::to_string(_bytes) + " bytes in " +
+                                std::to_string(_segments.size()) + " segments from " + _dir.string());
+    }
+}
+
+bool SpillQueue::Push(const std::vector<uint8_t>& head, const std::vector<uint8_t>& data) {
+    uint64_t record_size{head.size() + data.size()};
+
+    if (_bytes + Limit::RECORD_HEADER_SIZE + record_size > _limit) {
+        return false;
+    }
+
+    if (_tail_fd.Valid() && _segments.back().size >= SEGMENT_SIZE) {
+        _tail_fd = UniqueFD();
+    }
+
+    if (!_tail_fd.Valid() && !OpenTail()) {
+        return false;
+    }
+
+    Segment& tail{_segments.back()};
+    uint32_t net_size{htobe32(static_cast<uint32_t>(record_size))};
+
+    if (!StorageIO::WriteAll(_tail_fd.Get(), &net_size, sizeof(net_size)) ||
+        !StorageIO::WriteAll(_tail_fd.Get(), head.data(), head.size()) ||
+        !StorageIO::WriteAll(_tail_fd.Get(), data.data(), data.size())) {
+        static LogRateLimit rate{10};
+
+        _logger.PrintInTerminal(MessageType::K_ERROR, "spill write error: " + std::string(strerror(errno)), rate);
+
+        // Оборванная запись остается последней в сегменте: чтение пропустит ее вместе с хвостом
+        off_t end{lseek(_tail_fd.Get(), 0, SEEK_END)};
+
+        if (end > 0 && static_cast<uint64_t>(end) > tail.size) {
+            _bytes += static_cast<uint64_t>(end) - tail.size;
+            tail.size = static_cast<uint64_t>(end);
+        }
+
+        _tail_fd = UniqueFD();
+
+        return false;
+    }
+
+    tail.size += Limit::RECORD_HEADER_SIZE + record_size;
+    _bytes += Limit::RECORD_HEADER_SIZE + record_size;
+
+    return true;
+}
+
+bool SpillQueue::Pop(std::vector<uint8_t>& record) {
+    while (!_segments.empty()) {
+        Segment& head{_segments.front()};
+        uint64_t remaining{head.size - _head_offset};
+
+        if (remaining == 0) {
+            // Дописываемый сегмент удаляется, только когда прочитан целиком
+            if (_segments.size() == 1 && _tail_fd.Valid() && head.size < SEGMENT_SIZE) {
+                return false;
+            }
+
+            DropHead();
+
+            continue;
+        }
+
+        if (!_head_fd.Valid()) {
+            _head_fd = ResourceFactory::MakeUniqueFD(open(SegmentPath(head.number).c_str(), O_RDONLY | O_CLOEXEC));
+        }
+
+        uint32_t net_size{0};
+        bool ok{_head_fd.Valid() && remaining >= Limit::RECORD_HEADER_SIZE &&
+                ReadAt(_head_fd.Get(), &net_size, sizeof(net_size), _head_offset)};
+
+        uint64_t size{be32toh(net_size)};
+
+        if (ok && size <= remaining - Limit::RECORD_HEADER_SIZE) {
+            record.resize(size);
+
+            ok = ReadAt(_head_fd.Get(), record.data(), size, _head_offset + Limit::RECORD_HEADER_SIZE);
+        } else {
+            ok = false;
+        }
+
+        if (!ok) {
+            static LogRateLimit rate{10};
+
+            _logger.PrintInTerminal(MessageType::K_WARNING, "spill segment " + SegmentPath(head.number).string() +
+                                    " is truncated or unreadable, " + std::to_string(remaining) + " bytes skipped", rate);
+
+            _head_offset = head.size;
+            _bytes -= remaining;
+
+            continue;
+        }
+
+        _head_offset += Limit::RECORD_HEADER_SIZE + size;
+        _bytes -= Limit::RECORD_HEADER_SIZE + size;
+
+        return true;
+    }
+
+    return false;
+}
+
+bool SpillQueue::Empty() const noexcept {
+    return _bytes == 0;
+}
+
+uint64_t SpillQueue::GetBytes() const noexcept {
+    return _bytes;
+}
+
+uint64_t SpillQueue::GetLimit() const noexcept {
+    return _limit;
+}
+
+fs::path SpillQueue::SegmentPath(uint64_t number) const {
+    return _dir / (std::to_string(number) + ".spill");
+}
+
+bool SpillQueue::OpenTail() {
+    uint64_t number{_next_number++};
+
+    _tail_fd = ResourceFactory::MakeUniqueFD(open(SegmentPath(number).c_str(), O_WRONLY | O_CREAT | O_EXCL | O_APPEND | O_CLOEXEC, 0644));
+
+    if (!_tail_fd.Valid()) {
+        static LogRateLimit rate{10};
+
+        _logger.PrintInTerminal(MessageType::K_ERROR, "spill open error: " + std::string(strerror(errno)), rate);
+
+        return false;
+    }
+
+    _segments.push_back(Segment{number, 0});
+
+    return true;
+}
+
+void SpillQueue::DropHead() {
+    if (_segments.size() == 1) {
+        _tail_fd = UniqueFD();
+    }
+
+    StorageIO::RemoveFile(SegmentPath(_segments.front().number).string());
+
+    _segments.pop_front();
+    _head_fd = UniqueFD();
+    _head_offset = 0;
+}
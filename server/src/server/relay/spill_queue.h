@@ -0,0 +1,111 @@
+#ifndef SERVER_SERVER_RELAY_SPILL_QUEUE_H
+#define SERVER_SERVER_RELAY_SPILL_QUEUE_H
+
+#include <deque>
+#include <vector>
+#include <cstdint>
+#include <filesystem>
+
+#include "logger.h"
+#include "resource_factory.h"
+
+/**
+ * @brief Очередь записей на диске (FIFO)
+ *
+ * Записи дописываются в конец файла-сегмента ([4 байта: длина][запись]) и
+ * читаются с начала самого старого сегмента. Сегмент удаляется, как только
+ * прочитан целиком, поэтому диск занят только непрочитанными записями.
+ * Сегменты, оставшиеся от прошлого запуска, подхватываются конструктором и
+ * читаются первыми; запись, оборванная при аварийной остановке, пропускается
+ * вместе с хвостом своего сегмента.
+ *
+ * Не синхронизирована: вызывающий защищает очередь своим мьютексом.
+ */
+class SpillQueue {
+public:
+    static constexpr uint64_t SEGMENT_SIZE{64ULL * 1024 * 1024}; ///< Размер сегмента, после которого начинается следующий
+
+    /**
+     * @brief Конструктор
+     * @param dir Каталог сегментов (создается при необходимости)
+     * @param limit Максимальный объем непрочитанных записей на диске
+     * @throw std::runtime_error Если каталог не удалось создать или прочитать
+     */
+    SpillQueue(std::filesystem::path dir, uint64_t limit);
+
+    SpillQueue(const SpillQueue&) = delete;
+    SpillQueue& operator=(const SpillQueue&) = delete;
+
+public:
+    /**
+     * @brief Дописать запись в конец очереди
+     * @param head Начало записи
+     * @param data Продолжение записи (может быть пустым)
+     * @return false если запись не помещается в limit или не удалось записать файл
+     */
+    bool Push(const std::vector<uint8_t>& head, const std::vector<uint8_t>& data);
+
+    /**
+     * @brief Извлечь запись из начала очереди
+     * @param record Буфер для записи (содержимое заменяется)
+     * @return false если очередь пуста
+     */
+    bool Pop(std::vector<uint8_t>& record);
+
+    /**
+     * @brief Проверить пустоту очереди
+     * @return true если непрочитанных записей нет
+     */
+    bool Empty() const noexcept;
+
+    /**
+     * @brief Получить объем непрочитанных записей
+     * @return Байт на диске, включая заголовки записей
+     */
+    uint64_t GetBytes() const noexcept;
+
+    /**
+     * @brief Получить максимальный объем очереди
+     * @return Значение limit из конструктора
+     */
+    uint64_t GetLimit() const noexcept;
+
+private:
+    /// Файл-сегмент очереди
+    struct Segment {
+        uint64_t number{}; ///< Номер сегмента (имя файла)
+        uint64_t size{};   ///< Размер файла
+    };
+
+private:
+    /**
+     * @brief Получить путь к сегменту
+     * @param number Номер сегмента
+     * @return Путь "<dir>/<number>.spill"
+     */
+    std::filesystem::path SegmentPath(uint64_t number) const;
+
+    /**
+     * @brief Начать новый сегмент для записи
+     * @return true при успехе
+     */
+    bool OpenTail();
+
+    /**
+     * @brief Удалить прочитанный головной сегмент
+     */
+    void DropHead();
+
+private:
+    std::filesystem::path _dir;    ///< Каталог сегментов
+    uint64_t _limit;               ///< Максимальный объем непрочитанных записей
+    std::deque<Segment> _segments; ///< Сегменты от старого к новому
+    UniqueFD _head_fd;             ///< Открытый на чтение первый сегмент
+    uint64_t _head_offset{0};      ///< Позиция чтения в первом сегменте
+    UniqueFD _tail_fd;             ///< Открытый на запись последний сегмент (может быть закрыт)
+    uint64_t _bytes{0};            ///< Непрочитанных байт во всех сегментах
+    uint64_t _next_number{1};      ///< Номер следующего сегмента
+    Logger _logger;                ///< Логгер
+};
+
+#endif // SERVER_SERVER_RELAY_SPILL_QUEUE_H
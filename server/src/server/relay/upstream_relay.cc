@@ -0,0 +1,558 @@
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <algorithm>
+
+#include <endian.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "metrics.h"
+#include "upstream_relay.h"
+
+namespace Limit {
+constexpr size_t MAX_MESSAGE_SIZE{1024 * 1024 * 10}; // Как Limit::MAX_MESSAGE_SIZE сервера
+constexpr int HANDSHAKE_TIMEOUT_SEC{5};
+constexpr unsigned USER_TIMEOUT_MS{30000};
+constexpr auto RECONNECT_DELAY{std::chrono::seconds(1)};
+constexpr auto IDLE_WAKEUP{std::chrono::seconds(1)};
+}
+
+namespace {
+Metrics::Counter& frames_forwarded{Metrics::MetricsRegistry::Global().AddCounter(
+    "relay_frames_forwarded_total", "Frames sent to the upstream server")};
+Metrics::Counter& batches_sent{Metrics::MetricsRegistry::Global().AddCounter(
+    "relay_batches_sent_total", "Relay batches sent to the upstream server")};
+Metrics::Counter& frames_spilled{Metrics::MetricsRegistry::Global().AddCounter(
+    "relay_frames_spilled_total", "Frames written to the on-disk relay queue")};
+Metrics::Counter& frames_dropped{Metrics::MetricsRegistry::Global().AddCounter(
+    "relay_frames_dropped_total", "Frames dropped because the relay queue was full")};
+Metrics::Counter& uplink_failures{Metrics::MetricsRegistry::Global().AddCounter(
+    "relay_uplink_failures_total", "Failed upstream connection attempts and lost upstream connections")};
+Metrics::Gauge& uplinks_connected{Metrics::MetricsRegistry::Global().AddGauge(
+    "relay_uplinks_connected", "Open connections to the upstream server")};
+Metrics::Gauge& queue_bytes{Metrics::MetricsRegistry::Global().AddGauge(
+    "relay_queue_bytes", "Frame bytes waiting in the in-memory relay queue")};
+Metrics::Gauge& spill_bytes{Metrics::MetricsRegistry::Global().AddGauge(
+    "relay_spill_bytes", "Bytes waiting in the on-disk relay queue")};
+
+template<typename T>
+void AppendBig(std::vector<uint8_t>& buffer, T value) {
+    if constexpr (sizeof(T) == 2) {
+        value = htobe16(value);
+    } else if constexpr (sizeof(T) == 4) {
+        value = htobe32(value);
+    } else if constexpr (sizeof(T) == 8) {
+        value = htobe64(value);
+    }
+
+    auto bytes{reinterpret_cast<const uint8_t*>(&value)};
+
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+void AppendName(std::vector<uint8_t>& buffer, const std::string& name) {
+    AppendBig(buffer, static_cast<uint16_t>(name.size()));
+
+    buffer.insert(buffer.end(), name.begin(), name.end());
+}
+
+bool SendAll(int fd, const uint8_t* data, size_t size) {
+    size_t total_sent{0};
+
+    while (total_sent < size) {
+        ssize_t sent{send(fd, data + total_sent, size - total_sent, MSG_NOSIGNAL)};
+
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (sent <= 0) {
+            return false;
+        }
+
+        total_sent += static_cast<size_t>(sent);
+    }
+
+    return true;
+}
+
+bool RecvAll(int fd, uint8_t* data, size_t size) {
+    size_t total_received{0};
+
+    while (total_received < size) {
+        ssize_t received{recv(fd, data + total_received, size - total_received, 0)};
+
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (received <= 0) {
+            return false;
+        }
+
+        total_received += static_cast<size_t>(received);
+    }
+
+    return true;
+}
+
+/// Имя хоста, приведенное к правилам Session::IsValidName
+std::string RelayHostname() {
+    char buffer[256]{};
+
+    if (gethostname(buffer, sizeof(buffer) - 1) != 0 || buffer[0] == '\0') {
+        return "relay";
+    }
+
+    std::string hostname(buffer);
+
+    std::replace_if(hostname.begin(), hostname.end(), [](char c) {
+        return !(std::isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '_');
+    }, '-');
+
+    return hostname;
+}
+}
+
+UpstreamRelay::UpstreamRelay(const RelayPolicy& policy, std::filesystem::path spill_dir) :
+    _policy(policy),
+    _hostname(RelayHostname()),
+    _uplink_fds(policy.connections, -1)
+{
+    if (_policy.spill_bytes != 0) {
+        _spill = std::make_unique<SpillQueue>(std::move(spill_dir), _policy.spill_bytes);
+
+        UpdateGauges();
+    }
+}
+
+UpstreamRelay::~UpstreamRelay() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+
+        // Прерывает send(), заблокированный медленным каналом: пачка вернется в очередь
+        for (int fd : _uplink_fds) {
+            if (fd != -1) {
+                shutdown(fd, SHUT_RDWR);
+            }
+        }
+    }
+
+    _wake.notify_all();
+
+    for (auto& uplink : _uplinks) {
+        if (uplink.joinable()) {
+            uplink.join();
+        }
+    }
+
+    // Кадры из памяти встают за кадрами на диске; порядок по времени восстанавливается по timestamp
+    static const std::vector<uint8_t> empty;
+    size_t lost{0};
+
+    for (const RelayFrame& frame : _queue) {
+        if (!_spill || !_spill->Push(frame.head, frame.data ? *frame.data : empty)) {
+            ++lost;
+        }
+    }
+
+    if (lost != 0) {
+        _logger.PrintInTerminal(MessageType::K_WARNING, "Relay stopped with " + std::to_string(lost) + " queued frames lost");
+    }
+}
+
+void UpstreamRelay::Start() {
+    for (size_t i{0}; i < _policy.connections; ++i) {
+        _uplinks.emplace_back(&UpstreamRelay::UplinkLoop, this, i);
+    }
+}
+
+bool UpstreamRelay::Forward(const std::string& hostname, const std::string& username, uint64_t timestamp_ms,
+                            const Protocol::FrameHeader& header, FrameBuffer data) {
+    // Трассировка заканчивается на ретрансляторе: отметки клиента дальше не передаются
+    Protocol::FrameHeader relayed{header};
+    relayed.length = static_cast<uint32_t>(data->size());
+    relayed.flags &= static_cast<uint16_t>(~Protocol::FLAG_TRACE);
+
+    RelayFrame frame;
+    frame.head.reserve(2 * sizeof(uint16_t) + hostname.size() + username.size() + sizeof(uint64_t) + Protocol::FRAME_HEADER_SIZE);
+
+    AppendName(frame.head, hostname);
+    AppendName(frame.head, username);
+    AppendBig(frame.head, timestamp_ms);
+    Protocol::AppendFrameHeader(frame.head, relayed);
+
+    frame.data = std::move(data);
+
+    size_t size{frame.Size()};
+
+    if (Protocol::MESSAGE_HEADER_SIZE + sizeof(uint16_t) + size > Limit::MAX_MESSAGE_SIZE) {
+        static LogRateLimit rate{10};
+
+        frames_dropped.Inc();
+
+        _logger.PrintInTerminal(MessageType::K_WARNING, "frame of " + hostname + "/" + username + " too large to relay, dropped", rate);
+
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        bool spilled{_spill && !_spill->Empty()};
+        bool was_empty{_queue.empty() && !spilled};
+
+        // Пока на диске есть кадры, новые идут за ними, иначе нарушится порядок
+        if (!spilled && _queued_bytes + size <= _policy.memory_bytes) {
+            _queued_bytes += size;
+            _queue.push_back(std::move(frame));
+        } else if (_spill && _spill->Push(frame.head, *frame.data)) {
+            frames_spilled.Inc();
+        } else {
+            static LogRateLimit rate{10};
+
+            frames_dropped.Inc();
+
+            _logger.PrintInTerminal(MessageType::K_WARNING, "relay queue full, frame dropped", rate);
+
+            return false;
+        }
+
+        UpdateGauges();
+
+        if (!was_empty) {
+            return true;
+        }
+    }
+
+    _wake.notify_all();
+
+    return true;
+}
+
+bool UpstreamRelay::IsBacklogged() {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    if (_spill) {
+        return _spill->GetBytes() > _spill->GetLimit() / 4 * 3;
+    }
+
+    return _queued_bytes > _policy.memory_bytes / 4 * 3;
+}
+
+void UpstreamRelay::UplinkLoop(size_t index) {
+    const std::string upstream{_policy.upstream.host + ":" + std::to_string(_policy.upstream.port)};
+    const std::string name{"Relay uplink " + std::to_string(index)};
+
+    while (true) {
+        UniqueFD fd{Connect()};
+
+        if (!fd.Valid()) {
+            uplink_failures.Inc();
+
+            if (!Backoff()) {
+                return;
+            }
+
+            continue;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+
+            if (_stop) {
+                return;
+            }
+
+            _uplink_fds[index] = fd.Get();
+        }
+
+        uplinks_connected.Add(1);
+
+        _logger.PrintInTerminal(MessageType::K_INFO, name + " connected to " + upstream);
+
+        std::vector<RelayFrame> batch;
+
+        while (TakeBatch(batch)) {
+            if (!DrainReplies(fd.Get()) || (!batch.empty() && !SendBatch(fd.Get(), batch))) {
+                Requeue(batch);
+
+                break;
+            }
+
+            if (!batch.empty()) {
+                batches_sent.Inc();
+                frames_forwarded.Inc(batch.size());
+            }
+
+            batch.clear();
+        }
+
+        Requeue(batch);
+
+        bool stopping{false};
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+
+            _uplink_fds[index] = -1;
+            stopping = _stop;
+        }
+
+        uplinks_connected.Add(-1);
+
+        if (stopping) {
+            return;
+        }
+
+        uplink_failures.Inc();
+
+        _logger.PrintInTerminal(MessageType::K_WARNING, name + " lost connection to " + upstream);
+
+        if (!Backoff()) {
+            return;
+        }
+    }
+}
+
+UniqueFD UpstreamRelay::Connect() {
+    static LogRateLimit rate{10};
+
+    UniqueFD fd(ResourceFactory::MakeUniqueFD(socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)));
+
+    if (!fd.Valid()) {
+        _logger.PrintInTerminal(MessageType::K_ERROR, "socket() error: " + std::string(strerror(errno)), rate);
+
+        return UniqueFD();
+    }
+
+    struct timeval timeout{Limit::HANDSHAKE_TIMEOUT_SEC, 0};
+    int one{1};
+    unsigned user_timeout{Limit::USER_TIMEOUT_MS};
+
+    setsockopt(fd.Get(), SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd.Get(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd.Get(), IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setsockopt(fd.Get(), IPPROTO_TCP, TCP_USER_TIMEOUT, &user_timeout, sizeof(user_timeout));
+
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(_policy.upstream.port);
+    inet_pton(AF_INET, _policy.upstream.host.c_str(), &addr.sin_addr);
+
+    if (connect(fd.Get(), reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
+        _logger.PrintInTerminal(MessageType::K_WARNING, "upstream connect() error: " + std::string(strerror(errno)), rate);
+
+        return UniqueFD();
+    }
+
+    static const std::string username{"relay"};
+
+    std::vector<uint8_t> payload;
+    AppendName(payload, _hostname);
+    AppendName(payload, username);
+    AppendBig(payload, Protocol::VERSION_3);
+    AppendBig(payload, Protocol::AUTH_FLAG_RELAY);
+
+    std::vector<uint8_t> request{'A'};
+    AppendBig(request, static_cast<uint32_t>(payload.size()));
+    request.insert(request.end(), payload.begin(), payload.end());
+
+    uint8_t reply[Protocol::MESSAGE_HEADER_SIZE + sizeof(uint16_t)]{};
+
+    if (!SendAll(fd.Get(), request.data(), request.size()) || !RecvAll(fd.Get(), reply, 1)) {
+        _logger.PrintInTerminal(MessageType::K_WARNING, "upstream handshake error: " + std::string(strerror(errno)), rate);
+
+        return UniqueFD();
+    }
+
+    uint16_t version{Protocol::VERSION_1};
+
+    if (reply[0] == 'V' && RecvAll(fd.Get(), reply + 1, sizeof(reply) - 1)) {
+        std::memcpy(&version, reply + Protocol::MESSAGE_HEADER_SIZE, sizeof(version));
+        version = be16toh(version);
+    } else if (reply[0] != 'Y') {
+        _logger.PrintInTerminal(MessageType::K_ERROR, "upstream rejected relay authentication (is this address in its --accept-relays?)", rate);
+
+        return UniqueFD();
+    }
+
+    if (version < Protocol::VERSION_3) {
+        _logger.PrintInTerminal(MessageType::K_ERROR, "upstream does not accept relay batches (protocol v" + std::to_string(version) + ")", rate);
+
+        return UniqueFD();
+    }
+
+    // Медленный канал - нормальный режим: ждем сколько нужно, мертвое соединение обнаружит TCP_USER_TIMEOUT
+    struct timeval no_timeout{};
+
+    setsockopt(fd.Get(), SOL_SOCKET, SO_SNDTIMEO, &no_timeout, sizeof(no_timeout));
+
+    return fd;
+}
+
+bool UpstreamRelay::TakeBatch(std::vector<RelayFrame>& batch) {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    // Просыпаемся и без кадров, чтобы вычитать ответы и заметить закрытое соединение
+    _wake.wait_for(lock, Limit::IDLE_WAKEUP, [&] {
+        return _stop || !_queue.empty() || (_spill && !_spill->Empty());
+    });
+
+    if (_stop) {
+        return false;
+    }
+
+    size_t bytes{Protocol::MESSAGE_HEADER_SIZE + sizeof(uint16_t)};
+
+    while (batch.size() < BATCH_FRAMES && bytes < BATCH_BYTES) {
+        if (_queue.empty()) {
+            std::vector<uint8_t> record;
+
+            if (!_spill || !_spill->Pop(record)) {
+                break;
+            }
+
+            _queued_bytes += record.size();
+            _queue.push_back(RelayFrame{std::move(record), nullptr});
+        }
+
+        size_t size{_queue.front().Size()};
+
+        if (bytes + size > Limit::MAX_MESSAGE_SIZE) {
+            break;
+        }
+
+        bytes += size;
+        _queued_bytes -= size;
+
+        batch.push_back(std::move(_queue.front()));
+        _queue.pop_front();
+    }
+
+    UpdateGauges();
+
+    return true;
+}
+
+void UpstreamRelay::Requeue(std::vector<RelayFrame>& batch) {
+    if (batch.empty()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        for (auto it{batch.rbegin()}; it != batch.rend(); ++it) {
+            _queued_bytes += it->Size();
+            _queue.push_front(std::move(*it));
+        }
+
+        UpdateGauges();
+    }
+
+    batch.clear();
+
+    _wake.notify_all();
+}
+
+bool UpstreamRelay::SendBatch(int fd, const std::vector<RelayFrame>& batch) {
+    size_t payload_size{sizeof(uint16_t)};
+
+    for (const RelayFrame& frame : batch) {
+        payload_size += frame.Size();
+    }
+
+    std::vector<uint8_t> header{'R'};
+    AppendBig(header, static_cast<uint32_t>(payload_size));
+    AppendBig(header, static_cast<uint16_t>(batch.size()));
+
+    // Данные кадров уходят из общих буферов без копирования в сообщение
+    std::vector<struct iovec> iov;
+    iov.reserve(1 + 2 * batch.size());
+    iov.push_back({header.data(), header.size()});
+
+    for (const RelayFrame& frame : batch) {
+        iov.push_back({const_cast<uint8_t*>(frame.head.data()), frame.head.size()});
+
+        if (frame.data && !frame.data->empty()) {
+            iov.push_back({const_cast<uint8_t*>(frame.data->data()), frame.data->size()});
+        }
+    }
+
+    size_t index{0};
+
+    while (index < iov.size()) {
+        struct msghdr msg{};
+        msg.msg_iov = iov.data() + index;
+        msg.msg_iovlen = std::min<size_t>(iov.size() - index, IOV_MAX);
+
+        ssize_t sent{sendmsg(fd, &msg, MSG_NOSIGNAL)};
+
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (sent <= 0) {
+            return false;
+        }
+
+        auto remaining{static_cast<size_t>(sent)};
+
+        while (index < iov.size() && remaining >= iov[index].iov_len) {
+            remaining -= iov[index].iov_len;
+            ++index;
+        }
+
+        if (remaining != 0) {
+            iov[index].iov_base = static_cast<uint8_t*>(iov[index].iov_base) + remaining;
+            iov[index].iov_len -= remaining;
+        }
+    }
+
+    return true;
+}
+
+bool UpstreamRelay::DrainReplies(int fd) {
+    uint8_t buffer[4096];
+
+    while (true) {
+        ssize_t received{recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT)};
+
+        if (received > 0) {
+            continue;
+        }
+
+        if (received == 0) {
+            return false;
+        }
+
+        if (errno == EINTR) {
+            continue;
+        }
+
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+}
+
+bool UpstreamRelay::Backoff() {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    return !_wake.wait_for(lock, Limit::RECONNECT_DELAY, [&] { return _stop; });
+}
+
+void UpstreamRelay::UpdateGauges() noexcept {
+    queue_bytes.Set(static_cast<int64_t>(_queued_bytes));
+
+    if (_spill) {
+        spill_bytes.Set(static_cast<int64_t>(_spill->GetBytes()));
+    }
+}
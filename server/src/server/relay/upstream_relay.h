@@ -0,0 +1,197 @@
+#ifndef SERVER_SERVER_RELAY_UPSTREAM_RELAY_H
+#define SERVER_SERVER_RELAY_UPSTREAM_RELAY_H
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <filesystem>
+#include <condition_variable>
+
+#include "logger.h"
+#include "protocol.h"
+#include "spill_queue.h"
+#include "input_parser.h"
+#include "frame_storage.h"
+
+/**
+ * @brief Параметры ретрансляции кадров на вышестоящий сервер
+ */
+struct RelayPolicy {
+    ServerAddress upstream;                        ///< Вышестоящий сервер (порт 0 - ретрансляция выключена)
+    size_t connections{2};                         ///< Число соединений с вышестоящим сервером
+    uint64_t memory_bytes{64ULL * 1024 * 1024};    ///< Объем очереди в памяти
+    uint64_t spill_bytes{1024ULL * 1024 * 1024};   ///< Объем очереди на диске (0 - без сброса на диск)
+
+    /**
+     * @brief Проверить, включена ли ретрансляция
+     * @return true если задан вышестоящий сервер
+     */
+    bool Enabled() const noexcept {
+        return upstream.port != 0;
+    }
+};
+
+/**
+ * @brief Ретрансляция кадров на вышестоящий сервер
+ *
+ * Сервер филиала принимает клиентов как обычно, но вместо сохранения
+ * передает кадры сюда. Несколько долгоживущих соединений (протокол v3)
+ * забирают кадры из общей очереди пачками 'R', в которых у каждого кадра
+ * свои hostname и username: вышестоящий сервер видит несколько соединений
+ * ретранслятора вместо тысяч клиентских. Пачка набирается из всего, что
+ * накопилось за время отправки предыдущей, поэтому под нагрузкой мелкие
+ * кадры уходят крупными сообщениями без искусственной задержки.
+ *
+ * Очередь в памяти ограничена memory_bytes. Когда канал медленнее приема,
+ * новые кадры дописываются в SpillQueue на диске, а соединения дочитывают
+ * сначала память, затем диск: порядок кадров сохраняется. Когда заполнен и
+ * диск, новые кадры отбрасываются. При остановке очередь в памяти
+ * сбрасывается на диск и уходит после перезапуска.
+ *
+ * Кадр, отправленный в сокет, считается доставленным; пачка, которую не
+ * удалось отправить, возвращается в начало очереди и уходит по другому
+ * соединению (вышестоящий сервер может получить ее часть повторно).
+ *
+ * Forward() вызывается потоком событий и не ждет сети.
+ */
+class UpstreamRelay {
+public:
+    static constexpr size_t BATCH_FRAMES{256};        ///< Максимум кадров в пачке 'R'
+    static constexpr size_t BATCH_BYTES{1024 * 1024}; ///< Объем пачки, после которого она закрывается
+
+    /**
+     * @brief Конструктор
+     * @param policy Параметры ретрансляции
+     * @param spill_dir Каталог очереди на диске
+     * @throw std::runtime_error Если не удалось открыть очередь на диске
+     */
+    UpstreamRelay(const RelayPolicy& policy, std::filesystem::path spill_dir);
+
+    /**
+     * @brief Деструктор - останавливает соединения и сбрасывает очередь в памяти на диск
+     */
+    ~UpstreamRelay();
+
+    UpstreamRelay(const UpstreamRelay&) = delete;
+    UpstreamRelay& operator=(const UpstreamRelay&) = delete;
+
+public:
+    /**
+     * @brief Запустить соединения с вышестоящим сервером
+     */
+    void Start();
+
+    /**
+     * @brief Поставить кадр в очередь на отправку
+     * @param hostname Имя хоста клиента
+     * @param username Имя пользователя клиента
+     * @param timestamp_ms Время получения кадра ретранслятором
+     * @param header Заголовок кадра (для протокола v1 - пустой)
+     * @param data Данные кадра
+     * @return false если кадр отброшен (очередь заполнена)
+     */
+    bool Forward(const std::string& hostname, const std::string& username, uint64_t timestamp_ms,
+                 const Protocol::FrameHeader& header, FrameBuffer data);
+
+    /**
+     * @brief Проверить, почти ли заполнена очередь
+     * @return true если память заполнена, а на диске занято больше 3/4 объема
+     */
+    bool IsBacklogged();
+
+private:
+    /**
+     * @brief Кадр в очереди
+     *
+     * head - запись кадра пачки 'R' без данных, data - данные кадра. Кадр,
+     * прочитанный с диска, целиком лежит в head, а data пуст.
+     */
+    struct RelayFrame {
+        std::vector<uint8_t> head; ///< Начало записи кадра
+        FrameBuffer data;          ///< Данные кадра (может отсутствовать)
+
+        /**
+         * @brief Получить размер записи кадра
+         * @return Байт в пачке 'R'
+         */
+        size_t Size() const noexcept {
+            return head.size() + (data ? data->size() : 0);
+        }
+    };
+
+private:
+    /**
+     * @brief Цикл соединения с вышестоящим сервером
+     * @param index Номер соединения (для логов)
+     */
+    void UplinkLoop(size_t index);
+
+    /**
+     * @brief Подключиться и пройти аутентификацию с версией 3
+     * @return Сокет или невалидный UniqueFD при ошибке
+     */
+    UniqueFD Connect();
+
+    /**
+     * @brief Дождаться кадров и забрать пачку
+     * @param batch Пачка (заполняется)
+     * @return false при остановке
+     */
+    bool TakeBatch(std::vector<RelayFrame>& batch);
+
+    /**
+     * @brief Вернуть неотправленную пачку в начало очереди
+     * @param batch Пачка (данные перемещаются)
+     */
+    void Requeue(std::vector<RelayFrame>& batch);
+
+    /**
+     * @brief Отправить пачку 'R'
+     * @param fd Сокет вышестоящего сервера
+     * @param batch Кадры пачки
+     * @return true если пачка отправлена целиком
+     */
+    bool SendBatch(int fd, const std::vector<RelayFrame>& batch);
+
+    /**
+     * @brief Вычитать ответы вышестоящего сервера без ожидания
+     * @param fd Сокет вышестоящего сервера
+     * @return false если соединение закрыто
+     *
+     * Ретранслятору не нужны ни 'C', ни 'D', ни 'P': управление потоком
+     * обеспечивает TCP, а вычитывание не дает заполниться буферу сервера.
+     */
+    bool DrainReplies(int fd);
+
+    /**
+     * @brief Подождать перед повторным подключением
+     * @return false при остановке
+     */
+    bool Backoff();
+
+    /**
+     * @brief Обновить метрики объема очереди (под _mutex)
+     */
+    void UpdateGauges() noexcept;
+
+private:
+    RelayPolicy _policy;                 ///< Параметры ретрансляции
+    std::string _hostname;               ///< Имя хоста ретранслятора для аутентификации
+
+    std::mutex _mutex;                   ///< Защищает очередь, диск, сокеты и флаг остановки
+    std::condition_variable _wake;       ///< Появились кадры или остановка
+    std::deque<RelayFrame> _queue;       ///< Очередь в памяти (старше очереди на диске)
+    uint64_t _queued_bytes{0};           ///< Объем очереди в памяти
+    std::unique_ptr<SpillQueue> _spill;  ///< Очередь на диске (nullptr при spill_bytes == 0)
+    std::vector<int> _uplink_fds;        ///< Сокеты соединений (-1 - нет соединения)
+    bool _stop{false};                   ///< Флаг остановки
+
+    std::vector<std::thread> _uplinks;   ///< Потоки соединений
+    Logger _logger;                      ///< Логгер
+};
+
+#endif // SERVER_SERVER_RELAY_UPSTREAM_RELAY_H
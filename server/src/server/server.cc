@@ -1,13 +1,40 @@
 #include <atomic>
+#include <chrono>
+#include <algorithm>
 #include <csignal>
 #include <cstring>
 #include <iostream>
 
 #include <fcntl.h>
+#include <unistd.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
 
 #include "server.h"
+#include "metrics.h"
+#include "file_storage.h"
+#include "dedup_storage.h"
+#include "segment_storage.h"
+
+namespace Limit {
+constexpr size_t RECV_BUDGET_PER_TURN{256 * 1024}; // 256 Kb
+constexpr unsigned HANDOFF_RECV_TIMEOUT_MS{60 * 1000}; // старый процесс дописывает очередь записи
+constexpr unsigned HANDOFF_SEND_TIMEOUT_MS{10 * 1000};
+constexpr unsigned HANDOFF_READY_TIMEOUT_MS{10 * 1000};
+}
+
+namespace {
+Metrics::Counter& connections_accepted{Metrics::MetricsRegistry::Global().AddCounter(
+    "server_connections_accepted_total", "Accepted client connections")};
+Metrics::Gauge& sessions_active{Metrics::MetricsRegistry::Global().AddGauge(
+    "server_sessions_active", "Open sessions served by the event loop")};
+Metrics::Counter& connections_rejected{Metrics::MetricsRegistry::Global().AddCounter(
+    "server_connections_rejected_total", "Connections closed by admission control under overload")};
+Metrics::Gauge& accept_paused{Metrics::MetricsRegistry::Global().AddGauge(
+    "server_accept_paused", "1 while admission control defers new connections")};
+Metrics::Counter& sessions_taken_over{Metrics::MetricsRegistry::Global().AddCounter(
+    "server_sessions_taken_over_total", "Client connections received from the previous process on restart")};
+}
 
 std::atomic<bool> stop_flag{false};
 
@@ -17,9 +44,220 @@ void signal_handler(int sig) {
     }
 }
 
-Server::Server(uint16_t listen_port) :
-    _listen_port(listen_port)
-{}
+Server::Server(const ServerConfig& config) :
+    _config(config),
+    _admission(config.admission)
+{
+    if (_config.capture_period_ms != 0) {
+        _scheduler = std::make_unique<CaptureScheduler>(_config.capture_period_ms);
+    }
+}
+
+Server::~Server() {
+    // Компактизация обращается к хранилищу, индексу и очистке - останавливается раньше них
+    if (_compaction) {
+        _compaction->Stop();
+    }
+
+    if (_retention) {
+        _retention->Stop();
+    }
+}
+
+void Server::SetupStorage() {
+    const std::filesystem::path root{"screenshots"};
+
+    bool track_sync{_config.durability != DurabilityMode::K_NONE};
+
+    std::unique_ptr<FrameStorage> storage;
+
+    if (_config.storage_engine == StorageEngine::K_SEGMENTS) {
+        storage = std::make_unique<SegmentStorage>(root, _config.segment_size, _config.segment_age_sec, track_sync);
+    } else if (_config.storage_engine == StorageEngine::K_DEDUP) {
+        storage = std::make_unique<DedupStorage>(root, track_sync, _taken_storage.empty() ? nullptr : &_taken_storage);
+    } else {
+        storage = std::make_unique<FileStorage>(root, track_sync);
+    }
+
+    if (_config.retention.Enabled()) {
+        _retention = std::make_unique<RetentionManager>(root, _config.retention, *storage);
+        storage->SetObserver(_retention.get());
+    }
+
+    if (_config.query_port != 0) {
+        _frame_index = std::make_unique<FrameIndex>(root, *storage);
+
+        if (_config.cache_bytes != 0) {
+            _hot_cache = std::make_unique<HotFrameCache>(_config.cache_bytes, _config.cache_frames);
+        }
+    }
+
+    if (_config.thumbnail_workers != 0) {
+        _thumbnails = std::make_unique<ThumbnailPool>(root, _config.thumbnail_workers);
+    }
+
+    if (_retention && (_frame_index || _thumbnails)) {
+        _retention->SetEvictCallback([index = _frame_index.get(), thumbnails = _thumbnails.get()](const std::string& client, uint64_t newest_ms) {
+            if (index) {
+                index->Prune(client, newest_ms);
+            }
+
+            if (thumbnails) {
+                thumbnails->Prune(client, newest_ms);
+            }
+        });
+    }
+
+    if (_config.compaction.Enabled()) {
+        SetupCompaction(root, *storage);
+    }
+
+    if (!_config.trace_path.empty()) {
+        _trace = std::make_unique<TraceWriter>(_config.trace_path);
+    }
+
+    _taken_storage = {};
+
+    _writer = std::make_unique<StorageWriter>(std::move(storage), _config.durability, _config.sync_interval_ms);
+    _writer->SetFrameIndex(_frame_index.get());
+    _writer->SetTraceWriter(_trace.get());
+    _writer->SetThumbnailPool(_thumbnails.get());
+    _writer->Start();
+
+    if (_thumbnails) {
+        _thumbnails->Start();
+
+        _logger.PrintInTerminal(MessageType::K_INFO, "Building 1/4 and 1/16 thumbnails on " + std::to_string(_thumbnails->GetWorkers()) + " workers");
+    }
+
+    if (_retention) {
+        _retention->Start();
+    }
+
+    if (_compaction) {
+        _compaction->Start();
+    }
+
+    if (_frame_index) {
+        _query = std::make_unique<QueryServer>(_config.query_port, *_frame_index, _hot_cache.get());
+        _query->Start();
+    }
+}
+
+void Server::SetupCompaction(const std::filesystem::path& root, FrameStorage& storage) {
+    // Сегменты и журналы ссылок дописываются на месте - упаковывать можно только отдельные файлы кадров
+    if (_config.storage_engine != StorageEngine::K_FILES) {
+        _logger.PrintInTerminal(MessageType::K_WARNING, "--compact-after is supported only with --storage files, compaction disabled");
+
+        return;
+    }
+
+    _compaction = std::make_unique<CompactionManager>(root, _config.compaction, storage);
+
+    _compaction->SetCompactCallback([retention = _retention.get(), index = _frame_index.get()](const CompactedArchive& archive) {
+        if (retention) {
+            retention->OnUnitUpdate(archive.unit);
+
+            for (const auto& path : archive.removed) {
+                retention->OnUnitRemoved(path);
+            }
+        }
+
+        if (index) {
+            index->Replace(archive.unit.hostname + "/" + archive.unit.username, archive.removed, archive.frames);
+        }
+    });
+
+    _logger.PrintInTerminal(MessageType::K_INFO, "Compacting frames older than " + std::to_string(_config.compaction.min_age_sec) +
+                            " s into archives with a keyframe every " + std::to_string(_config.compaction.keyframe_interval) + " frames");
+}
+
+void Server::SetupRelay() {
+    if (!_config.relay.Enabled()) {
+        return;
+    }
+
+    _relay = std::make_unique<UpstreamRelay>(_config.relay, "relay_spill");
+    _relay->Start();
+
+    _logger.PrintInTerminal(MessageType::K_INFO, "Relaying frames to " + _config.relay.upstream.host + ":" +
+                            std::to_string(_config.relay.upstream.port));
+}
+
+bool Server::IsBacklogged() {
+    return _writer->IsBacklogged() || (_encoder && _encoder->IsBacklogged()) || (_relay && _relay->IsBacklogged());
+}
+
+void Server::SetupMetrics() {
+    if (_config.metrics_port == 0) {
+        return;
+    }
+
+    _metrics = std::make_unique<MetricsServer>(_config.metrics_port);
+    _metrics->Start();
+}
+
+void Server::SetupViewers() {
+    _viewers = std::make_unique<ViewerHub>();
+    _viewers->Start();
+}
+
+void Server::SetupEncoder() {
+    if (_config.encode_workers == 0) {
+        return;
+    }
+
+    _encoder = std::make_unique<EncodePool>(_config.encode_workers, *_writer, *_viewers, _hot_cache.get(), _relay.get());
+    _encoder->Start();
+
+    _logger.PrintInTerminal(MessageType::K_INFO, "Encoding raw frames on " + std::to_string(_encoder->GetWorkers()) + " workers");
+}
+
+void Server::HandleStorageAcks() {
+    std::vector<DurableAck> acks{_writer->TakeAcks()};
+
+    for (const auto& ack : acks) {
+        Session* session{FindSession(ack.owner)};
+
+        if (!session) {
+            continue;
+        }
+
+        bool was_empty{session->SendBufferEmpty()};
+
+        session->QueueDurableAck(ack);
+
+        if (was_empty && !FlushResponse(*session)) {
+            CloseSession(*session);
+        }
+    }
+
+    for (const auto& release : _writer->TakeReleases()) {
+        Session* session{FindSession(release.owner)};
+
+        if (!session) {
+            continue;
+        }
+
+        bool was_empty{session->SendBufferEmpty()};
+
+        if (session->QueueCredit(release) && was_empty && !FlushResponse(*session)) {
+            CloseSession(*session);
+        }
+    }
+}
+
+bool Server::FlushResponse(Session& session) {
+    if (!session.TrySend(session.GetClientFD())) {
+        return false;
+    }
+
+    if (!session.SendBufferEmpty()) {
+        UpdateEpollEvents(session, EPOLLIN | EPOLLOUT | EPOLLET);
+    }
+
+    return true;
+}
 
 void Server::SetupServerSocket() {
     _server_fd = UniqueFD(ResourceFactory::MakeUniqueFD(socket(AF_INET, SOCK_STREAM, 0)));
@@ -48,7 +286,7 @@ void Server::SetupServerSocket() {
     struct sockaddr_in server_addr = {};
     server_addr.sin_family = AF_INET;
     server_addr.sin_addr.s_addr = INADDR_ANY;
-    server_addr.sin_port = htons(_listen_port);
+    server_addr.sin_port = htons(_config.listen_port);
 
     auto s_addr{reinterpret_cast<struct sockaddr*>(&server_addr)};
 
@@ -70,15 +308,285 @@ void Server::SetupEpoll() {
 
     epoll_event event;
     event.events = EPOLLIN | EPOLLET;
-    event.data.fd = _server_fd.Get();
+    event.data.u64 = static_cast<uint32_t>(_server_fd.Get());
 
     if (epoll_ctl(_epoll_fd.Get(), EPOLL_CTL_ADD, _server_fd.Get(), &event) == -1) {
         throw std::runtime_error("epoll_ctl(): " + std::string(strerror(errno)));
     }
+
+    event.events = EPOLLIN;
+    event.data.u64 = static_cast<uint32_t>(_writer->GetNotifyFD());
+
+    if (epoll_ctl(_epoll_fd.Get(), EPOLL_CTL_ADD, _writer->GetNotifyFD(), &event) == -1) {
+        throw std::runtime_error("epoll_ctl(): " + std::string(strerror(errno)));
+    }
+}
+
+bool Server::TakeOver() {
+    if (_config.handoff_path.empty()) {
+        return false;
+    }
+
+    UniqueFD channel{HandoffChannel::Connect(_config.handoff_path, Limit::HANDOFF_RECV_TIMEOUT_MS)};
+
+    if (!channel.Valid()) {
+        return false;
+    }
+
+    _logger.PrintInTerminal(MessageType::K_INFO, "Taking over from the running server via " + _config.handoff_path);
+
+    // Без этой записи старый процесс считает передачу несостоявшейся и продолжает работу
+    if (!HandoffChannel::Send(channel.Get(), HandoffChannel::RECORD_READY, {})) {
+        _logger.PrintInTerminal(MessageType::K_WARNING, "handoff ready record not sent: " + std::string(strerror(errno)));
+
+        return false;
+    }
+
+    uint8_t type{0};
+    std::vector<uint8_t> payload;
+    UniqueFD passed;
+
+    while (true) {
+        if (!HandoffChannel::Receive(channel.Get(), type, payload, passed)) {
+            _logger.PrintInTerminal(MessageType::K_WARNING, "handoff interrupted after " +
+                                    std::to_string(_taken_sessions.size()) + " sessions");
+
+            break;
+        }
+
+        if (type == HandoffChannel::RECORD_LISTENER && passed.Valid()) {
+            _server_fd = std::move(passed);
+        } else if (type == HandoffChannel::RECORD_SESSION && passed.Valid()) {
+            TakenSession taken;
+
+            if (!HandoffChannel::DecodeSession(payload, taken.state)) {
+                static LogRateLimit rate{10};
+
+                _logger.PrintInTerminal(MessageType::K_WARNING, "bad handoff session record dropped", rate);
+
+                continue;
+            }
+
+            taken.fd = std::move(passed);
+            _taken_sessions.push_back(std::move(taken));
+        } else if (type == HandoffChannel::RECORD_END) {
+            _taken_storage = std::move(payload);
+
+            break;
+        }
+    }
+
+    if (!_server_fd.Valid()) {
+        // Без серверного сокета сессии не продолжить: клиенты переподключатся сами
+        _taken_sessions.clear();
+        _taken_storage.clear();
+
+        return false;
+    }
+
+    return true;
+}
+
+void Server::RestoreSessions() {
+    for (auto& taken : _taken_sessions) {
+        int fd{taken.fd.Get()};
+        uint32_t generation{_next_generation++};
+
+        if (_next_generation == 0) {
+            _next_generation = 1;
+        }
+
+        uint32_t addr{taken.state.addr};
+        uint32_t slot{taken.state.capture_slot};
+        bool is_relay{taken.state.is_relay};
+
+        auto session{std::make_unique<Session>(std::move(taken.fd), generation, addr, taken.state.port)};
+
+        session->RestoreState(std::move(taken.state));
+        session->SetUpstream(_relay.get());
+        session->SetEncoder(_encoder.get());
+        session->SetAddressLimit(_admission.AcquireAddress(addr));
+        session->SetRelayAllowed(_admission.AcceptsRelay(addr));
+
+        // Ретранслятору ограничение скорости клиента не применяется (см. Session::HandleRelayMessage)
+        if (!is_relay && !session->GetClientKey().empty()) {
+            session->SetClientLimit(_admission.AcquireClient(session->GetClientKey()));
+        }
+
+        // Расписание выдается заново: период нового процесса мог измениться
+        if (_scheduler && !session->GetClientKey().empty() && session->GetProtocolVersion() >= Protocol::VERSION_2) {
+            if (!_scheduler->Claim(slot)) {
+                slot = _scheduler->Assign();
+            }
+
+            session->AssignCaptureSlot(slot, _scheduler->GetPeriod(), _scheduler->GetPhase(slot));
+        }
+
+        epoll_event event;
+        event.events = EPOLLIN | EPOLLET;
+        event.data.u64 = session->GetHandle();
+
+        if (epoll_ctl(_epoll_fd.Get(), EPOLL_CTL_ADD, fd, &event) == -1) {
+            static LogRateLimit rate{10};
+
+            _logger.PrintInTerminal(MessageType::K_WARNING, "epoll_ctl() error: " + std::string(strerror(errno)), rate);
+
+            if (_scheduler) {
+                _scheduler->Release(session->ReleaseCaptureSlot());
+            }
+
+            continue;
+        }
+
+        if (static_cast<size_t>(fd) >= _sessions.size()) {
+            _sessions.resize(std::max(static_cast<size_t>(fd) + 1, _sessions.size() * 2));
+        }
+
+        sessions_taken_over.Inc();
+        sessions_active.Add(1);
+        ++_session_count;
+
+        Session& restored{*session};
+        _sessions[fd] = std::move(session);
+
+        if (!restored.SendBufferEmpty() && !FlushResponse(restored)) {
+            CloseSession(restored);
+
+            continue;
+        }
+
+        restored.SetScheduled(true);
+        _ready_queue.push_back(restored.GetHandle());
+    }
+
+    _taken_sessions.clear();
+}
+
+void Server::SetupHandoff() {
+    if (_config.handoff_path.empty()) {
+        return;
+    }
+
+    _handoff_fd = HandoffChannel::Listen(_config.handoff_path);
+
+    epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = static_cast<uint32_t>(_handoff_fd.Get());
+
+    if (epoll_ctl(_epoll_fd.Get(), EPOLL_CTL_ADD, _handoff_fd.Get(), &event) == -1) {
+        throw std::runtime_error("epoll_ctl(): " + std::string(strerror(errno)));
+    }
+}
+
+void Server::HandOff() {
+    UniqueFD channel{ResourceFactory::MakeUniqueFD(accept4(_handoff_fd.Get(), nullptr, nullptr, SOCK_CLOEXEC))};
+
+    if (!channel.Valid()) {
+        return;
+    }
+
+    // Канал блокирующий: пока идет передача, клиенты ждут в своих сокетах
+    int flags{fcntl(channel.Get(), F_GETFL, 0)};
+    fcntl(channel.Get(), F_SETFL, flags & ~O_NONBLOCK);
+
+    struct timeval timeout{};
+    timeout.tv_sec = Limit::HANDOFF_SEND_TIMEOUT_MS / 1000;
+
+    setsockopt(channel.Get(), SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    timeout.tv_sec = Limit::HANDOFF_READY_TIMEOUT_MS / 1000;
+
+    setsockopt(channel.Get(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    // Пока новый процесс не подтвердил, что жив, и не получил серверный сокет, ничего не
+    // останавливается: при любой ошибке здесь старый процесс работает дальше как ни в чем не бывало
+    uint8_t type{0};
+    std::vector<uint8_t> ready;
+    UniqueFD unused;
+
+    if (!HandoffChannel::Receive(channel.Get(), type, ready, unused) || type != HandoffChannel::RECORD_READY) {
+        _logger.PrintInTerminal(MessageType::K_ERROR, "handoff aborted, new process is not ready; keeping the sessions");
+
+        return;
+    }
+
+    if (!HandoffChannel::Send(channel.Get(), HandoffChannel::RECORD_LISTENER, {}, _server_fd.Get())) {
+        _logger.PrintInTerminal(MessageType::K_ERROR, "handoff aborted, keeping the sessions: " + std::string(strerror(errno)));
+
+        return;
+    }
+
+    _logger.PrintInTerminal(MessageType::K_INFO, "New server process connected, handing off " +
+                            std::to_string(_session_count) + " sessions");
+
+    if (_compaction) {
+        _compaction->Stop();
+    }
+
+    if (_retention) {
+        _retention->Stop();
+    }
+
+    // Пул дописывает свои кадры в очередь записи и ретрансляцию, пока они еще работают
+    _encoder.reset();
+    _query.reset();
+    _metrics.reset();
+    _relay.reset();
+    _viewers.reset();
+
+    // Последние подтверждения и кредит уходят новому процессу в буферах сессий
+    _writer->Stop();
+    HandleStorageAcks();
+
+    std::vector<uint8_t> storage_state;
+    _writer->GetStorage().SaveHandoffState(storage_state);
+
+    // Хранилище закрывает свои файлы раньше, чем их откроет новый процесс
+    _writer.reset();
+    _trace.reset();
+    _thumbnails.reset();
+
+    _handed_off = true;
+
+    // Дальше пути назад нет: при ошибке сессии, которые не успели уйти, закрываются вместе с процессом
+    size_t handed{0};
+
+    for (auto& session : _sessions) {
+        if (!session) {
+            continue;
+        }
+
+        std::vector<uint8_t> payload{HandoffChannel::EncodeSession(session->TakeState())};
+
+        if (!HandoffChannel::Send(channel.Get(), HandoffChannel::RECORD_SESSION, payload, session->GetClientFD())) {
+            _logger.PrintInTerminal(MessageType::K_ERROR, "handoff failed after " + std::to_string(handed) +
+                                    " sessions: " + std::string(strerror(errno)));
+
+            return;
+        }
+
+        ++handed;
+    }
+
+    if (!HandoffChannel::Send(channel.Get(), HandoffChannel::RECORD_END, storage_state)) {
+        _logger.PrintInTerminal(MessageType::K_ERROR, "handoff failed: " + std::string(strerror(errno)));
+
+        return;
+    }
+
+    _logger.PrintInTerminal(MessageType::K_INFO, "Handed off " + std::to_string(handed) + " sessions, exiting");
 }
 
 void Server::AcceptNewConnections() {
     while (true) {
+        bool admit{_admission.Admit(_session_count, IsBacklogged())};
+
+        if (!admit && _admission.GetMode() == AdmissionMode::K_DEFER) {
+            SetAcceptPaused(true);
+
+            break;
+        }
+
         struct sockaddr_in client_addr = {};
         auto c_addr{reinterpret_cast<sockaddr*>(&client_addr)};
         socklen_t c_addr_len{sizeof(client_addr)};
@@ -91,138 +599,309 @@ void Server::AcceptNewConnections() {
             } else if (errno == EINTR) {
                 continue;
             } else {
-                _logger.PrintInTerminal(MessageType::K_WARNING, "accept() error: " + std::string(strerror(errno)));
+                static LogRateLimit rate{10};
+
+                _logger.PrintInTerminal(MessageType::K_WARNING, "accept() error: " + std::string(strerror(errno)), rate);
 
                 break;
             }
         }
 
+        if (!admit) {
+            static LogRateLimit rate{10};
+
+            connections_rejected.Inc();
+
+            _logger.PrintInTerminal(MessageType::K_WARNING, "Server overloaded, connection rejected.", rate);
+
+            continue;
+        }
+
         int flags{fcntl(client_fd.Get(), F_GETFL, 0)};
         fcntl(client_fd.Get(), F_SETFL, flags | O_NONBLOCK);
 
+        int fd{client_fd.Get()};
+        uint32_t generation{_next_generation++};
+
+        if (_next_generation == 0) {
+            _next_generation = 1;
+        }
+
+        auto session{std::make_unique<Session>(std::move(client_fd), generation, client_addr.sin_addr.s_addr, ntohs(client_addr.sin_port))};
+
+        session->SetAddressLimit(_admission.AcquireAddress(client_addr.sin_addr.s_addr));
+        session->SetRelayAllowed(_admission.AcceptsRelay(client_addr.sin_addr.s_addr));
+        session->SetUpstream(_relay.get());
+        session->SetEncoder(_encoder.get());
+
         epoll_event event;
         event.events = EPOLLIN | EPOLLET;
-        event.data.fd = client_fd.Get();
+        event.data.u64 = session->GetHandle();
 
-        if (epoll_ctl(_epoll_fd.Get(), EPOLL_CTL_ADD, client_fd.Get(), &event) == -1) {
-            _logger.PrintInTerminal(MessageType::K_WARNING, "epoll_ctl() error: " + std::string(strerror(errno)));
+        if (epoll_ctl(_epoll_fd.Get(), EPOLL_CTL_ADD, fd, &event) == -1) {
+            static LogRateLimit rate{10};
+
+            _logger.PrintInTerminal(MessageType::K_WARNING, "epoll_ctl() error: " + std::string(strerror(errno)), rate);
 
             continue;
         }
 
-        char host_buf[INET_ADDRSTRLEN]{};
+        if (static_cast<size_t>(fd) >= _sessions.size()) {
+            _sessions.resize(std::max(static_cast<size_t>(fd) + 1, _sessions.size() * 2));
+        }
 
-        if (!inet_ntop(AF_INET, &client_addr.sin_addr, host_buf, sizeof(host_buf))) {
-            _logger.PrintInTerminal(MessageType::K_WARNING, "inet_ntop() failed");
+        static LogRateLimit rate{50};
 
-            continue;
-        }
+        _logger.PrintInTerminal(MessageType::K_INFO, "New connection! (client: " + session->GetClientAddress() + ")", rate);
+
+        connections_accepted.Inc();
+        sessions_active.Add(1);
+        ++_session_count;
+
+        _sessions[fd] = std::move(session);
+    }
+}
+
+Session* Server::FindSession(SessionHandle handle) noexcept {
+    size_t fd{static_cast<size_t>(Session::HandleToFD(handle))};
+
+    if (fd >= _sessions.size() || !_sessions[fd]) {
+        return nullptr;
+    }
+
+    Session* session{_sessions[fd].get()};
 
-        std::string host(host_buf);
-        std::string port{std::to_string(ntohs(client_addr.sin_port))};
+    if (session->GetGeneration() != Session::HandleToGeneration(handle)) {
+        return nullptr;
+    }
+
+    return session;
+}
 
-        auto session{std::make_shared<Session>(std::move(client_fd), host, port)};
+void Server::CloseSession(Session& session) {
+    int client_fd{session.GetClientFD()};
+    std::string address{session.GetClientAddress()};
 
-        _fd_session_ht[session->GetClientFD()] = session;
+    epoll_ctl(_epoll_fd.Get(), EPOLL_CTL_DEL, client_fd, nullptr);
 
-        _logger.PrintInTerminal(MessageType::K_INFO, "New connection! (client: " + host + ":" + port + ")");
+    if (_scheduler) {
+        _scheduler->Release(session.ReleaseCaptureSlot());
     }
+
+    _sessions[client_fd].reset();
+    sessions_active.Add(-1);
+    --_session_count;
+
+    static LogRateLimit rate{50};
+
+    _logger.PrintInTerminal(MessageType::K_INFO, "Close connection. (client: " + address + ")", rate);
 }
 
-void Server::CloseSession(std::shared_ptr<Session> session) {
-    int client_fd{session->GetClientFD()};
-    std::string host(session->GetClientHost());
-    std::string port{session->GetClientPort()};
+void Server::HandOffViewer(Session& session) {
+    int client_fd{session.GetClientFD()};
 
     epoll_ctl(_epoll_fd.Get(), EPOLL_CTL_DEL, client_fd, nullptr);
 
-    _fd_session_ht.erase(client_fd);
+    if (_scheduler) {
+        _scheduler->Release(session.ReleaseCaptureSlot());
+    }
+
+    _viewers->Attach(session.ReleaseClientFD(), session.GetSubscription(), session.GetClientAddress(), session.TakeUnsent());
+
+    _sessions[client_fd].reset();
+    sessions_active.Add(-1);
+    --_session_count;
+}
+
+void Server::SetAcceptPaused(bool paused) {
+    if (paused == _accept_paused) {
+        return;
+    }
+
+    epoll_event event;
+    event.events = paused ? 0 : EPOLLIN | EPOLLET;
+    event.data.u64 = static_cast<uint32_t>(_server_fd.Get());
 
-    _logger.PrintInTerminal(MessageType::K_INFO, "Close connection. (client: " + host + ":" + port + ")");
+    if (epoll_ctl(_epoll_fd.Get(), EPOLL_CTL_MOD, _server_fd.Get(), &event) == -1) {
+        throw std::runtime_error("epoll_ctl(): " + std::string(strerror(errno)));
+    }
+
+    _accept_paused = paused;
+    accept_paused.Set(paused ? 1 : 0);
+
+    static LogRateLimit rate{10};
+
+    _logger.PrintInTerminal(MessageType::K_WARNING, paused ? "Server overloaded, accepting paused." : "Accepting resumed.", rate);
 }
 
-void Server::UpdateEpollEvents(int fd, uint32_t events) {
+void Server::UpdateEpollEvents(const Session& session, uint32_t events) {
     epoll_event event;
-    event.data.fd = fd;
+    event.data.u64 = session.GetHandle();
     event.events = events;
 
-    if (epoll_ctl(_epoll_fd.Get(), EPOLL_CTL_MOD, fd, &event) == -1) {
+    if (epoll_ctl(_epoll_fd.Get(), EPOLL_CTL_MOD, session.GetClientFD(), &event) == -1) {
         throw std::runtime_error("epoll_ctl(): " + std::string(strerror(errno)));
     }
 }
 
-bool Server::HandleOutEvent(epoll_event& event, std::shared_ptr<Session> session) {
-    int client_fd{event.data.fd};
-
-    if (!session->TrySend(client_fd)) {
+bool Server::HandleOutEvent(Session& session) {
+    if (!session.TrySend(session.GetClientFD())) {
         return false;
     }
 
-    if (session->SendBufferEmpty()) {
-        UpdateEpollEvents(client_fd, EPOLLIN | EPOLLET);
+    if (session.SendBufferEmpty()) {
+        UpdateEpollEvents(session, EPOLLIN | EPOLLET);
     }
 
     return true;
 }
 
-bool Server::HandleInEvent(epoll_event& event, std::shared_ptr<Session> session) {
-    int client_fd{event.data.fd};
+bool Server::HandleMessages(Session& session) {
+    int client_fd{session.GetClientFD()};
 
-    if (!session->TryRecv(client_fd)) {
-        return false;
-    }
+    while (session.IsMessageComplete()) {
+        uint8_t msg_type{session.GetMessageType()};
+
+        if (msg_type == 'A') {
+            bool ok{session.HandleAuthRequest()};
 
-    session->ParseMessage();
+            session.QueueHandshakeResponse(ok);
 
-    if (session->IsMessageComplete()) {
-        uint8_t msg_type{session->GetMessageType()};
+            if (ok) {
+                session.SetClientLimit(_admission.AcquireClient(session.GetClientKey()));
+            }
 
-        if (msg_type == 'A') {
-            bool ok{session->HandleAuthRequest()};
+            // Первая выдача кредита и расписание идут сразу за 'V'
+            if (ok && session.GetProtocolVersion() >= Protocol::VERSION_2) {
+                if (_config.credit_frames != 0) {
+                    session.OpenCredit(_config.credit_frames, _config.credit_bytes);
+                }
+
+                if (_scheduler) {
+                    // Повторная аутентификация не должна занимать второй слот
+                    _scheduler->Release(session.ReleaseCaptureSlot());
+
+                    uint32_t slot{_scheduler->Assign()};
+
+                    session.AssignCaptureSlot(slot, _scheduler->GetPeriod(), _scheduler->GetPhase(slot));
+                }
+            }
+
+            if (!session.TrySend(client_fd)) {
+                return false;
+            }
+
+            if (!session.SendBufferEmpty()) {
+                UpdateEpollEvents(session, EPOLLIN | EPOLLOUT | EPOLLET);
+            }
+        } else if (msg_type == 'I' || msg_type == 'T' || msg_type == 'F' || msg_type == 'R') {
+            bool was_empty{session.SendBufferEmpty()};
+
+            if (msg_type == 'F') {
+                session.HandleBatchMessage(*_writer, *_viewers, _hot_cache.get());
+            } else if (msg_type == 'R') {
+                if (!session.HandleRelayMessage(*_writer, *_viewers, _hot_cache.get())) {
+                    return false;
+                }
+            } else {
+                session.HandleImgMessage(*_writer, *_viewers, _hot_cache.get());
+            }
 
-            if (!session->SendAuthResponse(client_fd, ok)) {
+            // Кадр, отброшенный ограничением скорости или ретранслированный, сразу возвращает кредит
+            if (was_empty && !session.SendBufferEmpty() && !FlushResponse(session)) {
                 return false;
             }
+        } else if (msg_type == 'S') {
+            bool ok{session.HandleSubscribeRequest()};
+
+            if (!session.SendAuthResponse(client_fd, ok)) {
+                return false;
+            }
+
+            if (ok) {
+                // Дальше соединение обслуживает ViewerHub; остальные сообщения зрителя не нужны
+                return true;
+            }
 
-            if (!session->SendBufferEmpty()) {
-                UpdateEpollEvents(client_fd, EPOLLIN | EPOLLOUT | EPOLLET);
+            if (!session.SendBufferEmpty()) {
+                UpdateEpollEvents(session, EPOLLIN | EPOLLOUT | EPOLLET);
             }
-        } else if (msg_type == 'I') {
-            session->HandleImgMessage();
+        } else {
+            session.DropMessage();
         }
     }
 
     return true;
 }
 
-void Server::HandleEvent(epoll_event& event) {
-    int client_fd{event.data.fd};
+bool Server::HandleInEvent(Session& session) {
+    if (!session.TryRecv(session.GetClientFD(), Limit::RECV_BUDGET_PER_TURN)) {
+        return false;
+    }
 
-    auto it{_fd_session_ht.find(client_fd)};
+    session.ParseMessage(_writer->IsTracing());
 
-    if (it == _fd_session_ht.end()) {
-        return;
+    if (!HandleMessages(session)) {
+        return false;
     }
 
-    auto& session{it->second};
+    if (session.IsViewer()) {
+        HandOffViewer(session);
+
+        return true;
+    }
+
+    if (session.HasPendingInput() && !session.IsScheduled()) {
+        session.SetScheduled(true);
+        _ready_queue.push_back(session.GetHandle());
+    }
+
+    return true;
+}
+
+void Server::ServeReadyQueue() {
+    for (size_t turns{_ready_queue.size()}; turns > 0; --turns) {
+        SessionHandle handle{_ready_queue.front()};
+        _ready_queue.pop_front();
+
+        Session* session{FindSession(handle)};
+
+        if (!session) {
+            continue;
+        }
+
+        session->SetScheduled(false);
+
+        if (!HandleInEvent(*session)) {
+            CloseSession(*session);
+        }
+    }
+}
+
+void Server::HandleEvent(epoll_event& event) {
+    Session* session{FindSession(event.data.u64)};
+
+    if (!session) {
+        return;
+    }
 
     if (event.events & (EPOLLERR | EPOLLRDHUP | EPOLLHUP)) {
-        CloseSession(session);
+        CloseSession(*session);
         
         return;
     }
 
     if (event.events & EPOLLOUT) {
-        if (!HandleOutEvent(event, session)) {
-            CloseSession(session);
+        if (!HandleOutEvent(*session)) {
+            CloseSession(*session);
 
             return;
         }
     }
 
-    if (event.events & EPOLLIN) {
-        if (!HandleInEvent(event, session)) {
-            CloseSession(session);
+    if ((event.events & EPOLLIN) && !session->IsScheduled()) {
+        if (!HandleInEvent(*session)) {
+            CloseSession(*session);
 
             return;
         }
@@ -236,7 +915,8 @@ void Server::EventLoop() {
     std::vector<epoll_event> events(MAX_EVENTS);
 
     while (!stop_flag.load(std::memory_order_relaxed)) {
-        int num_events{epoll_wait(_epoll_fd.Get(), events.data(), MAX_EVENTS, -1)};
+        int timeout{!_ready_queue.empty() ? 0 : _accept_paused ? 100 : -1};
+        int num_events{epoll_wait(_epoll_fd.Get(), events.data(), MAX_EVENTS, timeout)};
 
         if (num_events == -1) {
             if (errno == EINTR) {
@@ -247,14 +927,27 @@ void Server::EventLoop() {
         }
 
         for (int i{}; i < num_events; ++i) {
-            int fd{events[i].data.fd};
-
-            if (fd == _server_fd.Get()) {
+            if (events[i].data.u64 == static_cast<uint32_t>(_server_fd.Get())) {
                 AcceptNewConnections();
+            } else if (events[i].data.u64 == static_cast<uint32_t>(_writer->GetNotifyFD())) {
+                HandleStorageAcks();
+            } else if (events[i].data.u64 == static_cast<uint32_t>(_handoff_fd.Get())) {
+                HandOff();
+
+                // Сессии и хранилище переданы: оставшиеся события - уже не наши
+                if (_handed_off) {
+                    return;
+                }
             } else {
                 HandleEvent(events[i]);
             }
         }
+
+        ServeReadyQueue();
+
+        if (_accept_paused && _admission.Admit(_session_count, IsBacklogged())) {
+            SetAcceptPaused(false);
+        }
     }
 }
 
@@ -262,10 +955,40 @@ void Server::Run() {
     std::signal(SIGINT, signal_handler);
 
     try {
-        SetupServerSocket();
+        auto started{std::chrono::steady_clock::now()};
+        bool took_over{TakeOver()};
+
+        SetupMetrics();
+        SetupStorage();
+        SetupRelay();
+        SetupViewers();
+        SetupEncoder();
+
+        if (!took_over) {
+            SetupServerSocket();
+        }
+
         SetupEpoll();
+
+        if (took_over) {
+            size_t taken{_taken_sessions.size()};
+
+            RestoreSessions();
+
+            auto elapsed{std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started)};
+
+            _logger.PrintInTerminal(MessageType::K_INFO, "Took over listening socket and " + std::to_string(taken) +
+                                    " sessions in " + std::to_string(elapsed.count()) + " ms");
+        }
+
+        SetupHandoff();
         EventLoop();
     } catch (const std::runtime_error& ex) {
         _logger.PrintInTerminal(MessageType::K_ERROR, ex.what());
     }
+
+    // Файл сокета нужен следующему процессу, только если он еще не принял работу
+    if (_handoff_fd.Valid() && !_handed_off) {
+        unlink(_config.handoff_path.c_str());
+    }
 }
@@ -1,17 +1,58 @@
 #ifndef SERVER_SERVER_SERVER_h
 #define SERVER_SERVER_SERVER_h
 
+#include <deque>
 #include <string>
 #include <vector>
 #include <memory>
 #include <string_view>
-#include <unordered_map>
 
 #include <sys/epoll.h>
 
 #include "logger.h"
 #include "session.h"
+#include "viewer_hub.h"
+#include "input_parser.h"
+#include "metrics_server.h"
+#include "query_server.h"
+#include "trace_writer.h"
+#include "storage_writer.h"
+#include "thumbnail_pool.h"
+#include "retention_manager.h"
+#include "compaction_manager.h"
 #include "resource_factory.h"
+#include "capture_scheduler.h"
+#include "admission_control.h"
+#include "upstream_relay.h"
+#include "encode_pool.h"
+#include "handoff_channel.h"
+
+/**
+ * @brief Параметры запуска сервера
+ */
+struct ServerConfig {
+    uint16_t listen_port{};                               ///< Порт прослушивания
+    StorageEngine storage_engine{StorageEngine::K_FILES}; ///< Движок хранения скриншотов
+    uint64_t segment_size{256ULL * 1024 * 1024};          ///< Максимальный размер сегмента (для K_SEGMENTS)
+    unsigned segment_age_sec{3600};                       ///< Максимальный возраст сегмента (для K_SEGMENTS)
+    DurabilityMode durability{DurabilityMode::K_NONE};    ///< Режим сохранности скриншотов
+    unsigned sync_interval_ms{1000};                      ///< Интервал синхронизации (для K_PERIODIC)
+    RetentionPolicy retention;                            ///< Квоты и фоновая очистка хранилища
+    CompactionPolicy compaction;                          ///< Упаковка старых кадров в архивы (только для K_FILES)
+    uint16_t query_port{};                                ///< Порт выборки кадров на 127.0.0.1 (0 - выключено)
+    uint64_t cache_bytes{128ULL * 1024 * 1024};           ///< Память кэша горячих кадров (0 - выключен; только с выборкой)
+    size_t cache_frames{8};                               ///< Максимум кадров клиента в кэше
+    uint16_t metrics_port{};                              ///< Порт выдачи метрик на 127.0.0.1 (0 - выключено)
+    std::string trace_path;                               ///< Файл трассировки кадров (пусто - выключена)
+    uint64_t credit_frames{8};                            ///< Окно кредита клиента v2 в кадрах (0 - без управления потоком)
+    uint64_t credit_bytes{64ULL * 1024 * 1024};           ///< Окно кредита клиента v2 в байтах данных кадров
+    AdmissionPolicy admission;                            ///< Допуск соединений и ограничения скорости приема
+    uint32_t capture_period_ms{};                         ///< Период захвата клиентов v2 (0 - без расписания)
+    RelayPolicy relay;                                    ///< Ретрансляция на вышестоящий сервер вместо сохранения
+    std::string handoff_path;                             ///< Unix-сокет передачи работы новому процессу (пусто - выключено)
+    size_t encode_workers{};                              ///< Потоки кодирования кадров без PNG (0 - прием таких кадров выключен)
+    size_t thumbnail_workers{};                           ///< Потоки построения миниатюр (0 - миниатюры не строятся)
+};
 
 /**
  * @brief Класс TCP-сервера с использованием epoll
@@ -28,33 +69,190 @@
  *      - [имя устройства] 
  *      - [2 байта: длина имени пользователя]
  *      - [имя пользователя]
+ *      - [2 байта: запрашиваемая версия протокола] (необязательно, нет у клиентов v1)
+ *      - [2 байта: флаги Protocol::AUTH_FLAG_*] (необязательно, только вместе с версией)
  * 
  * 2. Ответ на аутентификацию (сервер -> клиент):
- *    - Успех: 'Y'
+ *    - Успех: 'Y' (клиенту без версии или с версией 1)
+ *    - Успех, версия 2 и выше:
+ *      - 'V'
+ *      - [4 байта размер данных (2)]
+ *      - [2 байта: согласованная версия - меньшая из запрошенной и Protocol::MAX_VERSION
+ *        (3 - при выключенном кодировании кадров без PNG)]
  *    - Ошибка: 'N'
+ *    - Старый сервер на запрос с версией отвечает 'Y': клиент остается на версии 1.
  * 
  * 3. Передача изображения (клиент -> сервер):
  *    - Формат:
  *      - 'I'
  *      - [4 байта размер данных]
  *      - [бинарные данные изображения]
+ *
+ * 4. Подтверждение сохранности (сервер -> клиент, только при --durability periodic|group):
+ *    - Формат:
+ *      - 'D'
+ *      - [4 байта размер данных (16)]
+ *      - [8 байт: номер первого кадра]
+ *      - [8 байт: номер последнего кадра]
+ *    - Кадры соединения нумеруются с 1 в порядке отправки; все кадры
+ *      из диапазона записаны и сброшены на диск.
+ *
+ * 5. Подписка на живые кадры хоста (зритель -> сервер, после аутентификации):
+ *    - Формат:
+ *      - 'S'
+ *      - [4 байта размер данных]
+ *      - [2 байта: длина имени устройства]
+ *      - [имя устройства]
+ *    - Ответ как на аутентификацию: 'Y' или 'N'. После 'Y' соединение
+ *      становится зрителем и других сообщений не принимает.
+ *
+ * 6. Живой кадр (сервер -> зритель):
+ *    - Формат:
+ *      - 'L'
+ *      - [4 байта размер данных]
+ *      - [8 байт: время получения кадра, мс]
+ *      - [2 байта: длина имени пользователя]
+ *      - [имя пользователя]
+ *      - [данные изображения]
+ *    - Зритель получает только самый новый кадр: если он не успевает
+ *      принимать, промежуточные кадры пропускаются.
+ *
+ * 7. Передача изображения с отметками времени (клиент -> сервер):
+ *    - Формат:
+ *      - 'T'
+ *      - [4 байта размер данных]
+ *      - [бинарные данные изображения]
+ *      - [8 байт: номер кадра у клиента]
+ *      - [8 байт: начало захвата, мкс с начала эпохи]
+ *      - [8 байт: конец кодирования, мкс]
+ *      - [8 байт: начало отправки, мкс]
+ *    - Обрабатывается как 'I'; при --trace-file отметки клиента вместе с
+ *      отметками сервера пишутся в файл трассировки (см. trace_format.h).
+ *
+ * 8. Пачка кадров (клиент -> сервер, только после согласования версии 2):
+ *    - Формат:
+ *      - 'F'
+ *      - [4 байта размер данных]
+ *      - [2 байта: число кадров]
+ *      - для каждого кадра:
+ *        - [32 байта: заголовок кадра Protocol::FrameHeader - номер, начало захвата,
+ *          длина данных, ширина, высота, формат, монитор, флаги, резерв]
+ *        - [16 байт: конец кодирования и начало отправки, мкс] (только с Protocol::FLAG_TRACE)
+ *        - [данные изображения]
+ *    - Каждый кадр обрабатывается как 'I'/'T'; размеры и монитор из заголовка
+ *      сохраняются в индексе без разбора PNG. Пачка с ошибкой разметки
+ *      отбрасывается целиком.
+ *    - Сообщения 'I' и 'T' принимаются и после согласования версии 2.
+ *    - С версии 4 (сервер с --encode-workers больше 0) формат кадра может быть
+ *      Protocol::CODEC_RAW_RGB или CODEC_RAW_RGB_ZLIB: сервер кодирует его в PNG
+ *      пулом потоков (EncodePool) и дальше обрабатывает как PNG. Кредит такого
+ *      кадра возвращается по его размеру в пачке, а не по размеру PNG.
+ *
+ * 9. Выдача кредита (сервер -> клиент, только после согласования версии 2):
+ *    - Формат:
+ *      - 'C'
+ *      - [4 байта размер данных (16)]
+ *      - [8 байт: граница числа кадров]
+ *      - [8 байт: граница объема данных кадров]
+ *    - Границы абсолютные, с начала соединения: клиент может отправить кадр,
+ *      пока после него отправленные кадры и их данные не выходят за границы.
+ *    - Первая выдача (окно --credit-frames/--credit-size) идет сразу за 'V',
+ *      следующие - по мере того как кадры покидают очередь записи. Новая
+ *      выдача заменяет предыдущую.
+ *    - Сервер не отбрасывает кадры сверх кредита, а только учитывает их в
+ *      метрике server_credit_overruns_total. Клиент, не получивший 'C'
+ *      (старый сервер или --credit-frames 0), отправляет без ограничений.
+ *
+ * 10. Расписание захвата (сервер -> клиент, только после согласования версии 2 и при --capture-period):
+ *    - Формат:
+ *      - 'P'
+ *      - [4 байта размер данных (8)]
+ *      - [4 байта: период, мс]
+ *      - [4 байта: фаза, мс]
+ *    - Клиент снимает экран в моменты t (мс с начала эпохи, UTC), для которых
+ *      (t - фаза) делится на период, вместо своего --period.
+ *    - Фазы раздаются так, чтобы клиенты равномерно покрывали период
+ *      (см. CaptureScheduler): одновременный запуск парка клиентов не дает
+ *      синхронных всплесков приема. Идет после 'V' (и 'C', если он есть).
+ *
+ * 11. Пачка кадров ретранслятора (сервер с --upstream -> вышестоящий сервер, только после согласования версии 3):
+ *    - Формат:
+ *      - 'R'
+ *      - [4 байта размер данных]
+ *      - [2 байта: число кадров]
+ *      - для каждого кадра:
+ *        - [2 байта: длина имени устройства]
+ *        - [имя устройства]
+ *        - [2 байта: длина имени пользователя]
+ *        - [имя пользователя]
+ *        - [8 байт: время получения кадра ретранслятором, мс]
+ *        - [32 байта: заголовок кадра Protocol::FrameHeader, без FLAG_TRACE]
+ *        - [данные изображения]
+ *    - Кадр сохраняется так, будто его прислал клиент с указанными именами
+ *      напрямую, но с временем получения ретранслятором. Пачка с ошибкой
+ *      разметки отбрасывается целиком.
+ *    - Пачки принимаются только с адресов из --accept-relays <ip>[/<бит>],...
+ *      Ретранслятор ставит AUTH_FLAG_RELAY в 'A', и с другого адреса получает
+ *      'N' еще при аутентификации; пачка 'R' с недопущенного адреса закрывает
+ *      соединение.
+ *    - После первой пачки кредит и ограничение скорости клиента к соединению
+ *      не применяются: их соблюдает ретранслятор для своих клиентов. Ограничение
+ *      IP-адреса (--rate-ip) действует на весь поток ретранслятора.
+ *    - Ретранслятор принимает клиентов как обычный сервер, но передает кадры
+ *      по --upstream-connections соединениям (см. UpstreamRelay). Кадры, не
+ *      успевающие уйти, копятся на диске в каталоге relay_spill (до --spill-size).
+ *
+ * @section handoff Перезапуск без разрыва соединений (--handoff <путь>):
+ *
+ * Сервер слушает Unix-сокет по указанному пути. Новый процесс, запущенный с тем
+ * же --handoff, подключается к нему, и старый процесс:
+ * 1. Ждет от нового процесса запись готовности и передает ему по HandoffChannel
+ *    серверный сокет. Если это не удалось, новый процесс считается мертвым,
+ *    и старый продолжает работу как прежде.
+ * 2. Останавливает очистку, выборку, метрики, ретрансляцию и рассылку зрителям
+ *    (порты и каталоги освобождаются для нового процесса).
+ * 3. Дописывает очередь записи и рассылает последние подтверждения и кредит
+ *    в буферы сессий, затем закрывает хранилище.
+ * 4. Передает сокеты клиентов с состоянием сессий (см. SessionState) и
+ *    состояние хранилища, после чего завершается.
+ *
+ * Новый процесс принимает все это до создания хранилища, не сканирует журналы
+ * (индекс DedupStorage приходит готовым) и сразу продолжает обслуживать
+ * сессии с того байта, на котором остановился старый: клиент видит только
+ * паузу. Соединения, пришедшие за время передачи, ждут в очереди listen().
+ * Зрители отключаются и переподключаются сами: их обслуживает ViewerHub.
  */
 class Server {
 public:
     /**
      * @brief Конструктор сервера
-     * @param listen_port Порт для прослушивания входящих соединений
+     * @param config Параметры запуска
+     */
+    explicit Server(const ServerConfig& config);
+
+    /**
+     * @brief Деструктор
+     *
+     * Поток очистки останавливается раньше потока записи: он удаляет файлы через
+     * хранилище, которым владеет StorageWriter. Сам менеджер удержания живет дольше -
+     * хранилище уведомляет его о закрытии единиц до последнего момента.
      */
-    explicit Server(uint16_t listen_port);
+    ~Server();
 
 public:
     /**
      * @brief Запуск основного цикла сервера
      * 
      * Последовательность работы:
-     * 1. Настройка серверного сокета
-     * 2. Инициализация epoll
-     * 3. Вход в цикл обработки событий
+     * 0. Прием работы у старого процесса (если задан --handoff и он запущен)
+     * 1. Запуск выдачи метрик (если включена)
+     * 2. Создание хранилища скриншотов (и запуск очистки и выборки, если включены)
+     *    и ретрансляции, если задан вышестоящий сервер
+     * 3. Запуск рассылки живым зрителям
+     * 4. Настройка серверного сокета (если он не принят от старого процесса)
+     * 5. Инициализация epoll, восстановление принятых сессий и прием подключений
+     *    следующего процесса (если задан --handoff)
+     * 6. Вход в цикл обработки событий
      * 
      * @note Обрабатывает сигнал SIGINT
      * @throw std::runtime_error При ошибках инициализации
@@ -62,6 +260,60 @@ public:
     void Run();
 
 private:
+    /**
+     * @brief Создание хранилища скриншотов, потока записи, менеджера удержания и сервера выборки согласно конфигурации
+     * @throw std::runtime_error При ошибках создания потока записи
+     */
+    void SetupStorage();
+
+    /**
+     * @brief Создание менеджера компактизации и привязка его к очистке и индексу кадров
+     * @param root Корневой каталог хранилища
+     * @param storage Хранилище
+     */
+    void SetupCompaction(const std::filesystem::path& root, FrameStorage& storage);
+
+    /**
+     * @brief Запуск ретрансляции на вышестоящий сервер, если он задан
+     * @throw std::runtime_error При ошибках открытия очереди на диске
+     */
+    void SetupRelay();
+
+    /**
+     * @brief Проверить, отстает ли сохранение или ретрансляция от приема
+     * @return true если почти заполнена очередь записи, кодирования или ретрансляции
+     */
+    bool IsBacklogged();
+
+    /**
+     * @brief Запуск выдачи метрик, если задан порт
+     * @throw std::runtime_error При ошибках открытия порта
+     */
+    void SetupMetrics();
+
+    /**
+     * @brief Запуск рассылки живым зрителям
+     * @throw std::runtime_error При ошибках создания потока рассылки
+     */
+    void SetupViewers();
+
+    /**
+     * @brief Запуск пула кодирования кадров без PNG, если задано число потоков
+     */
+    void SetupEncoder();
+
+    /**
+     * @brief Передать сессию-зрителя в рассылку
+     * @param session Сессия, принявшая подписку
+     * @warning После вызова ссылка на сессию становится недействительной
+     */
+    void HandOffViewer(Session& session);
+
+    /**
+     * @brief Разослать подтверждения сохранности и выдачи кредита от потока записи
+     */
+    void HandleStorageAcks();
+
     /**
      * @brief Инициализация epoll
      * @throw std::runtime_error При ошибках создания epoll
@@ -77,23 +329,68 @@ private:
      */
     void SetupServerSocket();
 
+    /**
+     * @brief Принять серверный сокет, сессии и состояние хранилища у старого процесса
+     * @return true если принят серверный сокет
+     *
+     * Если старого процесса нет (к сокету --handoff никто не подключен), сразу
+     * возвращает false. Ждет, пока старый процесс допишет очередь записи.
+     */
+    bool TakeOver();
+
+    /**
+     * @brief Зарегистрировать в epoll сессии, принятые от старого процесса
+     *
+     * Сессии получают новое поколение, ограничения скорости и слот расписания
+     * этого процесса и ставятся в очередь готовых к чтению: в сокетах и в
+     * принятом хвосте уже могут быть данные.
+     */
+    void RestoreSessions();
+
+    /**
+     * @brief Начать прием подключений следующего процесса, если задан --handoff
+     * @throw std::runtime_error При ошибках создания сокета или epoll_ctl
+     */
+    void SetupHandoff();
+
+    /**
+     * @brief Передать работу подключившемуся новому процессу (см. @ref handoff)
+     *
+     * До остановки чего-либо новый процесс должен прислать запись готовности
+     * и принять серверный сокет: если это не удалось (он упал или не отвечает),
+     * старый продолжает работу. После этого хранилище закрывается, сессии уходят по одной, и цикл
+     * событий завершается; при ошибке посреди передачи сессии, которые не успели
+     * уйти, закрываются вместе с процессом.
+     */
+    void HandOff();
+
     /**
      * @brief Основной цикл обработки событий
      * 
      * Использует epoll_wait для мультиплексирования ввода-вывода.
-     * Обрабатывает до 1024 событий за один вызов.
+     * Обрабатывает до 1024 событий за один вызов. Пока очередь готовых
+     * к чтению сессий не пуста, epoll_wait не блокируется. Пока прием
+     * соединений приостановлен, цикл просыпается раз в 100 мс, чтобы
+     * проверить, не спала ли перегрузка.
      * 
      * @throw std::runtime_error При ошибках epoll_wait
      */
     void EventLoop();
 
     /**
-     * @brief Обновить маску событий для файлового дескриптора
-     * @param fd Файловый дескриптор
+     * @brief Обновить маску событий для сессии
+     * @param session Сессия
      * @param events Новая маска событий (EPOLLIN/EPOLLOUT и др.)
      * @throw std::runtime_error При ошибках epoll_ctl
      */
-    void UpdateEpollEvents(int fd, uint32_t events);
+    void UpdateEpollEvents(const Session& session, uint32_t events);
+
+    /**
+     * @brief Найти сессию по дескриптору из epoll
+     * @param handle Дескриптор сессии (fd + поколение)
+     * @return Указатель на сессию или nullptr, если сессия уже закрыта
+     */
+    Session* FindSession(SessionHandle handle) noexcept;
 
     /**
      * @brief Прием новых подключений
@@ -103,38 +400,78 @@ private:
      * - Устанавливает non-blocking режим
      * - Добавляет в epoll
      * - Создает Session
-     * - Добавляет в хеш-таблицу активных сессий
+     * - Помещает ее в таблицу сессий по индексу fd
+     *
+     * При перегрузке (см. AdmissionControl) в режиме K_REJECT соединение
+     * сразу закрывается, в режиме K_DEFER прием приостанавливается.
      */
     void AcceptNewConnections();
 
+    /**
+     * @brief Приостановить или возобновить прием соединений
+     * @param paused true - убрать интерес к серверному сокету, false - вернуть
+     * @throw std::runtime_error При ошибках epoll_ctl
+     *
+     * Пока прием приостановлен, соединения ждут в очереди listen().
+     * При возобновлении epoll сразу сообщает о них, если очередь не пуста.
+     */
+    void SetAcceptPaused(bool paused);
+
+    /**
+     * @brief Отправить накопленный ответ сессии
+     * @param session Сессия
+     * @return true если сессия жива, false если нужно закрыть
+     *
+     * Если ответ не ушел целиком, включает EPOLLOUT.
+     */
+    bool FlushResponse(Session& session);
+
     /**
      * @brief Закрытие сессии
      * @param session Сессия для закрытия
      * 
-     * Удаляет сессию из epoll и хеш-таблицы,
+     * Удаляет сессию из epoll и таблицы сессий,
      * логирует событие закрытия.
+     * @warning После вызова ссылка на сессию становится недействительной
      */
-    void CloseSession(std::shared_ptr<Session> session);
+    void CloseSession(Session& session);
 
     /**
      * @brief Обработка события записи
-     * @param event Событие epoll
      * @param session Сессия для обработки
      * @return true если сессия жива, false если нужно закрыть
      */
-    bool HandleOutEvent(epoll_event& event, std::shared_ptr<Session> session);
+    bool HandleOutEvent(Session& session);
 
     /**
-     * @brief Обработка события чтения
-     * @param event Событие epoll
+     * @brief Обработка события чтения (один ход сессии)
      * @param session Сессия для обработки
      * @return true если сессия жива, false если нужно закрыть
      * 
-     * Обрабатывает два типа сообщений:
+     * Читает не больше бюджета на ход и обрабатывает все готовые сообщения:
      * - 'A' (аутентификация)
      * - 'I' (изображение)
+     * - 'F' и 'R' (пачки кадров клиента и ретранслятора)
+     * - 'S' (подписка зрителя; после нее сессия передается в ViewerHub)
+     *
+     * Если в сокете остались данные, сессия ставится в очередь готовых к чтению.
      */
-    bool HandleInEvent(epoll_event& event, std::shared_ptr<Session> session);
+    bool HandleInEvent(Session& session);
+
+    /**
+     * @brief Обработка готовых сообщений сессии
+     * @param session Сессия для обработки
+     * @return true если сессия жива, false если нужно закрыть
+     */
+    bool HandleMessages(Session& session);
+
+    /**
+     * @brief Выдать по одному ходу сессиям из очереди готовых к чтению
+     *
+     * Обходит только сессии, стоявшие в очереди на момент вызова (round-robin):
+     * сессия с недочитанными данными возвращается в конец очереди.
+     */
+    void ServeReadyQueue();
 
     /**
      * @brief Обработка одного события epoll
@@ -146,14 +483,45 @@ private:
     void HandleEvent(epoll_event& event);
 
 private:
-    uint16_t _listen_port;                                            ///< Порт прослушивания
+    /// Сессия, принятая от старого процесса и еще не зарегистрированная
+    struct TakenSession {
+        UniqueFD fd;        ///< Сокет клиента
+        SessionState state; ///< Состояние сессии
+    };
+
+private:
+    ServerConfig _config;                            ///< Параметры запуска
     
-    Logger _logger;                                                   ///< Логгер сервера
+    Logger _logger;                                  ///< Логгер сервера
+
+    UniqueFD _epoll_fd{};                            ///< Дескриптор epoll
+    UniqueFD _server_fd{};                           ///< Серверный сокет
+
+    std::unique_ptr<RetentionManager> _retention;    ///< Квоты и фоновая очистка хранилища
+    std::unique_ptr<CompactionManager> _compaction;  ///< Упаковка старых кадров в архивы
+    std::unique_ptr<FrameIndex> _frame_index;        ///< Индекс кадров по времени (если включена выборка)
+    std::unique_ptr<HotFrameCache> _hot_cache;       ///< Кэш последних кадров (если включена выборка)
+    std::unique_ptr<TraceWriter> _trace;             ///< Трассировка кадров (если задан файл)
+    std::unique_ptr<ThumbnailPool> _thumbnails;      ///< Миниатюры сохраненных кадров (останавливается после записи)
+    std::unique_ptr<StorageWriter> _writer;          ///< Поток записи скриншотов
+    std::unique_ptr<UpstreamRelay> _relay;           ///< Ретрансляция вместо сохранения (если задан --upstream)
+    std::unique_ptr<QueryServer> _query;             ///< Выборка кадров (останавливается первой)
+    std::unique_ptr<ViewerHub> _viewers;             ///< Рассылка живым зрителям
+    std::unique_ptr<EncodePool> _encoder;            ///< Кодирование кадров без PNG (останавливается раньше записи и зрителей)
+    std::unique_ptr<MetricsServer> _metrics;         ///< Выдача метрик
+    AdmissionControl _admission;                     ///< Допуск соединений и ограничения скорости
+    std::unique_ptr<CaptureScheduler> _scheduler;    ///< Фазы захвата клиентов (если задан период)
 
-    UniqueFD _epoll_fd{};                                             ///< Дескриптор epoll
-    UniqueFD _server_fd{};                                            ///< Серверный сокет
+    UniqueFD _handoff_fd{};                          ///< Прием подключений следующего процесса (если задан --handoff)
+    std::vector<TakenSession> _taken_sessions;       ///< Сессии от старого процесса (до RestoreSessions())
+    std::vector<uint8_t> _taken_storage;             ///< Состояние хранилища от старого процесса
+    bool _handed_off{false};                         ///< Работа передана новому процессу
 
-    std::unordered_map<int, std::shared_ptr<Session>> _fd_session_ht; ///< Активные сессии (fd -> Session)
+    std::vector<std::unique_ptr<Session>> _sessions; ///< Таблица активных сессий (индекс - fd)
+    std::deque<SessionHandle> _ready_queue;          ///< Сессии с непрочитанными данными (ждут своего хода)
+    uint32_t _next_generation{1};                    ///< Поколение для следующей сессии (0 - серверный сокет)
+    size_t _session_count{0};                        ///< Число открытых сессий
+    bool _accept_paused{false};                      ///< Прием соединений приостановлен (K_DEFER)
 };
 
 #endif // SERVER_SERVER_SERVER_h
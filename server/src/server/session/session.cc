@@ -2,46 +2,99 @@
 #include <ctime>
 #include <chrono>
 #include <cstring>
-#include <fstream>
+#include <utility>
 #include <iostream>
 #include <algorithm>
-#include <filesystem>
 
+#include <endian.h>
 #include <arpa/inet.h>
 #include <sys/epoll.h>
 #include <sys/socket.h>
 
+#include "metrics.h"
 #include "session.h"
 
 namespace Limit {
 constexpr uint32_t MAX_MESSAGE_SIZE{1024 * 1024 * 10}; // 10 Mb
+constexpr size_t TRACE_TRAILER_SIZE{4 * sizeof(uint64_t)};
 }
 
-namespace fs = std::filesystem;
+namespace {
+Metrics::Counter& batches_received{Metrics::MetricsRegistry::Global().AddCounter(
+    "server_batches_received_total", "Protocol v2 frame batches accepted")};
+Metrics::Counter& relay_batches_received{Metrics::MetricsRegistry::Global().AddCounter(
+    "server_relay_batches_received_total", "Protocol v3 relay batches accepted")};
+Metrics::Counter& bytes_received{Metrics::MetricsRegistry::Global().AddCounter(
+    "server_bytes_received_total", "Bytes received from client sockets")};
+Metrics::Counter& frames_received{Metrics::MetricsRegistry::Global().AddCounter(
+    "server_frames_received_total", "Image messages accepted for storage")};
+Metrics::Counter& credit_overruns{Metrics::MetricsRegistry::Global().AddCounter(
+    "server_credit_overruns_total", "Frames received from protocol v2 clients beyond the granted credit")};
+Metrics::Counter& frames_throttled{Metrics::MetricsRegistry::Global().AddCounter(
+    "server_frames_throttled_total", "Frames dropped by per-client or per-address rate limits")};
+Metrics::Counter& auth_failures{Metrics::MetricsRegistry::Global().AddCounter(
+    "server_auth_failures_total", "Rejected authentication requests")};
+Metrics::Histogram& parse_seconds{Metrics::MetricsRegistry::Global().AddHistogram(
+    "server_parse_seconds", "Time to split received bytes into messages (per read turn)")};
+Metrics::Histogram& save_screen_seconds{Metrics::MetricsRegistry::Global().AddHistogram(
+    "server_save_screen_seconds", "Time to hand a frame to the storage writer, including backpressure waits")};
+}
+
+Logger Session::_logger;
 
-Session::Session(UniqueFD&& client_fd, const std::string& host, const std::string& port) :
+Session::Session(UniqueFD&& client_fd, uint32_t generation, uint32_t addr, uint16_t port) :
     _client_fd(std::move(client_fd)),
-    _client_host(host),
+    _generation(generation),
+    _client_addr(addr),
     _client_port(port)
 {}
 
+int Session::HandleToFD(SessionHandle handle) noexcept {
+    return static_cast<int>(static_cast<uint32_t>(handle));
+}
+
+uint32_t Session::HandleToGeneration(SessionHandle handle) noexcept {
+    return static_cast<uint32_t>(handle >> 32);
+}
+
+SessionHandle Session::GetHandle() const noexcept {
+    return (static_cast<SessionHandle>(_generation) << 32) | static_cast<uint32_t>(_client_fd.Get());
+}
+
+uint32_t Session::GetGeneration() const noexcept {
+    return _generation;
+}
+
 int Session::GetClientFD() const noexcept {
     return _client_fd.Get();
 }
 
-std::string Session::GetClientHost() const noexcept {
-    return _client_host;
+std::string Session::GetClientHost() const {
+    char host_buf[INET_ADDRSTRLEN]{};
+
+    struct in_addr addr{};
+    addr.s_addr = _client_addr;
+
+    if (!inet_ntop(AF_INET, &addr, host_buf, sizeof(host_buf))) {
+        return "unknown";
+    }
+
+    return std::string(host_buf);
 }
 
-std::string Session::GetClientPort() const noexcept {
+uint16_t Session::GetClientPort() const noexcept {
     return _client_port;
 }
 
+std::string Session::GetClientAddress() const {
+    return GetClientHost() + ":" + std::to_string(_client_port);
+}
+
 uint8_t Session::GetMessageType() const {
     return PeekUint8(_messages.front().type_vec);
 }
 
-uint8_t Session::PeekUint8(const std::vector<uint8_t>& buffer) const {
+uint8_t Session::PeekUint8(const std::vector<uint8_t>& buffer) {
     if (buffer.size() < sizeof(uint8_t)) {
         throw std::runtime_error("Buffer too small to read uint8_t");
     }
@@ -49,7 +102,7 @@ uint8_t Session::PeekUint8(const std::vector<uint8_t>& buffer) const {
     return buffer.front();
 }
 
-uint16_t Session::PeekUint16(const std::vector<uint8_t>& buffer) const {
+uint16_t Session::PeekUint16(const std::vector<uint8_t>& buffer) {
     if (buffer.size() < sizeof(uint16_t)) {
         throw std::runtime_error("Buffer too small to read uint16_t");
     }
@@ -60,7 +113,7 @@ uint16_t Session::PeekUint16(const std::vector<uint8_t>& buffer) const {
     return ntohs(value);
 }
 
-uint32_t Session::PeekUint32(const std::vector<uint8_t>& buffer) const {
+uint32_t Session::PeekUint32(const std::vector<uint8_t>& buffer) {
     if (buffer.size() < sizeof(uint32_t)) {
         throw std::runtime_error("Buffer too small to read uint32_t");
     }
@@ -118,7 +171,9 @@ bool Session::FromReqToVec(std::vector<uint8_t>& vec, size_t len) {
     return true;
 }
 
-void Session::ParseMessage() {
+void Session::ParseMessage(bool trace) {
+    Metrics::ScopedTimer timer(parse_seconds);
+
     while (true) {
         if (size_t type_len{sizeof(uint8_t)}; _message.type_vec.size() != type_len) {
             if (!FromReqToVec(_message.type_vec, type_len)) {
@@ -134,9 +189,12 @@ void Session::ParseMessage() {
 
         if (size_t msg_len{PeekUint32(_message.size_vec)}; _message.bytes_vec.size() != msg_len) {
             if (msg_len > Limit::MAX_MESSAGE_SIZE) {
+                static LogRateLimit rate{10};
+
                 _logger.PrintInTerminal(
                     MessageType::K_WARNING,
-                    "[client: " + _client_host + ":" + _client_port + "] message too large: " + std::to_string(msg_len)
+                    "[client: " + GetClientAddress() + "] message too large: " + std::to_string(msg_len),
+                    rate
                 );
 
                 _message.Clear();
@@ -149,6 +207,10 @@ void Session::ParseMessage() {
             }
 
             if (_message.bytes_vec.size() == msg_len) {            
+                if (trace) {
+                    _message.received_us = TraceWriter::NowUs();
+                }
+
                 _messages.push(_message);
 
                 _message.Clear();
@@ -159,18 +221,48 @@ void Session::ParseMessage() {
     }
 }
 
-bool Session::TryRecv(int fd) {
-    constexpr size_t BUFFER_SIZE{4096};
+void Session::FeedRequest(const uint8_t* data, size_t size) {
+    _request.insert(_request.end(), data, data + size);
+}
+
+size_t Session::DiscardMessages() noexcept {
+    size_t count{_messages.size()};
+
+    std::queue<Message>().swap(_messages);
+
+    return count;
+}
+
+bool Session::TryRecv(int fd, size_t budget) {
+    constexpr size_t BUFFER_SIZE{16384};
+
+    size_t received{0};
+
+    _pending_input = false;
 
     while (true) {
-        char temp[BUFFER_SIZE];
+        if (received >= budget) {
+            _pending_input = true;
 
-        ssize_t n{recv(fd, temp, sizeof(temp), 0)};
+            break;
+        }
+
+        size_t old_size{_request.size()};
+        size_t chunk{std::min(BUFFER_SIZE, budget - received)};
+
+        _request.resize(old_size + chunk);
+
+        ssize_t n{recv(fd, _request.data() + old_size, chunk, 0)};
+
+        _request.resize(old_size + (n > 0 ? static_cast<size_t>(n) : 0));
 
         if (n > 0) {
-            _request.insert(_request.end(), temp, temp + n);
+            received += static_cast<size_t>(n);
+            bytes_received.Inc(static_cast<uint64_t>(n));
         } else if (n == 0) {
-            _logger.PrintInTerminal(MessageType::K_WARNING, "recv() error: connection closed by peer");
+            static LogRateLimit rate{20};
+
+            _logger.PrintInTerminal(MessageType::K_WARNING, "recv() error: connection closed by peer", rate);
 
             return false;
         } else {
@@ -180,7 +272,9 @@ bool Session::TryRecv(int fd) {
                 continue;
             }
 
-            _logger.PrintInTerminal(MessageType::K_WARNING, "recv() error: " + std::string(strerror(errno)));
+            static LogRateLimit rate{20};
+
+            _logger.PrintInTerminal(MessageType::K_WARNING, "recv() error: " + std::string(strerror(errno)), rate);
 
             return false;
         }
@@ -189,6 +283,18 @@ bool Session::TryRecv(int fd) {
     return true;
 }
 
+bool Session::HasPendingInput() const noexcept {
+    return _pending_input;
+}
+
+bool Session::IsScheduled() const noexcept {
+    return _scheduled;
+}
+
+void Session::SetScheduled(bool scheduled) noexcept {
+    _scheduled = scheduled;
+}
+
 bool Session::TrySend(int fd) {
     while (!_response.empty()) {
         ssize_t n{send(fd, _response.data(), _response.size(), MSG_NOSIGNAL)};
@@ -196,7 +302,9 @@ bool Session::TrySend(int fd) {
         if (n > 0) {
             _response.erase(_response.begin(), _response.begin() + n);
         } else if (n == 0) {
-            _logger.PrintInTerminal(MessageType::K_WARNING, "send() error: connection closed by peer");
+            static LogRateLimit rate{20};
+
+            _logger.PrintInTerminal(MessageType::K_WARNING, "send() error: connection closed by peer", rate);
             
             return false;
         } else {
@@ -205,12 +313,16 @@ bool Session::TrySend(int fd) {
             } else if (errno == EINTR) {
                 continue;
             } else if (errno == EPIPE) {
-                _logger.PrintInTerminal(MessageType::K_WARNING, "send() error: broken pipe (connection closed by client)");
+                static LogRateLimit rate{20};
+
+                _logger.PrintInTerminal(MessageType::K_WARNING, "send() error: broken pipe (connection closed by client)", rate);
 
                 return false;
             }
 
-            _logger.PrintInTerminal(MessageType::K_WARNING, "send() error: " + std::string(strerror(errno)));
+            static LogRateLimit rate{20};
+
+            _logger.PrintInTerminal(MessageType::K_WARNING, "send() error: " + std::string(strerror(errno)), rate);
 
             return false;
         }
@@ -222,15 +334,33 @@ bool Session::TrySend(int fd) {
 bool Session::SendAuthResponse(int fd, bool ok) {
     char resp{ok ? 'Y' : 'N'};
 
-    if (!_response.empty()) { 
-        _response[0] = static_cast<uint8_t>(resp);
-    } else {
-        _response.push_back(static_cast<uint8_t>(resp));
-    }
+    _response.push_back(static_cast<uint8_t>(resp));
 
     return TrySend(fd);
 }
 
+void Session::QueueHandshakeResponse(bool ok) {
+    if (!ok || _protocol == Protocol::VERSION_1) {
+        _response.push_back(static_cast<uint8_t>(ok ? 'Y' : 'N'));
+
+        return;
+    }
+
+    uint8_t reply[Protocol::MESSAGE_HEADER_SIZE + sizeof(uint16_t)];
+    uint32_t net_size{htonl(sizeof(uint16_t))};
+    uint16_t net_version{htons(_protocol)};
+
+    reply[0] = 'V';
+    std::memcpy(reply + 1, &net_size, sizeof(net_size));
+    std::memcpy(reply + Protocol::MESSAGE_HEADER_SIZE, &net_version, sizeof(net_version));
+
+    _response.insert(_response.end(), reply, reply + sizeof(reply));
+}
+
+uint16_t Session::GetProtocolVersion() const noexcept {
+    return _protocol;
+}
+
 bool Session::SendBufferEmpty() const {
     return _response.empty();
 }
@@ -240,48 +370,582 @@ bool Session::IsMessageComplete() const {
 }
 
 std::string Session::GetStringFromHostPort() {
-    std::string host{_client_host};
+    std::string host{GetClientHost()};
 
     host.erase(std::remove(host.begin(), host.end(), '.'), host.end());
 
-    return host + "_" + _client_port;
+    return host + "_" + std::to_string(_client_port);
+}
+
+void Session::SaveScreen(StorageWriter& writer, const SessionIdentity& identity, uint64_t timestamp_ms, FrameBuffer data,
+                         const Protocol::FrameHeader& header, std::unique_ptr<FrameTrace> trace) {
+    Metrics::ScopedTimer timer(save_screen_seconds);
+
+    writer.Submit(MakeStorageJob(identity, timestamp_ms, std::move(data), header, std::move(trace)));
+}
+
+StorageJob Session::MakeStorageJob(const SessionIdentity& identity, uint64_t timestamp_ms, FrameBuffer data,
+                                   const Protocol::FrameHeader& header, std::unique_ptr<FrameTrace> trace) {
+    StorageJob job;
+    job.owner = GetHandle();
+    job.seq = ++_frame_seq;
+    job.frame.hostname = identity.hostname;
+    job.frame.username = identity.username;
+    job.frame.peer = GetStringFromHostPort();
+    job.frame.timestamp_ms = timestamp_ms;
+    job.frame.codec = static_cast<FrameCodec>(header.codec);
+    job.frame.width = header.width;
+    job.frame.height = header.height;
+    job.frame.monitor = header.monitor;
+    job.data = std::move(data);
+    job.trace = std::move(trace);
+
+    return job;
+}
+
+void Session::EncodeFrame(const SessionIdentity& identity, uint64_t timestamp_ms, FrameBuffer data,
+                          const Protocol::FrameHeader& header, std::unique_ptr<FrameTrace> trace) {
+    if (!_strand) {
+        _strand = _encoder->OpenStrand();
+    }
+
+    size_t size{data->size()};
+
+    EncodeJob job;
+    job.job = MakeStorageJob(identity, timestamp_ms, std::move(data), header, std::move(trace));
+    job.header = header;
+    job.forward = _upstream != nullptr;
+
+    _encoder->Submit(_strand, std::move(job));
+
+    // Ретранслируемый кадр возвращает кредит сразу, как и без кодирования
+    if (_upstream) {
+        QueueCredit(StorageRelease{GetHandle(), 1, size});
+    }
+}
+
+void Session::QueueDurableAck(const DurableAck& ack) {
+    constexpr uint32_t PAYLOAD_SIZE{2 * sizeof(uint64_t)};
+
+    uint8_t header[sizeof(uint8_t) + sizeof(uint32_t)];
+    uint32_t net_size{htonl(PAYLOAD_SIZE)};
+
+    header[0] = 'D';
+    std::memcpy(header + 1, &net_size, sizeof(net_size));
+
+    uint64_t net_first{htobe64(ack.first_seq)};
+    uint64_t net_last{htobe64(ack.last_seq)};
+
+    auto first_bytes{reinterpret_cast<const uint8_t*>(&net_first)};
+    auto last_bytes{reinterpret_cast<const uint8_t*>(&net_last)};
+
+    _response.insert(_response.end(), header, header + sizeof(header));
+    _response.insert(_response.end(), first_bytes, first_bytes + sizeof(net_first));
+    _response.insert(_response.end(), last_bytes, last_bytes + sizeof(net_last));
+}
+
+void Session::OpenCredit(uint64_t frames, uint64_t bytes) {
+    _credit_frames = _received_frames + frames;
+    _credit_bytes = _received_bytes + bytes;
+
+    QueueCreditGrant();
+}
+
+bool Session::QueueCredit(const StorageRelease& release) {
+    if (_credit_frames == 0) {
+        return false;
+    }
+
+    _credit_frames += release.frames;
+    _credit_bytes += release.bytes;
+
+    QueueCreditGrant();
+
+    return true;
+}
+
+void Session::QueueCreditGrant() {
+    constexpr uint32_t PAYLOAD_SIZE{2 * sizeof(uint64_t)};
+
+    uint8_t header[sizeof(uint8_t) + sizeof(uint32_t)];
+    uint32_t net_size{htonl(PAYLOAD_SIZE)};
+
+    header[0] = 'C';
+    std::memcpy(header + 1, &net_size, sizeof(net_size));
+
+    uint64_t net_frames{htobe64(_credit_frames)};
+    uint64_t net_bytes{htobe64(_credit_bytes)};
+
+    auto frames_bytes{reinterpret_cast<const uint8_t*>(&net_frames)};
+    auto bytes_bytes{reinterpret_cast<const uint8_t*>(&net_bytes)};
+
+    _response.insert(_response.end(), header, header + sizeof(header));
+    _response.insert(_response.end(), frames_bytes, frames_bytes + sizeof(net_frames));
+    _response.insert(_response.end(), bytes_bytes, bytes_bytes + sizeof(net_bytes));
+}
+
+void Session::AssignCaptureSlot(uint32_t slot, uint32_t period_ms, uint32_t phase_ms) {
+    uint8_t message[Protocol::MESSAGE_HEADER_SIZE + 2 * sizeof(uint32_t)];
+    uint32_t net_size{htonl(2 * sizeof(uint32_t))};
+    uint32_t net_period{htonl(period_ms)};
+    uint32_t net_phase{htonl(phase_ms)};
+
+    message[0] = 'P';
+    std::memcpy(message + 1, &net_size, sizeof(net_size));
+    std::memcpy(message + Protocol::MESSAGE_HEADER_SIZE, &net_period, sizeof(net_period));
+    std::memcpy(message + Protocol::MESSAGE_HEADER_SIZE + sizeof(net_period), &net_phase, sizeof(net_phase));
+
+    _response.insert(_response.end(), message, message + sizeof(message));
+
+    _capture_slot = slot;
+}
+
+uint32_t Session::ReleaseCaptureSlot() noexcept {
+    return std::exchange(_capture_slot, CaptureScheduler::SLOTS);
 }
 
-void Session::SaveScreen(const Message& msg) {
-    std::string timestamp{_logger.GetCurrentTimestamp("%Y%m%d_%H%M%S")};
+void Session::SetClientLimit(IngestLimit limit) noexcept {
+    _client_limit = std::move(limit);
+}
 
-    fs::path base{fs::path("screenshots") / fs::path(_client_hostname) / fs::path(_client_username)};
+void Session::SetAddressLimit(IngestLimit limit) noexcept {
+    _address_limit = std::move(limit);
+}
 
-    std::error_code ec;
-    fs::create_directories(base, ec);
+void Session::SetUpstream(UpstreamRelay* relay) noexcept {
+    _upstream = relay;
+}
+
+void Session::SetRelayAllowed(bool allowed) noexcept {
+    _relay_allowed = allowed;
+}
+
+void Session::SetEncoder(EncodePool* encoder) noexcept {
+    _encoder = encoder;
+}
 
-    if (ec) {
-        _logger.PrintInTerminal(MessageType::K_ERROR, "create_directories() error: " + ec.message());
+const std::string& Session::GetClientKey() const noexcept {
+    static const std::string empty;
+
+    return _identity ? _identity->client : empty;
+}
+
+void Session::DropMessage() {
+    static LogRateLimit rate{10};
+
+    _logger.PrintInTerminal(
+        MessageType::K_WARNING,
+        "[client: " + GetClientAddress() + "] unknown message type dropped: " + std::to_string(GetMessageType()),
+        rate
+    );
+
+    _messages.pop();
+}
+
+void Session::HandleImgMessage(StorageWriter& writer, ViewerHub& viewers, HotFrameCache* cache) {
+    if (!_identity) {
+        static LogRateLimit rate{10};
+
+        _logger.PrintInTerminal(MessageType::K_WARNING, "[client: " + GetClientAddress() + "] image before authentication dropped", rate);
+
+        _messages.pop();
 
         return;
     }
 
-    std::string filename{timestamp + "_" + GetStringFromHostPort() + ".png"};
-    fs::path out_path{base / filename};
-    std::ofstream file(out_path, std::ios::binary);
+    Message& msg{_messages.front()};
+    std::unique_ptr<FrameTrace> trace;
 
-    if (!file) {
-        _logger.PrintInTerminal(MessageType::K_ERROR, "open file failed: " + out_path.string());
+    if (PeekUint8(msg.type_vec) == 'T') {
+        if (msg.bytes_vec.size() < Limit::TRACE_TRAILER_SIZE) {
+            static LogRateLimit rate{10};
+
+            _logger.PrintInTerminal(MessageType::K_WARNING, "[client: " + GetClientAddress() + "] traced image too short, dropped", rate);
+
+            _messages.pop();
+
+            return;
+        }
+
+        // Хвост отрезается без копирования кадра: [8: номер][8: захват][8: кодирование][8: отправка]
+        const uint8_t* trailer{msg.bytes_vec.data() + msg.bytes_vec.size() - Limit::TRACE_TRAILER_SIZE};
+
+        if (writer.IsTracing()) {
+            uint64_t fields[4];
+            std::memcpy(fields, trailer, sizeof(fields));
+
+            trace = std::make_unique<FrameTrace>();
+            trace->client = _identity->client;
+            trace->record.seq = be64toh(fields[0]);
+            trace->record.capture_start_us = be64toh(fields[1]);
+            trace->record.encode_done_us = be64toh(fields[2]);
+            trace->record.send_start_us = be64toh(fields[3]);
+            trace->record.recv_done_us = msg.received_us;
+            trace->record.handle_us = TraceWriter::NowUs();
+        }
+
+        msg.bytes_vec.resize(msg.bytes_vec.size() - Limit::TRACE_TRAILER_SIZE);
+    }
+
+    // Один буфер на кадр: его без копирования разделяют поток записи и все зрители
+    FrameBuffer data{std::make_shared<const std::vector<uint8_t>>(std::move(msg.bytes_vec))};
+
+    _messages.pop();
+
+    AcceptFrame(writer, viewers, cache, std::move(data), Protocol::FrameHeader{}, std::move(trace));
+}
+
+void Session::HandleBatchMessage(StorageWriter& writer, ViewerHub& viewers, HotFrameCache* cache) {
+    Message& msg{_messages.front()};
+
+    if (!_identity || _protocol < Protocol::VERSION_2) {
+        static LogRateLimit rate{10};
+
+        _logger.PrintInTerminal(MessageType::K_WARNING, "[client: " + GetClientAddress() + "] frame batch without protocol v2 dropped", rate);
+
+        _messages.pop();
+
+        return;
+    }
+
+    struct BatchFrame {
+        Protocol::FrameHeader header; ///< Заголовок кадра
+        size_t trace_offset;          ///< Начало отметок времени клиента (при FLAG_TRACE)
+        size_t data_offset;           ///< Начало данных кадра
+    };
+
+    const std::vector<uint8_t>& bytes{msg.bytes_vec};
+    std::vector<BatchFrame> frames;
+    bool valid{bytes.size() >= sizeof(uint16_t)};
+
+    if (valid) {
+        size_t count{PeekUint16(bytes)};
+        size_t pos{sizeof(uint16_t)};
+
+        frames.reserve(count);
+
+        for (size_t i{0}; i < count && valid; ++i) {
+            if (bytes.size() - pos < Protocol::FRAME_HEADER_SIZE) {
+                valid = false;
+
+                break;
+            }
+
+            BatchFrame frame{Protocol::ReadFrameHeader(bytes.data() + pos), 0, 0};
+            pos += Protocol::FRAME_HEADER_SIZE;
+
+            if (frame.header.flags & Protocol::FLAG_TRACE) {
+                if (bytes.size() - pos < Protocol::FRAME_TRACE_SIZE) {
+                    valid = false;
+
+                    break;
+                }
+
+                frame.trace_offset = pos;
+                pos += Protocol::FRAME_TRACE_SIZE;
+            }
+
+            valid = bytes.size() - pos >= frame.header.length && IsAcceptedCodec(frame.header.codec);
+
+            frame.data_offset = pos;
+            pos += frame.header.length;
+
+            frames.push_back(frame);
+        }
+
+        // Лишние байты после последнего кадра - тоже ошибка разметки
+        valid = valid && pos == bytes.size();
+    }
+
+    if (!valid) {
+        static LogRateLimit rate{10};
+
+        _logger.PrintInTerminal(MessageType::K_WARNING, "[client: " + GetClientAddress() + "] malformed frame batch dropped", rate);
+
+        _messages.pop();
 
         return;
     }
 
-    file.write(reinterpret_cast<const char*>(msg.bytes_vec.data()), msg.bytes_vec.size());
-    file.close();
+    batches_received.Inc();
+
+    for (size_t i{0}; i < frames.size(); ++i) {
+        const BatchFrame& frame{frames[i]};
+        std::unique_ptr<FrameTrace> trace;
+
+        if ((frame.header.flags & Protocol::FLAG_TRACE) && writer.IsTracing()) {
+            uint64_t fields[2];
+            std::memcpy(fields, bytes.data() + frame.trace_offset, sizeof(fields));
+
+            trace = std::make_unique<FrameTrace>();
+            trace->client = _identity->client;
+            trace->record.seq = frame.header.seq;
+            trace->record.capture_start_us = frame.header.capture_us;
+            trace->record.encode_done_us = be64toh(fields[0]);
+            trace->record.send_start_us = be64toh(fields[1]);
+            trace->record.recv_done_us = msg.received_us;
+            trace->record.handle_us = TraceWriter::NowUs();
+        }
+
+        FrameBuffer data;
+
+        if (frames.size() == 1) {
+            // Единственный кадр пачки: заголовки отрезаются на месте, без второго буфера
+            msg.bytes_vec.erase(msg.bytes_vec.begin(), msg.bytes_vec.begin() + static_cast<std::ptrdiff_t>(frame.data_offset));
+
+            data = std::make_shared<const std::vector<uint8_t>>(std::move(msg.bytes_vec));
+        } else {
+            auto begin{bytes.begin() + static_cast<std::ptrdiff_t>(frame.data_offset)};
 
-    std::string log_msg{"[client: " + _client_host + ":" + _client_port + "] Saved image: \"" + out_path.string() + "\""};
-    _logger.PrintInTerminal(MessageType::K_INFO, log_msg);
+            data = std::make_shared<const std::vector<uint8_t>>(begin, begin + frame.header.length);
+        }
+
+        AcceptFrame(writer, viewers, cache, std::move(data), frame.header, std::move(trace));
+    }
+
+    _messages.pop();
 }
 
-void Session::HandleImgMessage() {
-    SaveScreen(_messages.front());
+bool Session::HandleRelayMessage(StorageWriter& writer, ViewerHub& viewers, HotFrameCache* cache) {
+    Message& msg{_messages.front()};
+
+    // Пачка сохраняется от чужих имен: принимать ее можно только от известного ретранслятора
+    if (!_relay_allowed) {
+        static LogRateLimit rate{10};
+
+        _logger.PrintInTerminal(MessageType::K_WARNING, "[client: " + GetClientAddress() + "] relay batch from address not in --accept-relays, closing", rate);
+
+        _messages.pop();
+
+        return false;
+    }
+
+    if (!_identity || _protocol < Protocol::VERSION_3) {
+        static LogRateLimit rate{10};
+
+        _logger.PrintInTerminal(MessageType::K_WARNING, "[client: " + GetClientAddress() + "] relay batch without protocol v3 dropped", rate);
+
+        _messages.pop();
+
+        return true;
+    }
+
+    struct RelayedFrame {
+        SessionIdentity identity;     ///< Клиент ретранслятора
+        uint64_t timestamp_ms;        ///< Время получения кадра ретранслятором
+        Protocol::FrameHeader header; ///< Заголовок кадра
+        size_t data_offset;           ///< Начало данных кадра
+    };
+
+    const std::vector<uint8_t>& bytes{msg.bytes_vec};
+    std::vector<RelayedFrame> frames;
+    bool valid{bytes.size() >= sizeof(uint16_t)};
+
+    // [2: длина][строка] с проверкой по IsValidName()
+    auto read_name = [&](size_t& pos, std::string& name) {
+        if (bytes.size() - pos < sizeof(uint16_t)) {
+            return false;
+        }
+
+        uint16_t net_len;
+        std::memcpy(&net_len, bytes.data() + pos, sizeof(net_len));
+
+        size_t len{ntohs(net_len)};
+        pos += sizeof(net_len);
+
+        if (bytes.size() - pos < len) {
+            return false;
+        }
+
+        name.assign(reinterpret_cast<const char*>(bytes.data() + pos), len);
+        pos += len;
+
+        return IsValidName(name);
+    };
+
+    if (valid) {
+        size_t count{PeekUint16(bytes)};
+        size_t pos{sizeof(uint16_t)};
+
+        frames.reserve(count);
+
+        for (size_t i{0}; i < count && valid; ++i) {
+            RelayedFrame frame{};
+
+            valid = read_name(pos, frame.identity.hostname) && read_name(pos, frame.identity.username) &&
+                    bytes.size() - pos >= sizeof(uint64_t) + Protocol::FRAME_HEADER_SIZE;
+
+            if (!valid) {
+                break;
+            }
+
+            uint64_t net_timestamp;
+            std::memcpy(&net_timestamp, bytes.data() + pos, sizeof(net_timestamp));
+
+            frame.timestamp_ms = be64toh(net_timestamp);
+            pos += sizeof(net_timestamp);
+
+            frame.header = Protocol::ReadFrameHeader(bytes.data() + pos);
+            pos += Protocol::FRAME_HEADER_SIZE;
+
+            valid = bytes.size() - pos >= frame.header.length && frame.header.codec == Protocol::CODEC_PNG;
+
+            frame.identity.client = frame.identity.hostname + "/" + frame.identity.username;
+            frame.data_offset = pos;
+            pos += frame.header.length;
+
+            frames.push_back(std::move(frame));
+        }
+
+        valid = valid && pos == bytes.size();
+    }
+
+    if (!valid) {
+        static LogRateLimit rate{10};
+
+        _logger.PrintInTerminal(MessageType::K_WARNING, "[client: " + GetClientAddress() + "] malformed relay batch dropped", rate);
+
+        _messages.pop();
+
+        return true;
+    }
+
+    // Кредит и скорость каждого своего клиента ретранслятор соблюдает сам; корзина
+    // IP-адреса остается и ограничивает весь его поток. Повторная аутентификация
+    // выдает их заново, поэтому они снимаются с каждой пачкой.
+    _credit_frames = 0;
+    _client_limit.reset();
+
+    if (!_is_relay) {
+        _is_relay = true;
+
+        _logger.PrintInTerminal(MessageType::K_INFO, "[client: " + GetClientAddress() + "] relay " + _identity->client + " attached");
+    }
+
+    relay_batches_received.Inc();
+
+    for (RelayedFrame& frame : frames) {
+        FrameBuffer data;
+
+        if (frames.size() == 1) {
+            msg.bytes_vec.erase(msg.bytes_vec.begin(), msg.bytes_vec.begin() + static_cast<std::ptrdiff_t>(frame.data_offset));
+
+            data = std::make_shared<const std::vector<uint8_t>>(std::move(msg.bytes_vec));
+        } else {
+            auto begin{bytes.begin() + static_cast<std::ptrdiff_t>(frame.data_offset)};
+
+            data = std::make_shared<const std::vector<uint8_t>>(begin, begin + frame.header.length);
+        }
+
+        double size{static_cast<double>(data->size())};
+
+        if (_address_limit && !_address_limit->Has(size)) {
+            static LogRateLimit rate{10};
+
+            frames_throttled.Inc();
+
+            _logger.PrintInTerminal(MessageType::K_WARNING, "[client: " + GetClientAddress() + "] relay rate limit exceeded, frame dropped", rate);
+
+            // Номер занимается, как и в AcceptFrame(), чтобы подтверждения 'D' не разошлись с нумерацией
+            ++_frame_seq;
+
+            continue;
+        }
+
+        if (_address_limit) {
+            _address_limit->Take(size);
+        }
+
+        DeliverFrame(writer, viewers, cache, frame.identity, frame.timestamp_ms, std::move(data), frame.header, nullptr);
+    }
 
     _messages.pop();
+
+    return true;
+}
+
+void Session::AcceptFrame(StorageWriter& writer, ViewerHub& viewers, HotFrameCache* cache, FrameBuffer data,
+                          const Protocol::FrameHeader& header, std::unique_ptr<FrameTrace> trace) {
+    _received_frames += 1;
+    _received_bytes += data->size();
+
+    // Кредит не принуждается: кадр все равно принимается, но клиент с нарушением виден в метриках
+    if (_credit_frames != 0 && (_received_frames > _credit_frames || _received_bytes > _credit_bytes)) {
+        static LogRateLimit rate{10};
+
+        credit_overruns.Inc();
+
+        _logger.PrintInTerminal(MessageType::K_WARNING, "[client: " + GetClientAddress() + "] frame beyond granted credit", rate);
+    }
+
+    double size{static_cast<double>(data->size())};
+
+    if ((_client_limit && !_client_limit->Has(1)) || (_address_limit && !_address_limit->Has(size))) {
+        static LogRateLimit rate{10};
+
+        frames_throttled.Inc();
+
+        _logger.PrintInTerminal(MessageType::K_WARNING, "[client: " + GetClientAddress() + "] rate limit exceeded, frame dropped", rate);
+
+        // Номер занимается, чтобы подтверждения 'D' не разошлись с нумерацией клиента; кредит возвращается сразу
+        ++_frame_seq;
+        QueueCredit(StorageRelease{GetHandle(), 1, data->size()});
+
+        return;
+    }
+
+    if (_client_limit) {
+        _client_limit->Take(1);
+    }
+
+    if (_address_limit) {
+        _address_limit->Take(size);
+    }
+
+    auto now{std::chrono::system_clock::now().time_since_epoch()};
+    uint64_t timestamp_ms{static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(now).count())};
+
+    DeliverFrame(writer, viewers, cache, *_identity, timestamp_ms, std::move(data), header, std::move(trace));
+}
+
+void Session::DeliverFrame(StorageWriter& writer, ViewerHub& viewers, HotFrameCache* cache, const SessionIdentity& identity,
+                           uint64_t timestamp_ms, FrameBuffer data, const Protocol::FrameHeader& header,
+                           std::unique_ptr<FrameTrace> trace) {
+    frames_received.Inc();
+
+    // Кадр без PNG уходит в пул, а за ним и все следующие кадры сессии, чтобы не обогнать его
+    if (_encoder && (header.codec != Protocol::CODEC_PNG || _strand)) {
+        EncodeFrame(identity, timestamp_ms, std::move(data), header, std::move(trace));
+
+        return;
+    }
+
+    // Зрители получают кадр раньше, чем Submit() может заблокироваться на переполненной очереди записи
+    viewers.Publish(identity.hostname, identity.username, timestamp_ms, data);
+
+    if (_upstream) {
+        size_t size{data->size()};
+
+        _upstream->Forward(identity.hostname, identity.username, timestamp_ms, header, data);
+
+        // Номер занимается как при сохранении, а кредит возвращается сразу: кадр покинул сервер
+        ++_frame_seq;
+        QueueCredit(StorageRelease{GetHandle(), 1, size});
+    } else {
+        SaveScreen(writer, identity, timestamp_ms, data, header, std::move(trace));
+    }
+
+    if (cache) {
+        cache->Put(identity.client, timestamp_ms, std::move(data));
+    }
+}
+
+bool Session::IsAcceptedCodec(uint8_t codec) const noexcept {
+    if (codec == Protocol::CODEC_PNG) {
+        return true;
+    }
+
+    return _encoder && _protocol >= Protocol::VERSION_4 && (codec == Protocol::CODEC_RAW_RGB || codec == Protocol::CODEC_RAW_RGB_ZLIB);
 }
 
 bool Session::IsValidName(const std::string& name) {
@@ -299,15 +963,17 @@ bool Session::IsValidName(const std::string& name) {
 }
 
 void Session::ParseAuthMessage(Message& msg) {
+    auto identity{std::make_unique<SessionIdentity>()};
+
     uint16_t hostname_len{PopUint16(msg.bytes_vec)};
 
     if (hostname_len > Limit::MAX_MESSAGE_SIZE) {
         throw std::runtime_error("hostname too long");
     }
 
-    _client_hostname = PopString(msg.bytes_vec, hostname_len);
+    identity->hostname = PopString(msg.bytes_vec, hostname_len);
 
-    if (!IsValidName(_client_hostname)) {
+    if (!IsValidName(identity->hostname)) {
         throw std::runtime_error("Invalid hostname");
     }
     
@@ -317,11 +983,34 @@ void Session::ParseAuthMessage(Message& msg) {
         throw std::runtime_error("username too long");
     }
 
-    _client_username = PopString(msg.bytes_vec, username_len);
+    identity->username = PopString(msg.bytes_vec, username_len);
 
-    if (!IsValidName(_client_username)) {
+    if (!IsValidName(identity->username)) {
         throw std::runtime_error("Invalid username");
     }
+
+    identity->client = identity->hostname + "/" + identity->username;
+
+    // Клиенты первой версии заканчивают запрос на имени пользователя
+    uint16_t version{Protocol::VERSION_1};
+
+    if (msg.bytes_vec.size() >= sizeof(uint16_t)) {
+        version = PopUint16(msg.bytes_vec);
+
+        if (version < Protocol::VERSION_1) {
+            throw std::runtime_error("Invalid protocol version");
+        }
+    }
+
+    // Ретранслятор объявляет себя сразу: недопущенный получит 'N' и придержит кадры у себя
+    if (msg.bytes_vec.size() >= sizeof(uint16_t) && (PopUint16(msg.bytes_vec) & Protocol::AUTH_FLAG_RELAY) != 0 &&
+        !_relay_allowed) {
+        throw std::runtime_error("relay from address not in --accept-relays");
+    }
+
+    // Кадры без PNG (v4) принимаются, только если их есть кому кодировать
+    _protocol = std::min(version, _encoder ? Protocol::MAX_VERSION : Protocol::VERSION_3);
+    _identity = std::move(identity);
 }
 
 bool Session::HandleAuthRequest() {
@@ -332,10 +1021,124 @@ bool Session::HandleAuthRequest() {
 
         return true;
     } catch (const std::runtime_error& ex) {
-        _logger.PrintInTerminal(MessageType::K_WARNING, "[client: " + _client_host + ":" + _client_port + "] Authentication failed: " + std::string(ex.what()));
+        static LogRateLimit rate{10};
+
+        _logger.PrintInTerminal(MessageType::K_WARNING, "[client: " + GetClientAddress() + "] Authentication failed: " + std::string(ex.what()), rate);
+
+        auth_failures.Inc();
+
+        _messages.pop();
+
+        return false;
+    }
+}
+
+bool Session::HandleSubscribeRequest() {
+    Message& msg{_messages.front()};
+
+    try {
+        if (!_identity) {
+            throw std::runtime_error("not authenticated");
+        }
+
+        uint16_t hostname_len{PopUint16(msg.bytes_vec)};
+        std::string hostname{PopString(msg.bytes_vec, hostname_len)};
+
+        if (!IsValidName(hostname) || !msg.bytes_vec.empty()) {
+            throw std::runtime_error("Invalid hostname");
+        }
+
+        _subscription = std::move(hostname);
+
+        _messages.pop();
+
+        return true;
+    } catch (const std::runtime_error& ex) {
+        static LogRateLimit rate{10};
+
+        _logger.PrintInTerminal(MessageType::K_WARNING, "[client: " + GetClientAddress() + "] Subscription failed: " + std::string(ex.what()), rate);
 
         _messages.pop();
 
         return false;
     }
 }
+
+bool Session::IsViewer() const noexcept {
+    return !_subscription.empty();
+}
+
+const std::string& Session::GetSubscription() const noexcept {
+    return _subscription;
+}
+
+UniqueFD Session::ReleaseClientFD() noexcept {
+    return std::move(_client_fd);
+}
+
+std::vector<uint8_t> Session::TakeUnsent() noexcept {
+    return std::exchange(_response, {});
+}
+
+SessionState Session::TakeState() {
+    SessionState state;
+
+    state.addr = _client_addr;
+    state.port = _client_port;
+    state.protocol = _protocol;
+    state.frame_seq = _frame_seq;
+    state.credit_frames = _credit_frames;
+    state.credit_bytes = _credit_bytes;
+    state.received_frames = _received_frames;
+    state.received_bytes = _received_bytes;
+    state.capture_slot = _capture_slot;
+    state.is_relay = _is_relay;
+    state.unsent = TakeUnsent();
+
+    if (_identity) {
+        state.hostname = _identity->hostname;
+        state.username = _identity->username;
+    }
+
+    // Поток байт восстанавливается в исходном порядке: готовые сообщения,
+    // недособранное сообщение, затем еще не разобранный хвост
+    auto append{[&state](const Message& msg) {
+        state.unparsed.insert(state.unparsed.end(), msg.type_vec.begin(), msg.type_vec.end());
+        state.unparsed.insert(state.unparsed.end(), msg.size_vec.begin(), msg.size_vec.end());
+        state.unparsed.insert(state.unparsed.end(), msg.bytes_vec.begin(), msg.bytes_vec.end());
+    }};
+
+    for (; !_messages.empty(); _messages.pop()) {
+        append(_messages.front());
+    }
+
+    append(_message);
+    _message.Clear();
+
+    state.unparsed.insert(state.unparsed.end(), _request.begin(), _request.end());
+    _request.clear();
+
+    return state;
+}
+
+void Session::RestoreState(SessionState&& state) {
+    _protocol = state.protocol;
+    _frame_seq = state.frame_seq;
+    _credit_frames = state.credit_frames;
+    _credit_bytes = state.credit_bytes;
+    _received_frames = state.received_frames;
+    _received_bytes = state.received_bytes;
+    _is_relay = state.is_relay;
+    _response = std::move(state.unsent);
+    _request = std::move(state.unparsed);
+
+    if (!state.hostname.empty()) {
+        auto identity{std::make_unique<SessionIdentity>()};
+
+        identity->hostname = std::move(state.hostname);
+        identity->username = std::move(state.username);
+        identity->client = identity->hostname + "/" + identity->username;
+
+        _identity = std::move(identity);
+    }
+}
@@ -2,10 +2,20 @@
 #define SERVER_SERVER_SESSION_SESSION_H
 
 #include <queue>
+#include <memory>
 #include <vector>
 #include <string>
+#include <cstdint>
 
 #include "logger.h"
+#include "protocol.h"
+#include "viewer_hub.h"
+#include "storage_writer.h"
+#include "capture_scheduler.h"
+#include "admission_control.h"
+#include "hot_frame_cache.h"
+#include "upstream_relay.h"
+#include "encode_pool.h"
 #include "resource_factory.h"
 
 /**
@@ -20,6 +30,7 @@ struct Message {
     std::vector<uint8_t> type_vec;  ///< Вектор байт типа сообщения (1 байт)
     std::vector<uint8_t> size_vec;  ///< Вектор байт размера данных (4 байта)
     std::vector<uint8_t> bytes_vec; ///< Вектор байт данных сообщения
+    uint64_t received_us{};         ///< Время приема последнего байта (только при трассировке)
 
     /**
      * @brief Очистить все поля сообщения
@@ -28,9 +39,54 @@ struct Message {
         type_vec.clear();
         size_vec.clear();
         bytes_vec.clear();
+        received_us = 0;
     }
 };
 
+/**
+ * @brief Дескриптор сессии для epoll_event.data.u64
+ *
+ * Младшие 32 бита - файловый дескриптор (индекс в таблице сессий),
+ * старшие 32 бита - поколение сессии. Поколение защищает от событий,
+ * пришедших для уже закрытой сессии, чей fd был переиспользован ядром.
+ */
+using SessionHandle = uint64_t;
+
+/**
+ * @brief Данные аутентификации клиента
+ *
+ * Нужны только при сохранении скриншотов, поэтому хранятся
+ * вне объекта сессии и создаются после успешной аутентификации.
+ */
+struct SessionIdentity {
+    std::string hostname; ///< Имя хоста клиента
+    std::string username; ///< Имя пользователя клиента
+    std::string client;   ///< Ключ клиента ("hostname/username")
+};
+
+/**
+ * @brief Состояние сессии для передачи новому процессу сервера (см. HandoffChannel)
+ *
+ * Ограничения скорости и слот расписания принадлежат процессу и выдаются
+ * заново; поколение назначает новый процесс.
+ */
+struct SessionState {
+    uint32_t addr{};                                ///< IPv4-адрес клиента (сетевой порядок байт)
+    uint16_t port{};                                ///< Порт клиента
+    uint16_t protocol{};                            ///< Согласованная версия протокола
+    std::string hostname;                           ///< Имя хоста (пусто до аутентификации)
+    std::string username;                           ///< Имя пользователя
+    uint64_t frame_seq{};                           ///< Номер последнего принятого кадра
+    uint64_t credit_frames{};                       ///< Выданная граница кадров
+    uint64_t credit_bytes{};                        ///< Выданная граница байт
+    uint64_t received_frames{};                     ///< Принято кадров за соединение
+    uint64_t received_bytes{};                      ///< Принято байт данных кадров за соединение
+    uint32_t capture_slot{CaptureScheduler::SLOTS}; ///< Слот расписания (SLOTS - не назначен)
+    bool is_relay{false};                           ///< Клиент - ретранслятор
+    std::vector<uint8_t> unsent;                    ///< Неотправленные клиенту байты
+    std::vector<uint8_t> unparsed;                  ///< Принятые, но не обработанные байты (с границы сообщения)
+};
+
 /**
  * @brief Класс для управления клиентской сессией
  * 
@@ -42,12 +98,103 @@ public:
     /**
      * @brief Конструктор сессии
      * @param client_fd Уникальный файловый дескриптор клиентского сокета
-     * @param host IP-адрес клиента
-     * @param port Порт клиента
+     * @param generation Поколение сессии (см. SessionHandle)
+     * @param addr IPv4-адрес клиента (в сетевом порядке байт)
+     * @param port Порт клиента (в порядке байт хоста)
      */
-    Session(UniqueFD&& client_fd, const std::string& host, const std::string& port);
+    Session(UniqueFD&& client_fd, uint32_t generation, uint32_t addr, uint16_t port);
 
 public:
+    /**
+     * @brief Получить файловый дескриптор по дескриптору сессии
+     * @param handle Дескриптор сессии
+     * @return Файловый дескриптор
+     */
+    static int HandleToFD(SessionHandle handle) noexcept;
+
+    /**
+     * @brief Получить поколение по дескриптору сессии
+     * @param handle Дескриптор сессии
+     * @return Поколение сессии
+     */
+    static uint32_t HandleToGeneration(SessionHandle handle) noexcept;
+
+    /**
+     * @brief Проверить строки с hostname и username на валидность
+     * @param name Исходная строка
+     * @return true если все хорошо, иначе false
+     */
+    static bool IsValidName(const std::string& name);
+
+    /**
+     * @brief Прочитать uint8_t из буфера (без извлечения)
+     * @param buffer Входной буфер данных
+     * @return Прочитанное значение
+     * @throw std::runtime_error Если буфер слишком мал
+     */
+    static uint8_t PeekUint8(const std::vector<uint8_t>& buffer);
+
+    /**
+     * @brief Прочитать uint16_t из буфера (без извлечения)
+     * @param buffer Входной буфер данных
+     * @return Прочитанное значение (конвертируется из сетевого порядка)
+     * @throw std::runtime_error Если буфер слишком мал
+     */
+    static uint16_t PeekUint16(const std::vector<uint8_t>& buffer);
+
+    /**
+     * @brief Прочитать uint32_t из буфера (без извлечения)
+     * @param buffer Входной буфер данных
+     * @return Прочитанное значение (конвертируется из сетевого порядка)
+     * @throw std::runtime_error Если буфер слишком мал
+     */
+    static uint32_t PeekUint32(const std::vector<uint8_t>& buffer);
+
+    /**
+     * @brief Извлечь uint8_t из буфера
+     * @param buffer Буфер данных (будет модифицирован)
+     * @return Извлеченное значение
+     * @throw std::runtime_error Если буфер слишком мал
+     */
+    static uint8_t PopUint8(std::vector<uint8_t>& buffer);
+
+    /**
+     * @brief Извлечь uint16_t из буфера
+     * @param buffer Буфер данных (будет модифицирован)
+     * @return Извлеченное значение (конвертируется из сетевого порядка)
+     * @throw std::runtime_error Если буфер слишком мал
+     */
+    static uint16_t PopUint16(std::vector<uint8_t>& buffer);
+
+    /**
+     * @brief Извлечь uint32_t из буфера
+     * @param buffer Буфер данных (будет модифицирован)
+     * @return Извлеченное значение (конвертируется из сетевого порядка)
+     * @throw std::runtime_error Если буфер слишком мал
+     */
+    static uint32_t PopUint32(std::vector<uint8_t>& buffer);
+
+    /**
+     * @brief Извлечь строку из буфера
+     * @param buffer Буфер данных (будет модифицирован)
+     * @param str_len Длина извлекаемой строки
+     * @return Извлеченная строка
+     * @throw std::runtime_error Если буфер слишком мал
+     */
+    static std::string PopString(std::vector<uint8_t>& buffer, uint16_t str_len);
+
+    /**
+     * @brief Получить дескриптор сессии для epoll
+     * @return Поколение и файловый дескриптор, упакованные в 64 бита
+     */
+    SessionHandle GetHandle() const noexcept;
+
+    /**
+     * @brief Получить поколение сессии
+     * @return Поколение сессии
+     */
+    uint32_t GetGeneration() const noexcept;
+
     /**
      * @brief Получить файловый дескриптор клиента
      * @return Дескриптор сокета клиента
@@ -58,13 +205,19 @@ public:
      * @brief Получить IP-адрес клиента
      * @return Строка с IP-адресом
      */
-    std::string GetClientHost() const noexcept;
+    std::string GetClientHost() const;
 
     /**
      * @brief Получить порт клиента
-     * @return Строка с номером порта
+     * @return Номер порта
      */
-    std::string GetClientPort() const noexcept;
+    uint16_t GetClientPort() const noexcept;
+
+    /**
+     * @brief Получить адрес клиента для логов
+     * @return Строка в формате "ip:port"
+     */
+    std::string GetClientAddress() const;
 
     /**
      * @brief Получить тип текущего сообщения
@@ -76,9 +229,36 @@ public:
     /**
      * @brief Попытаться получить данные от клиента
      * @param fd Файловый дескриптор для чтения
+     * @param budget Максимум байт, которые можно прочитать за один ход
      * @return true если соединение активно, false если разрыв
+     *
+     * Если бюджет исчерпан раньше, чем сокет вернул EAGAIN,
+     * сессия помечается как имеющая непрочитанные данные (см. HasPendingInput()).
      */
-    bool TryRecv(int fd);
+    bool TryRecv(int fd, size_t budget);
+
+    /**
+     * @brief Проверить, остались ли в сокете непрочитанные данные
+     * @return true если последний TryRecv остановился из-за бюджета
+     */
+    bool HasPendingInput() const noexcept;
+
+    /**
+     * @brief Проверить, стоит ли сессия в очереди готовых к чтению
+     * @return true если сессия ожидает своего хода
+     */
+    bool IsScheduled() const noexcept;
+
+    /**
+     * @brief Отметить постановку сессии в очередь готовых к чтению
+     * @param scheduled Новое состояние
+     */
+    void SetScheduled(bool scheduled) noexcept;
+
+    /**
+     * @brief Отбросить текущее сообщение неизвестного типа
+     */
+    void DropMessage();
 
     /**
      * @brief Попытаться отправить данные клиенту
@@ -97,8 +277,41 @@ public:
 
     /**
      * @brief Разобрать полученные данные в сообщения
+     * @param trace Отмечать время приема сообщений (для трассировки кадров)
+     */
+    void ParseMessage(bool trace = false);
+
+    /**
+     * @brief Добавить байты во входной буфер, минуя сокет
+     * @param data Данные
+     * @param size Размер данных
+     *
+     * Позволяет разбирать поток сообщений без соединения (бенчмарки, инструменты).
+     */
+    void FeedRequest(const uint8_t* data, size_t size);
+
+    /**
+     * @brief Отбросить все разобранные сообщения
+     * @return Число отброшенных сообщений
      */
-    void ParseMessage();
+    size_t DiscardMessages() noexcept;
+
+    /**
+     * @brief Поставить в буфер отправки ответ на запрос аутентификации
+     * @param ok Результат аутентификации
+     *
+     * При ошибке - 'N'. Клиенту первой версии протокола - 'Y', клиенту,
+     * запросившему версию 2 и выше, - сообщение 'V' с согласованной версией.
+     * Отправляется вызывающим через TrySend(), чтобы следующие за 'V'
+     * сообщения ('C', 'P') ушли с ним одним сегментом.
+     */
+    void QueueHandshakeResponse(bool ok);
+
+    /**
+     * @brief Получить согласованную версию протокола
+     * @return Protocol::VERSION_1 до аутентификации или для старых клиентов
+     */
+    uint16_t GetProtocolVersion() const noexcept;
 
     /**
      * @brief Проверить пустоту буфера отправки
@@ -113,9 +326,116 @@ public:
     bool IsMessageComplete() const;
 
     /**
-     * @brief Обработать сообщение с изображением
+     * @brief Обработать сообщение с изображением ('I' или 'T')
+     * @param writer Поток записи, в очередь которого ставится кадр
+     * @param viewers Рассылка живым зрителям хоста
+     * @param cache Кэш горячих кадров (может отсутствовать)
+     *
+     * У 'T' отрезается хвост с клиентскими отметками времени; при включенной
+     * в writer трассировке они вместе с отметками сервера уходят в FrameTrace.
+     */
+    void HandleImgMessage(StorageWriter& writer, ViewerHub& viewers, HotFrameCache* cache);
+
+    /**
+     * @brief Обработать пачку кадров 'F' (протокол v2)
+     * @param writer Поток записи, в очередь которого ставятся кадры
+     * @param viewers Рассылка живым зрителям хоста
+     * @param cache Кэш горячих кадров (может отсутствовать)
+     *
+     * Пачка проверяется целиком до приема первого кадра: при любой ошибке
+     * разметки она отбрасывается полностью. Размеры, монитор и формат кадра
+     * берутся из заголовка кадра, PNG не разбирается.
+     */
+    void HandleBatchMessage(StorageWriter& writer, ViewerHub& viewers, HotFrameCache* cache);
+
+    /**
+     * @brief Обработать пачку кадров ретранслятора 'R' (протокол v3)
+     * @param writer Поток записи, в очередь которого ставятся кадры
+     * @param viewers Рассылка живым зрителям хоста
+     * @param cache Кэш горячих кадров (может отсутствовать)
+     *
+     * Каждый кадр сохраняется от имени hostname/username из своей записи и со
+     * временем получения ретранслятором. Пачки принимаются только с адресов
+     * --accept-relays (SetRelayAllowed()). После первой пачки сессия считается
+     * ретранслятором: кредит и ограничение скорости клиента к ней больше не
+     * применяются (их соблюдает сам ретранслятор), ограничение IP-адреса остается.
+     *
+     * @return false если адрес не допущен к ретрансляции и соединение нужно закрыть
+     */
+    bool HandleRelayMessage(StorageWriter& writer, ViewerHub& viewers, HotFrameCache* cache);
+
+    /**
+     * @brief Поставить в буфер отправки подтверждение сохранности кадров
+     * @param ack Диапазон надежно сохраненных кадров этой сессии
+     */
+    void QueueDurableAck(const DurableAck& ack);
+
+    /**
+     * @brief Открыть окно кредита и поставить в буфер отправки первую выдачу 'C'
+     * @param frames Окно в кадрах
+     * @param bytes Окно в байтах данных кадров
+     *
+     * Вызывается после успешного согласования версии 2. Без этого вызова
+     * сессия работает без управления потоком.
+     */
+    void OpenCredit(uint64_t frames, uint64_t bytes);
+
+    /**
+     * @brief Вернуть кредит за кадры, покинувшие очередь записи
+     * @param release Освобождение от потока записи
+     * @return true если в буфер отправки поставлена новая выдача 'C'
+     */
+    bool QueueCredit(const StorageRelease& release);
+
+    /**
+     * @brief Назначить слот расписания и поставить в буфер отправки сообщение 'P'
+     * @param slot Номер слота CaptureScheduler
+     * @param period_ms Период захвата
+     * @param phase_ms Фаза слота
+     */
+    void AssignCaptureSlot(uint32_t slot, uint32_t period_ms, uint32_t phase_ms);
+
+    /**
+     * @brief Забрать слот расписания (при закрытии сессии)
+     * @return Номер слота или CaptureScheduler::SLOTS, если слот не назначался
      */
-    void HandleImgMessage();
+    uint32_t ReleaseCaptureSlot() noexcept;
+
+    /**
+     * @brief Подключить ограничение скорости клиента (после аутентификации)
+     * @param limit Корзина в кадрах (nullptr - без ограничения)
+     */
+    void SetClientLimit(IngestLimit limit) noexcept;
+
+    /**
+     * @brief Подключить ограничение скорости IP-адреса
+     * @param limit Корзина в байтах данных кадров (nullptr - без ограничения)
+     */
+    void SetAddressLimit(IngestLimit limit) noexcept;
+
+    /**
+     * @brief Включить ретрансляцию кадров вместо сохранения
+     * @param relay Ретрансляция на вышестоящий сервер (nullptr - кадры сохраняются)
+     */
+    void SetUpstream(UpstreamRelay* relay) noexcept;
+
+    /**
+     * @brief Разрешить пачки ретранслятора 'R' с этого соединения
+     * @param allowed Адрес клиента входит в --accept-relays
+     */
+    void SetRelayAllowed(bool allowed) noexcept;
+
+    /**
+     * @brief Подключить пул кодирования кадров без PNG
+     * @param encoder Пул кодирования (nullptr - протокол ограничен версией 3)
+     */
+    void SetEncoder(EncodePool* encoder) noexcept;
+
+    /**
+     * @brief Получить ключ клиента
+     * @return "hostname/username" (пустая строка до аутентификации)
+     */
+    const std::string& GetClientKey() const noexcept;
 
     /**
      * @brief Обработать запрос аутентификации
@@ -123,64 +443,57 @@ public:
      */
     bool HandleAuthRequest();
 
-private:
     /**
-     * @brief Прочитать uint8_t из буфера (без извлечения)
-     * @param buffer Входной буфер данных
-     * @return Прочитанное значение
-     * @throw std::runtime_error Если буфер слишком мал
+     * @brief Обработать запрос подписки на кадры хоста
+     * @return true если подписка принята (сессия становится зрителем)
+     *
+     * Подписаться можно только после успешной аутентификации.
      */
-    uint8_t PeekUint8(const std::vector<uint8_t>& buffer) const;
+    bool HandleSubscribeRequest();
 
     /**
-     * @brief Прочитать uint16_t из буфера (без извлечения)
-     * @param buffer Входной буфер данных
-     * @return Прочитанное значение (конвертируется из сетевого порядка)
-     * @throw std::runtime_error Если буфер слишком мал
+     * @brief Проверить, стала ли сессия зрителем
+     * @return true если принят запрос подписки
      */
-    uint16_t PeekUint16(const std::vector<uint8_t>& buffer) const;
+    bool IsViewer() const noexcept;
 
     /**
-     * @brief Прочитать uint32_t из буфера (без извлечения)
-     * @param buffer Входной буфер данных
-     * @return Прочитанное значение (конвертируется из сетевого порядка)
-     * @throw std::runtime_error Если буфер слишком мал
+     * @brief Получить хост, на который подписан зритель
+     * @return Имя хоста (пустое, если сессия не зритель)
      */
-    uint32_t PeekUint32(const std::vector<uint8_t>& buffer) const;
+    const std::string& GetSubscription() const noexcept;
 
     /**
-     * @brief Извлечь uint8_t из буфера
-     * @param buffer Буфер данных (будет модифицирован)
-     * @return Извлеченное значение
-     * @throw std::runtime_error Если буфер слишком мал
+     * @brief Забрать сокет у сессии (для передачи зрителя в ViewerHub)
+     * @return Сокет клиента; сессия после этого не владеет соединением
      */
-    uint8_t PopUint8(std::vector<uint8_t>& buffer);
+    UniqueFD ReleaseClientFD() noexcept;
 
     /**
-     * @brief Извлечь uint16_t из буфера
-     * @param buffer Буфер данных (будет модифицирован)
-     * @return Извлеченное значение (конвертируется из сетевого порядка)
-     * @throw std::runtime_error Если буфер слишком мал
+     * @brief Забрать неотправленные байты
+     * @return Содержимое буфера отправки
      */
-    uint16_t PopUint16(std::vector<uint8_t>& buffer);
+    std::vector<uint8_t> TakeUnsent() noexcept;
 
     /**
-     * @brief Извлечь uint32_t из буфера
-     * @param buffer Буфер данных (будет модифицирован)
-     * @return Извлеченное значение (конвертируется из сетевого порядка)
-     * @throw std::runtime_error Если буфер слишком мал
+     * @brief Забрать состояние для передачи новому процессу
+     * @return Состояние; разобранные, но не обработанные сообщения возвращаются
+     *         в поток байт, чтобы новый процесс разобрал их заново
+     *
+     * После вызова сессия пуста и годится только для закрытия.
      */
-    uint32_t PopUint32(std::vector<uint8_t>& buffer);
+    SessionState TakeState();
 
     /**
-     * @brief Извлечь строку из буфера
-     * @param buffer Буфер данных (будет модифицирован)
-     * @param str_len Длина извлекаемой строки
-     * @return Извлеченная строка
-     * @throw std::runtime_error Если буфер слишком мал
+     * @brief Восстановить состояние, принятое от старого процесса
+     * @param state Состояние (данные перемещаются)
+     *
+     * Слот расписания не восстанавливается: вызывающий занимает его
+     * в своем CaptureScheduler и передает через AssignCaptureSlot().
      */
-    std::string PopString(std::vector<uint8_t>& buffer, uint16_t str_len);
+    void RestoreState(SessionState&& state);
 
+private:
     /**
      * @brief Сгенерировать строку идентификатора из хоста и порта
      * @return Строка в формате "ip_port" (например "192168011_8080")
@@ -188,13 +501,87 @@ private:
     std::string GetStringFromHostPort();
 
     /**
-     * @brief Сохранить скриншот из сообщения в файл
-     * @param msg Сообщение содержащее изображение
+     * @brief Передать скриншот на сохранение
+     * @param writer Поток записи
+     * @param identity Владелец кадра
+     * @param timestamp_ms Время получения кадра
+     * @param data Данные изображения
+     * @param header Заголовок кадра (для протокола v1 - пустой)
+     * @param trace Трассировка кадра (может отсутствовать)
      * 
-     * Сохраняет в папку screenshots/<hostname>/<username>/
-     * с именем файла <timestamp>_<host_port>.png
+     * Кадру присваивается очередной номер в рамках соединения.
+     * Раскладка на диске зависит от хранилища (см. FileStorage, SegmentStorage).
+     */
+    void SaveScreen(StorageWriter& writer, const SessionIdentity& identity, uint64_t timestamp_ms, FrameBuffer data,
+                    const Protocol::FrameHeader& header, std::unique_ptr<FrameTrace> trace);
+
+    /**
+     * @brief Собрать задание на сохранение кадра
+     * @param identity Владелец кадра
+     * @param timestamp_ms Время получения кадра
+     * @param data Данные изображения
+     * @param header Заголовок кадра (для протокола v1 - пустой)
+     * @param trace Трассировка кадра (может отсутствовать)
+     * @return Задание с очередным номером кадра в рамках соединения
+     */
+    StorageJob MakeStorageJob(const SessionIdentity& identity, uint64_t timestamp_ms, FrameBuffer data,
+                              const Protocol::FrameHeader& header, std::unique_ptr<FrameTrace> trace);
+
+    /**
+     * @brief Передать кадр в пул кодирования
+     * @param identity Владелец кадра
+     * @param timestamp_ms Время получения кадра
+     * @param data Данные кадра в формате клиента
+     * @param header Заголовок кадра
+     * @param trace Трассировка кадра (может отсутствовать)
+     *
+     * Зрители, кэш и запись (или ретрансляция) получают кадр из пула уже в PNG.
+     */
+    void EncodeFrame(const SessionIdentity& identity, uint64_t timestamp_ms, FrameBuffer data,
+                     const Protocol::FrameHeader& header, std::unique_ptr<FrameTrace> trace);
+
+    /**
+     * @brief Принять кадр клиента сессии: учесть кредит и ограничения скорости и передать в DeliverFrame()
+     * @param writer Поток записи
+     * @param viewers Рассылка живым зрителям хоста
+     * @param cache Кэш горячих кадров (может отсутствовать)
+     * @param data Данные изображения
+     * @param header Заголовок кадра (для протокола v1 - пустой)
+     * @param trace Трассировка кадра (может отсутствовать)
+     *
+     * Кадр сверх ограничения скорости клиента или IP-адреса отбрасывается.
+     */
+    void AcceptFrame(StorageWriter& writer, ViewerHub& viewers, HotFrameCache* cache, FrameBuffer data,
+                     const Protocol::FrameHeader& header, std::unique_ptr<FrameTrace> trace);
+
+    /**
+     * @brief Разослать кадр зрителям, сохранить или ретранслировать его и положить в кэш
+     * @param writer Поток записи
+     * @param viewers Рассылка живым зрителям хоста
+     * @param cache Кэш горячих кадров (может отсутствовать)
+     * @param identity Владелец кадра (клиент сессии или клиент ретранслятора)
+     * @param timestamp_ms Время получения кадра
+     * @param data Данные изображения
+     * @param header Заголовок кадра (для протокола v1 - пустой)
+     * @param trace Трассировка кадра (может отсутствовать)
+     *
+     * При ретрансляции кадр сразу возвращает кредит: он покинул сервер.
      */
-    void SaveScreen(const Message& msg);
+    void DeliverFrame(StorageWriter& writer, ViewerHub& viewers, HotFrameCache* cache, const SessionIdentity& identity,
+                      uint64_t timestamp_ms, FrameBuffer data, const Protocol::FrameHeader& header,
+                      std::unique_ptr<FrameTrace> trace);
+
+    /**
+     * @brief Проверить, допустим ли кодек кадра в пачке 'F'
+     * @param codec Кодек из заголовка кадра
+     * @return true для PNG, а с протоколом v4 и пулом кодирования - и для CODEC_RAW_*
+     */
+    bool IsAcceptedCodec(uint8_t codec) const noexcept;
+
+    /**
+     * @brief Поставить в буфер отправки текущие границы кредита
+     */
+    void QueueCreditGrant();
 
     /**
      * @brief Разобрать сообщение аутентификации
@@ -213,26 +600,37 @@ private:
      */
     bool FromReqToVec(std::vector<uint8_t>& vec, size_t len);
 
-    /**
-     * @brief Проверить строки с hostname и username на валидность
-     * @param name Исходная строка
-     * @return true если все хорошо, иначе false
-     */
-    bool IsValidName(const std::string& name);
-
 private:
-    UniqueFD _client_fd;            ///< Дескриптор клиентского сокета
-    std::string _client_host;       ///< IP-адрес клиента
-    std::string _client_port;       ///< Порт клиента
-    std::string _client_hostname;   ///< Имя хоста клиента
-    std::string _client_username;   ///< Имя пользователя клиента
-
-    Message _message;               ///< Текущее обрабатываемое сообщение
-    std::queue<Message> _messages;  ///< Очередь готовых сообщений
-    std::vector<uint8_t> _request;  ///< Буфер входящих данных
-    std::vector<uint8_t> _response; ///< Буфер исходящих данных
-
-    Logger _logger;                 ///< Логгер для записи событий
+    static Logger _logger;                           ///< Логгер для записи событий (общий для всех сессий)
+
+    UniqueFD _client_fd;                             ///< Дескриптор клиентского сокета
+    uint32_t _generation;                            ///< Поколение сессии
+    uint32_t _client_addr;                           ///< IPv4-адрес клиента (сетевой порядок байт)
+    uint16_t _client_port;                           ///< Порт клиента
+    bool _pending_input{false};                      ///< В сокете остались данные сверх бюджета
+    bool _scheduled{false};                          ///< Сессия стоит в очереди готовых к чтению
+    uint64_t _frame_seq{0};                          ///< Номер последнего принятого кадра
+    uint16_t _protocol{Protocol::VERSION_1};         ///< Согласованная версия протокола
+    uint64_t _credit_frames{0};                      ///< Выданная граница кадров (0 - без управления потоком)
+    uint64_t _credit_bytes{0};                       ///< Выданная граница байт данных кадров
+    uint64_t _received_frames{0};                    ///< Принято кадров за соединение
+    uint64_t _received_bytes{0};                     ///< Принято байт данных кадров за соединение
+    uint32_t _capture_slot{CaptureScheduler::SLOTS}; ///< Слот расписания (SLOTS - не назначен)
+    bool _is_relay{false};                           ///< Клиент - ретранслятор (прислал пачку 'R')
+    bool _relay_allowed{false};                      ///< Адрес клиента допущен к ретрансляции
+
+    std::unique_ptr<SessionIdentity> _identity;      ///< Данные аутентификации (nullptr до аутентификации)
+    IngestLimit _client_limit;                       ///< Ограничение скорости клиента (может отсутствовать)
+    IngestLimit _address_limit;                      ///< Ограничение скорости IP-адреса (может отсутствовать)
+    UpstreamRelay* _upstream{nullptr};               ///< Ретрансляция вместо сохранения (может отсутствовать)
+    EncodePool* _encoder{nullptr};                   ///< Пул кодирования кадров без PNG (может отсутствовать)
+    EncodePool::StrandHandle _strand;                ///< Очередь сессии в пуле (с первого кадра без PNG)
+    std::string _subscription;                       ///< Хост подписки зрителя (пусто для источника кадров)
+
+    Message _message;                                ///< Текущее обрабатываемое сообщение
+    std::queue<Message> _messages;                   ///< Очередь готовых сообщений
+    std::vector<uint8_t> _request;                   ///< Буфер входящих данных
+    std::vector<uint8_t> _response;                  ///< Буфер исходящих данных
 };
 
 #endif // SERVER_SERVER_SESSION_SESSION_H
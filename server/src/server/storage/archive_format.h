@@ -0,0 +1,58 @@
+#ifndef SERVER_SERVER_STORAGE_ARCHIVE_FORMAT_H
+#define SERVER_SERVER_STORAGE_ARCHIVE_FORMAT_H
+
+#include <cstdint>
+
+/**
+ * @brief Формат архива компактизации (см. CompactionManager)
+ *
+ * Старые кадры клиента упаковываются в файл <root>/<host>/<user>/<first_ms>.rfa:
+ * заголовок ArchiveHeader, подряд записи кадров и в конце индекс из
+ * ArchiveHeader::frames записей ArchiveEntry (порядок байт - хоста).
+ *
+ * Опорный кадр (KIND_KEYFRAME) хранится исходным PNG. Разностный (KIND_DELTA) -
+ * это сжатый zlib побайтовый XOR пикселей RGB с предыдущим кадром архива:
+ * неизменившиеся области экрана дают нули и почти ничего не занимают.
+ * Чтобы получить кадр, нужно разобрать ближайший предшествующий опорный
+ * и применить к нему разности по порядку.
+ *
+ * Архив пишется во временный файл (TMP_EXT) и получает свое имя после fdatasync,
+ * поэтому на диске бывают только целые архивы. Существующий архив с тем же
+ * именем никогда не заменяется.
+ */
+namespace Archive {
+constexpr char EXT[]{".rfa"};                                         ///< Расширение архива
+constexpr char TMP_EXT[]{".rfa.tmp"};                                 ///< Расширение недописанного архива
+constexpr uint8_t MAGIC[8]{'R', 'S', 'C', 'A', 'R', 'C', '0', '1'};   ///< Сигнатура архива
+constexpr uint8_t KIND_KEYFRAME{0};                                   ///< Опорный кадр: исходный PNG
+constexpr uint8_t KIND_DELTA{1};                                      ///< Разностный кадр: zlib(XOR с предыдущим)
+}
+
+/**
+ * @brief Заголовок архива
+ */
+struct ArchiveHeader {
+    uint8_t magic[8];      ///< Archive::MAGIC
+    uint32_t frames;       ///< Число кадров
+    uint32_t reserved;     ///< Выравнивание (ноль)
+    uint64_t index_offset; ///< Смещение индекса
+};
+
+/**
+ * @brief Запись индекса архива (один кадр)
+ */
+struct ArchiveEntry {
+    uint64_t timestamp_ms; ///< Время получения кадра (мс с начала эпохи)
+    uint64_t offset;       ///< Смещение записи кадра в архиве
+    uint32_t length;       ///< Длина записи кадра
+    uint16_t width;        ///< Ширина изображения
+    uint16_t height;       ///< Высота изображения
+    uint8_t kind;          ///< Вид записи (Archive::KIND_*)
+    uint8_t monitor;       ///< Номер монитора
+    uint8_t reserved[6];   ///< Выравнивание (нули)
+};
+
+static_assert(sizeof(ArchiveHeader) == 24, "ArchiveHeader layout");
+static_assert(sizeof(ArchiveEntry) == 32, "ArchiveEntry layout");
+
+#endif // SERVER_SERVER_STORAGE_ARCHIVE_FORMAT_H
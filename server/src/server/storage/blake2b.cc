@@ -0,0 +1,196 @@
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#include "blake2b.h"
+
+namespace {
+constexpr uint64_t IV[8]{
+    0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+    0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL, 0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+};
+
+constexpr uint8_t SIGMA[12][16]{
+    { 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15},
+    {14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3},
+    {11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4},
+    { 7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8},
+    { 9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13},
+    { 2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9},
+    {12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11},
+    {13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10},
+    { 6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5},
+    {10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13,  0},
+    { 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15},
+    {14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3}
+};
+
+inline uint64_t Rotr64(uint64_t x, int n) {
+    return (x >> n) | (x << (64 - n));
+}
+
+inline uint64_t Load64(const uint8_t* p) {
+    uint64_t value{0};
+
+    for (int i{7}; i >= 0; --i) {
+        value = (value << 8) | p[i];
+    }
+
+    return value;
+}
+
+inline void Mix(uint64_t* v, int a, int b, int c, int d, uint64_t x, uint64_t y) {
+    v[a] = v[a] + v[b] + x;
+    v[d] = Rotr64(v[d] ^ v[a], 32);
+    v[c] = v[c] + v[d];
+    v[b] = Rotr64(v[b] ^ v[c], 24);
+    v[a] = v[a] + v[b] + y;
+    v[d] = Rotr64(v[d] ^ v[a], 16);
+    v[c] = v[c] + v[d];
+    v[b] = Rotr64(v[b] ^ v[c], 63);
+}
+}
+
+Blake2b::Blake2b(size_t digest_size) :
+    _digest_size(digest_size)
+{
+    if (digest_size == 0 || digest_size > 64) {
+        throw std::invalid_argument("Invalid BLAKE2b digest size");
+    }
+
+    for (size_t i{0}; i < 8; ++i) {
+        _h[i] = IV[i];
+    }
+
+    // Блок параметров: длина хеша, без ключа, fanout = depth = 1
+    _h[0] ^= 0x01010000ULL ^ static_cast<uint64_t>(digest_size);
+}
+
+void Blake2b::Compress(const uint8_t* block, bool last) {
+    uint64_t m[16];
+    uint64_t v[16];
+
+    for (int i{0}; i < 16; ++i) {
+        m[i] = Load64(block + i * 8);
+    }
+
+    for (int i{0}; i < 8; ++i) {
+        v[i] = _h[i];
+        v[i + 8] = IV[i];
+    }
+
+    v[12] ^= _counter[0];
+    v[13] ^= _counter[1];
+
+    if (last) {
+        v[14] = ~v[14];
+    }
+
+    for (int round{0}; round < 12; ++round) {
+        const uint8_t* s{SIGMA[round]};
+
+        Mix(v, 0, 4,  8, 12, m[s[0]],  m[s[1]]);
+        Mix(v, 1, 5,  9, 13, m[s[2]],  m[s[3]]);
+        Mix(v, 2, 6, 10, 14, m[s[4]],  m[s[5]]);
+        Mix(v, 3, 7, 11, 15, m[s[6]],  m[s[7]]);
+        Mix(v, 0, 5, 10, 15, m[s[8]],  m[s[9]]);
+        Mix(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+        Mix(v, 2, 7,  8, 13, m[s[12]], m[s[13]]);
+        Mix(v, 3, 4,  9, 14, m[s[14]], m[s[15]]);
+    }
+
+    for (int i{0}; i < 8; ++i) {
+        _h[i] ^= v[i] ^ v[i + 8];
+    }
+}
+
+void Blake2b::Update(const uint8_t* data, size_t size) {
+    while (size > 0) {
+        // Последний блок сжимается только в Final(), поэтому полный буфер
+        // сбрасываем лишь когда точно известно, что за ним есть данные
+        if (_buffer_size == _buffer.size()) {
+            _counter[0] += _buffer.size();
+
+            if (_counter[0] < _buffer.size()) {
+                ++_counter[1];
+            }
+
+            Compress(_buffer.data(), false);
+
+            _buffer_size = 0;
+        }
+
+        size_t chunk{std::min(size, _buffer.size() - _buffer_size)};
+
+        std::memcpy(_buffer.data() + _buffer_size, data, chunk);
+
+        _buffer_size += chunk;
+        data += chunk;
+        size -= chunk;
+    }
+}
+
+void Blake2b::Final(uint8_t* out) {
+    _counter[0] += _buffer_size;
+
+    if (_counter[0] < _buffer_size) {
+        ++_counter[1];
+    }
+
+    std::memset(_buffer.data() + _buffer_size, 0, _buffer.size() - _buffer_size);
+
+    Compress(_buffer.data(), true);
+
+    for (size_t i{0}; i < _digest_size; ++i) {
+        out[i] = static_cast<uint8_t>(_h[i / 8] >> (8 * (i % 8)));
+    }
+}
+
+FrameHash Blake2b::Hash128(const uint8_t* data, size_t size) {
+    FrameHash hash{};
+
+    Blake2b blake(hash.size());
+    blake.Update(data, size);
+    blake.Final(hash.data());
+
+    return hash;
+}
+
+std::string Blake2b::ToHex(const FrameHash& hash) {
+    constexpr char DIGITS[]{"0123456789abcdef"};
+
+    std::string hex;
+    hex.reserve(hash.size() * 2);
+
+    for (uint8_t byte : hash) {
+        hex.push_back(DIGITS[byte >> 4]);
+        hex.push_back(DIGITS[byte & 0x0f]);
+    }
+
+    return hex;
+}
+
+bool Blake2b::FromHex(const std::string& hex, FrameHash& hash) {
+    if (hex.size() != hash.size() * 2) {
+        return false;
+    }
+
+    auto nibble{[](char c) -> int {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        return -1;
+    }};
+
+    for (size_t i{0}; i < hash.size(); ++i) {
+        int high{nibble(hex[2 * i])};
+        int low{nibble(hex[2 * i + 1])};
+
+        if (high < 0 || low < 0) {
+            return false;
+        }
+
+        hash[i] = static_cast<uint8_t>((high << 4) | low);
+    }
+
+    return true;
+}
@@ -0,0 +1,98 @@
+#ifndef SERVER_SERVER_STORAGE_BLAKE2B_H
+#define SERVER_SERVER_STORAGE_BLAKE2B_H
+
+#include <array>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @brief 128-битный хеш содержимого кадра
+ */
+using FrameHash = std::array<uint8_t, 16>;
+
+/**
+ * @brief Хешер FrameHash для unordered-контейнеров
+ *
+ * Хеш криптографический, поэтому достаточно первых 8 байт.
+ */
+struct FrameHashHasher {
+    size_t operator()(const FrameHash& hash) const noexcept {
+        size_t value{0};
+
+        for (size_t i{0}; i < sizeof(value); ++i) {
+            value = (value << 8) | hash[i];
+        }
+
+        return value;
+    }
+};
+
+/**
+ * @brief Реализация BLAKE2b (RFC 7693) без ключа
+ *
+ * Используется для адресации кадров по содержимому: стойкая к коллизиям
+ * и при этом быстрая (порядка 1 ГБ/с на ядро без SIMD).
+ */
+class Blake2b {
+public:
+    /**
+     * @brief Конструктор
+     * @param digest_size Размер хеша в байтах (1-64)
+     */
+    explicit Blake2b(size_t digest_size);
+
+public:
+    /**
+     * @brief Добавить данные
+     * @param data Данные
+     * @param size Размер данных
+     */
+    void Update(const uint8_t* data, size_t size);
+
+    /**
+     * @brief Завершить вычисление
+     * @param[out] out Буфер размером не меньше digest_size
+     */
+    void Final(uint8_t* out);
+
+    /**
+     * @brief Посчитать 128-битный хеш кадра
+     * @param data Данные
+     * @param size Размер данных
+     * @return Хеш
+     */
+    static FrameHash Hash128(const uint8_t* data, size_t size);
+
+    /**
+     * @brief Представить хеш в шестнадцатеричном виде
+     * @param hash Хеш
+     * @return Строка из 32 символов
+     */
+    static std::string ToHex(const FrameHash& hash);
+
+    /**
+     * @brief Разобрать хеш из шестнадцатеричной строки
+     * @param hex Строка из 32 символов
+     * @param[out] hash Хеш
+     * @return true если строка корректна
+     */
+    static bool FromHex(const std::string& hex, FrameHash& hash);
+
+private:
+    /**
+     * @brief Сжать очередной блок
+     * @param block Блок из 128 байт
+     * @param last Признак последнего блока
+     */
+    void Compress(const uint8_t* block, bool last);
+
+private:
+    std::array<uint64_t, 8> _h{};       ///< Состояние
+    std::array<uint8_t, 128> _buffer{}; ///< Неполный блок
+    size_t _buffer_size{0};             ///< Заполнено байт в _buffer
+    uint64_t _counter[2]{};             ///< Счетчик обработанных байт
+    size_t _digest_size;                ///< Размер хеша
+};
+
+#endif // SERVER_SERVER_STORAGE_BLAKE2B_H
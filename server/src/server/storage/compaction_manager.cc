@@ -0,0 +1,402 @@
+#include <cstdio>
+#include <algorithm>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "metrics.h"
+#include "storage_io.h"
+#include "frame_archive.h"
+#include "compaction_manager.h"
+
+namespace Limit {
+constexpr unsigned MAX_THREADS{4};
+constexpr size_t MAX_ARCHIVE_FRAMES{1000};
+constexpr size_t MIN_ARCHIVE_FRAMES{2};
+constexpr uint64_t IDLE_CLIENT_MS{60 * 60 * 1000}; // неполный архив - если клиент молчит час
+constexpr auto PASS_INTERVAL{std::chrono::minutes(1)};
+constexpr int BACKGROUND_NICE{10};
+}
+
+namespace fs = std::filesystem;
+
+namespace {
+Metrics::Counter& frames_compacted{Metrics::MetricsRegistry::Global().AddCounter(
+    "server_compaction_frames_total", "Frames packed into keyframe+delta archives")};
+Metrics::Counter& archives_written{Metrics::MetricsRegistry::Global().AddCounter(
+    "server_compaction_archives_total", "Compaction archives written")};
+Metrics::Counter& bytes_in{Metrics::MetricsRegistry::Global().AddCounter(
+    "server_compaction_input_bytes_total", "Bytes of storage units removed after packing")};
+Metrics::Counter& bytes_out{Metrics::MetricsRegistry::Global().AddCounter(
+    "server_compaction_output_bytes_total", "Bytes of compaction archives written")};
+Metrics::Counter& frames_skipped{Metrics::MetricsRegistry::Global().AddCounter(
+    "server_compaction_skipped_frames_total", "Frames left unpacked because they could not be read or decoded")};
+Metrics::Histogram& pass_seconds{Metrics::MetricsRegistry::Global().AddHistogram(
+    "server_compaction_pass_seconds", "Duration of one compaction pass over all clients")};
+
+uint64_t NowMs() {
+    auto now{std::chrono::system_clock::now().time_since_epoch()};
+
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(now).count());
+}
+
+/// Фоновый поток: idle-класс ввода-вывода и пониженный приоритет процессора (только для этого потока)
+void SetBackgroundPriority() {
+    StorageIO::SetIdleIOPriority();
+
+    setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), Limit::BACKGROUND_NICE);
+}
+
+bool EndsWith(const std::string& value, const std::string& suffix) {
+    return value.size() >= suffix.size() && value.compare(value.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+std::string FormatMb(uint64_t bytes) {
+    return std::to_string(bytes / (1024 * 1024)) + " MB";
+}
+
+/// Путь нового архива: <время первого кадра>.rfa, а если имя занято - <время>_<n>.rfa
+fs::path MakeArchivePath(const fs::path& dir, uint64_t timestamp_ms) {
+    std::string stem{std::to_string(timestamp_ms)};
+    fs::path path{dir / (stem + Archive::EXT)};
+    std::error_code ec;
+
+    for (unsigned n{1}; fs::exists(path, ec); ++n) {
+        path = dir / (stem + "_" + std::to_string(n) + Archive::EXT);
+    }
+
+    return path;
+}
+}
+
+CompactionManager::CompactionManager(fs::path root, const CompactionPolicy& policy, FrameStorage& storage) :
+    _root(std::move(root)),
+    _policy(policy),
+    _storage(storage)
+{}
+
+CompactionManager::~CompactionManager() {
+    Stop();
+}
+
+void CompactionManager::Start() {
+    _worker = std::thread(&CompactionManager::WorkerLoop, this);
+}
+
+void CompactionManager::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+
+    _wake.notify_all();
+
+    if (_worker.joinable()) {
+        _worker.join();
+    }
+}
+
+void CompactionManager::SetCompactCallback(CompactCallback callback) {
+    _on_compact = std::move(callback);
+}
+
+void CompactionManager::WorkerLoop() {
+    SetBackgroundPriority();
+
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    while (!_stop) {
+        lock.unlock();
+
+        RunPass();
+
+        lock.lock();
+
+        _wake.wait_for(lock, Limit::PASS_INTERVAL, [&] {
+            return _stop.load();
+        });
+    }
+}
+
+void CompactionManager::RunPass() {
+    auto started{std::chrono::steady_clock::now()};
+    uint64_t cutoff_ms{NowMs() - uint64_t{_policy.min_age_sec} * 1000};
+
+    struct ClientDir {
+        fs::path path;
+        std::string hostname;
+        std::string username;
+    };
+
+    std::vector<ClientDir> clients;
+    std::error_code ec;
+
+    for (const auto& host : fs::directory_iterator(_root, ec)) {
+        // Служебные каталоги хранилищ (.blobs) начинаются с точки
+        if (!host.is_directory(ec) || host.path().filename().string().front() == '.') {
+            continue;
+        }
+
+        std::error_code user_ec;
+
+        for (const auto& user : fs::directory_iterator(host.path(), user_ec)) {
+            if (user.is_directory(user_ec)) {
+                clients.push_back(ClientDir{user.path(), host.path().filename().string(), user.path().filename().string()});
+            }
+        }
+    }
+
+    unsigned threads{std::clamp(std::thread::hardware_concurrency(), 1U, Limit::MAX_THREADS)};
+    threads = std::min<unsigned>(threads, std::max<size_t>(clients.size(), 1));
+
+    std::atomic<size_t> next_client{0};
+    PassStats stats;
+
+    auto compact{[&] {
+        for (size_t i{next_client++}; i < clients.size() && !_stop; i = next_client++) {
+            CompactClient(clients[i].path, clients[i].hostname, clients[i].username, cutoff_ms, stats);
+        }
+    }};
+
+    std::vector<std::thread> workers;
+
+    for (unsigned i{1}; i < threads; ++i) {
+        workers.emplace_back([&] {
+            SetBackgroundPriority();
+            compact();
+        });
+    }
+
+    compact();
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    PruneQuarantine();
+
+    pass_seconds.ObserveSince(started);
+
+    if (stats.archives == 0) {
+        return;
+    }
+
+    char ratio[32]{};
+    std::snprintf(ratio, sizeof(ratio), "%.1fx", static_cast<double>(stats.bytes_in) / static_cast<double>(std::max<uint64_t>(stats.bytes_out, 1)));
+
+    _logger.PrintInTerminal(
+        MessageType::K_INFO,
+        "compaction: packed " + std::to_string(stats.frames) + " frames into " + std::to_string(stats.archives) +
+        " archives (" + std::to_string(clients.size()) + " clients scanned), " + FormatMb(stats.bytes_in) + " -> " + FormatMb(stats.bytes_out) + " (" + ratio + ")"
+    );
+}
+
+void CompactionManager::CompactClient(const fs::path& dir, const std::string& hostname, const std::string& username,
+                                      uint64_t cutoff_ms, PassStats& stats) {
+    std::vector<Candidate> candidates;
+    std::error_code ec;
+
+    for (const auto& file : fs::directory_iterator(dir, ec)) {
+        const fs::path& path{file.path()};
+
+        // Недописанный архив остается только после сбоя: проходы по клиенту не пересекаются
+        if (EndsWith(path.string(), Archive::TMP_EXT)) {
+            StorageIO::RemoveFile(path.string());
+            continue;
+        }
+
+        // Отложенная единица уже не упаковалась однажды
+        if (IsQuarantined(path.string())) {
+            continue;
+        }
+
+        Candidate candidate;
+
+        if (ArchiveReader::IsArchive(path) || !_storage.ListUnitFrames(path, candidate.frames) || candidate.frames.empty()) {
+            continue;
+        }
+
+        candidate.path = path.string();
+
+        for (const auto& frame : candidate.frames) {
+            candidate.newest_ms = std::max(candidate.newest_ms, frame.timestamp_ms);
+        }
+
+        if (candidate.newest_ms < cutoff_ms) {
+            candidates.push_back(std::move(candidate));
+        }
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate& lhs, const Candidate& rhs) {
+        return lhs.newest_ms < rhs.newest_ms;
+    });
+
+    std::vector<Candidate> group;
+    size_t group_frames{0};
+
+    for (auto& candidate : candidates) {
+        group_frames += candidate.frames.size();
+        group.push_back(std::move(candidate));
+
+        if (group_frames >= Limit::MAX_ARCHIVE_FRAMES) {
+            if (!WriteArchive(dir, hostname, username, group, stats)) {
+                return;
+            }
+
+            group.clear();
+            group_frames = 0;
+        }
+    }
+
+    // Хвост ждет, пока наберется полный архив, если только клиент не замолчал надолго
+    if (group_frames >= Limit::MIN_ARCHIVE_FRAMES && group.back().newest_ms + Limit::IDLE_CLIENT_MS < cutoff_ms) {
+        WriteArchive(dir, hostname, username, group, stats);
+    }
+}
+
+bool CompactionManager::WriteArchive(const fs::path& dir, const std::string& hostname, const std::string& username,
+                                     const std::vector<Candidate>& group, PassStats& stats) {
+    // Кадр и номер его единицы в группе: путь кадра у DedupStorage - это блок, а не журнал
+    std::vector<std::pair<const StoredFrame*, size_t>> frames;
+
+    for (size_t i{0}; i < group.size(); ++i) {
+        for (const auto& frame : group[i].frames) {
+            frames.emplace_back(&frame, i);
+        }
+    }
+
+    std::stable_sort(frames.begin(), frames.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.first->timestamp_ms < rhs.first->timestamp_ms;
+    });
+
+    fs::path path{MakeArchivePath(dir, frames.front().first->timestamp_ms)};
+
+    CompactedArchive result;
+    std::vector<bool> failed(group.size(), false);
+
+    try {
+        ArchiveWriter writer(path, _policy.keyframe_interval);
+        std::vector<uint8_t> data;
+
+        for (const auto& [frame, unit] : frames) {
+            if (_stop) {
+                return false;
+            }
+
+            if (frame->codec != FrameCodec::K_PNG || !ReadFrame(*frame, data) ||
+                !writer.Add(frame->timestamp_ms, frame->monitor, data)) {
+                frames_skipped.Inc();
+                failed[unit] = true;
+            }
+        }
+
+        for (size_t i{0}; i < group.size(); ++i) {
+            if (failed[i]) {
+                Quarantine(group[i].path);
+            }
+        }
+
+        if (writer.GetEntries().empty()) {
+            return true;
+        }
+
+        result.unit.bytes = writer.Finish();
+
+        for (const ArchiveEntry& entry : writer.GetEntries()) {
+            StoredFrame frame;
+            frame.timestamp_ms = entry.timestamp_ms;
+            frame.codec = FrameCodec::K_ARCHIVED;
+            frame.width = entry.width;
+            frame.height = entry.height;
+            frame.monitor = entry.monitor;
+            frame.location.path = path.string();
+            frame.location.offset = entry.offset;
+            frame.location.length = entry.length;
+
+            result.frames.push_back(std::move(frame));
+        }
+    } catch (const std::runtime_error& e) {
+        static LogRateLimit rate{10};
+
+        _logger.PrintInTerminal(MessageType::K_ERROR, "compaction failed: " + std::string(e.what()), rate);
+
+        return false;
+    }
+
+    // Единица с кадром, не попавшим в архив, остается целиком: ее кадры теперь есть и там, и там
+    uint64_t removed_bytes{0};
+
+    for (size_t i{0}; i < group.size(); ++i) {
+        if (failed[i]) {
+            continue;
+        }
+
+        removed_bytes += _storage.RemoveUnit(group[i].path);
+        result.removed.push_back(group[i].path);
+    }
+
+    result.unit.hostname = hostname;
+    result.unit.username = username;
+    result.unit.path = path.string();
+    result.unit.newest_ms = result.frames.back().timestamp_ms;
+    result.unit.closed = true;
+
+    frames_compacted.Inc(result.frames.size());
+    archives_written.Inc();
+    bytes_in.Inc(removed_bytes);
+    bytes_out.Inc(result.unit.bytes);
+
+    stats.archives += 1;
+    stats.frames += result.frames.size();
+    stats.bytes_in += removed_bytes;
+    stats.bytes_out += result.unit.bytes;
+
+    if (_on_compact) {
+        _on_compact(result);
+    }
+
+    return true;
+}
+
+void CompactionManager::Quarantine(const std::string& path) {
+    static LogRateLimit rate{10};
+
+    _logger.PrintInTerminal(MessageType::K_WARNING, "compaction: " + path + " has unreadable frames, left unpacked", rate);
+
+    std::lock_guard<std::mutex> lock(_quarantine_mutex);
+    _quarantine.insert(path);
+}
+
+bool CompactionManager::IsQuarantined(const std::string& path) {
+    std::lock_guard<std::mutex> lock(_quarantine_mutex);
+
+    return _quarantine.count(path) > 0;
+}
+
+void CompactionManager::PruneQuarantine() {
+    std::lock_guard<std::mutex> lock(_quarantine_mutex);
+    std::error_code ec;
+
+    for (auto it{_quarantine.begin()}; it != _quarantine.end();) {
+        if (fs::exists(*it, ec)) {
+            ++it;
+        } else {
+            it = _quarantine.erase(it);
+        }
+    }
+}
+
+bool CompactionManager::ReadFrame(const StoredFrame& frame, std::vector<uint8_t>& data) {
+    UniqueFD fd(ResourceFactory::MakeUniqueFD(open(frame.location.path.c_str(), O_RDONLY | O_CLOEXEC)));
+
+    if (!fd.Valid()) {
+        return false;
+    }
+
+    data.resize(frame.location.length);
+
+    return pread(fd.Get(), data.data(), data.size(), static_cast<off_t>(frame.location.offset)) == static_cast<ssize_t>(data.size());
+}
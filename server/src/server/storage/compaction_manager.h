@@ -0,0 +1,201 @@
+#ifndef SERVER_SERVER_STORAGE_COMPACTION_MANAGER_H
+#define SERVER_SERVER_STORAGE_COMPACTION_MANAGER_H
+
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <filesystem>
+#include <unordered_set>
+#include <condition_variable>
+
+#include "logger.h"
+#include "frame_storage.h"
+
+/**
+ * @brief Политика компактизации старых кадров
+ */
+struct CompactionPolicy {
+    unsigned min_age_sec{};         ///< Упаковывать кадры старше этого возраста (0 - компактизация выключена)
+    unsigned keyframe_interval{30}; ///< Опорный кадр не реже чем раз в столько кадров
+
+    /**
+     * @brief Проверить, включена ли компактизация
+     * @return true если задан возраст кадров
+     */
+    bool Enabled() const noexcept {
+        return min_age_sec != 0;
+    }
+};
+
+/**
+ * @brief Результат упаковки одной группы единиц хранения в архив
+ */
+struct CompactedArchive {
+    StorageUnit unit;                 ///< Новый архив как единица хранения
+    std::vector<std::string> removed; ///< Удаленные после упаковки единицы
+    std::vector<StoredFrame> frames;  ///< Кадры архива
+};
+
+/**
+ * @brief Фоновая компактизация старых кадров в архивы "опорный кадр + разности"
+ *
+ * Соседние скриншоты одного клиента почти совпадают, поэтому кадры старше
+ * min_age_sec упаковываются в архивы (см. archive_format.h): опорный кадр
+ * остается исходным PNG, а следующие хранятся сжатой разностью с предыдущим.
+ * Исходные единицы удаляются только после того, как архив надежно записан.
+ *
+ * Проход запускается раз в минуту. Каталоги клиентов делятся между несколькими
+ * потоками с idle-приоритетом ввода-вывода и пониженным приоритетом процессора,
+ * поэтому компактизация не мешает приему кадров. Архив собирается из целых
+ * единиц хранения до MAX_ARCHIVE_FRAMES кадров; неполный архив пишется только
+ * когда клиент давно не присылал кадров, иначе кадры ждут следующего прохода.
+ *
+ * Работает с хранилищем "один кадр - один файл": его единицы закрыты сразу
+ * после записи, и их можно читать и удалять в любой момент (поэтому сервер
+ * включает компактизацию только для --storage files).
+ *
+ * Единица, кадр которой не удалось прочитать или разобрать, остается на месте
+ * и больше не упаковывается, пока существует. Архив получает имя по времени
+ * первого кадра (с суффиксом, если имя занято) и никогда не заменяет другой.
+ */
+class CompactionManager {
+public:
+    /**
+     * @brief Конструктор
+     * @param root Корневой каталог хранилища
+     * @param policy Политика компактизации
+     * @param storage Хранилище (должно жить дольше менеджера или до Stop())
+     */
+    CompactionManager(std::filesystem::path root, const CompactionPolicy& policy, FrameStorage& storage);
+
+    /**
+     * @brief Деструктор - останавливает поток компактизации
+     */
+    ~CompactionManager();
+
+    CompactionManager(const CompactionManager&) = delete;
+    CompactionManager& operator=(const CompactionManager&) = delete;
+
+public:
+    /**
+     * @brief Запустить поток компактизации
+     */
+    void Start();
+
+    /**
+     * @brief Остановить поток компактизации (повторный вызов безопасен)
+     *
+     * Недописанный архив удаляется, исходные кадры остаются на месте.
+     */
+    void Stop();
+
+    /// Вызывается после записи архива и удаления упакованных единиц
+    using CompactCallback = std::function<void(const CompactedArchive& archive)>;
+
+    /**
+     * @brief Установить обработчик записанных архивов (до Start())
+     * @param callback Обработчик (вызывается из потоков компактизации)
+     */
+    void SetCompactCallback(CompactCallback callback);
+
+private:
+    /**
+     * @brief Итоги прохода
+     */
+    struct PassStats {
+        std::atomic<uint64_t> archives{0};  ///< Записано архивов
+        std::atomic<uint64_t> frames{0};    ///< Упаковано кадров
+        std::atomic<uint64_t> bytes_in{0};  ///< Объем удаленных единиц
+        std::atomic<uint64_t> bytes_out{0}; ///< Объем записанных архивов
+    };
+
+    /**
+     * @brief Единица хранения - кандидат на упаковку
+     */
+    struct Candidate {
+        std::string path;                ///< Путь к единице
+        uint64_t newest_ms{};            ///< Время последнего кадра
+        std::vector<StoredFrame> frames; ///< Кадры единицы
+    };
+
+    /// Основной цикл потока компактизации
+    void WorkerLoop();
+
+    /**
+     * @brief Выполнить проход по всем клиентам
+     */
+    void RunPass();
+
+    /**
+     * @brief Упаковать старые кадры одного клиента
+     * @param dir Каталог клиента
+     * @param hostname Имя хоста клиента
+     * @param username Имя пользователя клиента
+     * @param cutoff_ms Упаковываются единицы, все кадры которых старше этого времени
+     * @param stats Итоги прохода
+     */
+    void CompactClient(const std::filesystem::path& dir, const std::string& hostname, const std::string& username,
+                       uint64_t cutoff_ms, PassStats& stats);
+
+    /**
+     * @brief Записать архив из группы единиц и удалить упакованные единицы
+     * @param dir Каталог клиента
+     * @param hostname Имя хоста клиента
+     * @param username Имя пользователя клиента
+     * @param group Единицы по возрастанию времени
+     * @param stats Итоги прохода
+     * @return false если проход прерван остановкой или архив не записан
+     */
+    bool WriteArchive(const std::filesystem::path& dir, const std::string& hostname, const std::string& username,
+                      const std::vector<Candidate>& group, PassStats& stats);
+
+    /**
+     * @brief Прочитать кадр из единицы хранения
+     * @param frame Кадр
+     * @param[out] data Данные кадра
+     * @return true если кадр прочитан целиком
+     */
+    static bool ReadFrame(const StoredFrame& frame, std::vector<uint8_t>& data);
+
+    /**
+     * @brief Отложить единицу, которую не удалось упаковать
+     * @param path Путь к единице
+     */
+    void Quarantine(const std::string& path);
+
+    /**
+     * @brief Проверить, отложена ли единица
+     * @param path Путь к единице
+     * @return true если единицу упаковывать не нужно
+     */
+    bool IsQuarantined(const std::string& path);
+
+    /**
+     * @brief Забыть отложенные единицы, которых больше нет на диске
+     */
+    void PruneQuarantine();
+
+private:
+    std::filesystem::path _root;                 ///< Корневой каталог
+    CompactionPolicy _policy;                    ///< Политика компактизации
+    FrameStorage& _storage;                      ///< Хранилище
+
+    std::mutex _mutex;                           ///< Защищает флаг остановки для _wake
+    std::condition_variable _wake;               ///< Остановка
+    std::atomic<bool> _stop{false};              ///< Флаг остановки (проверяется и между кадрами)
+
+    CompactCallback _on_compact;                 ///< Обработчик записанных архивов
+
+    std::mutex _quarantine_mutex;                ///< Защищает _quarantine (потоки прохода)
+    std::unordered_set<std::string> _quarantine; ///< Единицы, которые не удалось упаковать
+
+    std::thread _worker;                         ///< Поток компактизации
+
+    Logger _logger;                              ///< Логгер
+};
+
+#endif // SERVER_SERVER_STORAGE_COMPACTION_MANAGER_H
@@ -0,0 +1,59 @@
+#ifndef SERVER_SERVER_STORAGE_DEDUP_FORMAT_H
+#define SERVER_SERVER_STORAGE_DEDUP_FORMAT_H
+
+#include <cstdint>
+
+/**
+ * @brief Формат дедуплицирующего хранилища
+ *
+ * Уникальное содержимое кадра хранится один раз: <root>/.blobs/<xx>/<hash>,
+ * где hash - 128-битный BLAKE2b в hex, xx - его первые два символа.
+ * Каждый принятый кадр - это запись DedupRefEntry в журнале ссылок клиента
+ * <root>/<host>/<user>/<start_ms>.refs (заголовок DedupRefsHeader, далее записи).
+ * Журналы ротируются по времени; при истечении срока журнал удаляется целиком,
+ * а блоки, на которые больше никто не ссылается, удаляются.
+ */
+namespace Dedup {
+constexpr char BLOBS_DIR[]{".blobs"};                                     ///< Каталог блоков (не может совпасть с hostname)
+constexpr char REFS_EXT[]{".refs"};                                       ///< Расширение журнала ссылок
+constexpr char TMP_EXT[]{".tmp"};                                         ///< Расширение недописанного блока
+constexpr uint8_t REFS_MAGIC[8]{'R', 'S', 'C', 'R', 'E', 'F', '0', '1'};  ///< Сигнатура журнала ссылок
+constexpr uint8_t INDEX_MAGIC[8]{'R', 'S', 'C', 'I', 'D', 'X', '0', '1'}; ///< Сигнатура индекса, передаваемого новому процессу
+}
+
+/**
+ * @brief Заголовок журнала ссылок
+ */
+struct DedupRefsHeader {
+    uint8_t magic[8]; ///< Dedup::REFS_MAGIC
+};
+
+/**
+ * @brief Запись журнала ссылок (один принятый кадр)
+ */
+struct DedupRefEntry {
+    uint64_t timestamp_ms; ///< Время получения кадра (мс с начала эпохи)
+    uint8_t hash[16];      ///< Хеш содержимого (имя блока)
+    uint32_t length;       ///< Длина кадра
+    uint8_t codec;         ///< Формат данных (FrameCodec)
+    uint8_t reserved[3];   ///< Выравнивание (нули)
+};
+
+static_assert(sizeof(DedupRefsHeader) == 8, "DedupRefsHeader layout");
+static_assert(sizeof(DedupRefEntry) == 32, "DedupRefEntry layout");
+
+/**
+ * @brief Запись индекса блоков, передаваемого новому процессу сервера
+ *
+ * Индекс - Dedup::INDEX_MAGIC и записи подряд, порядок байт хоста:
+ * старый и новый процесс работают на одной машине.
+ */
+struct DedupIndexEntry {
+    uint8_t hash[16];  ///< Хеш содержимого
+    uint32_t refcount; ///< Число ссылок
+    uint32_t size;     ///< Размер блока
+};
+
+static_assert(sizeof(DedupIndexEntry) == 24, "DedupIndexEntry layout");
+
+#endif // SERVER_SERVER_STORAGE_DEDUP_FORMAT_H
@@ -0,0 +1,615 @@
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "storage_io.h"
+#include "dedup_storage.h"
+
+namespace Limit {
+constexpr uint64_t REFS_ROTATE_MS{3600 * 1000}; // журнал ссылок - не дольше часа
+constexpr size_t MAX_OPEN_REFS{4096};
+}
+
+namespace fs = std::filesystem;
+
+namespace {
+uint64_t ElapsedNs(std::chrono::steady_clock::time_point since) {
+    auto elapsed{std::chrono::steady_clock::now() - since};
+
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+}
+}
+
+DedupStorage::DedupStorage(fs::path root, bool track_sync, const std::vector<uint8_t>* handoff_state) :
+    _root(std::move(root)),
+    _track_sync(track_sync)
+{
+    if (handoff_state && LoadHandoffIndex(*handoff_state)) {
+        return;
+    }
+
+    LoadIndex();
+}
+
+DedupStorage::~DedupStorage() {
+    while (!_open_refs.empty()) {
+        CloseRefs(_open_refs.begin()->first);
+    }
+
+    if (_track_sync) {
+        Sync();
+    }
+
+    LogStats();
+}
+
+fs::path DedupStorage::BlobPath(const FrameHash& hash) const {
+    std::string hex{Blake2b::ToHex(hash)};
+
+    return _root / Dedup::BLOBS_DIR / hex.substr(0, 2) / hex;
+}
+
+bool DedupStorage::ReadRefs(const fs::path& path, std::vector<DedupRefEntry>& entries) {
+    std::ifstream refs(path, std::ios::binary);
+
+    DedupRefsHeader header{};
+
+    if (!refs.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, Dedup::REFS_MAGIC, sizeof(header.magic)) != 0) {
+        return false;
+    }
+
+    DedupRefEntry entry{};
+
+    while (refs.read(reinterpret_cast<char*>(&entry), sizeof(entry))) {
+        entries.push_back(entry);
+    }
+
+    return true;
+}
+
+void DedupStorage::LoadIndex() {
+    std::error_code ec;
+
+    if (!fs::exists(_root, ec)) {
+        return;
+    }
+
+    size_t refs_logs{0};
+
+    // Журналы лежат в <root>/<host>/<user>/*.refs
+    for (const auto& host_dir : fs::directory_iterator(_root, ec)) {
+        if (!host_dir.is_directory() || host_dir.path().filename() == Dedup::BLOBS_DIR) {
+            continue;
+        }
+
+        for (const auto& user_dir : fs::directory_iterator(host_dir.path(), ec)) {
+            if (!user_dir.is_directory()) {
+                continue;
+            }
+
+            for (const auto& file : fs::directory_iterator(user_dir.path(), ec)) {
+                if (file.path().extension() != Dedup::REFS_EXT) {
+                    continue;
+                }
+
+                std::vector<DedupRefEntry> entries;
+
+                if (!ReadRefs(file.path(), entries)) {
+                    _logger.PrintInTerminal(MessageType::K_WARNING, "bad refs log skipped: " + file.path().string());
+
+                    continue;
+                }
+
+                for (const auto& entry : entries) {
+                    FrameHash hash;
+                    std::memcpy(hash.data(), entry.hash, hash.size());
+
+                    BlobInfo& blob{_blobs[hash]};
+                    ++blob.refcount;
+                    blob.size = entry.length;
+                }
+
+                ++refs_logs;
+            }
+        }
+    }
+
+    // Осиротевшие и недописанные блоки удаляем, отсутствующие - забываем
+    size_t orphans{0};
+
+    for (const auto& prefix_dir : fs::directory_iterator(_root / Dedup::BLOBS_DIR, ec)) {
+        for (const auto& file : fs::directory_iterator(prefix_dir.path(), ec)) {
+            FrameHash hash;
+            auto it{_blobs.end()};
+
+            if (Blake2b::FromHex(file.path().filename().string(), hash)) {
+                it = _blobs.find(hash);
+            }
+
+            if (it == _blobs.end()) {
+                fs::remove(file.path(), ec);
+                ++orphans;
+
+                continue;
+            }
+
+            it->second.present = true;
+        }
+    }
+
+    size_t missing{0};
+
+    for (auto it{_blobs.begin()}; it != _blobs.end();) {
+        if (!it->second.present) {
+            it = _blobs.erase(it);
+            ++missing;
+        } else {
+            ++it;
+        }
+    }
+
+    _logger.PrintInTerminal(
+        MessageType::K_INFO,
+        "dedup index loaded: " + std::to_string(_blobs.size()) + " blobs, " + std::to_string(refs_logs) + " refs logs, " +
+        std::to_string(orphans) + " orphan blobs removed, " + std::to_string(missing) + " missing blobs"
+    );
+}
+
+bool DedupStorage::LoadHandoffIndex(const std::vector<uint8_t>& state) {
+    size_t magic_size{sizeof(Dedup::INDEX_MAGIC)};
+
+    if (state.size() < magic_size || std::memcmp(state.data(), Dedup::INDEX_MAGIC, magic_size) != 0 ||
+        (state.size() - magic_size) % sizeof(DedupIndexEntry) != 0) {
+        return false;
+    }
+
+    size_t count{(state.size() - magic_size) / sizeof(DedupIndexEntry)};
+
+    _blobs.reserve(count);
+
+    for (size_t i{0}; i < count; ++i) {
+        DedupIndexEntry entry;
+        std::memcpy(&entry, state.data() + magic_size + i * sizeof(entry), sizeof(entry));
+
+        FrameHash hash;
+        std::memcpy(hash.data(), entry.hash, hash.size());
+
+        _blobs[hash] = BlobInfo{entry.refcount, entry.size, true};
+    }
+
+    _logger.PrintInTerminal(MessageType::K_INFO, "dedup index taken over: " + std::to_string(_blobs.size()) + " blobs");
+
+    return true;
+}
+
+void DedupStorage::SaveHandoffState(std::vector<uint8_t>& state) const {
+    std::lock_guard<std::mutex> lock(_index_mutex);
+
+    state.insert(state.end(), std::begin(Dedup::INDEX_MAGIC), std::end(Dedup::INDEX_MAGIC));
+    state.reserve(state.size() + _blobs.size() * sizeof(DedupIndexEntry));
+
+    for (const auto& [hash, info] : _blobs) {
+        DedupIndexEntry entry{};
+        std::memcpy(entry.hash, hash.data(), sizeof(entry.hash));
+        entry.refcount = info.refcount;
+        entry.size = info.size;
+
+        auto bytes{reinterpret_cast<const uint8_t*>(&entry)};
+        state.insert(state.end(), bytes, bytes + sizeof(entry));
+    }
+}
+
+bool DedupStorage::WriteBlob(const FrameHash& hash, const FrameRecord& frame) {
+    fs::path path{BlobPath(hash)};
+    fs::path dir{path.parent_path()};
+
+    if (_known_dirs.count(dir.string()) == 0) {
+        std::error_code ec;
+        fs::create_directories(dir, ec);
+
+        if (ec) {
+            static LogRateLimit rate{10};
+
+            _logger.PrintInTerminal(MessageType::K_ERROR, "create_directories() error: " + ec.message(), rate);
+
+            return false;
+        }
+
+        _known_dirs.insert(dir.string());
+
+        if (_track_sync) {
+            _dirty_dirs.insert(dir.parent_path().string());
+        }
+    }
+
+    fs::path tmp_path{path};
+    tmp_path += Dedup::TMP_EXT;
+
+    UniqueFD blob(ResourceFactory::MakeUniqueFD(open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)));
+
+    if (!blob.Valid()) {
+        _known_dirs.erase(dir.string());
+
+        static LogRateLimit rate{10};
+
+        _logger.PrintInTerminal(MessageType::K_ERROR, "open() error: " + tmp_path.string() + ": " + std::string(strerror(errno)), rate);
+
+        return false;
+    }
+
+    if (!StorageIO::WriteAll(blob.Get(), frame.data, frame.size) || rename(tmp_path.c_str(), path.c_str()) == -1) {
+        static LogRateLimit rate{10};
+
+        _logger.PrintInTerminal(MessageType::K_ERROR, "write blob failed: " + path.string() + ": " + std::string(strerror(errno)), rate);
+
+        unlink(tmp_path.c_str());
+
+        return false;
+    }
+
+    if (_track_sync) {
+        // Дескриптор не держим до Sync(): при частом приеме их накопилось бы больше лимита
+        StorageIO::StartWriteback(blob.Get());
+
+        _dirty_dirs.insert(dir.string());
+        _unsynced_blobs.push_back(path.string());
+    }
+
+    return true;
+}
+
+void DedupStorage::CloseRefs(const std::string& key) {
+    auto it{_open_refs.find(key)};
+
+    if (it == _open_refs.end()) {
+        return;
+    }
+
+    RefsLog& refs{it->second};
+
+    if (refs.bytes > sizeof(DedupRefsHeader)) {
+        NotifyUnit(StorageUnit{refs.hostname, refs.username, refs.path.string(), refs.bytes, refs.newest_ms, true});
+    }
+
+    if (_track_sync && refs.dirty) {
+        _unsynced_refs.push_back(std::move(refs.fd));
+    }
+
+    _open_refs.erase(it);
+}
+
+DedupStorage::RefsLog* DedupStorage::AcquireRefs(const FrameRecord& frame) {
+    std::string key{frame.hostname + "/" + frame.username};
+
+    auto it{_open_refs.find(key)};
+
+    if (it != _open_refs.end()) {
+        if (frame.timestamp_ms < it->second.opened_at_ms + Limit::REFS_ROTATE_MS) {
+            return &it->second;
+        }
+
+        CloseRefs(key);
+    }
+
+    if (_open_refs.size() >= Limit::MAX_OPEN_REFS) {
+        auto oldest{_open_refs.begin()};
+
+        for (auto cur{_open_refs.begin()}; cur != _open_refs.end(); ++cur) {
+            if (cur->second.opened_at_ms < oldest->second.opened_at_ms) {
+                oldest = cur;
+            }
+        }
+
+        CloseRefs(oldest->first);
+    }
+
+    fs::path dir{_root / fs::path(frame.hostname) / fs::path(frame.username)};
+
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+
+    if (ec) {
+        static LogRateLimit rate{10};
+
+        _logger.PrintInTerminal(MessageType::K_ERROR, "create_directories() error: " + ec.message(), rate);
+
+        return nullptr;
+    }
+
+    fs::path path{dir / (std::to_string(frame.timestamp_ms) + Dedup::REFS_EXT)};
+
+    UniqueFD fd(ResourceFactory::MakeUniqueFD(open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644)));
+
+    if (!fd.Valid()) {
+        static LogRateLimit rate{10};
+
+        _logger.PrintInTerminal(MessageType::K_ERROR, "open() error: " + path.string() + ": " + std::string(strerror(errno)), rate);
+
+        return nullptr;
+    }
+
+    off_t existing{lseek(fd.Get(), 0, SEEK_END)};
+
+    if (existing == 0) {
+        DedupRefsHeader header{};
+        std::memcpy(header.magic, Dedup::REFS_MAGIC, sizeof(header.magic));
+
+        if (!StorageIO::WriteAll(fd.Get(), &header, sizeof(header))) {
+            static LogRateLimit rate{10};
+
+            _logger.PrintInTerminal(MessageType::K_ERROR, "write() error: " + path.string() + ": " + std::string(strerror(errno)), rate);
+
+            return nullptr;
+        }
+    }
+
+    if (_track_sync) {
+        _dirty_dirs.insert(dir.string());
+        _dirty_dirs.insert(dir.parent_path().string());
+        _dirty_dirs.insert(_root.string());
+    }
+
+    RefsLog& refs{_open_refs[key]};
+    refs.hostname = frame.hostname;
+    refs.username = frame.username;
+    refs.path = path;
+    refs.fd = std::move(fd);
+    refs.opened_at_ms = frame.timestamp_ms;
+    refs.bytes = existing > 0 ? static_cast<uint64_t>(existing) : sizeof(DedupRefsHeader);
+    refs.dirty = _track_sync;
+
+    return &refs;
+}
+
+bool DedupStorage::Store(const FrameRecord& frame, FrameLocation& location) {
+    auto hash_start{std::chrono::steady_clock::now()};
+    FrameHash hash{Blake2b::Hash128(frame.data, frame.size)};
+    _stats.hash_ns += ElapsedNs(hash_start);
+
+    bool duplicate{false};
+
+    {
+        // Ссылка на существующий блок берется сразу, чтобы RemoveUnit не удалил его до записи ссылки
+        std::lock_guard<std::mutex> lock(_index_mutex);
+
+        auto lookup_start{std::chrono::steady_clock::now()};
+        auto it{_blobs.find(hash)};
+        _stats.lookup_ns += ElapsedNs(lookup_start);
+
+        if (it != _blobs.end()) {
+            duplicate = true;
+            ++it->second.refcount;
+        }
+    }
+
+    if (!duplicate && !WriteBlob(hash, frame)) {
+        return false;
+    }
+
+    RefsLog* refs{AcquireRefs(frame)};
+
+    if (!refs) {
+        if (duplicate) {
+            std::lock_guard<std::mutex> lock(_index_mutex);
+            Release(hash);
+        }
+
+        return false;
+    }
+
+    DedupRefEntry entry{};
+    entry.timestamp_ms = frame.timestamp_ms;
+    std::memcpy(entry.hash, hash.data(), hash.size());
+    entry.length = static_cast<uint32_t>(frame.size);
+    entry.codec = frame.codec;
+
+    if (!StorageIO::WriteAll(refs->fd.Get(), &entry, sizeof(entry))) {
+        static LogRateLimit rate{10};
+
+        _logger.PrintInTerminal(MessageType::K_ERROR, "write() error: " + refs->path.string() + ": " + std::string(strerror(errno)), rate);
+
+        if (duplicate) {
+            std::lock_guard<std::mutex> lock(_index_mutex);
+            Release(hash);
+        }
+
+        return false;
+    }
+
+    refs->dirty = _track_sync;
+    refs->newest_ms = frame.timestamp_ms;
+    refs->bytes += sizeof(entry) + frame.size;
+
+    if (!duplicate) {
+        std::lock_guard<std::mutex> lock(_index_mutex);
+
+        BlobInfo& blob{_blobs[hash]};
+        ++blob.refcount;
+        blob.size = static_cast<uint32_t>(frame.size);
+        blob.present = true;
+    }
+
+    ++_stats.frames;
+    _stats.logical_bytes += frame.size;
+
+    if (duplicate) {
+        ++_stats.duplicates;
+    } else {
+        _stats.written_bytes += frame.size;
+    }
+
+    NotifyUnit(StorageUnit{refs->hostname, refs->username, refs->path.string(), refs->bytes, refs->newest_ms, false});
+
+    location.path = BlobPath(hash).string();
+    location.offset = 0;
+    location.length = frame.size;
+
+    return true;
+}
+
+bool DedupStorage::Sync() {
+    bool ok{true};
+
+    // Сначала блоки, потом ссылки на них
+    for (const auto& blob : _unsynced_blobs) {
+        if (!StorageIO::SyncFile(blob)) {
+            _logger.PrintInTerminal(MessageType::K_ERROR, "fdatasync() error: " + blob + ": " + std::string(strerror(errno)));
+
+            ok = false;
+        }
+    }
+
+    _unsynced_blobs.clear();
+
+    for (const auto& dir : _dirty_dirs) {
+        if (!StorageIO::SyncDirectory(dir)) {
+            _logger.PrintInTerminal(MessageType::K_ERROR, "fsync() error: " + dir + ": " + std::string(strerror(errno)));
+
+            ok = false;
+        }
+    }
+
+    _dirty_dirs.clear();
+
+    for (const auto& refs : _unsynced_refs) {
+        if (fdatasync(refs.Get()) == -1) {
+            _logger.PrintInTerminal(MessageType::K_ERROR, "fdatasync() error: " + std::string(strerror(errno)));
+
+            ok = false;
+        }
+    }
+
+    _unsynced_refs.clear();
+
+    for (auto& [key, refs] : _open_refs) {
+        if (refs.dirty) {
+            if (fdatasync(refs.fd.Get()) == -1) {
+                _logger.PrintInTerminal(MessageType::K_ERROR, "fdatasync() error: " + refs.path.string() + ": " + std::string(strerror(errno)));
+
+                ok = false;
+            }
+
+            refs.dirty = false;
+        }
+    }
+
+    return ok;
+}
+
+uint64_t DedupStorage::Release(const FrameHash& hash) {
+    auto it{_blobs.find(hash)};
+
+    if (it == _blobs.end()) {
+        return 0;
+    }
+
+    if (--it->second.refcount > 0) {
+        return 0;
+    }
+
+    uint64_t size{it->second.size};
+
+    _blobs.erase(it);
+
+    if (unlink(BlobPath(hash).c_str()) == -1 && errno != ENOENT) {
+        _logger.PrintInTerminal(MessageType::K_WARNING, "unlink() error: " + BlobPath(hash).string() + ": " + std::string(strerror(errno)));
+
+        return 0;
+    }
+
+    return size;
+}
+
+bool DedupStorage::InspectUnit(const fs::path& path, uint64_t& bytes) const {
+    if (path.extension() != Dedup::REFS_EXT) {
+        return false;
+    }
+
+    std::vector<DedupRefEntry> entries;
+
+    if (!ReadRefs(path, entries)) {
+        return false;
+    }
+
+    bytes = sizeof(DedupRefsHeader);
+
+    for (const auto& entry : entries) {
+        bytes += sizeof(entry) + entry.length;
+    }
+
+    return true;
+}
+
+bool DedupStorage::ListUnitFrames(const fs::path& path, std::vector<StoredFrame>& frames) const {
+    std::vector<DedupRefEntry> entries;
+
+    if (path.extension() != Dedup::REFS_EXT || !ReadRefs(path, entries)) {
+        return false;
+    }
+
+    for (const auto& entry : entries) {
+        FrameHash hash;
+        std::memcpy(hash.data(), entry.hash, hash.size());
+
+        StoredFrame frame;
+        frame.timestamp_ms = entry.timestamp_ms;
+        frame.codec = static_cast<FrameCodec>(entry.codec);
+        frame.location.path = BlobPath(hash).string();
+        frame.location.length = entry.length;
+
+        frames.push_back(std::move(frame));
+    }
+
+    return true;
+}
+
+uint64_t DedupStorage::RemoveUnit(const std::string& path) {
+    std::vector<DedupRefEntry> entries;
+    ReadRefs(path, entries);
+
+    uint64_t freed{0};
+
+    {
+        std::lock_guard<std::mutex> lock(_index_mutex);
+
+        for (const auto& entry : entries) {
+            FrameHash hash;
+            std::memcpy(hash.data(), entry.hash, hash.size());
+
+            freed += Release(hash);
+        }
+    }
+
+    return freed + StorageIO::RemoveFile(path);
+}
+
+void DedupStorage::LogStats() {
+    if (_stats.frames == 0) {
+        return;
+    }
+
+    size_t blobs{0};
+
+    {
+        std::lock_guard<std::mutex> lock(_index_mutex);
+        blobs = _blobs.size();
+    }
+
+    double ratio{_stats.written_bytes == 0 ? 0.0 : static_cast<double>(_stats.logical_bytes) / static_cast<double>(_stats.written_bytes)};
+
+    _logger.PrintInTerminal(
+        MessageType::K_INFO,
+        "dedup stats: frames=" + std::to_string(_stats.frames) +
+        " duplicates=" + std::to_string(_stats.duplicates) +
+        " blobs=" + std::to_string(blobs) +
+        " ratio=" + std::to_string(ratio) +
+        " avg_hash_ns=" + std::to_string(_stats.hash_ns / _stats.frames) +
+        " avg_lookup_ns=" + std::to_string(_stats.lookup_ns / _stats.frames)
+    );
+}
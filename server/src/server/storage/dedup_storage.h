@@ -0,0 +1,175 @@
+#ifndef SERVER_SERVER_STORAGE_DEDUP_STORAGE_H
+#define SERVER_SERVER_STORAGE_DEDUP_STORAGE_H
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <unordered_set>
+#include <unordered_map>
+
+#include "logger.h"
+#include "blake2b.h"
+#include "dedup_format.h"
+#include "frame_storage.h"
+#include "resource_factory.h"
+
+/**
+ * @brief Дедуплицирующее хранилище с адресацией по содержимому
+ *
+ * Кадр хешируется BLAKE2b-128; по хешу в памяти ищется уже сохраненный блок.
+ * Если такой блок есть, на диск пишется только запись ссылки (32 байта) в журнал
+ * клиента, иначе - новый блок и ссылка. У каждого блока есть счетчик ссылок.
+ * Формат описан в dedup_format.h.
+ *
+ * Единица хранения - журнал ссылок (ротируется раз в час); ее объем - логический
+ * объем кадров, на которые она ссылается. При удалении журнала (RemoveUnit)
+ * блоки, на которые больше никто не ссылается, стираются.
+ *
+ * Индекс восстанавливается при запуске по журналам ссылок; блоки, на которые
+ * никто не ссылается (обрыв между записью блока и ссылки), удаляются. При
+ * передаче работы новому процессу (--handoff) индекс передается готовым.
+ */
+class DedupStorage : public FrameStorage {
+public:
+    /**
+     * @brief Конструктор - загружает индекс с диска
+     * @param root Корневой каталог хранилища
+     * @param track_sync Отслеживать несинхронизированные файлы для Sync()
+     * @param handoff_state Индекс от старого процесса (см. SaveHandoffState()); если он
+     *        задан и корректен, журналы и блоки не сканируются
+     */
+    explicit DedupStorage(std::filesystem::path root, bool track_sync = false,
+                          const std::vector<uint8_t>* handoff_state = nullptr);
+
+    /**
+     * @brief Деструктор - синхронизирует данные и логирует статистику
+     */
+    ~DedupStorage() override;
+
+public:
+    bool Store(const FrameRecord& frame, FrameLocation& location) override;
+
+    bool Sync() override;
+
+    bool InspectUnit(const std::filesystem::path& path, uint64_t& bytes) const override;
+
+    bool ListUnitFrames(const std::filesystem::path& path, std::vector<StoredFrame>& frames) const override;
+
+    uint64_t RemoveUnit(const std::string& path) override;
+
+    void SaveHandoffState(std::vector<uint8_t>& state) const override;
+
+private:
+    /**
+     * @brief Сведения о блоке
+     */
+    struct BlobInfo {
+        uint32_t refcount{}; ///< Число ссылок
+        uint32_t size{};     ///< Размер блока
+        bool present{};      ///< Файл блока найден на диске (используется при загрузке)
+    };
+
+    /**
+     * @brief Открытый журнал ссылок клиента
+     */
+    struct RefsLog {
+        std::string hostname;       ///< Имя хоста клиента
+        std::string username;       ///< Имя пользователя клиента
+        std::filesystem::path path; ///< Путь к журналу
+        UniqueFD fd;                ///< Дескриптор журнала
+        uint64_t opened_at_ms{};    ///< Время открытия
+        uint64_t newest_ms{};       ///< Время последней записи
+        uint64_t bytes{};           ///< Объем единицы хранения (журнал + кадры)
+        bool dirty{false};          ///< Есть записи после последнего Sync()
+    };
+
+    /**
+     * @brief Статистика дедупликации
+     */
+    struct Stats {
+        uint64_t frames{};        ///< Принято кадров
+        uint64_t duplicates{};    ///< Из них повторов
+        uint64_t logical_bytes{}; ///< Принято байт
+        uint64_t written_bytes{}; ///< Записано байт в блоки
+        uint64_t hash_ns{};       ///< Суммарное время хеширования
+        uint64_t lookup_ns{};     ///< Суммарное время поиска в индексе
+    };
+
+    /// Восстановить индекс по журналам ссылок и удалить осиротевшие блоки
+    void LoadIndex();
+
+    /**
+     * @brief Восстановить индекс, переданный старым процессом
+     * @param state Данные SaveHandoffState()
+     * @return false если данные некорректны (индекс не изменен)
+     */
+    bool LoadHandoffIndex(const std::vector<uint8_t>& state);
+
+    /**
+     * @brief Прочитать журнал ссылок
+     * @param path Путь к журналу
+     * @param[out] entries Записи журнала
+     * @return true если журнал корректен
+     */
+    static bool ReadRefs(const std::filesystem::path& path, std::vector<DedupRefEntry>& entries);
+
+    /**
+     * @brief Получить путь к файлу блока
+     * @param hash Хеш содержимого
+     * @return Путь к блоку
+     */
+    std::filesystem::path BlobPath(const FrameHash& hash) const;
+
+    /**
+     * @brief Записать новый блок (через временный файл и rename)
+     * @param hash Хеш содержимого
+     * @param frame Кадр
+     * @return true при успехе
+     */
+    bool WriteBlob(const FrameHash& hash, const FrameRecord& frame);
+
+    /**
+     * @brief Найти или открыть журнал ссылок клиента
+     * @param frame Кадр
+     * @return Указатель на журнал или nullptr при ошибке
+     */
+    RefsLog* AcquireRefs(const FrameRecord& frame);
+
+    /**
+     * @brief Закрыть журнал ссылок
+     * @param key Ключ клиента
+     */
+    void CloseRefs(const std::string& key);
+
+    /**
+     * @brief Снять ссылку с блока и удалить его, если ссылок не осталось
+     * @param hash Хеш блока
+     * @return Освобождено байт
+     *
+     * Вызывается под _index_mutex.
+     */
+    uint64_t Release(const FrameHash& hash);
+
+    /// Вывести статистику в лог
+    void LogStats();
+
+private:
+    std::filesystem::path _root;                                     ///< Корневой каталог
+    bool _track_sync;                                                ///< Отслеживать несинхронизированные файлы
+
+    mutable std::mutex _index_mutex;                                 ///< Защищает _blobs (Store и RemoveUnit из разных потоков)
+    std::unordered_map<FrameHash, BlobInfo, FrameHashHasher> _blobs; ///< Индекс блоков
+    std::unordered_map<std::string, RefsLog> _open_refs;             ///< Открытые журналы ("host/user" -> журнал)
+    std::unordered_set<std::string> _known_dirs;                     ///< Уже созданные каталоги
+
+    std::vector<std::string> _unsynced_blobs;                        ///< Блоки, записанные после Sync() (уже закрыты)
+    std::vector<UniqueFD> _unsynced_refs;                            ///< Закрытые, но не синхронизированные журналы
+    std::unordered_set<std::string> _dirty_dirs;                     ///< Каталоги с новыми записями после Sync()
+
+    Stats _stats;                                                    ///< Статистика
+
+    Logger _logger;                                                  ///< Логгер
+};
+
+#endif // SERVER_SERVER_STORAGE_DEDUP_STORAGE_H
@@ -0,0 +1,222 @@
+#include <ctime>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "storage_io.h"
+#include "file_storage.h"
+#include "frame_archive.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+std::string FormatTimestamp(uint64_t timestamp_ms) {
+    std::time_t time{static_cast<std::time_t>(timestamp_ms / 1000)};
+
+    std::tm local_time{};
+    localtime_r(&time, &local_time);
+
+    char buffer[32]{};
+    std::strftime(buffer, sizeof(buffer), "%Y%m%d_%H%M%S", &local_time);
+
+    return std::string(buffer);
+}
+
+/// Разобрать время из имени файла "<YYYYmmdd_HHMMSS>_<ip_port>.png" (с точностью до секунды)
+bool ParseTimestamp(const std::string& filename, uint64_t& timestamp_ms) {
+    std::tm local_time{};
+    const char* end{strptime(filename.c_str(), "%Y%m%d_%H%M%S", &local_time)};
+
+    if (!end || *end != '_') {
+        return false;
+    }
+
+    local_time.tm_isdst = -1;
+    std::time_t time{std::mktime(&local_time)};
+
+    if (time == -1) {
+        return false;
+    }
+
+    timestamp_ms = static_cast<uint64_t>(time) * 1000;
+
+    return true;
+}
+}
+
+FileStorage::FileStorage(fs::path root, bool track_sync) :
+    _root(std::move(root)),
+    _track_sync(track_sync)
+{}
+
+bool FileStorage::EnsureDirectory(const fs::path& dir) {
+    if (_known_dirs.count(dir.string()) != 0) {
+        return true;
+    }
+
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+
+    if (ec) {
+        static LogRateLimit rate{10};
+
+        _logger.PrintInTerminal(MessageType::K_ERROR, "create_directories() error: " + ec.message(), rate);
+
+        return false;
+    }
+
+    _known_dirs.insert(dir.string());
+
+    if (_track_sync) {
+        // Новые каталоги тоже должны попасть на диск: сбрасываем всю цепочку до корня
+        for (fs::path parent{dir.parent_path()}; !parent.empty(); parent = parent.parent_path()) {
+            _dirty_dirs.insert(parent.string());
+
+            if (parent == _root) {
+                break;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool FileStorage::Store(const FrameRecord& frame, FrameLocation& location) {
+    fs::path base{_root / fs::path(frame.hostname) / fs::path(frame.username)};
+
+    if (!EnsureDirectory(base)) {
+        return false;
+    }
+
+    std::string filename{FormatTimestamp(frame.timestamp_ms) + "_" + frame.peer + ".png"};
+    fs::path out_path{base / filename};
+
+    UniqueFD file(ResourceFactory::MakeUniqueFD(open(out_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)));
+
+    if (!file.Valid()) {
+        // Каталог могли удалить снаружи - в следующий раз создадим заново
+        _known_dirs.erase(base.string());
+
+        static LogRateLimit rate{10};
+
+        _logger.PrintInTerminal(MessageType::K_ERROR, "open file failed: " + out_path.string() + ": " + std::string(strerror(errno)), rate);
+
+        return false;
+    }
+
+    if (!StorageIO::WriteAll(file.Get(), frame.data, frame.size)) {
+        static LogRateLimit rate{10};
+
+        _logger.PrintInTerminal(MessageType::K_ERROR, "write file failed: " + out_path.string() + ": " + std::string(strerror(errno)), rate);
+
+        return false;
+    }
+
+    if (_track_sync) {
+        StorageIO::StartWriteback(file.Get());
+
+        _dirty_dirs.insert(base.string());
+        _unsynced_files.push_back(out_path.string());
+    }
+
+    location.path = out_path.string();
+    location.offset = 0;
+    location.length = frame.size;
+
+    NotifyUnit(StorageUnit{frame.hostname, frame.username, location.path, frame.size, frame.timestamp_ms, true});
+
+    return true;
+}
+
+bool FileStorage::Sync() {
+    bool ok{true};
+
+    for (const auto& file : _unsynced_files) {
+        if (!StorageIO::SyncFile(file)) {
+            _logger.PrintInTerminal(MessageType::K_ERROR, "fdatasync() error: " + file + ": " + std::string(strerror(errno)));
+
+            ok = false;
+        }
+    }
+
+    _unsynced_files.clear();
+
+    for (const auto& dir : _dirty_dirs) {
+        if (!StorageIO::SyncDirectory(dir)) {
+            _logger.PrintInTerminal(MessageType::K_ERROR, "fsync() error: " + dir + ": " + std::string(strerror(errno)));
+
+            ok = false;
+        }
+    }
+
+    _dirty_dirs.clear();
+
+    return ok;
+}
+
+bool FileStorage::InspectUnit(const fs::path& path, uint64_t& bytes) const {
+    if (path.extension() != ".png" && !ArchiveReader::IsArchive(path)) {
+        return false;
+    }
+
+    std::error_code ec;
+    bytes = fs::file_size(path, ec);
+
+    return !ec;
+}
+
+uint64_t FileStorage::RemoveUnit(const std::string& path) {
+    return StorageIO::RemoveFile(path);
+}
+
+bool FileStorage::ListUnitFrames(const fs::path& path, std::vector<StoredFrame>& frames) const {
+    uint64_t bytes{};
+    StoredFrame frame;
+
+    if (!InspectUnit(path, bytes)) {
+        return false;
+    }
+
+    if (ArchiveReader::IsArchive(path)) {
+        return ListArchiveFrames(path, frames);
+    }
+
+    if (!ParseTimestamp(path.filename().string(), frame.timestamp_ms)) {
+        return false;
+    }
+
+    frame.codec = FrameCodec::K_PNG;
+    frame.location.path = path.string();
+    frame.location.length = bytes;
+
+    frames.push_back(std::move(frame));
+
+    return true;
+}
+
+bool FileStorage::ListArchiveFrames(const fs::path& path, std::vector<StoredFrame>& frames) const {
+    try {
+        ArchiveReader reader(path);
+
+        for (const ArchiveEntry& entry : reader.GetEntries()) {
+            StoredFrame frame;
+            frame.timestamp_ms = entry.timestamp_ms;
+            frame.codec = FrameCodec::K_ARCHIVED;
+            frame.width = entry.width;
+            frame.height = entry.height;
+            frame.monitor = entry.monitor;
+            frame.location.path = path.string();
+            frame.location.offset = entry.offset;
+            frame.location.length = entry.length;
+
+            frames.push_back(std::move(frame));
+        }
+    } catch (const std::runtime_error&) {
+        // Архив не читается - его кадры недоступны для поиска
+        return false;
+    }
+
+    return true;
+}
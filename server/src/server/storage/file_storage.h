@@ -0,0 +1,72 @@
+#ifndef SERVER_SERVER_STORAGE_FILE_STORAGE_H
+#define SERVER_SERVER_STORAGE_FILE_STORAGE_H
+
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <unordered_set>
+
+#include "logger.h"
+#include "frame_storage.h"
+#include "resource_factory.h"
+
+/**
+ * @brief Хранилище "один кадр - один файл"
+ *
+ * Сохраняет кадры в <root>/<hostname>/<username>/<timestamp>_<ip_port>.png.
+ * Созданные каталоги запоминаются, чтобы не вызывать create_directories на каждый кадр.
+ * При отслеживании синхронизации запись кадра на диск начинается сразу, файл
+ * закрывается, а Sync() открывает записанные файлы заново и дожидается их
+ * записи вместе с измененными каталогами: открытых дескрипторов не копится.
+ *
+ * Единица хранения - файл кадра; он закрыт сразу после записи. Старые кадры
+ * CompactionManager упаковывает в архивы <first_ms>.rfa (см. archive_format.h),
+ * которые тоже являются единицами хранения.
+ */
+class FileStorage : public FrameStorage {
+public:
+    /**
+     * @brief Конструктор
+     * @param root Корневой каталог хранилища
+     * @param track_sync Отслеживать несинхронизированные файлы для Sync()
+     */
+    explicit FileStorage(std::filesystem::path root, bool track_sync = false);
+
+public:
+    bool Store(const FrameRecord& frame, FrameLocation& location) override;
+
+    bool Sync() override;
+
+    bool InspectUnit(const std::filesystem::path& path, uint64_t& bytes) const override;
+
+    bool ListUnitFrames(const std::filesystem::path& path, std::vector<StoredFrame>& frames) const override;
+
+    uint64_t RemoveUnit(const std::string& path) override;
+
+private:
+    /**
+     * @brief Создать каталог клиента, если он еще не создан
+     * @param dir Каталог
+     * @return true если каталог существует
+     */
+    bool EnsureDirectory(const std::filesystem::path& dir);
+
+    /**
+     * @brief Перечислить кадры архива компактизации
+     * @param path Путь к архиву
+     * @param[out] frames Кадры (кодек K_ARCHIVED, смещение - запись кадра в архиве)
+     * @return true если индекс архива прочитан
+     */
+    bool ListArchiveFrames(const std::filesystem::path& path, std::vector<StoredFrame>& frames) const;
+
+private:
+    std::filesystem::path _root;                 ///< Корневой каталог
+    bool _track_sync;                            ///< Отслеживать несинхронизированные файлы
+    std::unordered_set<std::string> _known_dirs; ///< Уже созданные каталоги
+    std::unordered_set<std::string> _dirty_dirs; ///< Каталоги с новыми записями после Sync()
+    std::vector<std::string> _unsynced_files;    ///< Файлы, записанные после Sync()
+
+    Logger _logger;                              ///< Логгер
+};
+
+#endif // SERVER_SERVER_STORAGE_FILE_STORAGE_H
@@ -0,0 +1,309 @@
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <zlib.h>
+
+#include "png_codec.h"
+#include "storage_io.h"
+#include "frame_archive.h"
+
+namespace fs = std::filesystem;
+
+namespace Limit {
+constexpr uint32_t MAX_FRAMES{1'000'000};
+}
+
+namespace {
+/// Наложить разность на кадр: dst ^= delta
+void XorInto(uint8_t* dst, const uint8_t* delta, size_t size) {
+    for (size_t i{0}; i < size; ++i) {
+        dst[i] ^= delta[i];
+    }
+}
+
+/// Получить разность кадров: out = a ^ b
+void XorFrames(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t size) {
+    for (size_t i{0}; i < size; ++i) {
+        out[i] = a[i] ^ b[i];
+    }
+}
+
+size_t PixelBytes(const ArchiveEntry& entry) {
+    return static_cast<size_t>(entry.width) * entry.height * 3;
+}
+}
+
+ArchiveWriter::ArchiveWriter(fs::path path, unsigned keyframe_interval) :
+    _path(std::move(path)),
+    _keyframe_interval(std::max(keyframe_interval, 1u))
+{
+    _tmp_path = _path;
+    _tmp_path.replace_extension(Archive::TMP_EXT);
+
+    _fd = ResourceFactory::MakeUniqueFD(open(_tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+
+    if (!_fd.Valid()) {
+        throw std::runtime_error("open archive failed: " + _tmp_path.string() + ": " + std::string(strerror(errno)));
+    }
+
+    // Заголовок перезаписывается в Finish(), когда известны число кадров и смещение индекса
+    ArchiveHeader header{};
+    Write(reinterpret_cast<const uint8_t*>(&header), sizeof(header));
+}
+
+ArchiveWriter::~ArchiveWriter() {
+    if (!_finished) {
+        unlink(_tmp_path.c_str());
+    }
+}
+
+bool ArchiveWriter::Add(uint64_t timestamp_ms, uint8_t monitor, const std::vector<uint8_t>& png) {
+    ArchiveEntry entry{};
+
+    if (!PngCodec::Decode(png.data(), png.size(), _current, entry.width, entry.height)) {
+        return false;
+    }
+
+    entry.timestamp_ms = timestamp_ms;
+    entry.offset = _offset;
+    entry.monitor = monitor;
+
+    bool keyframe{_entries.empty() || _since_keyframe + 1 >= _keyframe_interval ||
+                  entry.width != _entries.back().width || entry.height != _entries.back().height};
+
+    if (keyframe) {
+        entry.kind = Archive::KIND_KEYFRAME;
+        entry.length = static_cast<uint32_t>(png.size());
+
+        Write(png.data(), png.size());
+
+        _since_keyframe = 0;
+    } else {
+        // XOR с предыдущим кадром: неизменившиеся пиксели становятся нулями, которые zlib сжимает почти в ничто
+        XorFrames(_current.data(), _previous.data(), _previous.data(), _current.size());
+
+        uLongf size{compressBound(static_cast<uLong>(_current.size()))};
+        _delta.resize(size);
+
+        if (compress2(_delta.data(), &size, _previous.data(), static_cast<uLong>(_current.size()), Z_DEFAULT_COMPRESSION) != Z_OK) {
+            throw std::runtime_error("compress delta failed: " + _tmp_path.string());
+        }
+
+        entry.kind = Archive::KIND_DELTA;
+        entry.length = static_cast<uint32_t>(size);
+
+        Write(_delta.data(), size);
+
+        ++_since_keyframe;
+    }
+
+    _entries.push_back(entry);
+    _previous.swap(_current);
+
+    return true;
+}
+
+uint64_t ArchiveWriter::Finish() {
+    ArchiveHeader header{};
+    std::memcpy(header.magic, Archive::MAGIC, sizeof(header.magic));
+    header.frames = static_cast<uint32_t>(_entries.size());
+    header.index_offset = _offset;
+
+    Write(reinterpret_cast<const uint8_t*>(_entries.data()), _entries.size() * sizeof(ArchiveEntry));
+
+    // Время изменения - по последнему кадру: по нему очистка упорядочивает единицы после перезапуска
+    uint64_t newest_ms{_entries.empty() ? 0 : _entries.back().timestamp_ms};
+    timespec times[2]{};
+    times[0].tv_nsec = UTIME_OMIT;
+    times[1].tv_sec = static_cast<time_t>(newest_ms / 1000);
+    times[1].tv_nsec = static_cast<long>(newest_ms % 1000) * 1000000;
+
+    if (pwrite(_fd.Get(), &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)) ||
+        futimens(_fd.Get(), times) == -1 || fdatasync(_fd.Get()) == -1) {
+        throw std::runtime_error("finish archive failed: " + _tmp_path.string() + ": " + std::string(strerror(errno)));
+    }
+
+    // link() вместо rename(): если под этим именем уже есть архив, он не заменяется (EEXIST)
+    if (link(_tmp_path.c_str(), _path.c_str()) == -1) {
+        throw std::runtime_error("finish archive failed: " + _path.string() + ": " + std::string(strerror(errno)));
+    }
+
+    _finished = true;
+
+    unlink(_tmp_path.c_str());
+
+    // Без сброса каталога после сбоя могли бы пропасть и архив, и (уже удаленные) исходные кадры
+    if (!StorageIO::SyncDirectory(_path.parent_path().string())) {
+        throw std::runtime_error("fsync() error: " + _path.parent_path().string() + ": " + std::string(strerror(errno)));
+    }
+
+    return _offset;
+}
+
+const std::vector<ArchiveEntry>& ArchiveWriter::GetEntries() const noexcept {
+    return _entries;
+}
+
+void ArchiveWriter::Write(const uint8_t* data, size_t size) {
+    if (!StorageIO::WriteAll(_fd.Get(), data, size)) {
+        throw std::runtime_error("write archive failed: " + _tmp_path.string() + ": " + std::string(strerror(errno)));
+    }
+
+    _offset += size;
+}
+
+ArchiveReader::ArchiveReader(const fs::path& path) :
+    _path(path),
+    _fd(ResourceFactory::MakeUniqueFD(open(path.c_str(), O_RDONLY | O_CLOEXEC)))
+{
+    if (!_fd.Valid()) {
+        throw std::runtime_error("open archive failed: " + path.string() + ": " + std::string(strerror(errno)));
+    }
+
+    struct stat st{};
+    ArchiveHeader header{};
+
+    if (fstat(_fd.Get(), &st) == -1 ||
+        pread(_fd.Get(), &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)) ||
+        std::memcmp(header.magic, Archive::MAGIC, sizeof(header.magic)) != 0 ||
+        header.frames == 0 || header.frames > Limit::MAX_FRAMES ||
+        header.index_offset + header.frames * sizeof(ArchiveEntry) != static_cast<uint64_t>(st.st_size)) {
+        throw std::runtime_error("bad archive header: " + path.string());
+    }
+
+    _entries.resize(header.frames);
+
+    size_t index_size{_entries.size() * sizeof(ArchiveEntry)};
+
+    if (pread(_fd.Get(), _entries.data(), index_size, static_cast<off_t>(header.index_offset)) != static_cast<ssize_t>(index_size)) {
+        throw std::runtime_error("read archive index failed: " + path.string());
+    }
+
+    for (size_t i{0}; i < _entries.size(); ++i) {
+        const ArchiveEntry& entry{_entries[i]};
+
+        // Разность без опорного кадра перед ней восстановить нельзя
+        if (entry.offset < sizeof(ArchiveHeader) || entry.offset + entry.length > header.index_offset ||
+            (i == 0 && entry.kind != Archive::KIND_KEYFRAME) ||
+            (entry.kind != Archive::KIND_KEYFRAME && entry.kind != Archive::KIND_DELTA)) {
+            throw std::runtime_error("bad archive index: " + path.string());
+        }
+    }
+}
+
+bool ArchiveReader::IsArchive(const fs::path& path) {
+    return path.extension() == Archive::EXT;
+}
+
+const fs::path& ArchiveReader::GetPath() const noexcept {
+    return _path;
+}
+
+const std::vector<ArchiveEntry>& ArchiveReader::GetEntries() const noexcept {
+    return _entries;
+}
+
+bool ArchiveReader::Find(uint64_t offset, size_t& index) const {
+    auto it{std::lower_bound(_entries.begin(), _entries.end(), offset, [](const ArchiveEntry& entry, uint64_t value) {
+        return entry.offset < value;
+    })};
+
+    if (it == _entries.end() || it->offset != offset) {
+        return false;
+    }
+
+    index = static_cast<size_t>(it - _entries.begin());
+
+    return true;
+}
+
+const std::vector<uint8_t>& ArchiveReader::DecodeFrame(size_t index) {
+    if (index >= _entries.size()) {
+        throw std::out_of_range("archive frame out of range: " + std::to_string(index));
+    }
+
+    size_t start{index};
+
+    while (_entries[start].kind != Archive::KIND_KEYFRAME) {
+        --start;
+    }
+
+    // Продолжаем от уже восстановленного кадра, если он между опорным и нужным
+    if (_cursor != SIZE_MAX && _cursor >= start && _cursor <= index) {
+        start = _cursor + 1;
+    } else {
+        _cursor = SIZE_MAX;
+    }
+
+    for (size_t i{start}; i <= index; ++i) {
+        Apply(i);
+    }
+
+    return _pixels;
+}
+
+void ArchiveReader::ReadFrame(size_t index, std::vector<uint8_t>& png) {
+    const ArchiveEntry& entry{_entries.at(index)};
+
+    if (entry.kind == Archive::KIND_KEYFRAME) {
+        ReadRecord(entry, png);
+        return;
+    }
+
+    const std::vector<uint8_t>& pixels{DecodeFrame(index)};
+
+    if (!PngCodec::Encode(pixels.data(), entry.width, entry.height, png)) {
+        throw std::runtime_error("encode frame failed: " + _path.string() + "@" + std::to_string(entry.offset));
+    }
+}
+
+void ArchiveReader::ReadRecord(const ArchiveEntry& entry, std::vector<uint8_t>& out) const {
+    out.resize(entry.length);
+
+    if (pread(_fd.Get(), out.data(), entry.length, static_cast<off_t>(entry.offset)) != static_cast<ssize_t>(entry.length)) {
+        throw std::runtime_error("read frame failed: " + _path.string() + "@" + std::to_string(entry.offset));
+    }
+}
+
+void ArchiveReader::Apply(size_t index) {
+    const ArchiveEntry& entry{_entries[index]};
+
+    ReadRecord(entry, _record);
+
+    // Пока кадр не восстановлен до конца, прежнее содержимое _pixels уже испорчено
+    _cursor = SIZE_MAX;
+
+    if (entry.kind == Archive::KIND_KEYFRAME) {
+        uint16_t width{};
+        uint16_t height{};
+
+        if (!PngCodec::Decode(_record.data(), _record.size(), _pixels, width, height) ||
+            width != entry.width || height != entry.height) {
+            throw std::runtime_error("bad keyframe: " + _path.string() + "@" + std::to_string(entry.offset));
+        }
+    } else {
+        // Разность всегда того же размера, что и предыдущий кадр (смена размера дает опорный)
+        thread_local std::vector<uint8_t> delta;
+
+        size_t size{PixelBytes(entry)};
+        uLongf inflated{static_cast<uLongf>(size)};
+
+        delta.resize(size);
+
+        if (_pixels.size() != size ||
+            uncompress(delta.data(), &inflated, _record.data(), static_cast<uLong>(_record.size())) != Z_OK ||
+            inflated != size) {
+            throw std::runtime_error("bad delta frame: " + _path.string() + "@" + std::to_string(entry.offset));
+        }
+
+        XorInto(_pixels.data(), delta.data(), size);
+    }
+
+    _cursor = index;
+}
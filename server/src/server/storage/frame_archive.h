@@ -0,0 +1,170 @@
+#ifndef SERVER_SERVER_STORAGE_FRAME_ARCHIVE_H
+#define SERVER_SERVER_STORAGE_FRAME_ARCHIVE_H
+
+#include <vector>
+#include <cstdint>
+#include <filesystem>
+
+#include "archive_format.h"
+#include "resource_factory.h"
+
+/**
+ * @brief Запись архива компактизации (см. archive_format.h)
+ *
+ * Кадры добавляются по возрастанию времени. Опорный кадр пишется каждые
+ * keyframe_interval кадров и при смене размеров изображения, остальные - разностями
+ * с предыдущим кадром. Архив появляется под своим именем только после Finish();
+ * незавершенный временный файл удаляется деструктором.
+ */
+class ArchiveWriter {
+public:
+    /**
+     * @brief Конструктор
+     * @param path Итоговый путь архива (<first_ms>.rfa)
+     * @param keyframe_interval Опорный кадр не реже чем раз в столько кадров (не меньше 1)
+     * @throw std::runtime_error Если временный файл не удалось создать
+     */
+    ArchiveWriter(std::filesystem::path path, unsigned keyframe_interval);
+
+    /**
+     * @brief Деструктор - удаляет временный файл, если архив не завершен
+     */
+    ~ArchiveWriter();
+
+    ArchiveWriter(const ArchiveWriter&) = delete;
+    ArchiveWriter& operator=(const ArchiveWriter&) = delete;
+
+public:
+    /**
+     * @brief Добавить кадр
+     * @param timestamp_ms Время получения кадра
+     * @param monitor Номер монитора
+     * @param png Кадр в PNG
+     * @return false если PNG не удалось разобрать (кадр не добавлен)
+     * @throw std::runtime_error При ошибке записи
+     */
+    bool Add(uint64_t timestamp_ms, uint8_t monitor, const std::vector<uint8_t>& png);
+
+    /**
+     * @brief Дописать индекс, сбросить архив на диск и дать ему постоянное имя
+     * @return Итоговый размер архива
+     * @throw std::runtime_error При ошибке записи или если архив с таким именем уже есть
+     */
+    uint64_t Finish();
+
+    /**
+     * @brief Получить записи добавленных кадров
+     * @return Записи индекса
+     */
+    const std::vector<ArchiveEntry>& GetEntries() const noexcept;
+
+private:
+    /**
+     * @brief Дописать запись кадра
+     * @param data Данные записи
+     * @param size Размер данных
+     */
+    void Write(const uint8_t* data, size_t size);
+
+private:
+    std::filesystem::path _path;        ///< Итоговый путь
+    std::filesystem::path _tmp_path;    ///< Путь временного файла
+    unsigned _keyframe_interval;        ///< Интервал опорных кадров
+    UniqueFD _fd;                       ///< Временный файл
+    uint64_t _offset{};                 ///< Текущий размер файла
+    bool _finished{false};              ///< Архив переименован
+
+    std::vector<ArchiveEntry> _entries; ///< Индекс
+    unsigned _since_keyframe{};         ///< Кадров после последнего опорного
+    std::vector<uint8_t> _previous;     ///< Пиксели предыдущего кадра
+    std::vector<uint8_t> _current;      ///< Пиксели добавляемого кадра
+    std::vector<uint8_t> _delta;        ///< Сжатая разность
+};
+
+/**
+ * @brief Чтение архива компактизации
+ *
+ * Кадр восстанавливается от ближайшего предшествующего опорного. Последний
+ * восстановленный кадр запоминается, поэтому последовательное чтение (проигрывание
+ * по времени) применяет по одной разности на кадр.
+ */
+class ArchiveReader {
+public:
+    /**
+     * @brief Конструктор
+     * @param path Путь к архиву
+     * @throw std::runtime_error Если архив не удалось открыть или он поврежден
+     */
+    explicit ArchiveReader(const std::filesystem::path& path);
+
+public:
+    /**
+     * @brief Проверить, является ли файл архивом (по расширению)
+     * @param path Путь к файлу
+     * @return true для .rfa
+     */
+    static bool IsArchive(const std::filesystem::path& path);
+
+    /**
+     * @brief Получить путь к архиву
+     * @return Путь
+     */
+    const std::filesystem::path& GetPath() const noexcept;
+
+    /**
+     * @brief Получить записи индекса
+     * @return Записи в порядке времени
+     */
+    const std::vector<ArchiveEntry>& GetEntries() const noexcept;
+
+    /**
+     * @brief Найти кадр по смещению записи
+     * @param offset Смещение записи (StoredFrame::location.offset)
+     * @param[out] index Номер кадра
+     * @return true если кадр найден
+     */
+    bool Find(uint64_t offset, size_t& index) const;
+
+    /**
+     * @brief Восстановить пиксели кадра
+     * @param index Номер кадра
+     * @return Пиксели RGB (действительны до следующего вызова)
+     * @throw std::out_of_range Если кадра с таким номером нет
+     * @throw std::runtime_error При ошибке чтения или поврежденной записи
+     */
+    const std::vector<uint8_t>& DecodeFrame(size_t index);
+
+    /**
+     * @brief Получить кадр в PNG
+     * @param index Номер кадра
+     * @param[out] png Кадр: для опорного - исходный PNG, для разностного - закодированный заново
+     * @throw std::out_of_range Если кадра с таким номером нет
+     * @throw std::runtime_error При ошибке чтения или поврежденной записи
+     */
+    void ReadFrame(size_t index, std::vector<uint8_t>& png);
+
+private:
+    /**
+     * @brief Прочитать запись кадра
+     * @param entry Запись индекса
+     * @param[out] out Данные записи
+     */
+    void ReadRecord(const ArchiveEntry& entry, std::vector<uint8_t>& out) const;
+
+    /**
+     * @brief Применить к _pixels запись кадра
+     * @param index Номер кадра
+     */
+    void Apply(size_t index);
+
+private:
+    std::filesystem::path _path;        ///< Путь к архиву
+    UniqueFD _fd;                       ///< Архив
+    std::vector<ArchiveEntry> _entries; ///< Индекс
+
+    size_t _cursor{SIZE_MAX};           ///< Номер кадра в _pixels (SIZE_MAX - нет)
+    std::vector<uint8_t> _pixels;       ///< Последний восстановленный кадр
+    std::vector<uint8_t> _record;       ///< Буфер записи
+};
+
+#endif // SERVER_SERVER_STORAGE_FRAME_ARCHIVE_H
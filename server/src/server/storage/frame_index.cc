@@ -0,0 +1,240 @@
+#include <set>
+#include <utility>
+#include <unordered_set>
+#include <algorithm>
+
+#include "frame_index.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+bool EarlierThan(const IndexedFrame& frame, uint64_t timestamp_ms) {
+    return frame.timestamp_ms < timestamp_ms;
+}
+}
+
+FrameIndex::FrameIndex(fs::path root, const FrameStorage& storage) :
+    _root(std::move(root)),
+    _storage(storage)
+{}
+
+FrameIndex::ClientFrames& FrameIndex::GetClient(const std::string& client) {
+    std::lock_guard<std::mutex> lock(_clients_mutex);
+
+    auto& entry{_clients[client]};
+
+    if (!entry) {
+        entry = std::make_unique<ClientFrames>();
+    }
+
+    return *entry;
+}
+
+FrameIndex::ClientFrames* FrameIndex::FindClient(const std::string& client) {
+    std::lock_guard<std::mutex> lock(_clients_mutex);
+
+    auto it{_clients.find(client)};
+
+    return it == _clients.end() ? nullptr : it->second.get();
+}
+
+void FrameIndex::Add(const FrameRecord& frame, const FrameLocation& location) {
+    ClientFrames* found{FindClient(frame.hostname + "/" + frame.username)};
+
+    if (!found) {
+        return;
+    }
+
+    ClientFrames& entry{*found};
+
+    std::unique_lock<std::shared_mutex> lock(entry.mutex);
+
+    // Кадр уже на диске: до начала подгрузки его найдет она сама
+    if (!entry.loading && !entry.loaded) {
+        return;
+    }
+
+    IndexedFrame indexed;
+    indexed.timestamp_ms = frame.timestamp_ms;
+    indexed.offset = location.offset;
+    indexed.length = location.length;
+    indexed.codec = frame.codec;
+    indexed.width = frame.width;
+    indexed.height = frame.height;
+    indexed.monitor = frame.monitor;
+
+    // Кадры одного сегмента ссылаются на одну строку пути
+    if (!entry.frames.empty() && *entry.frames.back().path == location.path) {
+        indexed.path = entry.frames.back().path;
+
+        // FileStorage перезаписывает файл кадром той же секунды от того же адреса
+        if (entry.frames.back().offset == location.offset) {
+            entry.frames.back() = std::move(indexed);
+
+            return;
+        }
+    } else {
+        indexed.path = std::make_shared<const std::string>(location.path);
+    }
+
+    if (entry.frames.empty() || entry.frames.back().timestamp_ms <= indexed.timestamp_ms) {
+        entry.frames.push_back(std::move(indexed));
+    } else {
+        auto pos{std::upper_bound(entry.frames.begin(), entry.frames.end(), indexed.timestamp_ms,
+            [](uint64_t timestamp_ms, const IndexedFrame& other) {
+                return timestamp_ms < other.timestamp_ms;
+            })};
+
+        entry.frames.insert(pos, std::move(indexed));
+    }
+}
+
+void FrameIndex::Load(ClientFrames& entry, const std::string& hostname, const std::string& username) {
+    {
+        std::unique_lock<std::shared_mutex> lock(entry.mutex);
+
+        if (entry.loaded) {
+            return;
+        }
+
+        // Кадры, записанные с этого момента, Add() добавит сам: чтение каталога их может и не застать
+        entry.loading = true;
+    }
+
+    std::vector<StoredFrame> stored;
+    size_t units{0};
+
+    std::error_code ec;
+
+    for (const auto& file : fs::directory_iterator(_root / hostname / username, ec)) {
+        if (_storage.ListUnitFrames(file.path(), stored)) {
+            ++units;
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> lock(entry.mutex);
+
+    if (entry.loaded) {
+        return;
+    }
+
+    // Кадры, уже добавленные потоком записи, могли попасть и в выборку с диска
+    std::set<std::pair<std::string, uint64_t>> known;
+
+    for (const auto& frame : entry.frames) {
+        known.emplace(*frame.path, frame.offset);
+    }
+
+    std::shared_ptr<const std::string> path;
+
+    for (auto& frame : stored) {
+        if (known.count({frame.location.path, frame.location.offset}) != 0) {
+            continue;
+        }
+
+        if (!path || *path != frame.location.path) {
+            path = std::make_shared<const std::string>(frame.location.path);
+        }
+
+        entry.frames.push_back(IndexedFrame{
+            frame.timestamp_ms, frame.location.offset, frame.location.length, frame.codec, frame.width, frame.height, frame.monitor, path
+        });
+    }
+
+    std::stable_sort(entry.frames.begin(), entry.frames.end(), [](const IndexedFrame& lhs, const IndexedFrame& rhs) {
+        return lhs.timestamp_ms < rhs.timestamp_ms;
+    });
+
+    entry.loading = false;
+    entry.loaded = true;
+
+    _logger.PrintInTerminal(
+        MessageType::K_INFO,
+        "frame index loaded: " + hostname + "/" + username + ": " + std::to_string(stored.size()) +
+        " frames from " + std::to_string(units) + " units"
+    );
+}
+
+std::vector<IndexedFrame> FrameIndex::Lookup(const std::string& hostname, const std::string& username,
+                                             uint64_t from_ms, uint64_t to_ms, size_t limit) {
+    ClientFrames& entry{GetClient(hostname + "/" + username)};
+
+    bool loaded{false};
+
+    {
+        std::shared_lock<std::shared_mutex> lock(entry.mutex);
+        loaded = entry.loaded;
+    }
+
+    if (!loaded) {
+        Load(entry, hostname, username);
+    }
+
+    std::vector<IndexedFrame> result;
+
+    std::shared_lock<std::shared_mutex> lock(entry.mutex);
+
+    auto it{std::lower_bound(entry.frames.begin(), entry.frames.end(), from_ms, EarlierThan)};
+
+    for (; it != entry.frames.end() && it->timestamp_ms <= to_ms && result.size() < limit; ++it) {
+        result.push_back(*it);
+    }
+
+    return result;
+}
+
+void FrameIndex::Prune(const std::string& client, uint64_t newest_ms) {
+    ClientFrames* found{FindClient(client)};
+
+    if (!found) {
+        return;
+    }
+
+    ClientFrames& entry{*found};
+
+    std::unique_lock<std::shared_mutex> lock(entry.mutex);
+
+    while (!entry.frames.empty() && entry.frames.front().timestamp_ms <= newest_ms) {
+        entry.frames.pop_front();
+    }
+}
+
+void FrameIndex::Replace(const std::string& client, const std::vector<std::string>& removed,
+                         const std::vector<StoredFrame>& archived) {
+    ClientFrames* found{FindClient(client)};
+
+    if (!found) {
+        return;
+    }
+
+    ClientFrames& entry{*found};
+
+    std::unordered_set<std::string> gone(removed.begin(), removed.end());
+
+    std::unique_lock<std::shared_mutex> lock(entry.mutex);
+
+    entry.frames.erase(std::remove_if(entry.frames.begin(), entry.frames.end(), [&](const IndexedFrame& frame) {
+        return gone.count(*frame.path) != 0;
+    }), entry.frames.end());
+
+    // Не подгруженный клиент прочитает архив с диска сам
+    if (!entry.loading && !entry.loaded) {
+        return;
+    }
+
+    std::shared_ptr<const std::string> path;
+
+    for (const auto& frame : archived) {
+        if (!path || *path != frame.location.path) {
+            path = std::make_shared<const std::string>(frame.location.path);
+        }
+
+        entry.frames.push_back(IndexedFrame{
+            frame.timestamp_ms, frame.location.offset, frame.location.length, frame.codec, frame.width, frame.height, frame.monitor, path
+        });
+    }
+
+    std::stable_sort(entry.frames.begin(), entry.frames.end(), [](const IndexedFrame& lhs, const IndexedFrame& rhs) {
+        return lhs.timestamp_ms < rhs.timestamp_ms;
+    });
+}
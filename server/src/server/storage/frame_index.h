@@ -0,0 +1,145 @@
+#ifndef SERVER_SERVER_STORAGE_FRAME_INDEX_H
+#define SERVER_SERVER_STORAGE_FRAME_INDEX_H
+
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <filesystem>
+#include <shared_mutex>
+#include <unordered_map>
+
+#include "logger.h"
+#include "frame_storage.h"
+
+/**
+ * @brief Кадр в индексе по времени
+ */
+struct IndexedFrame {
+    uint64_t timestamp_ms{};                 ///< Время получения кадра
+    uint64_t offset{};                       ///< Смещение кадра в файле
+    uint64_t length{};                       ///< Длина кадра
+    FrameCodec codec{};                      ///< Формат данных
+    uint16_t width{};                        ///< Ширина изображения (0 - неизвестна)
+    uint16_t height{};                       ///< Высота изображения (0 - неизвестна)
+    uint8_t monitor{};                       ///< Номер монитора
+    std::shared_ptr<const std::string> path; ///< Файл с кадром (общий для кадров одного сегмента)
+};
+
+/**
+ * @brief Индекс сохраненных кадров по времени
+ *
+ * Для каждого клиента (hostname/username) хранит кадры, упорядоченные по времени,
+ * поэтому выборка диапазона - двоичный поиск, а не обход каталога с разбором имен.
+ *
+ * Клиент попадает в индекс при первом запросе по нему: его кадры подгружаются
+ * с диска (через FrameStorage::ListUnitFrames), и с начала подгрузки индекс
+ * пополняется потоком записи после каждого сохраненного кадра. Кадры клиентов,
+ * которых никто не запрашивал, в память не попадают: их найдет подгрузка.
+ * Кадры удаленных при очистке единиц убираются через Prune(), а упакованных
+ * в архив - заменяются через Replace().
+ *
+ * У каждого клиента своя блокировка чтения-записи: поиск по одному клиенту
+ * не мешает записи кадров другого.
+ */
+class FrameIndex {
+public:
+    /**
+     * @brief Конструктор
+     * @param root Корневой каталог хранилища
+     * @param storage Хранилище (для загрузки кадров с диска)
+     */
+    FrameIndex(std::filesystem::path root, const FrameStorage& storage);
+
+    FrameIndex(const FrameIndex&) = delete;
+    FrameIndex& operator=(const FrameIndex&) = delete;
+
+public:
+    /**
+     * @brief Добавить сохраненный кадр
+     * @param frame Кадр
+     * @param location Место, куда он записан
+     *
+     * Кадр клиента, которого еще не запрашивали, пропускается.
+     */
+    void Add(const FrameRecord& frame, const FrameLocation& location);
+
+    /**
+     * @brief Найти кадры клиента в диапазоне времени
+     * @param hostname Имя хоста клиента
+     * @param username Имя пользователя клиента
+     * @param from_ms Начало диапазона (включительно)
+     * @param to_ms Конец диапазона (включительно)
+     * @param limit Максимальное число кадров
+     * @return Кадры в порядке времени
+     */
+    std::vector<IndexedFrame> Lookup(const std::string& hostname, const std::string& username,
+                                     uint64_t from_ms, uint64_t to_ms, size_t limit);
+
+    /**
+     * @brief Забыть кадры клиента не новее заданного времени
+     * @param client Ключ клиента ("hostname/username")
+     * @param newest_ms Время последнего кадра удаленной единицы хранения
+     *
+     * Очистка удаляет единицы клиента от старых к новым, поэтому все кадры
+     * не новее удаленной единицы уже недоступны.
+     */
+    void Prune(const std::string& client, uint64_t newest_ms);
+
+    /**
+     * @brief Заменить кадры упакованных единиц кадрами архива
+     * @param client Ключ клиента ("hostname/username")
+     * @param removed Удаленные после упаковки единицы хранения
+     * @param archived Кадры архива, в который они вошли
+     *
+     * Вызывается после компактизации (см. CompactionManager).
+     */
+    void Replace(const std::string& client, const std::vector<std::string>& removed,
+                 const std::vector<StoredFrame>& archived);
+
+private:
+    /**
+     * @brief Кадры одного клиента
+     */
+    struct ClientFrames {
+        std::shared_mutex mutex;         ///< Защищает поля ниже
+        std::deque<IndexedFrame> frames; ///< Кадры по возрастанию времени
+        bool loading{false};             ///< Идет подгрузка с диска: Add() уже пополняет frames
+        bool loaded{false};              ///< Кадры с диска уже подгружены
+    };
+
+    /**
+     * @brief Найти или создать запись клиента
+     * @param client Ключ клиента
+     * @return Запись клиента (живет до разрушения индекса)
+     */
+    ClientFrames& GetClient(const std::string& client);
+
+    /**
+     * @brief Найти запись клиента, не создавая ее
+     * @param client Ключ клиента
+     * @return Запись клиента или nullptr, если клиента еще не запрашивали
+     */
+    ClientFrames* FindClient(const std::string& client);
+
+    /**
+     * @brief Подгрузить кадры клиента, записанные до первого запроса по нему
+     * @param entry Запись клиента
+     * @param hostname Имя хоста клиента
+     * @param username Имя пользователя клиента
+     */
+    void Load(ClientFrames& entry, const std::string& hostname, const std::string& username);
+
+private:
+    std::filesystem::path _root;                                             ///< Корневой каталог
+    const FrameStorage& _storage;                                            ///< Хранилище
+
+    std::mutex _clients_mutex;                                               ///< Защищает _clients
+    std::unordered_map<std::string, std::unique_ptr<ClientFrames>> _clients; ///< Клиент -> его кадры
+
+    Logger _logger;                                                          ///< Логгер
+};
+
+#endif // SERVER_SERVER_STORAGE_FRAME_INDEX_H
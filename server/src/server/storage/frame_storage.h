@@ -0,0 +1,192 @@
+#ifndef SERVER_SERVER_STORAGE_FRAME_STORAGE_H
+#define SERVER_SERVER_STORAGE_FRAME_STORAGE_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <filesystem>
+
+/**
+ * @brief Формат данных кадра
+ */
+enum FrameCodec : uint8_t {
+    K_PNG = 0,     ///< PNG-изображение, как его прислал клиент
+    K_ARCHIVED = 1 ///< Запись архива компактизации: кадр восстанавливается через ArchiveReader и выдается в PNG
+};
+
+/**
+ * @brief Данные принятого кадра
+ *
+ * Неизменяемый буфер с подсчетом ссылок: один и тот же кадр без копирования
+ * разделяют поток записи и живые зрители (см. ViewerHub).
+ */
+using FrameBuffer = std::shared_ptr<const std::vector<uint8_t>>;
+
+/**
+ * @brief Кадр, передаваемый в хранилище
+ *
+ * Не владеет данными: указатель действителен только на время вызова FrameStorage::Store().
+ */
+struct FrameRecord {
+    std::string hostname;    ///< Имя хоста клиента
+    std::string username;    ///< Имя пользователя клиента
+    std::string peer;        ///< Адрес клиента в формате "ip_port" (для имен файлов)
+    uint64_t timestamp_ms{}; ///< Время получения кадра (мс с начала эпохи)
+    FrameCodec codec{};      ///< Формат данных
+    uint16_t width{};        ///< Ширина изображения (0 - неизвестна, протокол v1)
+    uint16_t height{};       ///< Высота изображения (0 - неизвестна, протокол v1)
+    uint8_t monitor{};       ///< Номер монитора
+    const uint8_t* data{};   ///< Данные кадра
+    size_t size{};           ///< Размер данных
+};
+
+/**
+ * @brief Место хранения кадра
+ */
+struct FrameLocation {
+    std::string path;  ///< Файл, в котором лежит кадр
+    uint64_t offset{}; ///< Смещение кадра в файле
+    uint64_t length{}; ///< Длина кадра
+
+    /**
+     * @brief Описание места хранения для логов
+     * @return "path" для отдельного файла или "path@offset" для сегмента
+     */
+    std::string Describe() const {
+        return offset == 0 ? path : path + "@" + std::to_string(offset);
+    }
+};
+
+/**
+ * @brief Кадр, найденный в единице хранения на диске
+ */
+struct StoredFrame {
+    uint64_t timestamp_ms{}; ///< Время получения кадра
+    FrameCodec codec{};      ///< Формат данных
+    uint16_t width{};        ///< Ширина изображения (0 - хранилище ее не знает)
+    uint16_t height{};       ///< Высота изображения (0 - хранилище ее не знает)
+    uint8_t monitor{};       ///< Номер монитора
+    FrameLocation location;  ///< Где лежат данные кадра
+};
+
+/**
+ * @brief Единица хранения - то, что удаляется целиком при очистке
+ *
+ * Для FileStorage - файл кадра, для SegmentStorage - сегмент с индексом,
+ * для DedupStorage - журнал ссылок.
+ */
+struct StorageUnit {
+    std::string hostname; ///< Имя хоста клиента
+    std::string username; ///< Имя пользователя клиента
+    std::string path;     ///< Путь к файлу единицы (идентификатор)
+    uint64_t bytes{};     ///< Текущий объем единицы
+    uint64_t newest_ms{}; ///< Время последнего кадра в единице
+    bool closed{};        ///< Единица больше не дописывается и может быть удалена
+};
+
+/**
+ * @brief Наблюдатель за единицами хранения
+ */
+class StorageObserver {
+public:
+    virtual ~StorageObserver() = default;
+
+    /**
+     * @brief Единица хранения создана, выросла или закрыта
+     * @param unit Актуальное состояние единицы (объем - полный, а не приращение)
+     *
+     * Вызывается из потока записи.
+     */
+    virtual void OnUnitUpdate(const StorageUnit& unit) = 0;
+
+    /**
+     * @brief Единица хранения удалена не очисткой (упакована в архив, см. CompactionManager)
+     * @param path Путь к файлу единицы
+     */
+    virtual void OnUnitRemoved(const std::string& /*path*/) {}
+};
+
+/**
+ * @brief Интерфейс хранилища скриншотов
+ *
+ * Реализации раскладывают кадры по диску в своем формате.
+ * Store() и Sync() выполняются из одного потока (см. StorageWriter);
+ * InspectUnit(), ListUnitFrames() и RemoveUnit() могут вызываться из других потоков параллельно с ними.
+ */
+class FrameStorage {
+public:
+    virtual ~FrameStorage() = default;
+
+public:
+    /**
+     * @brief Сохранить кадр
+     * @param frame Кадр для сохранения
+     * @param[out] location Место, куда был записан кадр
+     * @return true если кадр записан, false при ошибке (ошибка логируется)
+     */
+    virtual bool Store(const FrameRecord& frame, FrameLocation& location) = 0;
+
+    /**
+     * @brief Сбросить на диск все кадры, сохраненные после предыдущего Sync()
+     * @return true если все данные и записи каталогов надежно записаны
+     *
+     * Имеет смысл только для хранилищ, созданных с отслеживанием синхронизации.
+     */
+    virtual bool Sync() = 0;
+
+    /**
+     * @brief Проверить, является ли файл единицей хранения, и получить ее объем
+     * @param path Путь к файлу, найденному при сканировании каталога клиента
+     * @param[out] bytes Объем единицы
+     * @return true если файл - единица хранения этого движка
+     */
+    virtual bool InspectUnit(const std::filesystem::path& path, uint64_t& bytes) const = 0;
+
+    /**
+     * @brief Перечислить кадры единицы хранения
+     * @param path Путь к файлу, найденному в каталоге клиента
+     * @param[out] frames Кадры дописываются в конец
+     * @return true если файл - единица хранения этого движка
+     */
+    virtual bool ListUnitFrames(const std::filesystem::path& path, std::vector<StoredFrame>& frames) const = 0;
+
+    /**
+     * @brief Удалить закрытую единицу хранения
+     * @param path Путь к файлу единицы
+     * @return Освобождено байт на диске
+     */
+    virtual uint64_t RemoveUnit(const std::string& path) = 0;
+
+    /**
+     * @brief Сохранить состояние, которое новый процесс сервера иначе восстанавливал бы сканированием диска
+     * @param[out] state Состояние дописывается в конец (пусто - восстанавливать нечего)
+     *
+     * Вызывается после остановки записи (см. Server, --handoff).
+     */
+    virtual void SaveHandoffState(std::vector<uint8_t>& /*state*/) const {}
+
+    /**
+     * @brief Установить наблюдателя за единицами хранения
+     * @param observer Наблюдатель (nullptr - отключить)
+     */
+    void SetObserver(StorageObserver* observer) noexcept {
+        _observer = observer;
+    }
+
+protected:
+    /**
+     * @brief Сообщить наблюдателю об изменении единицы хранения
+     * @param unit Единица хранения
+     */
+    void NotifyUnit(const StorageUnit& unit) {
+        if (_observer) {
+            _observer->OnUnitUpdate(unit);
+        }
+    }
+
+protected:
+    StorageObserver* _observer{nullptr}; ///< Наблюдатель за единицами хранения
+};
+
+#endif // SERVER_SERVER_STORAGE_FRAME_STORAGE_H
@@ -0,0 +1,126 @@
+#include <cstdio>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+
+#include "hot_frame_cache.h"
+
+HotFrameCache::HotFrameCache(uint64_t capacity_bytes, size_t frames_per_client) :
+    _capacity(capacity_bytes),
+    _shard_capacity(capacity_bytes / SHARDS),
+    _frames_per_client(frames_per_client)
+{}
+
+HotFrameCache::Shard& HotFrameCache::GetShard(const std::string& client) {
+    return _shards[std::hash<std::string>()(client) % SHARDS];
+}
+
+void HotFrameCache::Remove(Shard& shard, LruList::iterator it) {
+    auto order{shard.per_client.find(it->key.client)};
+
+    // LRU может вытеснить и не самый старый кадр клиента: время убирается из очереди, где бы оно ни стояло,
+    // иначе оно занимало бы место в лимите кадров клиента (очередь не длиннее _frames_per_client)
+    if (order != shard.per_client.end()) {
+        auto position{std::find(order->second.begin(), order->second.end(), it->key.timestamp_ms)};
+
+        if (position != order->second.end()) {
+            order->second.erase(position);
+        }
+
+        if (order->second.empty()) {
+            shard.per_client.erase(order);
+        }
+    }
+
+    shard.bytes -= it->data->size();
+    shard.entries.erase(it->key);
+    shard.lru.erase(it);
+}
+
+void HotFrameCache::Put(const std::string& client, uint64_t timestamp_ms, FrameBuffer data) {
+    if (!data || data->size() > _shard_capacity) {
+        return;
+    }
+
+    Shard& shard{GetShard(client)};
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    Key key{client, timestamp_ms};
+
+    if (auto found{shard.entries.find(key)}; found != shard.entries.end()) {
+        shard.bytes -= found->second->data->size();
+        shard.bytes += data->size();
+        found->second->data = std::move(data);
+        shard.lru.splice(shard.lru.begin(), shard.lru, found->second);
+
+        return;
+    }
+
+    shard.bytes += data->size();
+    shard.lru.push_front(Entry{key, std::move(data)});
+    shard.entries.emplace(std::move(key), shard.lru.begin());
+
+    shard.per_client[client].push_back(timestamp_ms);
+
+    // В очереди только кадры, которые есть в кэше: Remove() убирает время вытесненного кадра
+    // (и саму очередь, если она опустела - поэтому она ищется заново на каждом шаге)
+    for (auto order{shard.per_client.find(client)};
+         order != shard.per_client.end() && order->second.size() > _frames_per_client;
+         order = shard.per_client.find(client)) {
+        Remove(shard, shard.entries.at(Key{client, order->second.front()}));
+    }
+
+    while (shard.bytes > _shard_capacity) {
+        Remove(shard, std::prev(shard.lru.end()));
+    }
+}
+
+FrameBuffer HotFrameCache::Get(const std::string& client, uint64_t timestamp_ms, uint64_t length) {
+    Shard& shard{GetShard(client)};
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it{shard.entries.find(Key{client, timestamp_ms})};
+
+    if (it == shard.entries.end() || it->second->data->size() != length) {
+        shard.misses.fetch_add(1, std::memory_order_relaxed);
+
+        return nullptr;
+    }
+
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    shard.hits.fetch_add(1, std::memory_order_relaxed);
+
+    return it->second->data;
+}
+
+HotFrameCacheStats HotFrameCache::GetStats() {
+    HotFrameCacheStats stats;
+    stats.capacity = _capacity;
+
+    for (auto& shard : _shards) {
+        stats.hits += shard.hits.load(std::memory_order_relaxed);
+        stats.misses += shard.misses.load(std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        stats.bytes += shard.bytes;
+        stats.frames += shard.entries.size();
+    }
+
+    return stats;
+}
+
+std::string HotFrameCache::Describe() {
+    HotFrameCacheStats stats{GetStats()};
+
+    uint64_t lookups{stats.hits + stats.misses};
+
+    char hit_rate[16];
+    std::snprintf(hit_rate, sizeof(hit_rate), "%.1f%%", lookups == 0 ? 0.0 : 100.0 * stats.hits / lookups);
+
+    return "hot cache: " + std::to_string(stats.bytes / 1024) + " KB of " + std::to_string(stats.capacity / (1024 * 1024)) + " MB, " +
+           std::to_string(stats.frames) + " frames, hit rate " + hit_rate + " (" + std::to_string(stats.hits) + "/" +
+           std::to_string(lookups) + ")";
+}
@@ -0,0 +1,150 @@
+#ifndef SERVER_SERVER_STORAGE_HOT_FRAME_CACHE_H
+#define SERVER_SERVER_STORAGE_HOT_FRAME_CACHE_H
+
+#include <list>
+#include <array>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <cstdint>
+#include <unordered_map>
+
+#include "frame_storage.h"
+
+/**
+ * @brief Счетчики кэша горячих кадров
+ */
+struct HotFrameCacheStats {
+    uint64_t hits{};     ///< Попаданий
+    uint64_t misses{};   ///< Промахов
+    uint64_t bytes{};    ///< Объем кадров в кэше
+    uint64_t frames{};   ///< Число кадров в кэше
+    uint64_t capacity{}; ///< Бюджет памяти
+};
+
+/**
+ * @brief Кэш последних кадров клиентов в памяти
+ *
+ * Заполняется на пути приема сразу после передачи кадра на запись, поэтому
+ * запросы недавних кадров (см. QueryServer) не читают диск. Кадр хранится тем же
+ * буфером FrameBuffer, что ушел в поток записи и зрителям, - без копирования.
+ *
+ * Кэш разбит на сегменты по хешу клиента, у каждого свой мьютекс, список LRU и
+ * доля общего бюджета памяти; поиск - одна хеш-таблица, O(1). У клиента хранится
+ * не больше frames_per_client последних кадров, сверх этого и сверх бюджета сегмента
+ * вытесняются давно не запрошенные кадры.
+ */
+class HotFrameCache {
+public:
+    /**
+     * @brief Конструктор
+     * @param capacity_bytes Общий бюджет памяти
+     * @param frames_per_client Максимум кадров одного клиента
+     */
+    HotFrameCache(uint64_t capacity_bytes, size_t frames_per_client);
+
+    HotFrameCache(const HotFrameCache&) = delete;
+    HotFrameCache& operator=(const HotFrameCache&) = delete;
+
+public:
+    /**
+     * @brief Добавить кадр
+     * @param client Ключ клиента ("hostname/username")
+     * @param timestamp_ms Время получения кадра
+     * @param data Данные кадра
+     */
+    void Put(const std::string& client, uint64_t timestamp_ms, FrameBuffer data);
+
+    /**
+     * @brief Найти кадр
+     * @param client Ключ клиента
+     * @param timestamp_ms Время получения кадра
+     * @param length Ожидаемая длина (защита от совпадения времени у разных кадров)
+     * @return Данные кадра или nullptr при промахе
+     */
+    FrameBuffer Get(const std::string& client, uint64_t timestamp_ms, uint64_t length);
+
+    /**
+     * @brief Получить счетчики
+     * @return Попадания, промахи и занятая память
+     */
+    HotFrameCacheStats GetStats();
+
+    /**
+     * @brief Описание состояния для логов
+     * @return Строка с долей попаданий и занятой памятью
+     */
+    std::string Describe();
+
+private:
+    /**
+     * @brief Ключ кадра
+     */
+    struct Key {
+        std::string client;      ///< Ключ клиента
+        uint64_t timestamp_ms{}; ///< Время получения кадра
+
+        bool operator==(const Key& other) const noexcept {
+            return timestamp_ms == other.timestamp_ms && client == other.client;
+        }
+    };
+
+    /**
+     * @brief Хеш ключа кадра
+     */
+    struct KeyHash {
+        size_t operator()(const Key& key) const noexcept {
+            return std::hash<std::string>()(key.client) ^ (key.timestamp_ms * 0x9E3779B97F4A7C15ULL);
+        }
+    };
+
+    /**
+     * @brief Кадр в кэше
+     */
+    struct Entry {
+        Key key;          ///< Ключ
+        FrameBuffer data; ///< Данные кадра
+    };
+
+    using LruList = std::list<Entry>;
+
+    /**
+     * @brief Сегмент кэша
+     */
+    struct Shard {
+        std::mutex mutex;                                                 ///< Защищает поля ниже
+        LruList lru;                                                      ///< Кадры, начиная с недавно использованных
+        std::unordered_map<Key, LruList::iterator, KeyHash> entries;      ///< Ключ -> кадр
+        std::unordered_map<std::string, std::deque<uint64_t>> per_client; ///< Время кадров клиента в порядке добавления
+        uint64_t bytes{0};                                                ///< Объем кадров сегмента
+
+        std::atomic<uint64_t> hits{0};                                    ///< Попаданий
+        std::atomic<uint64_t> misses{0};                                  ///< Промахов
+    };
+
+    static constexpr size_t SHARDS{16};
+
+    /**
+     * @brief Выбрать сегмент клиента
+     * @param client Ключ клиента
+     * @return Сегмент (все кадры клиента лежат в одном сегменте)
+     */
+    Shard& GetShard(const std::string& client);
+
+    /**
+     * @brief Удалить кадр из сегмента (под мьютексом сегмента)
+     * @param shard Сегмент
+     * @param it Кадр
+     */
+    void Remove(Shard& shard, LruList::iterator it);
+
+private:
+    uint64_t _capacity;                ///< Общий бюджет памяти
+    uint64_t _shard_capacity;          ///< Бюджет памяти сегмента
+    size_t _frames_per_client;         ///< Максимум кадров клиента
+
+    std::array<Shard, SHARDS> _shards; ///< Сегменты
+};
+
+#endif // SERVER_SERVER_STORAGE_HOT_FRAME_CACHE_H
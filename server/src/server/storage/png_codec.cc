@@ -0,0 +1,219 @@
+#include <cstring>
+
+#include <zlib.h>
+
+#define STB_IMAGE_WRITE_STATIC
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+#include "png_codec.h"
+
+namespace Limit {
+constexpr size_t MAX_PIXEL_BYTES{64 * 1024 * 1024}; // 64 Mb, с запасом для 4K RGBA
+}
+
+namespace {
+constexpr uint8_t PNG_SIGNATURE[8]{0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+constexpr uint8_t COLOR_RGB{2};
+constexpr uint8_t COLOR_RGBA{6};
+
+uint32_t ReadBE32(const uint8_t* p) {
+    return (uint32_t{p[0]} << 24) | (uint32_t{p[1]} << 16) | (uint32_t{p[2]} << 8) | uint32_t{p[3]};
+}
+
+void WritePNG(void* context, void* data, int size) {
+    auto out{static_cast<std::vector<uint8_t>*>(context)};
+    auto bytes{static_cast<const uint8_t*>(data)};
+
+    out->insert(out->end(), bytes, bytes + size);
+}
+
+uint8_t Paeth(int a, int b, int c) {
+    int p{a + b - c};
+    int pa{p > a ? p - a : a - p};
+    int pb{p > b ? p - b : b - p};
+    int pc{p > c ? p - c : c - p};
+
+    if (pa <= pb && pa <= pc) {
+        return static_cast<uint8_t>(a);
+    }
+
+    return static_cast<uint8_t>(pb <= pc ? b : c);
+}
+
+/// Снять фильтр со строки на месте; prior - предыдущая строка без фильтра (нули для первой)
+bool Unfilter(uint8_t type, uint8_t* row, const uint8_t* prior, size_t length, size_t bpp) {
+    switch (type) {
+    case 0:
+        return true;
+    case 1:
+        for (size_t i{bpp}; i < length; ++i) {
+            row[i] = static_cast<uint8_t>(row[i] + row[i - bpp]);
+        }
+        return true;
+    case 2:
+        for (size_t i{0}; i < length; ++i) {
+            row[i] = static_cast<uint8_t>(row[i] + prior[i]);
+        }
+        return true;
+    case 3:
+        for (size_t i{0}; i < length; ++i) {
+            int left{i >= bpp ? row[i - bpp] : 0};
+            row[i] = static_cast<uint8_t>(row[i] + ((left + prior[i]) >> 1));
+        }
+        return true;
+    case 4:
+        for (size_t i{0}; i < length; ++i) {
+            int left{i >= bpp ? row[i - bpp] : 0};
+            int upper_left{i >= bpp ? prior[i - bpp] : 0};
+            row[i] = static_cast<uint8_t>(row[i] + Paeth(left, prior[i], upper_left));
+        }
+        return true;
+    default:
+        return false;
+    }
+}
+}
+
+bool PngCodec::Encode(const uint8_t* pixels, uint16_t width, uint16_t height, std::vector<uint8_t>& png) {
+    png.clear();
+
+    return stbi_write_png_to_func(WritePNG, &png, width, height, 3, pixels, width * 3) != 0;
+}
+
+bool PngCodec::Decode(const uint8_t* data, size_t size, std::vector<uint8_t>& pixels, uint16_t& width, uint16_t& height) {
+    if (size < sizeof(PNG_SIGNATURE) || std::memcmp(data, PNG_SIGNATURE, sizeof(PNG_SIGNATURE)) != 0) {
+        return false;
+    }
+
+    uint32_t png_width{0};
+    uint32_t png_height{0};
+    size_t channels{0};
+    bool ended{false};
+
+    z_stream stream{};
+    std::vector<uint8_t> filtered;
+    size_t inflated{0};
+
+    if (inflateInit(&stream) != Z_OK) {
+        return false;
+    }
+
+    size_t pos{sizeof(PNG_SIGNATURE)};
+
+    while (!ended) {
+        if (size - pos < 12) {
+            inflateEnd(&stream);
+            return false;
+        }
+
+        uint32_t length{ReadBE32(data + pos)};
+        const uint8_t* type{data + pos + 4};
+        const uint8_t* body{type + 4};
+
+        if (length > size - pos - 12 ||
+            ReadBE32(body + length) != crc32(0L, type, static_cast<uInt>(length + 4))) {
+            inflateEnd(&stream);
+            return false;
+        }
+
+        if (std::memcmp(type, "IHDR", 4) == 0) {
+            // Глубина 8 бит, сжатие и фильтры по умолчанию, без чересстрочности
+            if (length != 13 || body[8] != 8 || (body[9] != COLOR_RGB && body[9] != COLOR_RGBA) ||
+                body[10] != 0 || body[11] != 0 || body[12] != 0) {
+                inflateEnd(&stream);
+                return false;
+            }
+
+            png_width = ReadBE32(body);
+            png_height = ReadBE32(body + 4);
+            channels = body[9] == COLOR_RGB ? 3 : 4;
+
+            if (png_width == 0 || png_height == 0 || png_width > UINT16_MAX || png_height > UINT16_MAX ||
+                (png_width * channels + 1) * static_cast<size_t>(png_height) > Limit::MAX_PIXEL_BYTES) {
+                inflateEnd(&stream);
+                return false;
+            }
+
+            filtered.resize((png_width * channels + 1) * static_cast<size_t>(png_height));
+        } else if (std::memcmp(type, "IDAT", 4) == 0) {
+            if (filtered.empty()) {
+                inflateEnd(&stream);
+                return false;
+            }
+
+            stream.next_in = const_cast<Bytef*>(body);
+            stream.avail_in = length;
+
+            while (stream.avail_in > 0 && inflated < filtered.size()) {
+                stream.next_out = filtered.data() + inflated;
+                stream.avail_out = static_cast<uInt>(filtered.size() - inflated);
+
+                int status{inflate(&stream, Z_NO_FLUSH)};
+
+                inflated = filtered.size() - stream.avail_out;
+
+                if (status == Z_STREAM_END) {
+                    break;
+                }
+
+                if (status != Z_OK) {
+                    inflateEnd(&stream);
+                    return false;
+                }
+            }
+        } else if (std::memcmp(type, "IEND", 4) == 0) {
+            ended = true;
+        } else if ((type[0] & 0x20) == 0) {
+            // Неизвестный критический блок (например, палитра PLTE) - формат не поддерживается
+            inflateEnd(&stream);
+            return false;
+        }
+
+        pos += length + 12;
+    }
+
+    inflateEnd(&stream);
+
+    if (filtered.empty() || inflated != filtered.size()) {
+        return false;
+    }
+
+    size_t stride{png_width * channels};
+    std::vector<uint8_t> zero_row(stride, 0);
+
+    pixels.resize(static_cast<size_t>(png_width) * png_height * 3);
+
+    for (size_t y{0}; y < png_height; ++y) {
+        uint8_t* row{filtered.data() + y * (stride + 1)};
+        const uint8_t* prior{y == 0 ? zero_row.data() : row - stride};
+
+        if (!Unfilter(row[0], row + 1, prior, stride, channels)) {
+            return false;
+        }
+    }
+
+    // Фильтры сняты на месте, осталось выбросить байты фильтров и альфа-канал
+    uint8_t* out{pixels.data()};
+
+    for (size_t y{0}; y < png_height; ++y) {
+        const uint8_t* row{filtered.data() + y * (stride + 1) + 1};
+
+        if (channels == 3) {
+            std::memcpy(out, row, stride);
+            out += stride;
+        } else {
+            for (size_t x{0}; x < png_width; ++x) {
+                *out++ = row[x * 4];
+                *out++ = row[x * 4 + 1];
+                *out++ = row[x * 4 + 2];
+            }
+        }
+    }
+
+    width = static_cast<uint16_t>(png_width);
+    height = static_cast<uint16_t>(png_height);
+
+    return true;
+}
@@ -0,0 +1,38 @@
+#ifndef SERVER_SERVER_STORAGE_PNG_CODEC_H
+#define SERVER_SERVER_STORAGE_PNG_CODEC_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Кодирование и разбор PNG на стороне сервера
+ *
+ * Кодирует через stb_image_write. Разбирает только то, что присылают клиенты
+ * и пишет Encode(): 8 бит на канал, RGB или RGBA, без чересстрочности.
+ */
+class PngCodec {
+public:
+    /**
+     * @brief Закодировать пиксели в PNG
+     * @param pixels Пиксели RGB (3 байта на пиксель, строки подряд)
+     * @param width Ширина
+     * @param height Высота
+     * @param[out] png Данные PNG
+     * @return false при ошибке кодирования
+     */
+    static bool Encode(const uint8_t* pixels, uint16_t width, uint16_t height, std::vector<uint8_t>& png);
+
+    /**
+     * @brief Разобрать PNG в пиксели RGB
+     * @param data Данные PNG
+     * @param size Размер данных
+     * @param[out] pixels Пиксели RGB (альфа-канал отбрасывается)
+     * @param[out] width Ширина
+     * @param[out] height Высота
+     * @return false если файл поврежден или его формат не поддерживается
+     */
+    static bool Decode(const uint8_t* data, size_t size, std::vector<uint8_t>& pixels, uint16_t& width, uint16_t& height);
+};
+
+#endif // SERVER_SERVER_STORAGE_PNG_CODEC_H
@@ -0,0 +1,378 @@
+#include <atomic>
+#include <limits>
+#include <algorithm>
+
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+
+#include "storage_io.h"
+#include "retention_manager.h"
+
+namespace Limit {
+constexpr unsigned MAX_SCAN_THREADS{8};
+constexpr uint64_t MIN_EVICT_COST{4096}; // даже пустой файл стоит обновления метаданных
+constexpr auto IDLE_POLL{std::chrono::seconds(1)};
+}
+
+namespace fs = std::filesystem;
+
+namespace {
+uint64_t NowMs() {
+    auto now{std::chrono::system_clock::now().time_since_epoch()};
+
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(now).count());
+}
+
+std::string FormatMb(uint64_t bytes) {
+    return std::to_string(bytes / (1024 * 1024)) + " MB";
+}
+}
+
+RetentionManager::RetentionManager(fs::path root, const RetentionPolicy& policy, FrameStorage& storage) :
+    _root(std::move(root)),
+    _policy(policy),
+    _storage(storage)
+{}
+
+RetentionManager::~RetentionManager() {
+    Stop();
+}
+
+void RetentionManager::Start() {
+    _worker = std::thread(&RetentionManager::WorkerLoop, this);
+}
+
+void RetentionManager::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+
+    _wake.notify_all();
+
+    if (_worker.joinable()) {
+        _worker.join();
+    }
+}
+
+void RetentionManager::SetEvictCallback(EvictCallback callback) {
+    _on_evict = std::move(callback);
+}
+
+void RetentionManager::OnUnitUpdate(const StorageUnit& unit) {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    Upsert(unit, false);
+}
+
+void RetentionManager::OnUnitRemoved(const std::string& path) {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto it{_units.find(path)};
+
+    if (it != _units.end()) {
+        Erase(it);
+    }
+}
+
+void RetentionManager::Account(std::unordered_map<std::string, Usage>& areas, std::unordered_set<std::string>& over,
+                               const std::string& key, uint64_t quota, const Unit& unit, bool add) {
+    Usage& usage{areas[key]};
+
+    if (add) {
+        usage.bytes += unit.bytes;
+
+        if (unit.closed) {
+            usage.closed.emplace(unit.newest_ms, &unit);
+        }
+    } else {
+        usage.bytes -= unit.bytes;
+
+        if (unit.closed) {
+            usage.closed.erase({unit.newest_ms, &unit});
+        }
+    }
+
+    if (quota != 0 && usage.bytes > quota) {
+        over.insert(key);
+    } else {
+        over.erase(key);
+    }
+
+    if (usage.bytes == 0 && usage.closed.empty()) {
+        areas.erase(key);
+    }
+}
+
+void RetentionManager::Upsert(const StorageUnit& unit, bool only_new) {
+    auto it{_units.find(unit.path)};
+
+    if (it != _units.end()) {
+        if (only_new) {
+            return;
+        }
+
+        // Проще переучесть единицу целиком, чем разбирать, что в ней поменялось
+        Erase(it);
+    }
+
+    Unit& added{_units[unit.path]};
+    added.path = unit.path;
+    added.client = unit.hostname + "/" + unit.username;
+    added.user = unit.username;
+    added.bytes = unit.bytes;
+    added.newest_ms = unit.newest_ms;
+    added.closed = unit.closed;
+
+    Account(_clients, _clients_over, added.client, _policy.client_bytes, added, true);
+    Account(_users, _users_over, added.user, _policy.user_bytes, added, true);
+
+    _total.bytes += added.bytes;
+
+    if (added.closed) {
+        _total.closed.emplace(added.newest_ms, &added);
+    }
+}
+
+void RetentionManager::Erase(std::unordered_map<std::string, Unit>::iterator it) {
+    const Unit& unit{it->second};
+
+    Account(_clients, _clients_over, unit.client, _policy.client_bytes, unit, false);
+    Account(_users, _users_over, unit.user, _policy.user_bytes, unit, false);
+
+    _total.bytes -= unit.bytes;
+
+    if (unit.closed) {
+        _total.closed.erase({unit.newest_ms, &unit});
+    }
+
+    _units.erase(it);
+}
+
+uint64_t RetentionManager::GetFreeBytes() const {
+    struct statvfs st{};
+
+    if (statvfs(_root.c_str(), &st) == -1) {
+        return std::numeric_limits<uint64_t>::max();
+    }
+
+    return static_cast<uint64_t>(st.f_bavail) * st.f_frsize;
+}
+
+bool RetentionManager::PickVictim(Victim& victim) {
+    const Unit* unit{nullptr};
+
+    if (_total.closed.empty()) {
+        return false;
+    }
+
+    uint64_t max_age_ms{static_cast<uint64_t>(_policy.max_age_sec) * 1000};
+
+    if (max_age_ms != 0 && _total.closed.begin()->first + max_age_ms < NowMs()) {
+        unit = _total.closed.begin()->second;
+        victim.reason = "max age";
+    }
+
+    for (auto key{_clients_over.begin()}; !unit && key != _clients_over.end(); ++key) {
+        const Usage& usage{_clients[*key]};
+
+        if (!usage.closed.empty()) {
+            unit = usage.closed.begin()->second;
+            victim.reason = "client quota";
+        }
+    }
+
+    for (auto key{_users_over.begin()}; !unit && key != _users_over.end(); ++key) {
+        const Usage& usage{_users[*key]};
+
+        if (!usage.closed.empty()) {
+            unit = usage.closed.begin()->second;
+            victim.reason = "user quota";
+        }
+    }
+
+    if (!unit && _policy.total_bytes != 0 && _total.bytes > _policy.total_bytes) {
+        unit = _total.closed.begin()->second;
+        victim.reason = "total quota";
+    }
+
+    if (!unit && _policy.min_free_bytes != 0 && GetFreeBytes() < _policy.min_free_bytes) {
+        unit = _total.closed.begin()->second;
+        victim.reason = "min free";
+    }
+
+    if (!unit) {
+        return false;
+    }
+
+    victim.path = unit->path;
+    victim.client = unit->client;
+    victim.bytes = unit->bytes;
+    victim.newest_ms = unit->newest_ms;
+
+    // Из индекса убираем сразу: повторно эту единицу не выберут, пока идет удаление
+    Erase(_units.find(unit->path));
+
+    return true;
+}
+
+void RetentionManager::Throttle(uint64_t bytes, std::unique_lock<std::mutex>& lock) {
+    if (_policy.evict_rate == 0) {
+        return;
+    }
+
+    auto cost{std::chrono::microseconds(std::max(bytes, Limit::MIN_EVICT_COST) * 1000000 / _policy.evict_rate)};
+
+    _next_slot = std::max(_next_slot, std::chrono::steady_clock::now()) + cost;
+
+    _wake.wait_until(lock, _next_slot, [&] {
+        return _stop;
+    });
+}
+
+void RetentionManager::ScanExisting() {
+    auto started{std::chrono::steady_clock::now()};
+    uint64_t scan_start_ms{NowMs()};
+
+    std::vector<fs::path> hosts;
+    std::error_code ec;
+
+    for (const auto& entry : fs::directory_iterator(_root, ec)) {
+        // Служебные каталоги хранилищ (.blobs) начинаются с точки
+        if (entry.is_directory(ec) && entry.path().filename().string().front() != '.') {
+            hosts.push_back(entry.path());
+        }
+    }
+
+    unsigned threads{std::clamp(std::thread::hardware_concurrency(), 1U, Limit::MAX_SCAN_THREADS)};
+    threads = std::min<unsigned>(threads, std::max<size_t>(hosts.size(), 1));
+
+    std::atomic<size_t> next_host{0};
+    std::atomic<size_t> units{0};
+
+    auto scan{[&] {
+        StorageIO::SetIdleIOPriority();
+
+        for (size_t i{next_host++}; i < hosts.size(); i = next_host++) {
+            std::vector<StorageUnit> found;
+            std::error_code dir_ec;
+
+            for (const auto& user_dir : fs::directory_iterator(hosts[i], dir_ec)) {
+                if (!user_dir.is_directory(dir_ec)) {
+                    continue;
+                }
+
+                for (const auto& file : fs::directory_iterator(user_dir.path(), dir_ec)) {
+                    struct stat st{};
+
+                    if (stat(file.path().c_str(), &st) == -1 || !S_ISREG(st.st_mode)) {
+                        continue;
+                    }
+
+                    uint64_t mtime_ms{static_cast<uint64_t>(st.st_mtim.tv_sec) * 1000 + static_cast<uint64_t>(st.st_mtim.tv_nsec) / 1000000};
+
+                    StorageUnit unit;
+
+                    if (mtime_ms >= scan_start_ms || !_storage.InspectUnit(file.path(), unit.bytes)) {
+                        continue;
+                    }
+
+                    unit.hostname = hosts[i].filename().string();
+                    unit.username = user_dir.path().filename().string();
+                    unit.path = file.path().string();
+                    unit.newest_ms = mtime_ms;
+                    unit.closed = true;
+
+                    found.push_back(std::move(unit));
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(_mutex);
+
+            if (_stop) {
+                return;
+            }
+
+            for (const auto& unit : found) {
+                Upsert(unit, true);
+            }
+
+            units += found.size();
+        }
+    }};
+
+    std::vector<std::thread> workers;
+
+    for (unsigned i{1}; i < threads; ++i) {
+        workers.emplace_back(scan);
+    }
+
+    scan();
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    auto elapsed{std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started)};
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    _logger.PrintInTerminal(
+        MessageType::K_INFO,
+        "retention scan: " + std::to_string(units.load()) + " units in " + std::to_string(hosts.size()) + " host dirs, " +
+        FormatMb(_total.bytes) + " in use, " + std::to_string(elapsed.count()) + " ms (" + std::to_string(threads) + " threads)"
+    );
+}
+
+void RetentionManager::WorkerLoop() {
+    StorageIO::SetIdleIOPriority();
+
+    ScanExisting();
+
+    uint64_t evicted_units{0};
+    uint64_t evicted_bytes{0};
+    uint64_t freed_bytes{0};
+    const char* last_reason{""};
+
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    while (!_stop) {
+        Victim victim;
+
+        if (!PickVictim(victim)) {
+            if (evicted_units != 0) {
+                _logger.PrintInTerminal(
+                    MessageType::K_INFO,
+                    "retention: evicted " + std::to_string(evicted_units) + " units (" + FormatMb(evicted_bytes) + " accounted, " +
+                    FormatMb(freed_bytes) + " freed), last reason: " + last_reason + ", " + FormatMb(_total.bytes) + " in use"
+                );
+
+                evicted_units = evicted_bytes = freed_bytes = 0;
+            }
+
+            _wake.wait_for(lock, Limit::IDLE_POLL, [&] {
+                return _stop;
+            });
+
+            continue;
+        }
+
+        lock.unlock();
+
+        uint64_t freed{_storage.RemoveUnit(victim.path)};
+
+        if (_on_evict) {
+            _on_evict(victim.client, victim.newest_ms);
+        }
+
+        lock.lock();
+
+        ++evicted_units;
+        evicted_bytes += victim.bytes;
+        freed_bytes += freed;
+        last_reason = victim.reason;
+
+        Throttle(freed, lock);
+    }
+}
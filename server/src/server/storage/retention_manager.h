@@ -0,0 +1,215 @@
+#ifndef SERVER_SERVER_STORAGE_RETENTION_MANAGER_H
+#define SERVER_SERVER_STORAGE_RETENTION_MANAGER_H
+
+#include <set>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <cstdint>
+#include <filesystem>
+#include <unordered_set>
+#include <unordered_map>
+#include <condition_variable>
+
+#include "logger.h"
+#include "frame_storage.h"
+
+/**
+ * @brief Политика хранения скриншотов
+ *
+ * Нулевое значение означает отсутствие ограничения.
+ */
+struct RetentionPolicy {
+    uint64_t client_bytes{};   ///< Квота на клиента (hostname/username)
+    uint64_t user_bytes{};     ///< Квота на пользователя (по всем хостам)
+    uint64_t total_bytes{};    ///< Общая квота
+    unsigned max_age_sec{};    ///< Максимальный возраст кадров
+    uint64_t min_free_bytes{}; ///< Минимум свободного места на диске
+    uint64_t evict_rate{};     ///< Скорость удаления, байт/с
+
+    /**
+     * @brief Проверить, задано ли хоть одно ограничение
+     * @return true если очистка нужна
+     */
+    bool Enabled() const noexcept {
+        return client_bytes != 0 || user_bytes != 0 || total_bytes != 0 || max_age_sec != 0 || min_free_bytes != 0;
+    }
+};
+
+/**
+ * @brief Менеджер удержания: квоты и фоновая очистка хранилища
+ *
+ * Ведет индекс занятого места по единицам хранения (см. StorageUnit) с итогами
+ * на клиента, пользователя и всего. Индекс строится при запуске параллельным
+ * сканированием каталогов и дальше поддерживается инкрементально по уведомлениям
+ * хранилища (OnUnitUpdate).
+ *
+ * Фоновый поток с idle-приоритетом ввода-вывода удаляет самые старые закрытые
+ * единицы, пока нарушено хоть одно ограничение: возраст, квота клиента,
+ * квота пользователя, общая квота, минимум свободного места. Скорость удаления
+ * ограничена evict_rate, поэтому очистка не отнимает диск у записи кадров.
+ */
+class RetentionManager : public StorageObserver {
+public:
+    /**
+     * @brief Конструктор
+     * @param root Корневой каталог хранилища
+     * @param policy Политика хранения
+     * @param storage Хранилище (должно жить дольше менеджера или до Stop())
+     */
+    RetentionManager(std::filesystem::path root, const RetentionPolicy& policy, FrameStorage& storage);
+
+    /**
+     * @brief Деструктор - останавливает поток очистки
+     */
+    ~RetentionManager() override;
+
+    RetentionManager(const RetentionManager&) = delete;
+    RetentionManager& operator=(const RetentionManager&) = delete;
+
+public:
+    /**
+     * @brief Запустить сканирование и поток очистки
+     */
+    void Start();
+
+    /**
+     * @brief Остановить поток очистки (повторный вызов безопасен)
+     */
+    void Stop();
+
+    void OnUnitUpdate(const StorageUnit& unit) override;
+
+    void OnUnitRemoved(const std::string& path) override;
+
+    /// Вызывается после удаления единицы: ключ клиента и время ее последнего кадра
+    using EvictCallback = std::function<void(const std::string& client, uint64_t newest_ms)>;
+
+    /**
+     * @brief Установить обработчик удаления единиц (до Start())
+     * @param callback Обработчик (вызывается из потока очистки)
+     */
+    void SetEvictCallback(EvictCallback callback);
+
+private:
+    struct Unit;
+
+    /// Единицы в порядке возраста (время последнего кадра, единица)
+    using AgeOrder = std::set<std::pair<uint64_t, const Unit*>>;
+
+    /**
+     * @brief Учтенная единица хранения
+     */
+    struct Unit {
+        std::string path;     ///< Путь к файлу единицы
+        std::string client;   ///< Ключ клиента ("hostname/username")
+        std::string user;     ///< Имя пользователя
+        uint64_t bytes{};     ///< Объем
+        uint64_t newest_ms{}; ///< Время последнего кадра
+        bool closed{};        ///< Можно удалять
+    };
+
+    /**
+     * @brief Занятое место в одной области (клиент, пользователь или все)
+     */
+    struct Usage {
+        uint64_t bytes{}; ///< Объем всех единиц
+        AgeOrder closed;  ///< Закрытые единицы по возрасту
+    };
+
+    /**
+     * @brief Кандидат на удаление
+     */
+    struct Victim {
+        std::string path;       ///< Путь к единице
+        std::string client;     ///< Ключ клиента
+        uint64_t bytes{};       ///< Учтенный объем
+        uint64_t newest_ms{};   ///< Время последнего кадра
+        const char* reason{""}; ///< Нарушенное ограничение
+    };
+
+    /// Основной цикл потока очистки
+    void WorkerLoop();
+
+    /**
+     * @brief Построить индекс по уже существующим файлам
+     *
+     * Каталоги хостов делятся между несколькими потоками. Файлы, измененные после
+     * начала сканирования, пропускаются: о них сообщит само хранилище.
+     */
+    void ScanExisting();
+
+    /**
+     * @brief Обновить единицу в индексе (под _mutex)
+     * @param unit Состояние единицы
+     * @param only_new Не трогать уже известную единицу (для результатов сканирования)
+     */
+    void Upsert(const StorageUnit& unit, bool only_new);
+
+    /**
+     * @brief Убрать единицу из индекса (под _mutex)
+     * @param it Итератор на единицу
+     */
+    void Erase(std::unordered_map<std::string, Unit>::iterator it);
+
+    /**
+     * @brief Изменить объем области и обновить множество нарушителей квоты (под _mutex)
+     * @param areas Итоги по областям
+     * @param over Множество областей, превысивших квоту
+     * @param key Ключ области
+     * @param quota Квота (0 - без ограничения)
+     * @param unit Единица
+     * @param add true - добавить единицу, false - убрать
+     */
+    void Account(std::unordered_map<std::string, Usage>& areas, std::unordered_set<std::string>& over,
+                 const std::string& key, uint64_t quota, const Unit& unit, bool add);
+
+    /**
+     * @brief Выбрать единицу для удаления (под _mutex)
+     * @param[out] victim Кандидат
+     * @return true если какое-то ограничение нарушено и есть что удалить
+     */
+    bool PickVictim(Victim& victim);
+
+    /**
+     * @brief Получить свободное место на диске хранилища
+     * @return Свободно байт (UINT64_MAX, если узнать не удалось)
+     */
+    uint64_t GetFreeBytes() const;
+
+    /**
+     * @brief Выдержать паузу согласно ограничению скорости удаления
+     * @param bytes Только что удалено байт
+     * @param lock Захваченный _mutex (отпускается на время паузы)
+     */
+    void Throttle(uint64_t bytes, std::unique_lock<std::mutex>& lock);
+
+private:
+    std::filesystem::path _root;                      ///< Корневой каталог
+    RetentionPolicy _policy;                          ///< Политика хранения
+    FrameStorage& _storage;                           ///< Хранилище
+
+    std::mutex _mutex;                                ///< Защищает индекс и флаг остановки
+    std::condition_variable _wake;                    ///< Остановка
+    bool _stop{false};                                ///< Флаг остановки
+
+    std::unordered_map<std::string, Unit> _units;     ///< Единицы по пути
+    std::unordered_map<std::string, Usage> _clients;  ///< Итоги по клиентам
+    std::unordered_map<std::string, Usage> _users;    ///< Итоги по пользователям
+    std::unordered_set<std::string> _clients_over;    ///< Клиенты сверх квоты
+    std::unordered_set<std::string> _users_over;      ///< Пользователи сверх квоты
+    Usage _total;                                     ///< Общий итог
+
+    EvictCallback _on_evict;                          ///< Обработчик удаления единиц
+
+    std::chrono::steady_clock::time_point _next_slot; ///< Раньше этого момента удалять нельзя (ограничение скорости)
+
+    std::thread _worker;                              ///< Поток очистки
+
+    Logger _logger;                                   ///< Логгер
+};
+
+#endif // SERVER_SERVER_STORAGE_RETENTION_MANAGER_H
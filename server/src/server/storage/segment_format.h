@@ -0,0 +1,60 @@
+#ifndef SERVER_SERVER_STORAGE_SEGMENT_FORMAT_H
+#define SERVER_SERVER_STORAGE_SEGMENT_FORMAT_H
+
+#include <cstdint>
+
+/**
+ * @brief Формат сегментного хранилища
+ *
+ * Кадры клиента дописываются подряд в файл сегмента <root>/<host>/<user>/<start_ms>.seg.
+ * Рядом лежит индекс <start_ms>.idx: заголовок SegmentIndexHeader и далее
+ * записи SegmentIndexEntry фиксированного размера (порядок байт - хоста).
+ * Кадр считается сохраненным только после записи его индекса.
+ *
+ * Индексы первой версии (INDEX_MAGIC_V1, записи SegmentIndexEntryV1 без размеров
+ * изображения) по-прежнему читаются.
+ */
+namespace Segment {
+constexpr char DATA_EXT[]{".seg"};                                           ///< Расширение файла данных
+constexpr char INDEX_EXT[]{".idx"};                                          ///< Расширение файла индекса
+constexpr uint8_t INDEX_MAGIC[8]{'R', 'S', 'C', 'I', 'D', 'X', '0', '2'};    ///< Сигнатура индекса
+constexpr uint8_t INDEX_MAGIC_V1[8]{'R', 'S', 'C', 'I', 'D', 'X', '0', '1'}; ///< Сигнатура индекса первой версии
+}
+
+/**
+ * @brief Заголовок файла индекса
+ */
+struct SegmentIndexHeader {
+    uint8_t magic[8]; ///< Segment::INDEX_MAGIC
+};
+
+/**
+ * @brief Запись индекса сегмента (один кадр)
+ */
+struct SegmentIndexEntry {
+    uint64_t timestamp_ms; ///< Время получения кадра (мс с начала эпохи)
+    uint64_t offset;       ///< Смещение кадра в файле сегмента
+    uint32_t length;       ///< Длина кадра
+    uint8_t codec;         ///< Формат данных (FrameCodec)
+    uint8_t monitor;       ///< Номер монитора
+    uint16_t width;        ///< Ширина изображения (0 - неизвестна)
+    uint16_t height;       ///< Высота изображения (0 - неизвестна)
+    uint8_t reserved[6];   ///< Выравнивание (нули)
+};
+
+/**
+ * @brief Запись индекса первой версии
+ */
+struct SegmentIndexEntryV1 {
+    uint64_t timestamp_ms; ///< Время получения кадра (мс с начала эпохи)
+    uint64_t offset;       ///< Смещение кадра в файле сегмента
+    uint32_t length;       ///< Длина кадра
+    uint8_t codec;         ///< Формат данных (FrameCodec)
+    uint8_t reserved[3];   ///< Выравнивание (нули)
+};
+
+static_assert(sizeof(SegmentIndexHeader) == 8, "SegmentIndexHeader layout");
+static_assert(sizeof(SegmentIndexEntry) == 32, "SegmentIndexEntry layout");
+static_assert(sizeof(SegmentIndexEntryV1) == 24, "SegmentIndexEntryV1 layout");
+
+#endif // SERVER_SERVER_STORAGE_SEGMENT_FORMAT_H
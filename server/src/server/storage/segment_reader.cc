@@ -0,0 +1,92 @@
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "segment_reader.h"
+
+namespace fs = std::filesystem;
+
+SegmentReader::SegmentReader(const fs::path& path) {
+    fs::path index_path{path};
+    index_path.replace_extension(Segment::INDEX_EXT);
+
+    _data_path = path;
+    _data_path.replace_extension(Segment::DATA_EXT);
+
+    std::ifstream index(index_path, std::ios::binary);
+
+    if (!index) {
+        throw std::runtime_error("open index failed: " + index_path.string());
+    }
+
+    SegmentIndexHeader header{};
+
+    if (!index.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        throw std::runtime_error("bad index header: " + index_path.string());
+    }
+
+    bool legacy{std::memcmp(header.magic, Segment::INDEX_MAGIC_V1, sizeof(header.magic)) == 0};
+
+    if (!legacy && std::memcmp(header.magic, Segment::INDEX_MAGIC, sizeof(header.magic)) != 0) {
+        throw std::runtime_error("bad index header: " + index_path.string());
+    }
+
+    std::error_code ec;
+    uint64_t data_size{fs::file_size(_data_path, ec)};
+
+    if (ec) {
+        throw std::runtime_error("stat segment failed: " + _data_path.string());
+    }
+
+    // После сбоя индекс может оказаться на диске раньше данных - такие записи отбрасываем
+    while (true) {
+        SegmentIndexEntry entry{};
+
+        if (legacy) {
+            SegmentIndexEntryV1 old_entry{};
+
+            if (!index.read(reinterpret_cast<char*>(&old_entry), sizeof(old_entry))) {
+                break;
+            }
+
+            entry.timestamp_ms = old_entry.timestamp_ms;
+            entry.offset = old_entry.offset;
+            entry.length = old_entry.length;
+            entry.codec = old_entry.codec;
+        } else if (!index.read(reinterpret_cast<char*>(&entry), sizeof(entry))) {
+            break;
+        }
+
+        if (entry.offset + entry.length > data_size) {
+            break;
+        }
+
+        _entries.push_back(entry);
+    }
+}
+
+const fs::path& SegmentReader::GetDataPath() const noexcept {
+    return _data_path;
+}
+
+const std::vector<SegmentIndexEntry>& SegmentReader::GetEntries() const noexcept {
+    return _entries;
+}
+
+void SegmentReader::ReadFrame(size_t index, std::vector<uint8_t>& out) const {
+    const SegmentIndexEntry& entry{_entries.at(index)};
+
+    std::ifstream data(_data_path, std::ios::binary);
+
+    if (!data) {
+        throw std::runtime_error("open segment failed: " + _data_path.string());
+    }
+
+    out.resize(entry.length);
+
+    data.seekg(static_cast<std::streamoff>(entry.offset));
+
+    if (!data.read(reinterpret_cast<char*>(out.data()), entry.length)) {
+        throw std::runtime_error("read frame failed: " + _data_path.string() + "@" + std::to_string(entry.offset));
+    }
+}
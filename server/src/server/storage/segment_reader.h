@@ -0,0 +1,53 @@
+#ifndef SERVER_SERVER_STORAGE_SEGMENT_READER_H
+#define SERVER_SERVER_STORAGE_SEGMENT_READER_H
+
+#include <vector>
+#include <cstdint>
+#include <filesystem>
+
+#include "segment_format.h"
+
+/**
+ * @brief Чтение сегмента сегментного хранилища
+ *
+ * Загружает индекс сегмента (любой версии) и позволяет прочитать любой кадр по номеру.
+ * Недописанная последняя запись индекса (обрыв при записи) и записи,
+ * указывающие за конец файла данных, игнорируются.
+ */
+class SegmentReader {
+public:
+    /**
+     * @brief Конструктор
+     * @param path Путь к файлу индекса (.idx) или данных (.seg) сегмента
+     * @throw std::runtime_error Если индекс не удалось прочитать
+     */
+    explicit SegmentReader(const std::filesystem::path& path);
+
+public:
+    /**
+     * @brief Получить путь к файлу данных сегмента
+     * @return Путь к .seg
+     */
+    const std::filesystem::path& GetDataPath() const noexcept;
+
+    /**
+     * @brief Получить записи индекса
+     * @return Записи индекса в порядке записи кадров
+     */
+    const std::vector<SegmentIndexEntry>& GetEntries() const noexcept;
+
+    /**
+     * @brief Прочитать кадр
+     * @param index Номер кадра в сегменте
+     * @param[out] out Данные кадра
+     * @throw std::out_of_range Если кадра с таким номером нет
+     * @throw std::runtime_error При ошибке чтения
+     */
+    void ReadFrame(size_t index, std::vector<uint8_t>& out) const;
+
+private:
+    std::filesystem::path _data_path;        ///< Путь к файлу данных
+    std::vector<SegmentIndexEntry> _entries; ///< Записи индекса
+};
+
+#endif // SERVER_SERVER_STORAGE_SEGMENT_READER_H
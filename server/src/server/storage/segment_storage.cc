@@ -0,0 +1,340 @@
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "segment_format.h"
+#include "segment_reader.h"
+#include "storage_io.h"
+#include "segment_storage.h"
+
+namespace Limit {
+constexpr size_t MAX_OPEN_SEGMENTS{4096};
+constexpr int MAX_CREATE_ATTEMPTS{16};
+}
+
+namespace fs = std::filesystem;
+
+SegmentStorage::SegmentStorage(fs::path root, uint64_t segment_size, unsigned segment_age_sec, bool track_sync) :
+    _root(std::move(root)),
+    _segment_size(segment_size),
+    _segment_age_ms(static_cast<uint64_t>(segment_age_sec) * 1000),
+    _track_sync(track_sync)
+{}
+
+SegmentStorage::~SegmentStorage() {
+    while (!_lru.empty()) {
+        Seal(_lru.begin());
+    }
+
+    if (_track_sync) {
+        Sync();
+    }
+}
+
+bool SegmentStorage::Create(const fs::path& dir, uint64_t now_ms, OpenSegment& segment) {
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+
+    if (ec) {
+        static LogRateLimit rate{10};
+
+        _logger.PrintInTerminal(MessageType::K_ERROR, "create_directories() error: " + ec.message(), rate);
+
+        return false;
+    }
+
+    // Имя сегмента - время открытия; при совпадении сдвигаем на миллисекунду
+    for (int attempt{0}; attempt < Limit::MAX_CREATE_ATTEMPTS; ++attempt) {
+        std::string stem{std::to_string(now_ms + attempt)};
+        fs::path data_path{dir / (stem + Segment::DATA_EXT)};
+        fs::path index_path{dir / (stem + Segment::INDEX_EXT)};
+
+        UniqueFD data_fd(ResourceFactory::MakeUniqueFD(open(data_path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_APPEND | O_CLOEXEC, 0644)));
+
+        if (!data_fd.Valid()) {
+            if (errno == EEXIST) {
+                continue;
+            }
+
+            static LogRateLimit rate{10};
+
+            _logger.PrintInTerminal(MessageType::K_ERROR, "open() error: " + data_path.string() + ": " + std::string(strerror(errno)), rate);
+
+            return false;
+        }
+
+        UniqueFD index_fd(ResourceFactory::MakeUniqueFD(open(index_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644)));
+
+        if (!index_fd.Valid()) {
+            static LogRateLimit rate{10};
+
+            _logger.PrintInTerminal(MessageType::K_ERROR, "open() error: " + index_path.string() + ": " + std::string(strerror(errno)), rate);
+
+            unlink(data_path.c_str());
+
+            return false;
+        }
+
+        SegmentIndexHeader header{};
+        std::memcpy(header.magic, Segment::INDEX_MAGIC, sizeof(header.magic));
+
+        if (!StorageIO::WriteAll(index_fd.Get(), &header, sizeof(header))) {
+            static LogRateLimit rate{10};
+
+            _logger.PrintInTerminal(MessageType::K_ERROR, "write() error: " + index_path.string() + ": " + std::string(strerror(errno)), rate);
+
+            unlink(data_path.c_str());
+            unlink(index_path.c_str());
+
+            return false;
+        }
+
+        // Место выделяется заранее, но размер файла растет только по мере записи
+        if (fallocate(data_fd.Get(), FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(_segment_size)) == -1) {
+            if (errno != EOPNOTSUPP) {
+                _logger.PrintInTerminal(MessageType::K_WARNING, "fallocate() error: " + data_path.string() + ": " + std::string(strerror(errno)));
+            }
+        }
+
+        segment.path = data_path;
+        segment.data_fd = std::move(data_fd);
+        segment.index_fd = std::move(index_fd);
+        segment.size = 0;
+        segment.opened_at_ms = now_ms;
+
+        if (_track_sync) {
+            segment.dirty = true;
+
+            _dirty_dirs.insert(dir.string());
+        }
+
+        return true;
+    }
+
+    static LogRateLimit rate{10};
+
+    _logger.PrintInTerminal(MessageType::K_ERROR, "cannot create segment in " + dir.string(), rate);
+
+    return false;
+}
+
+void SegmentStorage::NotifySegment(const OpenSegment& segment, bool closed) {
+    uint64_t index_bytes{sizeof(SegmentIndexHeader) + segment.frames * sizeof(SegmentIndexEntry)};
+
+    NotifyUnit(StorageUnit{segment.hostname, segment.username, segment.path.string(), segment.size + index_bytes, segment.newest_ms, closed});
+}
+
+void SegmentStorage::Seal(SegmentList::iterator it) {
+    // Возвращаем файловой системе заранее выделенный, но не записанный хвост
+    if (it->data_fd.Valid() && ftruncate(it->data_fd.Get(), static_cast<off_t>(it->size)) == -1) {
+        _logger.PrintInTerminal(MessageType::K_WARNING, "ftruncate() error: " + it->path.string() + ": " + std::string(strerror(errno)));
+    }
+
+    if (it->frames > 0) {
+        NotifySegment(*it, true);
+    }
+
+    _by_key.erase(it->key);
+
+    if (_track_sync && it->dirty) {
+        _sealed_unsynced.push_back(std::move(*it));
+    }
+
+    _lru.erase(it);
+}
+
+bool SegmentStorage::SyncSegment(const OpenSegment& segment) {
+    // Индекс сбрасывается после данных: запись индекса не должна пережить сбой раньше кадра
+    if (fdatasync(segment.data_fd.Get()) == -1 || fdatasync(segment.index_fd.Get()) == -1) {
+        _logger.PrintInTerminal(MessageType::K_ERROR, "fdatasync() error: " + segment.path.string() + ": " + std::string(strerror(errno)));
+
+        return false;
+    }
+
+    return true;
+}
+
+bool SegmentStorage::Sync() {
+    bool ok{true};
+
+    for (auto& segment : _lru) {
+        if (segment.dirty) {
+            ok = SyncSegment(segment) && ok;
+            segment.dirty = false;
+        }
+    }
+
+    for (const auto& segment : _sealed_unsynced) {
+        ok = SyncSegment(segment) && ok;
+    }
+
+    _sealed_unsynced.clear();
+
+    for (const auto& dir : _dirty_dirs) {
+        if (!StorageIO::SyncDirectory(dir)) {
+            _logger.PrintInTerminal(MessageType::K_ERROR, "fsync() error: " + dir + ": " + std::string(strerror(errno)));
+
+            ok = false;
+        }
+    }
+
+    _dirty_dirs.clear();
+
+    return ok;
+}
+
+SegmentStorage::SegmentList::iterator SegmentStorage::Acquire(const FrameRecord& frame) {
+    std::string key{frame.hostname + "/" + frame.username};
+
+    auto found{_by_key.find(key)};
+
+    if (found != _by_key.end()) {
+        auto it{found->second};
+
+        bool too_big{it->size > 0 && it->size + frame.size > _segment_size};
+        bool too_old{frame.timestamp_ms >= it->opened_at_ms + _segment_age_ms};
+
+        if (!too_big && !too_old) {
+            _lru.splice(_lru.begin(), _lru, it);
+
+            return it;
+        }
+
+        Seal(it);
+    }
+
+    if (_by_key.size() >= Limit::MAX_OPEN_SEGMENTS) {
+        Seal(std::prev(_lru.end()));
+    }
+
+    OpenSegment segment;
+    segment.key = key;
+    segment.hostname = frame.hostname;
+    segment.username = frame.username;
+
+    if (!Create(_root / fs::path(frame.hostname) / fs::path(frame.username), frame.timestamp_ms, segment)) {
+        return _lru.end();
+    }
+
+    _lru.push_front(std::move(segment));
+    _by_key[key] = _lru.begin();
+
+    return _lru.begin();
+}
+
+bool SegmentStorage::Store(const FrameRecord& frame, FrameLocation& location) {
+    auto it{Acquire(frame)};
+
+    if (it == _lru.end()) {
+        return false;
+    }
+
+    SegmentIndexEntry entry{};
+    entry.timestamp_ms = frame.timestamp_ms;
+    entry.offset = it->size;
+    entry.length = static_cast<uint32_t>(frame.size);
+    entry.codec = frame.codec;
+    entry.monitor = frame.monitor;
+    entry.width = frame.width;
+    entry.height = frame.height;
+
+    if (!StorageIO::WriteAll(it->data_fd.Get(), frame.data, frame.size)) {
+        static LogRateLimit rate{10};
+
+        _logger.PrintInTerminal(MessageType::K_ERROR, "write() error: " + it->path.string() + ": " + std::string(strerror(errno)), rate);
+
+        Seal(it);
+
+        return false;
+    }
+
+    it->size += frame.size;
+
+    if (!StorageIO::WriteAll(it->index_fd.Get(), &entry, sizeof(entry))) {
+        static LogRateLimit rate{10};
+
+        _logger.PrintInTerminal(MessageType::K_ERROR, "write() error: index of " + it->path.string() + ": " + std::string(strerror(errno)), rate);
+
+        Seal(it);
+
+        return false;
+    }
+
+    it->dirty = _track_sync;
+    it->frames += 1;
+    it->newest_ms = frame.timestamp_ms;
+
+    NotifySegment(*it, false);
+
+    location.path = it->path.string();
+    location.offset = entry.offset;
+    location.length = entry.length;
+
+    return true;
+}
+
+bool SegmentStorage::InspectUnit(const fs::path& path, uint64_t& bytes) const {
+    if (path.extension() != Segment::DATA_EXT) {
+        return false;
+    }
+
+    fs::path index_path{path};
+    index_path.replace_extension(Segment::INDEX_EXT);
+
+    std::error_code ec;
+    bytes = fs::file_size(path, ec);
+
+    if (ec) {
+        return false;
+    }
+
+    uint64_t index_bytes{fs::file_size(index_path, ec)};
+
+    if (!ec) {
+        bytes += index_bytes;
+    }
+
+    return true;
+}
+
+bool SegmentStorage::ListUnitFrames(const fs::path& path, std::vector<StoredFrame>& frames) const {
+    if (path.extension() != Segment::DATA_EXT) {
+        return false;
+    }
+
+    try {
+        SegmentReader reader(path);
+
+        for (const auto& entry : reader.GetEntries()) {
+            StoredFrame frame;
+            frame.timestamp_ms = entry.timestamp_ms;
+            frame.codec = static_cast<FrameCodec>(entry.codec);
+            frame.width = entry.width;
+            frame.height = entry.height;
+            frame.monitor = entry.monitor;
+            frame.location.path = path.string();
+            frame.location.offset = entry.offset;
+            frame.location.length = entry.length;
+
+            frames.push_back(std::move(frame));
+        }
+    } catch (const std::runtime_error&) {
+        // Индекс сегмента не читается - кадры этого сегмента недоступны для поиска
+        return false;
+    }
+
+    return true;
+}
+
+uint64_t SegmentStorage::RemoveUnit(const std::string& path) {
+    fs::path index_path{path};
+    index_path.replace_extension(Segment::INDEX_EXT);
+
+    // Индекс удаляется первым: при сбое между вызовами останется .seg, который найдет следующее сканирование
+    uint64_t freed{StorageIO::RemoveFile(index_path.string())};
+
+    return freed + StorageIO::RemoveFile(path);
+}
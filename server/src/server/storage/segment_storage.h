@@ -0,0 +1,131 @@
+#ifndef SERVER_SERVER_STORAGE_SEGMENT_STORAGE_H
+#define SERVER_SERVER_STORAGE_SEGMENT_STORAGE_H
+
+#include <list>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <unordered_set>
+#include <unordered_map>
+
+#include "logger.h"
+#include "frame_storage.h"
+#include "resource_factory.h"
+
+/**
+ * @brief Сегментное хранилище кадров
+ *
+ * Вместо файла на каждый кадр дописывает кадры клиента (hostname/username)
+ * в большой сегмент, место под который заранее выделяется через fallocate.
+ * Сегмент закрывается при превышении размера или возраста, неиспользованный
+ * хвост при этом освобождается. Формат файлов описан в segment_format.h.
+ *
+ * Число одновременно открытых сегментов ограничено: при превышении
+ * закрывается сегмент, в который дольше всего не писали.
+ *
+ * При отслеживании синхронизации Sync() сбрасывает данные и индексы измененных
+ * сегментов (сначала данные, потом индекс), а также каталоги с новыми сегментами.
+ * Закрытые до Sync() сегменты держатся открытыми до него.
+ *
+ * Единица хранения - сегмент вместе с индексом; удалять можно только закрытые сегменты.
+ */
+class SegmentStorage : public FrameStorage {
+public:
+    /**
+     * @brief Конструктор
+     * @param root Корневой каталог хранилища
+     * @param segment_size Максимальный размер сегмента в байтах
+     * @param segment_age_sec Максимальный возраст сегмента в секундах
+     * @param track_sync Отслеживать несинхронизированные сегменты для Sync()
+     */
+    SegmentStorage(std::filesystem::path root, uint64_t segment_size, unsigned segment_age_sec, bool track_sync = false);
+
+    /**
+     * @brief Деструктор - закрывает все открытые сегменты
+     */
+    ~SegmentStorage() override;
+
+public:
+    bool Store(const FrameRecord& frame, FrameLocation& location) override;
+
+    bool Sync() override;
+
+    bool InspectUnit(const std::filesystem::path& path, uint64_t& bytes) const override;
+
+    bool ListUnitFrames(const std::filesystem::path& path, std::vector<StoredFrame>& frames) const override;
+
+    uint64_t RemoveUnit(const std::string& path) override;
+
+private:
+    /**
+     * @brief Открытый сегмент клиента
+     */
+    struct OpenSegment {
+        std::string key;            ///< Ключ клиента ("hostname/username")
+        std::string hostname;       ///< Имя хоста клиента
+        std::string username;       ///< Имя пользователя клиента
+        std::filesystem::path path; ///< Путь к файлу данных
+        UniqueFD data_fd;           ///< Файл данных
+        UniqueFD index_fd;          ///< Файл индекса
+        uint64_t size{};            ///< Записано байт
+        uint64_t frames{};          ///< Записано кадров
+        uint64_t opened_at_ms{};    ///< Время открытия сегмента
+        uint64_t newest_ms{};       ///< Время последнего кадра
+        bool dirty{false};          ///< Есть записи после последнего Sync()
+    };
+
+    using SegmentList = std::list<OpenSegment>;
+
+    /**
+     * @brief Найти или открыть сегмент, в который поместится кадр
+     * @param frame Кадр
+     * @return Итератор на сегмент или end() при ошибке
+     */
+    SegmentList::iterator Acquire(const FrameRecord& frame);
+
+    /**
+     * @brief Создать новый сегмент в каталоге клиента
+     * @param dir Каталог клиента
+     * @param now_ms Текущее время
+     * @param[out] segment Сегмент для заполнения
+     * @return true при успехе
+     */
+    bool Create(const std::filesystem::path& dir, uint64_t now_ms, OpenSegment& segment);
+
+    /**
+     * @brief Закрыть сегмент и освободить невостребованное место
+     * @param it Итератор на сегмент
+     *
+     * Несинхронизированный сегмент откладывается до следующего Sync().
+     */
+    void Seal(SegmentList::iterator it);
+
+    /**
+     * @brief Сообщить наблюдателю о состоянии сегмента
+     * @param segment Сегмент
+     * @param closed Сегмент закрыт
+     */
+    void NotifySegment(const OpenSegment& segment, bool closed);
+
+    /**
+     * @brief Сбросить данные и индекс сегмента на диск
+     * @param segment Сегмент
+     * @return true при успехе
+     */
+    bool SyncSegment(const OpenSegment& segment);
+
+private:
+    std::filesystem::path _root;                                    ///< Корневой каталог
+    uint64_t _segment_size;                                         ///< Максимальный размер сегмента
+    uint64_t _segment_age_ms;                                       ///< Максимальный возраст сегмента
+    bool _track_sync;                                               ///< Отслеживать несинхронизированные сегменты
+
+    SegmentList _lru;                                               ///< Открытые сегменты (в начале - недавние)
+    std::unordered_map<std::string, SegmentList::iterator> _by_key; ///< Открытые сегменты по ключу клиента
+    std::vector<OpenSegment> _sealed_unsynced;                      ///< Закрытые, но еще не синхронизированные сегменты
+    std::unordered_set<std::string> _dirty_dirs;                    ///< Каталоги с новыми сегментами после Sync()
+
+    Logger _logger;                                                 ///< Логгер
+};
+
+#endif // SERVER_SERVER_STORAGE_SEGMENT_STORAGE_H
@@ -0,0 +1,69 @@
+#include <cerrno>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "storage_io.h"
+#include "resource_factory.h"
+
+bool StorageIO::WriteAll(int fd, const void* data, size_t size) {
+    auto bytes{static_cast<const uint8_t*>(data)};
+    size_t written{0};
+
+    while (written < size) {
+        ssize_t n{write(fd, bytes + written, size - written)};
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return false;
+        }
+
+        written += static_cast<size_t>(n);
+    }
+
+    return true;
+}
+
+bool StorageIO::SyncDirectory(const std::string& dir) {
+    UniqueFD dir_fd(ResourceFactory::MakeUniqueFD(open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)));
+
+    return dir_fd.Valid() && fsync(dir_fd.Get()) == 0;
+}
+
+void StorageIO::StartWriteback(int fd) {
+    sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+}
+
+bool StorageIO::SyncFile(const std::string& path) {
+    UniqueFD fd(ResourceFactory::MakeUniqueFD(open(path.c_str(), O_RDONLY | O_CLOEXEC)));
+
+    if (!fd.Valid()) {
+        return errno == ENOENT;
+    }
+
+    return fdatasync(fd.Get()) == 0;
+}
+
+uint64_t StorageIO::RemoveFile(const std::string& path) {
+    struct stat st{};
+
+    if (stat(path.c_str(), &st) == -1 || unlink(path.c_str()) == -1) {
+        return 0;
+    }
+
+    return static_cast<uint64_t>(st.st_size);
+}
+
+void StorageIO::SetIdleIOPriority() {
+    constexpr int IOPRIO_WHO_PROCESS{1};
+    constexpr int IOPRIO_CLASS_IDLE{3};
+    constexpr int IOPRIO_CLASS_SHIFT{13};
+
+    syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+}
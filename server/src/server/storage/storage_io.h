@@ -0,0 +1,60 @@
+#ifndef SERVER_SERVER_STORAGE_STORAGE_IO_H
+#define SERVER_SERVER_STORAGE_STORAGE_IO_H
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Общие операции ввода-вывода хранилищ
+ */
+class StorageIO {
+public:
+    /**
+     * @brief Записать буфер целиком (с повтором при EINTR и частичной записи)
+     * @param fd Файловый дескриптор
+     * @param data Данные
+     * @param size Размер данных
+     * @return true если записаны все байты, иначе errno содержит причину
+     */
+    static bool WriteAll(int fd, const void* data, size_t size);
+
+    /**
+     * @brief Сбросить на диск записи каталога (новые и переименованные файлы)
+     * @param dir Путь к каталогу
+     * @return true при успехе, иначе errno содержит причину
+     */
+    static bool SyncDirectory(const std::string& dir);
+
+    /**
+     * @brief Начать запись данных файла на диск, не дожидаясь ее (sync_file_range)
+     * @param fd Файловый дескриптор
+     *
+     * После этого дескриптор можно закрыть: SyncFile() по пути дождется записи.
+     */
+    static void StartWriteback(int fd);
+
+    /**
+     * @brief Сбросить на диск данные файла по пути (fdatasync через новый дескриптор)
+     * @param path Путь к файлу
+     * @return true при успехе или если файла уже нет (удален очисткой), иначе errno содержит причину
+     */
+    static bool SyncFile(const std::string& path);
+
+    /**
+     * @brief Удалить файл
+     * @param path Путь к файлу
+     * @return Размер удаленного файла (0, если файла нет или удалить не удалось)
+     */
+    static uint64_t RemoveFile(const std::string& path);
+
+    /**
+     * @brief Перевести вызывающий поток в класс ввода-вывода idle
+     *
+     * Диск достается потоку, только когда он никому больше не нужен.
+     * Для фоновых проходов: очистки, сканирования и компактизации.
+     */
+    static void SetIdleIOPriority();
+};
+
+#endif // SERVER_SERVER_STORAGE_STORAGE_IO_H
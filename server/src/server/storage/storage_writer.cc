@@ -0,0 +1,311 @@
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "metrics.h"
+#include "storage_writer.h"
+
+namespace Limit {
+constexpr size_t MAX_QUEUE_BYTES{256 * 1024 * 1024}; // 256 Mb
+constexpr size_t MAX_BATCH_FRAMES{512};
+}
+
+namespace {
+Metrics::Gauge& queued_bytes{Metrics::MetricsRegistry::Global().AddGauge(
+    "server_storage_queue_bytes", "Frame bytes waiting in the storage writer queue")};
+Metrics::Histogram& store_seconds{Metrics::MetricsRegistry::Global().AddHistogram(
+    "server_storage_store_seconds", "Time to write one frame to the storage engine")};
+Metrics::Histogram& sync_seconds{Metrics::MetricsRegistry::Global().AddHistogram(
+    "server_storage_sync_seconds", "Time to flush written frames to disk")};
+Metrics::Counter& store_failures{Metrics::MetricsRegistry::Global().AddCounter(
+    "server_storage_store_failures_total", "Frames the storage engine failed to write")};
+}
+
+StorageWriter::StorageWriter(std::unique_ptr<FrameStorage> storage, DurabilityMode mode, unsigned sync_interval_ms) :
+    _storage(std::move(storage)),
+    _mode(mode),
+    _sync_interval_ms(sync_interval_ms),
+    _notify_fd(ResourceFactory::MakeUniqueFD(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)))
+{
+    if (!_notify_fd.Valid()) {
+        throw std::runtime_error("eventfd(): " + std::string(strerror(errno)));
+    }
+}
+
+StorageWriter::~StorageWriter() {
+    Stop();
+}
+
+void StorageWriter::Start() {
+    _worker = std::thread(&StorageWriter::WorkerLoop, this);
+}
+
+void StorageWriter::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+
+    _has_jobs.notify_all();
+
+    if (_worker.joinable()) {
+        _worker.join();
+    }
+}
+
+FrameStorage& StorageWriter::GetStorage() noexcept {
+    return *_storage;
+}
+
+void StorageWriter::SetFrameIndex(FrameIndex* index) noexcept {
+    _index = index;
+}
+
+void StorageWriter::SetTraceWriter(TraceWriter* trace) noexcept {
+    _trace = trace;
+}
+
+void StorageWriter::SetThumbnailPool(ThumbnailPool* thumbnails) noexcept {
+    _thumbnails = thumbnails;
+}
+
+bool StorageWriter::IsTracing() const noexcept {
+    return _trace != nullptr;
+}
+
+void StorageWriter::Submit(StorageJob&& job) {
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        _has_space.wait(lock, [&] {
+            return _queue.empty() || _queued_bytes + job.data->size() <= Limit::MAX_QUEUE_BYTES;
+        });
+
+        if (job.trace) {
+            job.trace->record.submitted_us = TraceWriter::NowUs();
+        }
+
+        _queued_bytes += job.data->size();
+        _queue.push_back(std::move(job));
+
+        queued_bytes.Set(static_cast<int64_t>(_queued_bytes));
+    }
+
+    _has_jobs.notify_one();
+}
+
+void StorageWriter::Release(const StorageRelease& release) {
+    {
+        std::lock_guard<std::mutex> lock(_acks_mutex);
+
+        _releases.push_back(release);
+    }
+
+    Notify();
+}
+
+int StorageWriter::GetNotifyFD() const noexcept {
+    return _notify_fd.Get();
+}
+
+std::vector<DurableAck> StorageWriter::TakeAcks() {
+    uint64_t counter{};
+
+    while (read(_notify_fd.Get(), &counter, sizeof(counter)) == -1 && errno == EINTR) {}
+
+    std::lock_guard<std::mutex> lock(_acks_mutex);
+
+    return std::exchange(_acks, {});
+}
+
+std::vector<StorageRelease> StorageWriter::TakeReleases() {
+    std::lock_guard<std::mutex> lock(_acks_mutex);
+
+    return std::exchange(_releases, {});
+}
+
+bool StorageWriter::IsBacklogged() {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    return _queued_bytes > Limit::MAX_QUEUE_BYTES / 4 * 3;
+}
+
+bool StorageWriter::IsDurable() const noexcept {
+    return _mode != DurabilityMode::K_NONE;
+}
+
+void StorageWriter::WriteBatch(std::vector<StorageJob>& batch) {
+    if (batch.empty()) {
+        return;
+    }
+
+    std::vector<StorageRelease> releases;
+
+    for (auto& job : batch) {
+        job.frame.data = job.data->data();
+        job.frame.size = job.data->size();
+
+        // Кредит возвращается и за кадры, которые хранилище не смогло записать:
+        // иначе клиент навсегда потеряет часть окна
+        auto release{std::find_if(releases.begin(), releases.end(), [&](const StorageRelease& item) {
+            return item.owner == job.owner;
+        })};
+
+        if (release == releases.end()) {
+            release = releases.insert(releases.end(), StorageRelease{job.owner, 0, 0});
+        }
+
+        release->frames += 1;
+        release->bytes += job.wire_bytes != 0 ? job.wire_bytes : job.data->size();
+
+        FrameLocation location;
+
+        auto started{std::chrono::steady_clock::now()};
+
+        if (!_storage->Store(job.frame, location)) {
+            store_failures.Inc();
+
+            continue;
+        }
+
+        store_seconds.ObserveSince(started);
+
+        if (Logger::IsEnabled(MessageType::K_DEBUG)) {
+            _logger.PrintInTerminal(MessageType::K_DEBUG, "[client: " + job.frame.hostname + "/" + job.frame.username + "] Saved image: \"" + location.Describe() + "\"");
+        }
+
+        if (_index) {
+            _index->Add(job.frame, location);
+        }
+
+        if (_thumbnails) {
+            _thumbnails->Submit(job.frame, job.data);
+        }
+
+        if (_trace && job.trace) {
+            job.trace->record.stored_us = TraceWriter::NowUs();
+            job.trace->record.length = static_cast<uint32_t>(job.data->size());
+
+            _trace->Write(*job.trace);
+        }
+
+        if (!IsDurable()) {
+            continue;
+        }
+
+        // Подряд идущие кадры одного отправителя склеиваются в один диапазон
+        auto it{_open_ranges.find(job.owner)};
+
+        if (it != _open_ranges.end() && _uncommitted[it->second].last_seq + 1 == job.seq) {
+            _uncommitted[it->second].last_seq = job.seq;
+        } else {
+            _open_ranges[job.owner] = _uncommitted.size();
+            _uncommitted.push_back(DurableAck{job.owner, job.seq, job.seq});
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_acks_mutex);
+
+        _releases.insert(_releases.end(), releases.begin(), releases.end());
+    }
+
+    Notify();
+}
+
+void StorageWriter::Commit() {
+    auto started{std::chrono::steady_clock::now()};
+    bool synced{_storage->Sync()};
+
+    sync_seconds.ObserveSince(started);
+
+    if (!synced) {
+        _logger.PrintInTerminal(MessageType::K_ERROR, "storage sync failed: " + std::to_string(_uncommitted.size()) + " frame ranges not acknowledged");
+
+        _uncommitted.clear();
+        _open_ranges.clear();
+
+        return;
+    }
+
+    if (_uncommitted.empty()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_acks_mutex);
+
+        _acks.insert(_acks.end(), _uncommitted.begin(), _uncommitted.end());
+    }
+
+    _uncommitted.clear();
+    _open_ranges.clear();
+
+    Notify();
+}
+
+void StorageWriter::Notify() {
+    uint64_t one{1};
+
+    while (write(_notify_fd.Get(), &one, sizeof(one)) == -1 && errno == EINTR) {}
+}
+
+void StorageWriter::WorkerLoop() {
+    using Clock = std::chrono::steady_clock;
+
+    const auto interval{std::chrono::milliseconds(_sync_interval_ms)};
+    auto next_sync{Clock::now() + interval};
+
+    std::vector<StorageJob> batch;
+
+    while (true) {
+        bool stopping{false};
+
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+
+            auto ready{[&] { return _stop || !_queue.empty(); }};
+
+            if (_mode == DurabilityMode::K_PERIODIC) {
+                _has_jobs.wait_until(lock, next_sync, ready);
+            } else {
+                _has_jobs.wait(lock, ready);
+            }
+
+            size_t count{std::min(_queue.size(), Limit::MAX_BATCH_FRAMES)};
+
+            for (size_t i{0}; i < count; ++i) {
+                _queued_bytes -= _queue.front().data->size();
+                batch.push_back(std::move(_queue.front()));
+                _queue.pop_front();
+            }
+
+            queued_bytes.Set(static_cast<int64_t>(_queued_bytes));
+
+            stopping = _stop && _queue.empty();
+        }
+
+        _has_space.notify_all();
+
+        WriteBatch(batch);
+        batch.clear();
+
+        if (_mode == DurabilityMode::K_GROUP) {
+            Commit();
+        } else if (_mode == DurabilityMode::K_PERIODIC && (Clock::now() >= next_sync || stopping)) {
+            Commit();
+
+            next_sync = Clock::now() + interval;
+        }
+
+        if (stopping) {
+            break;
+        }
+    }
+}
@@ -0,0 +1,234 @@
+#ifndef SERVER_SERVER_STORAGE_STORAGE_WRITER_H
+#define SERVER_SERVER_STORAGE_STORAGE_WRITER_H
+
+#include <mutex>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <memory>
+#include <cstdint>
+#include <unordered_map>
+#include <condition_variable>
+
+#include "logger.h"
+#include "frame_index.h"
+#include "trace_writer.h"
+#include "thumbnail_pool.h"
+#include "input_parser.h"
+#include "frame_storage.h"
+#include "resource_factory.h"
+
+/**
+ * @brief Задание на сохранение кадра
+ *
+ * Держит ссылку на данные кадра: frame.data указывает в data и выставляется StorageWriter.
+ */
+struct StorageJob {
+    uint64_t owner{};                  ///< Идентификатор отправителя (SessionHandle), возвращается в подтверждении
+    uint64_t seq{};                    ///< Номер кадра в рамках соединения (с 1)
+    FrameRecord frame;                 ///< Метаданные кадра
+    FrameBuffer data;                  ///< Данные кадра (общие с живыми зрителями)
+    uint64_t wire_bytes{};             ///< Размер кадра, каким его прислал клиент (0 - размер data), для возврата кредита
+
+    std::unique_ptr<FrameTrace> trace; ///< Трассировка кадра (только при включенной трассировке)
+};
+
+/**
+ * @brief Подтверждение надежного сохранения кадров
+ *
+ * Все кадры отправителя с номерами [first_seq, last_seq] записаны и сброшены на диск.
+ */
+struct DurableAck {
+    uint64_t owner{};     ///< Идентификатор отправителя
+    uint64_t first_seq{}; ///< Первый подтвержденный номер
+    uint64_t last_seq{};  ///< Последний подтвержденный номер
+};
+
+/**
+ * @brief Освобождение кредита отправителя
+ *
+ * Кадры отправителя покинули очередь записи (сохранены или отброшены хранилищем).
+ */
+struct StorageRelease {
+    uint64_t owner{};  ///< Идентификатор отправителя
+    uint64_t frames{}; ///< Число кадров
+    uint64_t bytes{};  ///< Объем данных кадров
+};
+
+/**
+ * @brief Поток записи скриншотов
+ *
+ * Снимает дисковый ввод-вывод с потока событий: кадры ставятся в ограниченную
+ * очередь, а отдельный поток сохраняет их в FrameStorage согласно режиму сохранности:
+ * - K_NONE: кадры записываются, синхронизация и подтверждения не выполняются;
+ * - K_PERIODIC: кадры записываются по мере поступления, Sync() - раз в интервал;
+ * - K_GROUP: поток забирает всю накопившуюся очередь, записывает ее и делает
+ *   один Sync() на пачку. Пока идет синхронизация, копится следующая пачка.
+ *
+ * После каждой успешной синхронизации формируются подтверждения DurableAck,
+ * а после каждой записанной пачки (в любом режиме) - освобождения StorageRelease
+ * для возврата кредита клиентам. О наличии того и другого поток событий узнает
+ * по eventfd (GetNotifyFD()).
+ */
+class StorageWriter {
+public:
+    /**
+     * @brief Конструктор
+     * @param storage Хранилище кадров (должно отслеживать синхронизацию, если mode != K_NONE)
+     * @param mode Режим сохранности
+     * @param sync_interval_ms Интервал синхронизации для K_PERIODIC
+     * @throw std::runtime_error Если не удалось создать eventfd
+     */
+    StorageWriter(std::unique_ptr<FrameStorage> storage, DurabilityMode mode, unsigned sync_interval_ms);
+
+    /**
+     * @brief Деструктор - дописывает очередь, синхронизирует и останавливает поток (см. Stop())
+     */
+    ~StorageWriter();
+
+    StorageWriter(const StorageWriter&) = delete;
+    StorageWriter& operator=(const StorageWriter&) = delete;
+
+public:
+    /**
+     * @brief Запустить поток записи
+     */
+    void Start();
+
+    /**
+     * @brief Дописать очередь, синхронизировать и остановить поток
+     *
+     * Подтверждения и освобождения последних кадров остаются доступны через
+     * TakeAcks() и TakeReleases(). Повторный вызов ничего не делает.
+     */
+    void Stop();
+
+    /**
+     * @brief Получить хранилище (только после Stop())
+     * @return Хранилище кадров
+     */
+    FrameStorage& GetStorage() noexcept;
+
+    /**
+     * @brief Подключить индекс кадров по времени (до Start())
+     * @param index Индекс, пополняемый после каждого сохраненного кадра
+     */
+    void SetFrameIndex(FrameIndex* index) noexcept;
+
+    /**
+     * @brief Подключить запись трассировки кадров (до Start())
+     * @param trace Файл трассировки, в который попадают сохраненные кадры с StorageJob::trace
+     */
+    void SetTraceWriter(TraceWriter* trace) noexcept;
+
+    /**
+     * @brief Подключить построение миниатюр (до Start())
+     * @param thumbnails Пул, получающий каждый сохраненный кадр (пропускает кадры, если занят)
+     */
+    void SetThumbnailPool(ThumbnailPool* thumbnails) noexcept;
+
+    /**
+     * @brief Проверить, включена ли трассировка
+     * @return true, если подключен TraceWriter
+     */
+    bool IsTracing() const noexcept;
+
+    /**
+     * @brief Поставить кадр в очередь на запись
+     * @param job Задание (данные перемещаются)
+     *
+     * Если очередь переполнена, блокирует вызывающий поток до освобождения места:
+     * так перегрузка диска превращается в обратное давление по TCP.
+     */
+    void Submit(StorageJob&& job);
+
+    /**
+     * @brief Вернуть кредит за кадр, который не дошел до очереди записи
+     * @param release Освобождение
+     *
+     * Для стадий перед записью (см. EncodePool): кадр, отброшенный там,
+     * возвращает кредит тем же путем, что и записанный. Потокобезопасен.
+     */
+    void Release(const StorageRelease& release);
+
+    /**
+     * @brief Получить eventfd, сигнализирующий о новых подтверждениях
+     * @return Файловый дескриптор (неблокирующий)
+     */
+    int GetNotifyFD() const noexcept;
+
+    /**
+     * @brief Забрать накопившиеся подтверждения
+     * @return Подтверждения в порядке их появления
+     *
+     * Сбрасывает счетчик eventfd, поэтому вызывается раньше TakeReleases().
+     */
+    std::vector<DurableAck> TakeAcks();
+
+    /**
+     * @brief Забрать накопившиеся освобождения кредита
+     * @return Освобождения в порядке их появления
+     */
+    std::vector<StorageRelease> TakeReleases();
+
+    /**
+     * @brief Проверить, почти ли заполнена очередь записи
+     * @return true если в очереди больше 3/4 допустимого объема
+     */
+    bool IsBacklogged();
+
+    /**
+     * @brief Проверить, требует ли режим подтверждений
+     * @return true для K_PERIODIC и K_GROUP
+     */
+    bool IsDurable() const noexcept;
+
+private:
+    /// Основной цикл потока записи
+    void WorkerLoop();
+
+    /**
+     * @brief Записать задания в хранилище
+     * @param batch Задания
+     */
+    void WriteBatch(std::vector<StorageJob>& batch);
+
+    /**
+     * @brief Синхронизировать хранилище и опубликовать подтверждения
+     */
+    void Commit();
+
+    /**
+     * @brief Разбудить поток событий
+     */
+    void Notify();
+
+private:
+    std::unique_ptr<FrameStorage> _storage;            ///< Хранилище кадров
+    DurabilityMode _mode;                              ///< Режим сохранности
+    unsigned _sync_interval_ms;                        ///< Интервал синхронизации для K_PERIODIC
+    FrameIndex* _index{nullptr};                       ///< Индекс кадров по времени (может отсутствовать)
+    TraceWriter* _trace{nullptr};                      ///< Запись трассировки (может отсутствовать)
+    ThumbnailPool* _thumbnails{nullptr};               ///< Построение миниатюр (может отсутствовать)
+
+    std::mutex _mutex;                                 ///< Защищает очередь и флаг остановки
+    std::condition_variable _has_jobs;                 ///< Появились задания или остановка
+    std::condition_variable _has_space;                ///< В очереди освободилось место
+    std::deque<StorageJob> _queue;                     ///< Очередь заданий
+    size_t _queued_bytes{0};                           ///< Объем данных в очереди
+    bool _stop{false};                                 ///< Флаг остановки
+
+    std::vector<DurableAck> _uncommitted;              ///< Записанные, но не синхронизированные кадры (только поток записи)
+    std::unordered_map<uint64_t, size_t> _open_ranges; ///< Отправитель -> его последний диапазон в _uncommitted
+
+    std::mutex _acks_mutex;                            ///< Защищает _acks и _releases
+    std::vector<DurableAck> _acks;                     ///< Подтверждения для потока событий
+    std::vector<StorageRelease> _releases;             ///< Освобождения кредита для потока событий
+    UniqueFD _notify_fd;                               ///< eventfd для уведомления потока событий
+
+    std::thread _worker;                               ///< Поток записи
+
+    Logger _logger;                                    ///< Логгер
+};
+
+#endif // SERVER_SERVER_STORAGE_STORAGE_WRITER_H
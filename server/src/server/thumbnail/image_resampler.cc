@@ -0,0 +1,123 @@
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+
+#include "image_resampler.h"
+
+namespace {
+/**
+ * @brief Сложить байты нескольких строк поэлементно
+ * @param src Первая строка блока
+ * @param stride Длина строки в байтах
+ * @param rows Число строк (не больше MAX_FACTOR, чтобы сумма помещалась в 16 бит)
+ * @param[out] sums Суммы по каждому байту строки
+ */
+template <bool VECTOR>
+void SumRows(const uint8_t* src, size_t stride, unsigned rows, uint16_t* sums) {
+    size_t i{0};
+
+#if defined(__SSE2__)
+    if constexpr (VECTOR) {
+        const __m128i zero{_mm_setzero_si128()};
+
+        // Каналы не разделяются: 16 байт строки - это 16 независимых сумм
+        for (; i + 16 <= stride; i += 16) {
+            __m128i lo{zero};
+            __m128i hi{zero};
+
+            for (unsigned r{0}; r < rows; ++r) {
+                __m128i bytes{_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + r * stride + i))};
+
+                lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(bytes, zero));
+                hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(bytes, zero));
+            }
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(sums + i), lo);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(sums + i + 8), hi);
+        }
+    }
+#endif
+
+    for (; i < stride; ++i) {
+        uint16_t sum{0};
+
+        for (unsigned r{0}; r < rows; ++r) {
+            sum = static_cast<uint16_t>(sum + src[r * stride + i]);
+        }
+
+        sums[i] = sum;
+    }
+}
+
+template <bool VECTOR>
+bool DownscaleImpl(const uint8_t* src, uint16_t width, uint16_t height, unsigned factor, std::vector<uint8_t>& dst) {
+    if (width == 0 || height == 0 || factor == 0 || factor > ImageResampler::MAX_FACTOR) {
+        return false;
+    }
+
+    size_t stride{static_cast<size_t>(width) * 3};
+    uint16_t out_width{ImageResampler::ScaledSize(width, factor)};
+    uint16_t out_height{ImageResampler::ScaledSize(height, factor)};
+
+    // Суммы строк блока живут в потоке и переиспользуются между кадрами
+    thread_local std::vector<uint16_t> sums;
+
+    sums.resize(stride);
+    dst.resize(static_cast<size_t>(out_width) * out_height * 3);
+
+    uint8_t* out{dst.data()};
+
+    for (uint16_t oy{0}; oy < out_height; ++oy) {
+        unsigned y{static_cast<unsigned>(oy) * factor};
+        unsigned rows{std::min(factor, height - y)};
+
+        SumRows<VECTOR>(src + y * stride, stride, rows, sums.data());
+
+        for (uint16_t ox{0}; ox < out_width; ++ox) {
+            unsigned x{static_cast<unsigned>(ox) * factor};
+            unsigned cols{std::min(factor, width - x)};
+            unsigned count{cols * rows};
+
+            uint32_t r{0};
+            uint32_t g{0};
+            uint32_t b{0};
+
+            const uint16_t* column{sums.data() + static_cast<size_t>(x) * 3};
+
+            for (unsigned c{0}; c < cols; ++c, column += 3) {
+                r += column[0];
+                g += column[1];
+                b += column[2];
+            }
+
+            *out++ = static_cast<uint8_t>((r + count / 2) / count);
+            *out++ = static_cast<uint8_t>((g + count / 2) / count);
+            *out++ = static_cast<uint8_t>((b + count / 2) / count);
+        }
+    }
+
+    return true;
+}
+}
+
+uint16_t ImageResampler::ScaledSize(uint16_t size, unsigned factor) noexcept {
+    return static_cast<uint16_t>((size + factor - 1) / factor);
+}
+
+bool ImageResampler::Downscale(const uint8_t* src, uint16_t width, uint16_t height, unsigned factor, std::vector<uint8_t>& dst) {
+    return DownscaleImpl<true>(src, width, height, factor, dst);
+}
+
+bool ImageResampler::DownscaleScalar(const uint8_t* src, uint16_t width, uint16_t height, unsigned factor, std::vector<uint8_t>& dst) {
+    return DownscaleImpl<false>(src, width, height, factor, dst);
+}
+
+bool ImageResampler::IsVectorized() noexcept {
+#if defined(__SSE2__)
+    return true;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,57 @@
+#ifndef SERVER_SERVER_THUMBNAIL_IMAGE_RESAMPLER_H
+#define SERVER_SERVER_THUMBNAIL_IMAGE_RESAMPLER_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Уменьшение кадров RGB в целое число раз
+ *
+ * Каждый пиксель результата - среднее блока factor x factor исходных пикселей
+ * (box-фильтр): для уменьшения в целое число раз он не дает муара на тексте
+ * и тонких рамках окон. Блоки у правого и нижнего края неполные и усредняются
+ * по тем пикселям, что есть, поэтому размер результата округляется вверх.
+ *
+ * Суммы по строкам блока накапливаются векторно (SSE2 на x86-64, где он есть
+ * всегда): по 16 байт за раз, без учета границ пикселей. Оставшееся сложение
+ * по столбцам блока в factor раз короче и делается скалярно.
+ */
+class ImageResampler {
+public:
+    static constexpr unsigned MAX_FACTOR{16}; ///< Больше - суммы строк блока не помещаются в 16 бит
+
+    /**
+     * @brief Получить размер стороны после уменьшения
+     * @param size Исходный размер
+     * @param factor Во сколько раз уменьшить
+     * @return Размер с округлением вверх
+     */
+    static uint16_t ScaledSize(uint16_t size, unsigned factor) noexcept;
+
+    /**
+     * @brief Уменьшить кадр
+     * @param src Пиксели RGB (3 байта на пиксель, строки подряд)
+     * @param width Ширина
+     * @param height Высота
+     * @param factor Во сколько раз уменьшить (1..MAX_FACTOR)
+     * @param[out] dst Пиксели результата размером ScaledSize(width) x ScaledSize(height)
+     * @return false если кадр пуст или factor вне допустимого диапазона
+     */
+    static bool Downscale(const uint8_t* src, uint16_t width, uint16_t height, unsigned factor, std::vector<uint8_t>& dst);
+
+    /**
+     * @brief То же без векторных инструкций
+     *
+     * Эталон для сравнения в бенчмарке; результат совпадает с Downscale() побайтно.
+     */
+    static bool DownscaleScalar(const uint8_t* src, uint16_t width, uint16_t height, unsigned factor, std::vector<uint8_t>& dst);
+
+    /**
+     * @brief Проверить, используются ли векторные инструкции
+     * @return true если Downscale() собран с SSE2
+     */
+    static bool IsVectorized() noexcept;
+};
+
+#endif // SERVER_SERVER_THUMBNAIL_IMAGE_RESAMPLER_H
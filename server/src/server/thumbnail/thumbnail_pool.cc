@@ -0,0 +1,269 @@
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iterator>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "metrics.h"
+#include "png_codec.h"
+#include "storage_io.h"
+#include "thumbnail_pool.h"
+#include "image_resampler.h"
+#include "resource_factory.h"
+
+namespace Limit {
+constexpr size_t QUEUE_FRAMES_PER_WORKER{2}; // дольше кадр ждать не должен: миниатюра нужна свежей
+constexpr int BACKGROUND_NICE{10};
+}
+
+namespace fs = std::filesystem;
+
+namespace {
+Metrics::Counter& frames_done{Metrics::MetricsRegistry::Global().AddCounter(
+    "server_thumbnail_frames_total", "Stored frames for which thumbnails were written")};
+Metrics::Counter& frames_skipped{Metrics::MetricsRegistry::Global().AddCounter(
+    "server_thumbnail_skipped_total", "Stored frames left without thumbnails because the thumbnail pool was saturated")};
+Metrics::Counter& thumbnail_failures{Metrics::MetricsRegistry::Global().AddCounter(
+    "server_thumbnail_failures_total", "Stored frames whose thumbnails could not be decoded or written")};
+Metrics::Gauge& queued_frames{Metrics::MetricsRegistry::Global().AddGauge(
+    "server_thumbnail_queue_frames", "Frames waiting in the thumbnail pool")};
+Metrics::Histogram& thumbnail_seconds{Metrics::MetricsRegistry::Global().AddHistogram(
+    "server_thumbnail_seconds", "Time to decode one frame and write all of its thumbnails")};
+
+/// Вставить время в упорядоченную очередь без повторов (почти всегда - в конец)
+void InsertSorted(std::deque<uint64_t>& known, uint64_t timestamp_ms) {
+    auto it{std::upper_bound(known.begin(), known.end(), timestamp_ms)};
+
+    if (it != known.begin() && *std::prev(it) == timestamp_ms) {
+        return;
+    }
+
+    known.insert(it, timestamp_ms);
+}
+}
+
+ThumbnailPool::ThumbnailPool(fs::path root, size_t workers) :
+    _root(std::move(root)),
+    _workers(std::max<size_t>(workers, 1)),
+    _capacity(_workers.size() * Limit::QUEUE_FRAMES_PER_WORKER)
+{}
+
+ThumbnailPool::~ThumbnailPool() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+
+    _has_jobs.notify_all();
+
+    for (auto& worker : _workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+void ThumbnailPool::Start() {
+    for (auto& worker : _workers) {
+        worker = std::thread(&ThumbnailPool::WorkerLoop, this);
+    }
+}
+
+bool ThumbnailPool::Submit(const FrameRecord& frame, const FrameBuffer& data) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        if (_queue.size() >= _capacity) {
+            frames_skipped.Inc();
+
+            return false;
+        }
+
+        _queue.push_back(Job{frame.hostname, frame.username, frame.timestamp_ms, data});
+
+        queued_frames.Set(static_cast<int64_t>(_queue.size()));
+    }
+
+    _has_jobs.notify_one();
+
+    return true;
+}
+
+void ThumbnailPool::Prune(const std::string& client, uint64_t newest_ms) {
+    std::vector<uint64_t> expired;
+
+    {
+        std::lock_guard<std::mutex> lock(_known_mutex);
+
+        auto it{_known.find(client)};
+
+        if (it == _known.end()) {
+            it = _known.emplace(client, LoadKnown(client)).first;
+        }
+
+        std::deque<uint64_t>& known{it->second};
+        auto end{std::upper_bound(known.begin(), known.end(), newest_ms)};
+
+        expired.assign(known.begin(), end);
+        known.erase(known.begin(), end);
+    }
+
+    fs::path dir{_root / client};
+
+    for (uint64_t timestamp_ms : expired) {
+        for (unsigned factor : FACTORS) {
+            StorageIO::RemoveFile(GetPath(dir, timestamp_ms, factor).string());
+        }
+    }
+}
+
+size_t ThumbnailPool::GetWorkers() const noexcept {
+    return _workers.size();
+}
+
+fs::path ThumbnailPool::GetPath(const fs::path& client_dir, uint64_t timestamp_ms, unsigned factor) {
+    return client_dir / DIR / (std::to_string(timestamp_ms) + "_" + std::to_string(factor) + ".png");
+}
+
+void ThumbnailPool::WorkerLoop() {
+    // Только для этого потока: при нехватке процессора отстают миниатюры, а не прием
+    setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), Limit::BACKGROUND_NICE);
+
+    for (;;) {
+        Job job;
+
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+
+            _has_jobs.wait(lock, [&] { return _stop || !_queue.empty(); });
+
+            if (_queue.empty()) {
+                return;
+            }
+
+            job = std::move(_queue.front());
+            _queue.pop_front();
+
+            queued_frames.Set(static_cast<int64_t>(_queue.size()));
+        }
+
+        Process(job);
+    }
+}
+
+void ThumbnailPool::Process(const Job& job) {
+    auto started{std::chrono::steady_clock::now()};
+    std::string client{job.hostname + "/" + job.username};
+
+    // Буферы живут в потоке пула и переиспользуются между кадрами
+    thread_local std::vector<uint8_t> pixels;
+    thread_local std::vector<uint8_t> scaled;
+    thread_local std::vector<uint8_t> png;
+
+    uint16_t width{};
+    uint16_t height{};
+
+    if (!PngCodec::Decode(job.data->data(), job.data->size(), pixels, width, height)) {
+        static LogRateLimit rate{10};
+
+        thumbnail_failures.Inc();
+
+        _logger.PrintInTerminal(MessageType::K_WARNING, "[client: " + client + "] frame " +
+                                std::to_string(job.timestamp_ms) + " is not a supported PNG, no thumbnails", rate);
+
+        return;
+    }
+
+    fs::path dir{_root / job.hostname / job.username};
+    std::error_code ec;
+
+    fs::create_directories(dir / DIR, ec);
+
+    // Каждая следующая миниатюра строится из предыдущей: 1/16 - это 1/4 от 1/4
+    unsigned done_factor{1};
+
+    for (unsigned factor : FACTORS) {
+        unsigned step{factor / done_factor};
+        uint16_t scaled_width{ImageResampler::ScaledSize(width, step)};
+        uint16_t scaled_height{ImageResampler::ScaledSize(height, step)};
+
+        if (!ImageResampler::Downscale(pixels.data(), width, height, step, scaled) ||
+            !PngCodec::Encode(scaled.data(), scaled_width, scaled_height, png) ||
+            !WriteFile(GetPath(dir, job.timestamp_ms, factor), png)) {
+            thumbnail_failures.Inc();
+
+            return;
+        }
+
+        pixels.swap(scaled);
+        width = scaled_width;
+        height = scaled_height;
+        done_factor = factor;
+    }
+
+    Remember(client, job.timestamp_ms);
+
+    thumbnail_seconds.ObserveSince(started);
+    frames_done.Inc();
+}
+
+bool ThumbnailPool::WriteFile(const fs::path& path, const std::vector<uint8_t>& data) {
+    // Читатель каталога видит либо целую миниатюру, либо никакой
+    fs::path tmp_path{path.string() + ".tmp"};
+
+    UniqueFD file(ResourceFactory::MakeUniqueFD(open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)));
+
+    if (!file.Valid() || !StorageIO::WriteAll(file.Get(), data.data(), data.size()) ||
+        rename(tmp_path.c_str(), path.c_str()) == -1) {
+        static LogRateLimit rate{10};
+
+        _logger.PrintInTerminal(MessageType::K_ERROR, "write thumbnail failed: " + path.string() + ": " + std::string(strerror(errno)), rate);
+
+        unlink(tmp_path.c_str());
+
+        return false;
+    }
+
+    return true;
+}
+
+void ThumbnailPool::Remember(const std::string& client, uint64_t timestamp_ms) {
+    std::lock_guard<std::mutex> lock(_known_mutex);
+
+    auto it{_known.find(client)};
+
+    // Пока очистка не трогала клиента, его миниатюры найдет LoadKnown()
+    if (it != _known.end()) {
+        InsertSorted(it->second, timestamp_ms);
+    }
+}
+
+std::deque<uint64_t> ThumbnailPool::LoadKnown(const std::string& client) {
+    std::vector<uint64_t> found;
+    std::error_code ec;
+
+    for (const auto& file : fs::directory_iterator(_root / client / DIR, ec)) {
+        std::string name{file.path().filename().string()};
+        size_t separator{name.find('_')};
+
+        if (separator == std::string::npos || file.path().extension() != ".png") {
+            continue;
+        }
+
+        try {
+            found.push_back(std::stoull(name.substr(0, separator)));
+        } catch (const std::logic_error&) {
+            continue;
+        }
+    }
+
+    std::sort(found.begin(), found.end());
+    found.erase(std::unique(found.begin(), found.end()), found.end());
+
+    return std::deque<uint64_t>(found.begin(), found.end());
+}
@@ -0,0 +1,153 @@
+#ifndef SERVER_SERVER_THUMBNAIL_THUMBNAIL_POOL_H
+#define SERVER_SERVER_THUMBNAIL_THUMBNAIL_POOL_H
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <filesystem>
+#include <unordered_map>
+#include <condition_variable>
+
+#include "logger.h"
+#include "frame_storage.h"
+
+/**
+ * @brief Пул потоков, строящих миниатюры сохраненных кадров
+ *
+ * Поток записи передает сюда каждый сохраненный кадр. Поток пула разбирает PNG,
+ * уменьшает кадр в 4 раза (ImageResampler), а полученное - еще в 4 раза, и
+ * кладет обе миниатюры рядом с кадрами клиента:
+ *   <root>/<hostname>/<username>/thumbs/<timestamp_ms>_4.png
+ *   <root>/<hostname>/<username>/thumbs/<timestamp_ms>_16.png
+ *
+ * Миниатюры - необязательное дополнение к кадрам, поэтому прием их не ждет:
+ * очередь короткая, и если она заполнена, кадр остается без миниатюр. Потоки
+ * работают с пониженным приоритетом, так что при нехватке процессора первыми
+ * отстают именно они. Миниатюры не сбрасываются на диск отдельно: после сбоя
+ * часть последних может пропасть.
+ *
+ * Миниатюры кадров, удаленных очисткой, удаляет Prune().
+ */
+class ThumbnailPool {
+public:
+    static constexpr const char* DIR{"thumbs"}; ///< Подкаталог миниатюр в каталоге клиента
+    static constexpr unsigned FACTORS[]{4, 16}; ///< Во сколько раз уменьшаются миниатюры
+
+    /**
+     * @brief Конструктор
+     * @param root Корневой каталог хранилища
+     * @param workers Число потоков (не меньше 1)
+     */
+    ThumbnailPool(std::filesystem::path root, size_t workers);
+
+    /**
+     * @brief Деструктор - дописывает миниатюры из очереди и останавливает потоки
+     */
+    ~ThumbnailPool();
+
+    ThumbnailPool(const ThumbnailPool&) = delete;
+    ThumbnailPool& operator=(const ThumbnailPool&) = delete;
+
+public:
+    /**
+     * @brief Запустить потоки
+     */
+    void Start();
+
+    /**
+     * @brief Поставить сохраненный кадр в очередь
+     * @param frame Метаданные кадра (поле data не используется)
+     * @param data Данные кадра в PNG
+     * @return false если очередь заполнена и кадр пропущен
+     *
+     * Никогда не блокирует вызывающий поток.
+     */
+    bool Submit(const FrameRecord& frame, const FrameBuffer& data);
+
+    /**
+     * @brief Удалить миниатюры кадров клиента не новее заданного времени
+     * @param client Ключ клиента ("hostname/username")
+     * @param newest_ms Время последнего кадра удаленной единицы хранения
+     *
+     * При первом вызове по клиенту читает каталог его миниатюр, дальше
+     * обходится без обращений к диску, кроме самого удаления.
+     */
+    void Prune(const std::string& client, uint64_t newest_ms);
+
+    /**
+     * @brief Получить число потоков
+     * @return Число потоков
+     */
+    size_t GetWorkers() const noexcept;
+
+    /**
+     * @brief Получить путь к миниатюре
+     * @param client_dir Каталог клиента (<root>/<hostname>/<username>)
+     * @param timestamp_ms Время кадра
+     * @param factor Во сколько раз уменьшен кадр
+     * @return Путь к файлу миниатюры
+     */
+    static std::filesystem::path GetPath(const std::filesystem::path& client_dir, uint64_t timestamp_ms, unsigned factor);
+
+private:
+    /**
+     * @brief Кадр, ожидающий миниатюр
+     */
+    struct Job {
+        std::string hostname;    ///< Имя хоста клиента
+        std::string username;    ///< Имя пользователя клиента
+        uint64_t timestamp_ms{}; ///< Время кадра
+        FrameBuffer data;        ///< Данные кадра в PNG (общие с потоком записи)
+    };
+
+    /// Основной цикл потока пула
+    void WorkerLoop();
+
+    /**
+     * @brief Построить и записать миниатюры одного кадра
+     * @param job Кадр
+     */
+    void Process(const Job& job);
+
+    /**
+     * @brief Записать файл через временный и переименование
+     * @param path Путь к файлу
+     * @param data Содержимое
+     * @return false при ошибке записи
+     */
+    bool WriteFile(const std::filesystem::path& path, const std::vector<uint8_t>& data);
+
+    /**
+     * @brief Учесть записанные миниатюры кадра
+     * @param client Ключ клиента
+     * @param timestamp_ms Время кадра
+     */
+    void Remember(const std::string& client, uint64_t timestamp_ms);
+
+    /**
+     * @brief Прочитать время кадров, у которых есть миниатюры (под _known_mutex)
+     * @param client Ключ клиента
+     * @return Время кадров по возрастанию
+     */
+    std::deque<uint64_t> LoadKnown(const std::string& client);
+
+private:
+    std::filesystem::path _root;                                  ///< Корневой каталог
+    std::vector<std::thread> _workers;                            ///< Потоки пула
+    size_t _capacity;                                             ///< Максимум кадров в очереди
+
+    std::mutex _mutex;                                            ///< Защищает очередь и флаг остановки
+    std::condition_variable _has_jobs;                            ///< Появились кадры или остановка
+    std::deque<Job> _queue;                                       ///< Очередь кадров
+    bool _stop{false};                                            ///< Флаг остановки
+
+    std::mutex _known_mutex;                                      ///< Защищает _known
+    std::unordered_map<std::string, std::deque<uint64_t>> _known; ///< Кадры с миниатюрами по клиентам (после первого Prune())
+
+    Logger _logger;                                               ///< Логгер
+};
+
+#endif // SERVER_SERVER_THUMBNAIL_THUMBNAIL_POOL_H
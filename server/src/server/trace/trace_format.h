@@ -0,0 +1,45 @@
+#ifndef SERVER_SERVER_TRACE_TRACE_FORMAT_H
+#define SERVER_SERVER_TRACE_TRACE_FORMAT_H
+
+#include <cstdint>
+
+/**
+ * @brief Формат файла трассировки кадров
+ *
+ * Файл начинается с заголовка TraceFileHeader, далее подряд идут записи:
+ * TraceRecord фиксированного размера и за ней имя клиента ("hostname/username")
+ * длиной client_len (порядок байт - хоста). Все времена - микросекунды с начала
+ * эпохи; первые три берутся по часам клиента, остальные - по часам сервера.
+ */
+namespace Trace {
+constexpr uint8_t FILE_MAGIC[8]{'R', 'S', 'C', 'T', 'R', 'C', '0', '1'}; ///< Сигнатура файла
+}
+
+/**
+ * @brief Заголовок файла трассировки
+ */
+struct TraceFileHeader {
+    uint8_t magic[8]; ///< Trace::FILE_MAGIC
+};
+
+/**
+ * @brief Запись трассировки одного кадра
+ */
+struct TraceRecord {
+    uint64_t seq;              ///< Номер кадра у клиента (с 1 в рамках соединения)
+    uint64_t capture_start_us; ///< Клиент: начало захвата экрана
+    uint64_t encode_done_us;   ///< Клиент: кадр закодирован
+    uint64_t send_start_us;    ///< Клиент: начало отправки
+    uint64_t recv_done_us;     ///< Сервер: сообщение принято целиком
+    uint64_t handle_us;        ///< Сервер: начало обработки сообщения
+    uint64_t submitted_us;     ///< Сервер: кадр передан в поток записи (SaveScreen завершен)
+    uint64_t stored_us;        ///< Сервер: кадр записан хранилищем
+    uint32_t length;           ///< Размер кадра
+    uint16_t client_len;       ///< Длина имени клиента, идущего следом
+    uint8_t reserved[2];       ///< Выравнивание (нули)
+};
+
+static_assert(sizeof(TraceFileHeader) == 8, "TraceFileHeader layout");
+static_assert(sizeof(TraceRecord) == 72, "TraceRecord layout");
+
+#endif // SERVER_SERVER_TRACE_TRACE_FORMAT_H
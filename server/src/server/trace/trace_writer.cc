@@ -0,0 +1,65 @@
+#include <cerrno>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+
+#include "storage_io.h"
+#include "trace_writer.h"
+
+namespace Limit {
+constexpr size_t TRACE_BUFFER_SIZE{64 * 1024};
+constexpr auto TRACE_FLUSH_INTERVAL{std::chrono::seconds(1)};
+}
+
+TraceWriter::TraceWriter(const std::string& path) :
+    _path(path),
+    _fd(ResourceFactory::MakeUniqueFD(open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644))),
+    _last_flush(std::chrono::steady_clock::now())
+{
+    if (!_fd.Valid()) {
+        throw std::runtime_error("open() error: " + path + ": " + std::string(strerror(errno)));
+    }
+
+    TraceFileHeader header{};
+    std::memcpy(header.magic, Trace::FILE_MAGIC, sizeof(header.magic));
+
+    _buffer.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    _buffer.reserve(Limit::TRACE_BUFFER_SIZE);
+
+    _logger.PrintInTerminal(MessageType::K_INFO, "Tracing frames to " + path);
+}
+
+TraceWriter::~TraceWriter() {
+    Flush();
+}
+
+void TraceWriter::Write(const FrameTrace& trace) {
+    TraceRecord record{trace.record};
+    record.client_len = static_cast<uint16_t>(std::min<size_t>(trace.client.size(), UINT16_MAX));
+
+    _buffer.append(reinterpret_cast<const char*>(&record), sizeof(record));
+    _buffer.append(trace.client.data(), record.client_len);
+
+    if (_buffer.size() >= Limit::TRACE_BUFFER_SIZE ||
+        std::chrono::steady_clock::now() - _last_flush >= Limit::TRACE_FLUSH_INTERVAL) {
+        Flush();
+    }
+}
+
+void TraceWriter::Flush() {
+    _last_flush = std::chrono::steady_clock::now();
+
+    if (_buffer.empty()) {
+        return;
+    }
+
+    if (!StorageIO::WriteAll(_fd.Get(), _buffer.data(), _buffer.size())) {
+        static LogRateLimit rate{1};
+
+        _logger.PrintInTerminal(MessageType::K_ERROR, "trace write() error: " + _path + ": " + std::string(strerror(errno)), rate);
+    }
+
+    _buffer.clear();
+}
@@ -0,0 +1,78 @@
+#ifndef SERVER_SERVER_TRACE_TRACE_WRITER_H
+#define SERVER_SERVER_TRACE_TRACE_WRITER_H
+
+#include <string>
+#include <chrono>
+#include <cstdint>
+
+#include "logger.h"
+#include "trace_format.h"
+#include "resource_factory.h"
+
+/**
+ * @brief Трассировка одного кадра
+ *
+ * Заполняется по пути кадра: клиентские времена и прием - в Session,
+ * запись - в StorageWriter, который и передает ее в TraceWriter.
+ */
+struct FrameTrace {
+    std::string client; ///< Ключ клиента ("hostname/username")
+    TraceRecord record; ///< Номер кадра и времена этапов
+};
+
+/**
+ * @brief Запись трассировки кадров в файл (см. trace_format.h)
+ *
+ * Записи копятся в буфере и сбрасываются в файл пачками - при заполнении
+ * буфера, раз в секунду и при разрушении. Вызывается только из потока записи
+ * хранилища, поэтому не синхронизирована.
+ */
+class TraceWriter {
+public:
+    /**
+     * @brief Конструктор - создает (перезаписывает) файл и пишет заголовок
+     * @param path Путь к файлу трассировки
+     * @throw std::runtime_error Если файл не удалось открыть
+     */
+    explicit TraceWriter(const std::string& path);
+
+    /**
+     * @brief Деструктор - сбрасывает буфер
+     */
+    ~TraceWriter();
+
+    TraceWriter(const TraceWriter&) = delete;
+    TraceWriter& operator=(const TraceWriter&) = delete;
+
+public:
+    /**
+     * @brief Текущее время для отметок трассировки
+     * @return Микросекунды с начала эпохи
+     */
+    static uint64_t NowUs() noexcept {
+        auto now{std::chrono::system_clock::now().time_since_epoch()};
+
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now).count());
+    }
+
+    /**
+     * @brief Добавить запись
+     * @param trace Трассировка кадра
+     */
+    void Write(const FrameTrace& trace);
+
+    /**
+     * @brief Сбросить буфер в файл
+     */
+    void Flush();
+
+private:
+    std::string _path;                                 ///< Путь к файлу
+    UniqueFD _fd;                                      ///< Файл трассировки
+    std::string _buffer;                               ///< Несброшенные записи
+    std::chrono::steady_clock::time_point _last_flush; ///< Время последнего сброса
+
+    Logger _logger;                                    ///< Логгер
+};
+
+#endif // SERVER_SERVER_TRACE_TRACE_WRITER_H
@@ -0,0 +1,127 @@
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+#include "frame_archive.h"
+#include "frame_storage.h"
+#include "segment_reader.h"
+
+namespace {
+void PrintUsage() {
+    std::cerr << "Usage:\n"
+              << "  frame_tool list <segment.idx | archive.rfa>\n"
+              << "  frame_tool extract <segment.idx | archive.rfa> <frame_number> <out.png>\n";
+}
+
+std::string CodecToString(uint8_t codec) {
+    switch (codec) {
+        case FrameCodec::K_PNG:      return "png";
+        case FrameCodec::K_ARCHIVED: return "archived";
+        default:                     return "unknown(" + std::to_string(codec) + ")";
+    }
+}
+
+void WriteFile(const std::string& out_path, const std::vector<uint8_t>& data) {
+    std::ofstream out(out_path, std::ios::binary);
+
+    if (!out.write(reinterpret_cast<const char*>(data.data()), data.size())) {
+        throw std::runtime_error("write failed: " + out_path);
+    }
+}
+
+void ListArchive(const std::string& path) {
+    ArchiveReader reader(path);
+
+    const auto& entries{reader.GetEntries()};
+
+    for (size_t i{0}; i < entries.size(); ++i) {
+        std::cout << i << '\t'
+                  << entries[i].timestamp_ms << '\t'
+                  << entries[i].offset << '\t'
+                  << entries[i].length << '\t'
+                  << (entries[i].kind == Archive::KIND_KEYFRAME ? "key" : "delta") << '\t'
+                  << entries[i].width << 'x' << entries[i].height << '\t'
+                  << static_cast<unsigned>(entries[i].monitor) << '\n';
+    }
+}
+
+void ExtractArchived(const std::string& path, size_t frame_number, const std::string& out_path) {
+    ArchiveReader reader(path);
+
+    if (frame_number >= reader.GetEntries().size()) {
+        throw std::invalid_argument("No frame " + std::to_string(frame_number) + " in " + path);
+    }
+
+    std::vector<uint8_t> frame;
+    reader.ReadFrame(frame_number, frame);
+
+    WriteFile(out_path, frame);
+}
+
+void ListFrames(const std::string& path) {
+    if (ArchiveReader::IsArchive(path)) {
+        ListArchive(path);
+        return;
+    }
+
+    SegmentReader reader(path);
+
+    const auto& entries{reader.GetEntries()};
+
+    for (size_t i{0}; i < entries.size(); ++i) {
+        std::cout << i << '\t'
+                  << entries[i].timestamp_ms << '\t'
+                  << entries[i].offset << '\t'
+                  << entries[i].length << '\t'
+                  << CodecToString(entries[i].codec) << '\t'
+                  << entries[i].width << 'x' << entries[i].height << '\t'
+                  << static_cast<unsigned>(entries[i].monitor) << '\n';
+    }
+}
+
+void ExtractFrame(const std::string& path, size_t frame_number, const std::string& out_path) {
+    if (ArchiveReader::IsArchive(path)) {
+        ExtractArchived(path, frame_number, out_path);
+        return;
+    }
+
+    SegmentReader reader(path);
+
+    if (frame_number >= reader.GetEntries().size()) {
+        throw std::invalid_argument("No frame " + std::to_string(frame_number) + " in " + path);
+    }
+
+    if (reader.GetEntries()[frame_number].codec != FrameCodec::K_PNG) {
+        throw std::runtime_error("Unsupported codec: " + CodecToString(reader.GetEntries()[frame_number].codec));
+    }
+
+    std::vector<uint8_t> frame;
+    reader.ReadFrame(frame_number, frame);
+
+    WriteFile(out_path, frame);
+}
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        std::string command{argc > 1 ? argv[1] : ""};
+
+        if (command == "list" && argc == 3) {
+            ListFrames(argv[2]);
+        } else if (command == "extract" && argc == 5) {
+            ExtractFrame(argv[2], std::stoul(argv[3]), argv[4]);
+        } else {
+            PrintUsage();
+
+            return 1;
+        }
+    } catch (const std::exception& ex) {
+        std::cerr << ex.what() << '\n';
+
+        return 1;
+    }
+
+    return 0;
+}
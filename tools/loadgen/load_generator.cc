@@ -0,0 +1,676 @@
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <stdexcept>
+#include <filesystem>
+
+#include <endian.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+
+#include <zlib.h>
+
+#include "protocol.h"
+#include "load_generator.h"
+
+namespace Limit {
+constexpr size_t MAX_FRAME_SIZE{1024 * 1024 * 10};                  // Как Limit::MAX_MESSAGE_SIZE сервера
+constexpr size_t MAX_CORPUS_FILES{1024};
+constexpr size_t SYNTHETIC_FRAMES{64};
+constexpr size_t RAW_FRAMES{8};                                     // Кадры без PNG велики: 6 Мб на 1920x1080
+constexpr size_t AUTH_FRAME{SIZE_MAX};                              // Pending::frame запроса аутентификации
+constexpr uint16_t PROTOCOL_VERSION{2};
+constexpr uint16_t RAW_PROTOCOL_VERSION{4};
+constexpr uint64_t WINDOW_US{100000};                               // Окно подсчета пиковой скорости
+constexpr size_t MESSAGE_HEADER_SIZE{sizeof(uint8_t) + sizeof(uint32_t)};
+}
+
+namespace {
+uint64_t NowUs() {
+    auto now{std::chrono::steady_clock::now().time_since_epoch()};
+
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now).count());
+}
+
+void AppendUint16(std::vector<uint8_t>& buffer, uint16_t value) {
+    uint16_t net{htons(value)};
+    auto bytes{reinterpret_cast<const uint8_t*>(&net)};
+
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(net));
+}
+
+void AppendUint32(std::vector<uint8_t>& buffer, uint32_t value) {
+    uint32_t net{htonl(value)};
+    auto bytes{reinterpret_cast<const uint8_t*>(&net)};
+
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(net));
+}
+
+std::vector<uint8_t> MakeImageMessage(const std::vector<uint8_t>& frame) {
+    std::vector<uint8_t> message;
+    message.reserve(sizeof(uint8_t) + sizeof(uint32_t) + frame.size());
+
+    message.push_back('I');
+    AppendUint32(message, static_cast<uint32_t>(frame.size()));
+    message.insert(message.end(), frame.begin(), frame.end());
+
+    return message;
+}
+
+std::vector<uint8_t> MakeRawFrameMessage(const Protocol::FrameHeader& header, const std::vector<uint8_t>& frame) {
+    std::vector<uint8_t> message;
+    message.reserve(Limit::MESSAGE_HEADER_SIZE + sizeof(uint16_t) + Protocol::FRAME_HEADER_SIZE + frame.size());
+
+    message.push_back('F');
+    AppendUint32(message, static_cast<uint32_t>(sizeof(uint16_t) + Protocol::FRAME_HEADER_SIZE + frame.size()));
+    AppendUint16(message, 1);
+    Protocol::AppendFrameHeader(message, header);
+    message.insert(message.end(), frame.begin(), frame.end());
+
+    return message;
+}
+
+double Percentile(const std::vector<uint32_t>& sorted, double p) {
+    size_t index{static_cast<size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5)};
+
+    return static_cast<double>(sorted[index]) / 1000.0;
+}
+}
+
+LoadGenerator::LoadGenerator(const LoadConfig& config) :
+    _config(config),
+    _rng(config.seed)
+{
+    LoadCorpus();
+}
+
+void LoadGenerator::LoadCorpus() {
+    _frame_overhead = Limit::MESSAGE_HEADER_SIZE;
+
+    if (_config.raw_width != 0) {
+        MakeRawCorpus();
+
+        return;
+    }
+
+    if (_config.corpus_dir.empty()) {
+        std::uniform_int_distribution<size_t> size_dist(_config.min_size, _config.max_size);
+        std::uniform_int_distribution<int> byte_dist(0, 255);
+
+        for (size_t i{0}; i < Limit::SYNTHETIC_FRAMES; ++i) {
+            std::vector<uint8_t> frame(size_dist(_rng));
+
+            // Случайные байты не сжимаются - как уже закодированный PNG
+            for (auto& byte : frame) {
+                byte = static_cast<uint8_t>(byte_dist(_rng));
+            }
+
+            _corpus.push_back(MakeImageMessage(frame));
+        }
+
+        return;
+    }
+
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(_config.corpus_dir)) {
+        if (_corpus.size() >= Limit::MAX_CORPUS_FILES) {
+            break;
+        }
+
+        if (!entry.is_regular_file() || entry.file_size() == 0 || entry.file_size() > Limit::MAX_FRAME_SIZE) {
+            continue;
+        }
+
+        std::ifstream in(entry.path(), std::ios::binary);
+        std::vector<uint8_t> frame((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+        if (!frame.empty()) {
+            _corpus.push_back(MakeImageMessage(frame));
+        }
+    }
+
+    if (_corpus.empty()) {
+        throw std::runtime_error("no frames in corpus: " + _config.corpus_dir);
+    }
+}
+
+void LoadGenerator::MakeRawCorpus() {
+    size_t width{_config.raw_width};
+    size_t height{_config.raw_height};
+    size_t raw_size{width * height * 3};
+
+    std::uniform_int_distribution<int> byte_dist(0, 255);
+
+    _frame_overhead = Limit::MESSAGE_HEADER_SIZE + sizeof(uint16_t) + Protocol::FRAME_HEADER_SIZE;
+
+    for (size_t i{0}; i < Limit::RAW_FRAMES; ++i) {
+        std::vector<uint8_t> pixels(raw_size);
+
+        // Однотонные полосы окон и шумный прямоугольник "видео" на четверть экрана
+        for (size_t y{0}; y < height; ++y) {
+            uint8_t shade{static_cast<uint8_t>((y / 64 + i) * 37)};
+
+            for (size_t x{0}; x < width; ++x) {
+                bool noisy{x < width / 2 && y < height / 2};
+                uint8_t* pixel{pixels.data() + (y * width + x) * 3};
+
+                pixel[0] = noisy ? static_cast<uint8_t>(byte_dist(_rng)) : shade;
+                pixel[1] = noisy ? static_cast<uint8_t>(byte_dist(_rng)) : static_cast<uint8_t>(shade / 2);
+                pixel[2] = noisy ? static_cast<uint8_t>(byte_dist(_rng)) : static_cast<uint8_t>(255 - shade);
+            }
+        }
+
+        Protocol::FrameHeader header;
+        header.width = _config.raw_width;
+        header.height = _config.raw_height;
+        header.codec = Protocol::CODEC_RAW_RGB;
+
+        std::vector<uint8_t> frame;
+
+        if (_config.raw_zlib) {
+            uLongf size{compressBound(static_cast<uLong>(pixels.size()))};
+
+            frame.resize(size);
+
+            if (compress2(frame.data(), &size, pixels.data(), static_cast<uLong>(pixels.size()), Z_BEST_SPEED) != Z_OK) {
+                throw std::runtime_error("compress2() failed");
+            }
+
+            frame.resize(size);
+            header.codec = Protocol::CODEC_RAW_RGB_ZLIB;
+        } else {
+            frame = std::move(pixels);
+        }
+
+        if (frame.size() > Limit::MAX_FRAME_SIZE - _frame_overhead) {
+            throw std::runtime_error("raw frame does not fit into one message, use --zlib or a smaller --raw");
+        }
+
+        header.length = static_cast<uint32_t>(frame.size());
+
+        _corpus.push_back(MakeRawFrameMessage(header, frame));
+    }
+}
+
+std::vector<uint8_t> LoadGenerator::MakeAuthRequest() {
+    char hostname[32];
+    char username[32];
+
+    std::snprintf(hostname, sizeof(hostname), "lg-%08x", static_cast<unsigned>(_rng()));
+    std::snprintf(username, sizeof(username), "user%u", static_cast<unsigned>(_rng() % 100000));
+
+    std::vector<uint8_t> request;
+    request.push_back('A');
+    AppendUint32(request, 0);
+
+    AppendUint16(request, static_cast<uint16_t>(std::strlen(hostname)));
+    request.insert(request.end(), hostname, hostname + std::strlen(hostname));
+    AppendUint16(request, static_cast<uint16_t>(std::strlen(username)));
+    request.insert(request.end(), username, username + std::strlen(username));
+    AppendUint16(request, _config.raw_width != 0 ? Limit::RAW_PROTOCOL_VERSION : Limit::PROTOCOL_VERSION);
+
+    uint32_t net_size{htonl(static_cast<uint32_t>(request.size() - sizeof(uint8_t) - sizeof(uint32_t)))};
+    std::memcpy(request.data() + sizeof(uint8_t), &net_size, sizeof(net_size));
+
+    return request;
+}
+
+void LoadGenerator::OpenConnections() {
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(_config.port);
+
+    if (inet_pton(AF_INET, _config.host.c_str(), &addr.sin_addr) != 1) {
+        throw std::runtime_error("invalid server address: " + _config.host);
+    }
+
+    _connections.resize(_config.clients);
+
+    for (size_t i{0}; i < _connections.size(); ++i) {
+        Connection& conn{_connections[i]};
+
+        conn.fd = ResourceFactory::MakeUniqueFD(socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+        conn.auth = MakeAuthRequest();
+
+        if (!conn.fd.Valid() ||
+            (connect(conn.fd.Get(), reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == -1 && errno != EINPROGRESS)) {
+            ++_connect_failures;
+            Close(conn);
+
+            continue;
+        }
+
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.u64 = i;
+
+        if (epoll_ctl(_epoll_fd.Get(), EPOLL_CTL_ADD, conn.fd.Get(), &event) == -1) {
+            throw std::runtime_error("epoll_ctl() error: " + std::string(strerror(errno)));
+        }
+    }
+}
+
+void LoadGenerator::Close(Connection& conn) {
+    if (conn.state == State::K_ACTIVE) {
+        --_active;
+    }
+
+    conn.state = State::K_CLOSED;
+    conn.fd.Reset();
+    conn.out.clear();
+    conn.sent_us.clear();
+}
+
+bool LoadGenerator::Flush(Connection& conn) {
+    while (!conn.out.empty()) {
+        Pending& pending{conn.out.front()};
+
+        const std::vector<uint8_t>& message{pending.frame == Limit::AUTH_FRAME ? conn.auth : _corpus[pending.frame]};
+
+        ssize_t n{send(conn.fd.Get(), message.data() + pending.offset, message.size() - pending.offset, MSG_NOSIGNAL)};
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+
+        pending.offset += static_cast<size_t>(n);
+
+        if (pending.offset < message.size()) {
+            continue;
+        }
+
+        if (pending.frame != Limit::AUTH_FRAME) {
+            uint64_t now_us{NowUs()};
+            size_t window{static_cast<size_t>((now_us - _start_us) / Limit::WINDOW_US)};
+
+            if (window >= _windows.size()) {
+                _windows.resize(window + 1);
+            }
+
+            ++_windows[window];
+            ++conn.sent_seq;
+            ++_frames_sent;
+            _bytes_sent += message.size();
+
+            conn.sent_us.push_back(now_us);
+        }
+
+        conn.out.pop_front();
+    }
+
+    return true;
+}
+
+void LoadGenerator::HandleAck(Connection& conn, uint64_t last_seq) {
+    uint64_t now{NowUs()};
+
+    while (conn.acked_seq < last_seq && !conn.sent_us.empty()) {
+        _latencies_us.push_back(static_cast<uint32_t>(std::min<uint64_t>(now - conn.sent_us.front(), UINT32_MAX)));
+
+        conn.sent_us.pop_front();
+        ++conn.acked_seq;
+        ++_frames_acked;
+    }
+}
+
+void LoadGenerator::HandleSchedule(size_t index, uint32_t period_ms, uint32_t phase_ms) {
+    Connection& conn{_connections[index]};
+
+    if (period_ms == 0) {
+        return;
+    }
+
+    conn.period_us = static_cast<uint64_t>(period_ms) * 1000;
+
+    // Ближайший момент, когда (системное время - фаза) кратно периоду
+    uint64_t now_us{NowUs()};
+    uint64_t wall_us{static_cast<uint64_t>(static_cast<int64_t>(now_us) + _wall_offset_us)};
+    uint64_t phase_us{static_cast<uint64_t>(phase_ms % period_ms) * 1000};
+    uint64_t since_phase{(wall_us + conn.period_us - phase_us) % conn.period_us};
+
+    conn.next_due_us = now_us + conn.period_us - since_phase;
+    _timers.emplace(conn.next_due_us, index);
+}
+
+bool LoadGenerator::Receive(size_t index) {
+    constexpr size_t HEADER_SIZE{Limit::MESSAGE_HEADER_SIZE};
+
+    Connection& conn{_connections[index]};
+
+    while (true) {
+        uint8_t buffer[16384];
+
+        ssize_t n{recv(conn.fd.Get(), buffer, sizeof(buffer), 0)};
+
+        if (n > 0) {
+            conn.in.insert(conn.in.end(), buffer, buffer + n);
+        } else if (n == 0) {
+            return false;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        } else {
+            return false;
+        }
+    }
+
+    size_t pos{0};
+
+    if (conn.state == State::K_AUTH && !conn.in.empty()) {
+        // 'Y' - сервер первой версии, 'V' [4: размер][2: версия] - второй
+        if (conn.in[0] == 'V') {
+            if (conn.in.size() < HEADER_SIZE + sizeof(uint16_t)) {
+                return true;
+            }
+
+            pos = HEADER_SIZE + sizeof(uint16_t);
+        } else if (conn.in[0] == 'Y') {
+            pos = 1;
+        } else {
+            ++_auth_failures;
+
+            return false;
+        }
+
+        conn.state = State::K_ACTIVE;
+        ++_active;
+    }
+
+    while (conn.state == State::K_ACTIVE && conn.in.size() - pos >= HEADER_SIZE) {
+        uint32_t net_size;
+        std::memcpy(&net_size, conn.in.data() + pos + 1, sizeof(net_size));
+
+        size_t size{ntohl(net_size)};
+
+        if (conn.in.size() - pos - HEADER_SIZE < size) {
+            break;
+        }
+
+        if (conn.in[pos] == 'D' && size == 2 * sizeof(uint64_t)) {
+            uint64_t net_last;
+            std::memcpy(&net_last, conn.in.data() + pos + HEADER_SIZE + sizeof(uint64_t), sizeof(net_last));
+
+            HandleAck(conn, be64toh(net_last));
+        } else if (conn.in[pos] == 'C' && size == 2 * sizeof(uint64_t)) {
+            uint64_t net_frames;
+            uint64_t net_bytes;
+            std::memcpy(&net_frames, conn.in.data() + pos + HEADER_SIZE, sizeof(net_frames));
+            std::memcpy(&net_bytes, conn.in.data() + pos + HEADER_SIZE + sizeof(net_frames), sizeof(net_bytes));
+
+            conn.credit_frames = be64toh(net_frames);
+            conn.credit_bytes = be64toh(net_bytes);
+        } else if (conn.in[pos] == 'P' && size == 2 * sizeof(uint32_t)) {
+            uint32_t net_period;
+            uint32_t net_phase;
+            std::memcpy(&net_period, conn.in.data() + pos + HEADER_SIZE, sizeof(net_period));
+            std::memcpy(&net_phase, conn.in.data() + pos + HEADER_SIZE + sizeof(net_period), sizeof(net_phase));
+
+            HandleSchedule(index, ntohl(net_period), ntohl(net_phase));
+        }
+
+        pos += HEADER_SIZE + size;
+    }
+
+    conn.in.erase(conn.in.begin(), conn.in.begin() + pos);
+
+    return true;
+}
+
+void LoadGenerator::HandleEvent(size_t index, uint32_t events) {
+    Connection& conn{_connections[index]};
+
+    if (conn.state == State::K_CLOSED) {
+        return;
+    }
+
+    if (conn.state == State::K_CONNECTING) {
+        int error{0};
+        socklen_t len{sizeof(error)};
+
+        if (getsockopt(conn.fd.Get(), SOL_SOCKET, SO_ERROR, &error, &len) == -1 || error != 0) {
+            ++_connect_failures;
+            Close(conn);
+
+            return;
+        }
+
+        if (!(events & EPOLLOUT)) {
+            return;
+        }
+
+        conn.state = State::K_AUTH;
+        conn.out.push_front(Pending{Limit::AUTH_FRAME, 0});
+    }
+
+    bool ok{true};
+
+    if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+        ok = Receive(index);
+    }
+
+    if (ok && (events & EPOLLOUT || !conn.out.empty())) {
+        ok = Flush(conn);
+    }
+
+    if (!ok) {
+        if (conn.state == State::K_ACTIVE) {
+            ++_disconnects;
+        }
+
+        Close(conn);
+    }
+}
+
+uint64_t LoadGenerator::Schedule(uint64_t now_us) {
+    std::uniform_int_distribution<size_t> frame_dist(0, _corpus.size() - 1);
+
+    while (!_timers.empty() && _timers.top().first <= now_us) {
+        auto [due_us, index] = _timers.top();
+        _timers.pop();
+
+        Connection& conn{_connections[index]};
+
+        // Таймер, замененный расписанием сервера, пропускается
+        if (conn.state == State::K_CLOSED || due_us != conn.next_due_us) {
+            continue;
+        }
+
+        // Расписание не сдвигается при задержках: отставание догоняется пачкой (открытая модель нагрузки)
+        conn.next_due_us = due_us + (conn.period_us != 0 ? conn.period_us : _interval_us);
+        _timers.emplace(conn.next_due_us, index);
+
+        if (conn.state != State::K_ACTIVE) {
+            continue;
+        }
+
+        size_t frame{frame_dist(_rng)};
+        uint64_t frame_bytes{_corpus[frame].size() - _frame_overhead};
+
+        bool no_credit{conn.credit_frames != 0 &&
+                       (conn.queued_frames >= conn.credit_frames || conn.queued_bytes + frame_bytes > conn.credit_bytes)};
+
+        if (conn.out.size() >= _config.max_backlog || no_credit) {
+            ++_frames_skipped;
+
+            continue;
+        }
+
+        ++conn.queued_frames;
+        conn.queued_bytes += frame_bytes;
+        conn.out.push_back(Pending{frame, 0});
+
+        if (conn.out.size() == 1 && !Flush(conn)) {
+            ++_disconnects;
+            Close(conn);
+        }
+    }
+
+    return _timers.empty() ? UINT64_MAX : _timers.top().first;
+}
+
+void LoadGenerator::PrintProgress(unsigned elapsed_sec) {
+    std::printf(
+        "%4us  sent %7.0f f/s %8.1f MB/s  acked %9llu  skipped %8llu  active %zu\n",
+        elapsed_sec,
+        static_cast<double>(_frames_sent - _last_frames),
+        static_cast<double>(_bytes_sent - _last_bytes) / (1024.0 * 1024.0),
+        static_cast<unsigned long long>(_frames_acked),
+        static_cast<unsigned long long>(_frames_skipped),
+        _active
+    );
+    std::fflush(stdout);
+
+    _last_frames = _frames_sent;
+    _last_bytes = _bytes_sent;
+}
+
+void LoadGenerator::PrintReport(double send_sec) {
+    uint64_t corpus_bytes{0};
+
+    for (const auto& message : _corpus) {
+        corpus_bytes += message.size();
+    }
+
+    double target_fps{static_cast<double>(_config.clients) * _config.rate};
+    double target_mbps{target_fps * static_cast<double>(corpus_bytes) / static_cast<double>(_corpus.size()) / (1024.0 * 1024.0)};
+
+    std::printf("\n");
+    std::printf("connections    %zu requested, %zu active at end, %zu connect failures, %zu auth failures, %zu disconnects\n",
+                _config.clients, _active, _connect_failures, _auth_failures, _disconnects);
+    std::printf("target         %.0f frames/s, %.1f MB/s (%zu corpus frames)\n", target_fps, target_mbps, _corpus.size());
+    std::printf("achieved       %.0f frames/s, %.1f MB/s over %.1f s (%llu frames, %llu skipped by client backlog or credit)\n",
+                static_cast<double>(_frames_sent) / send_sec,
+                static_cast<double>(_bytes_sent) / (1024.0 * 1024.0) / send_sec,
+                send_sec,
+                static_cast<unsigned long long>(_frames_sent),
+                static_cast<unsigned long long>(_frames_skipped));
+
+    if (!_windows.empty()) {
+        uint32_t peak{*std::max_element(_windows.begin(), _windows.end())};
+        double mean{static_cast<double>(_frames_sent) / send_sec};
+        double peak_fps{static_cast<double>(peak) * 1e6 / static_cast<double>(Limit::WINDOW_US)};
+
+        std::printf("peak 100 ms    %.0f frames/s (%.1fx the mean)\n", peak_fps, mean > 0 ? peak_fps / mean : 0.0);
+    }
+
+    if (_latencies_us.empty()) {
+        std::printf("ack latency    no durable acks received (server runs with --durability none?)\n");
+
+        return;
+    }
+
+    std::sort(_latencies_us.begin(), _latencies_us.end());
+
+    std::printf("ack latency ms p50 %.3f  p90 %.3f  p99 %.3f  p99.9 %.3f  max %.3f (%llu frames acked)\n",
+                Percentile(_latencies_us, 0.50),
+                Percentile(_latencies_us, 0.90),
+                Percentile(_latencies_us, 0.99),
+                Percentile(_latencies_us, 0.999),
+                static_cast<double>(_latencies_us.back()) / 1000.0,
+                static_cast<unsigned long long>(_frames_acked));
+}
+
+void LoadGenerator::Run() {
+    // Тысячи соединений не помещаются в мягкий лимит дескрипторов по умолчанию
+    struct rlimit limit{};
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    _epoll_fd = ResourceFactory::MakeUniqueFD(epoll_create1(EPOLL_CLOEXEC));
+
+    if (!_epoll_fd.Valid()) {
+        throw std::runtime_error("epoll_create1() error: " + std::string(strerror(errno)));
+    }
+
+    OpenConnections();
+
+    _interval_us = static_cast<uint64_t>(1000000.0 / _config.rate);
+
+    uint64_t start_us{NowUs()};
+    uint64_t wall_us{static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count())};
+
+    _start_us = start_us;
+    _wall_offset_us = static_cast<int64_t>(wall_us) - static_cast<int64_t>(start_us);
+
+    uint64_t send_end_us{start_us + static_cast<uint64_t>(_config.duration_sec) * 1000000};
+    uint64_t drain_end_us{send_end_us + static_cast<uint64_t>(_config.drain_sec) * 1000000};
+    uint64_t next_progress_us{start_us + 1000000};
+
+    std::uniform_int_distribution<uint64_t> phase_dist(0, _interval_us);
+
+    // При aligned все снимают на ближайшей границе периода по системным часам, как клиенты с одним --period
+    uint64_t aligned_us{start_us + _interval_us - wall_us % _interval_us};
+
+    for (size_t i{0}; i < _connections.size(); ++i) {
+        Connection& conn{_connections[i]};
+
+        if (conn.state != State::K_CLOSED) {
+            conn.next_due_us = _config.aligned ? aligned_us : start_us + phase_dist(_rng);
+            _timers.emplace(conn.next_due_us, i);
+        }
+    }
+
+    std::vector<epoll_event> events(1024);
+
+    while (true) {
+        uint64_t now_us{NowUs()};
+        uint64_t next_us{next_progress_us};
+
+        if (now_us < send_end_us) {
+            next_us = std::min(next_us, Schedule(now_us));
+        } else {
+            bool queued{std::any_of(_connections.begin(), _connections.end(), [](const Connection& conn) {
+                return !conn.out.empty();
+            })};
+            bool unacked{std::any_of(_connections.begin(), _connections.end(), [](const Connection& conn) {
+                return !conn.sent_us.empty();
+            })};
+
+            // Без единого подтверждения сервер, видимо, работает без них - ждать нечего
+            if (now_us >= drain_end_us || (!queued && (!unacked || _frames_acked == 0))) {
+                break;
+            }
+        }
+
+        if (now_us >= next_progress_us) {
+            PrintProgress(static_cast<unsigned>((now_us - start_us) / 1000000));
+            next_progress_us += 1000000;
+
+            continue;
+        }
+
+        int timeout_ms{static_cast<int>((std::max(next_us, now_us) - now_us + 999) / 1000)};
+        int n{epoll_wait(_epoll_fd.Get(), events.data(), static_cast<int>(events.size()), timeout_ms)};
+
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            throw std::runtime_error("epoll_wait() error: " + std::string(strerror(errno)));
+        }
+
+        for (int i{0}; i < n; ++i) {
+            HandleEvent(static_cast<size_t>(events[i].data.u64), events[i].events);
+        }
+    }
+
+    double send_sec{static_cast<double>(std::min(NowUs(), send_end_us) - start_us) / 1000000.0};
+
+    PrintReport(send_sec);
+}
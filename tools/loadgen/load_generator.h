@@ -0,0 +1,229 @@
+#ifndef TOOLS_LOADGEN_LOAD_GENERATOR_H
+#define TOOLS_LOADGEN_LOAD_GENERATOR_H
+
+#include <deque>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+#include "resource_factory.h"
+
+/**
+ * @brief Параметры нагрузки
+ */
+struct LoadConfig {
+    std::string host{"127.0.0.1"}; ///< Адрес сервера
+    uint16_t port{};               ///< Порт сервера
+    size_t clients{100};           ///< Число одновременных соединений
+    double rate{1.0};              ///< Кадров в секунду на одно соединение
+    unsigned duration_sec{10};     ///< Длительность отправки
+    std::string corpus_dir;        ///< Каталог с кадрами (пусто - синтетические кадры)
+    size_t min_size{100 * 1024};   ///< Минимальный размер синтетического кадра
+    size_t max_size{100 * 1024};   ///< Максимальный размер синтетического кадра
+    size_t max_backlog{16};        ///< Максимум неотправленных кадров соединения
+    unsigned drain_sec{5};         ///< Сколько ждать подтверждений после окончания отправки
+    uint32_t seed{1};              ///< Начальное значение генератора случайных чисел
+    bool aligned{false};           ///< Все соединения снимают в начале общего периода (без расписания сервера)
+    uint16_t raw_width{};          ///< Ширина синтетических кадров без PNG (0 - кадры 'I')
+    uint16_t raw_height{};         ///< Высота синтетических кадров без PNG
+    bool raw_zlib{false};          ///< Сжимать кадры без PNG zlib (CODEC_RAW_RGB_ZLIB)
+};
+
+/**
+ * @brief Генератор нагрузки: парк синтетических клиентов в одном потоке
+ *
+ * Открывает clients неблокирующих соединений и обслуживает их одним epoll
+ * (edge-triggered). Каждое соединение аутентифицируется со случайными
+ * именами хоста и пользователя (запрашивая протокол v2) и отправляет сообщения
+ * 'I' с заданной частотой: с равномерно случайной начальной фазой или, при
+ * aligned, все разом в начале периода - как парк клиентов, запущенный
+ * одновременно. Кадры берутся случайно из заранее загруженного набора: файлов
+ * каталога corpus_dir или случайных данных размером от min_size до max_size.
+ *
+ * С raw_width кадры синтетические и без PNG: пачки 'F' из одного кадра
+ * CODEC_RAW_RGB (или CODEC_RAW_RGB_ZLIB) с запросом протокола v4 - нагрузка
+ * на пул кодирования сервера. Сервер без v4 такие пачки отбрасывает.
+ *
+ * Если сервер присылает расписание ('P'), соединение переходит на его период
+ * и фазу; выдачи кредита ('C') ограничивают очередь соединения так же, как
+ * max_backlog. Пиковая скорость отправки считается по окнам в 100 мс.
+ *
+ * Если сервер присылает подтверждения сохранности ('D', режимы periodic и group),
+ * для каждого кадра измеряется время от отправки последнего байта до подтверждения.
+ * Если сервер не успевает принимать и у соединения копится больше max_backlog
+ * кадров, новые кадры не ставятся в очередь и учитываются как пропущенные.
+ */
+class LoadGenerator {
+public:
+    /**
+     * @brief Конструктор - загружает набор кадров
+     * @param config Параметры нагрузки
+     * @throw std::runtime_error Если набор кадров пуст или каталог не читается
+     */
+    explicit LoadGenerator(const LoadConfig& config);
+
+    LoadGenerator(const LoadGenerator&) = delete;
+    LoadGenerator& operator=(const LoadGenerator&) = delete;
+
+public:
+    /**
+     * @brief Выполнить прогон и вывести отчет
+     * @throw std::runtime_error При ошибках epoll
+     */
+    void Run();
+
+private:
+    /**
+     * @brief Состояние соединения
+     */
+    enum class State {
+        K_CONNECTING, ///< Идет неблокирующий connect()
+        K_AUTH,       ///< Запрос аутентификации отправлен, ждем 'Y'/'V'/'N'
+        K_ACTIVE,     ///< Отправка кадров
+        K_CLOSED      ///< Соединение закрыто
+    };
+
+    /**
+     * @brief Сообщение в очереди отправки соединения
+     */
+    struct Pending {
+        size_t frame{};  ///< Индекс кадра в наборе (SIZE_MAX - запрос аутентификации)
+        size_t offset{}; ///< Сколько байт уже отправлено
+    };
+
+    /**
+     * @brief Синтетический клиент
+     */
+    struct Connection {
+        UniqueFD fd;                      ///< Сокет
+        State state{State::K_CONNECTING}; ///< Состояние
+        std::vector<uint8_t> auth;        ///< Запрос аутентификации
+        std::deque<Pending> out;          ///< Очередь отправки
+        std::vector<uint8_t> in;          ///< Непрочитанные байты ответов сервера
+        uint64_t sent_seq{0};             ///< Кадров отправлено целиком (номер последнего)
+        uint64_t acked_seq{0};            ///< Последний подтвержденный номер
+        std::deque<uint64_t> sent_us;     ///< Время отправки неподтвержденных кадров
+        uint64_t next_due_us{0};          ///< Время следующего кадра (устаревшие таймеры пропускаются)
+        uint64_t period_us{0};            ///< Период из расписания сервера (0 - _interval_us)
+        uint64_t credit_frames{0};        ///< Граница кадров от сервера (0 - без кредита)
+        uint64_t credit_bytes{0};         ///< Граница байт данных кадров от сервера
+        uint64_t queued_frames{0};        ///< Кадров поставлено в очередь за соединение
+        uint64_t queued_bytes{0};         ///< Байт данных кадров поставлено в очередь
+    };
+
+    /**
+     * @brief Загрузить кадры из каталога или сгенерировать их
+     */
+    void LoadCorpus();
+
+    /**
+     * @brief Сгенерировать кадры без PNG, похожие на экран
+     */
+    void MakeRawCorpus();
+
+    /**
+     * @brief Открыть соединения и зарегистрировать их в epoll
+     */
+    void OpenConnections();
+
+    /**
+     * @brief Сформировать запрос аутентификации со случайными именами
+     * @return Сообщение 'A'
+     */
+    std::vector<uint8_t> MakeAuthRequest();
+
+    /**
+     * @brief Обработать событие epoll соединения
+     * @param index Индекс соединения
+     * @param events Маска событий
+     */
+    void HandleEvent(size_t index, uint32_t events);
+
+    /**
+     * @brief Отправить все, что позволяет сокет
+     * @param conn Соединение
+     * @return false при ошибке соединения
+     */
+    bool Flush(Connection& conn);
+
+    /**
+     * @brief Прочитать и разобрать ответы сервера
+     * @param index Индекс соединения
+     * @return false при ошибке или закрытии соединения
+     */
+    bool Receive(size_t index);
+
+    /**
+     * @brief Учесть подтверждение сохранности
+     * @param conn Соединение
+     * @param last_seq Последний подтвержденный номер
+     */
+    void HandleAck(Connection& conn, uint64_t last_seq);
+
+    /**
+     * @brief Перейти на расписание сервера
+     * @param index Индекс соединения
+     * @param period_ms Период
+     * @param phase_ms Фаза относительно начала эпохи
+     */
+    void HandleSchedule(size_t index, uint32_t period_ms, uint32_t phase_ms);
+
+    /**
+     * @brief Закрыть соединение
+     * @param conn Соединение
+     */
+    void Close(Connection& conn);
+
+    /**
+     * @brief Поставить в очередь кадры соединений, чье время подошло
+     * @param now_us Текущее время
+     * @return Время следующей отправки
+     */
+    uint64_t Schedule(uint64_t now_us);
+
+    /**
+     * @brief Вывести строку прогресса за последний интервал
+     * @param elapsed_sec Прошло секунд с начала
+     */
+    void PrintProgress(unsigned elapsed_sec);
+
+    /**
+     * @brief Вывести итоговый отчет
+     * @param send_sec Фактическая длительность отправки
+     */
+    void PrintReport(double send_sec);
+
+private:
+    LoadConfig _config;                        ///< Параметры нагрузки
+    std::mt19937 _rng;                         ///< Генератор случайных чисел
+
+    std::vector<std::vector<uint8_t>> _corpus; ///< Готовые сообщения 'I' или 'F' (заголовок и кадр)
+    size_t _frame_overhead{};                  ///< Байт сообщения сверх данных кадра (для учета кредита)
+    std::vector<Connection> _connections;      ///< Соединения
+    UniqueFD _epoll_fd;                        ///< epoll всех соединений
+
+    /// Очередь отправок: (время, индекс соединения), ближайшее время сверху
+    std::priority_queue<std::pair<uint64_t, size_t>, std::vector<std::pair<uint64_t, size_t>>, std::greater<>> _timers;
+    uint64_t _interval_us{};             ///< Интервал между кадрами соединения
+    int64_t _wall_offset_us{};           ///< Системное время минус монотонное (для фаз расписания)
+    uint64_t _start_us{};                ///< Начало отправки
+    std::vector<uint32_t> _windows;      ///< Кадров отправлено по окнам в 100 мс с _start_us
+
+    std::vector<uint32_t> _latencies_us; ///< Задержки подтверждений
+    uint64_t _frames_sent{0};            ///< Кадров отправлено
+    uint64_t _bytes_sent{0};             ///< Байт отправлено
+    uint64_t _frames_skipped{0};         ///< Кадров пропущено из-за переполненной очереди
+    uint64_t _frames_acked{0};           ///< Кадров подтверждено
+    size_t _active{0};                   ///< Соединений в состоянии K_ACTIVE
+    size_t _connect_failures{0};         ///< Не удалось подключиться
+    size_t _auth_failures{0};            ///< Отказано в аутентификации
+    size_t _disconnects{0};              ///< Разрывов после аутентификации
+
+    uint64_t _last_frames{0};            ///< _frames_sent на момент прошлой строки прогресса
+    uint64_t _last_bytes{0};             ///< _bytes_sent на момент прошлой строки прогресса
+};
+
+#endif // TOOLS_LOADGEN_LOAD_GENERATOR_H
@@ -0,0 +1,182 @@
+#include <string>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+
+#include <getopt.h>
+
+#include "load_generator.h"
+
+namespace {
+void PrintUsage() {
+    std::cerr << "Usage: loadgen --srv <ip:port> [options]\n"
+              << "  --clients <n>         simultaneous connections (default 100)\n"
+              << "  --rate <fps>          frames per second per connection (default 1)\n"
+              << "  --duration <sec>      sending time (default 10)\n"
+              << "  --corpus <dir>        send files from directory instead of synthetic frames\n"
+              << "  --size <min>[:<max>]  synthetic frame size in bytes (default 102400)\n"
+              << "  --backlog <n>         max queued frames per connection before skipping (default 16)\n"
+              << "  --drain <sec>         time to wait for acks after sending (default 5)\n"
+              << "  --seed <n>            random seed (default 1)\n"
+              << "  --aligned             all connections capture on the same period boundary\n"
+              << "  --raw <w>x<h>         send synthetic raw RGB frames for server-side encoding (protocol v4)\n"
+              << "  --zlib                compress raw frames with zlib\n";
+}
+
+unsigned long ParseNumber(const char* value, const char* option) {
+    char* end{nullptr};
+    unsigned long result{std::strtoul(value, &end, 10)};
+
+    if (end == value || *end != '\0') {
+        throw std::invalid_argument(std::string("invalid value for --") + option + ": " + value);
+    }
+
+    return result;
+}
+
+void ParseServer(const std::string& value, LoadConfig& config) {
+    size_t colon{value.rfind(':')};
+
+    if (colon == std::string::npos || colon == 0) {
+        throw std::invalid_argument("--srv must be <ip:port>");
+    }
+
+    unsigned long port{ParseNumber(value.c_str() + colon + 1, "srv")};
+
+    if (port == 0 || port > 65535) {
+        throw std::invalid_argument("invalid port: " + value);
+    }
+
+    config.host = value.substr(0, colon);
+    config.port = static_cast<uint16_t>(port);
+}
+
+void ParseSize(const std::string& value, LoadConfig& config) {
+    size_t colon{value.find(':')};
+
+    config.min_size = ParseNumber(value.substr(0, colon).c_str(), "size");
+    config.max_size = colon == std::string::npos ? config.min_size : ParseNumber(value.substr(colon + 1).c_str(), "size");
+
+    if (config.min_size == 0 || config.min_size > config.max_size) {
+        throw std::invalid_argument("invalid --size: " + value);
+    }
+}
+
+void ParseRawSize(const std::string& value, LoadConfig& config) {
+    size_t x{value.find('x')};
+
+    if (x == std::string::npos) {
+        throw std::invalid_argument("--raw must be <width>x<height>");
+    }
+
+    unsigned long width{ParseNumber(value.substr(0, x).c_str(), "raw")};
+    unsigned long height{ParseNumber(value.substr(x + 1).c_str(), "raw")};
+
+    if (width == 0 || height == 0 || width > 65535 || height > 65535) {
+        throw std::invalid_argument("invalid --raw: " + value);
+    }
+
+    config.raw_width = static_cast<uint16_t>(width);
+    config.raw_height = static_cast<uint16_t>(height);
+}
+
+LoadConfig ParseArguments(int argc, char* argv[]) {
+    static const option long_options[] = {
+        {"srv",      required_argument, nullptr, 's'},
+        {"clients",  required_argument, nullptr, 'c'},
+        {"rate",     required_argument, nullptr, 'r'},
+        {"duration", required_argument, nullptr, 'd'},
+        {"corpus",   required_argument, nullptr, 'C'},
+        {"size",     required_argument, nullptr, 'z'},
+        {"backlog",  required_argument, nullptr, 'b'},
+        {"drain",    required_argument, nullptr, 'D'},
+        {"seed",     required_argument, nullptr, 'S'},
+        {"aligned",  no_argument,       nullptr, 'a'},
+        {"raw",      required_argument, nullptr, 'R'},
+        {"zlib",     no_argument,       nullptr, 'Z'},
+        {nullptr,    0,                 nullptr, 0}
+    };
+
+    LoadConfig config;
+    bool has_server{false};
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "", long_options, nullptr)) != -1) {
+        switch (opt) {
+            case 's':
+                ParseServer(optarg, config);
+                has_server = true;
+                break;
+            case 'c':
+                config.clients = ParseNumber(optarg, "clients");
+                break;
+            case 'r':
+                config.rate = std::strtod(optarg, nullptr);
+                break;
+            case 'd':
+                config.duration_sec = static_cast<unsigned>(ParseNumber(optarg, "duration"));
+                break;
+            case 'C':
+                config.corpus_dir = optarg;
+                break;
+            case 'z':
+                ParseSize(optarg, config);
+                break;
+            case 'b':
+                config.max_backlog = ParseNumber(optarg, "backlog");
+                break;
+            case 'D':
+                config.drain_sec = static_cast<unsigned>(ParseNumber(optarg, "drain"));
+                break;
+            case 'S':
+                config.seed = static_cast<uint32_t>(ParseNumber(optarg, "seed"));
+                break;
+            case 'a':
+                config.aligned = true;
+                break;
+            case 'R':
+                ParseRawSize(optarg, config);
+                break;
+            case 'Z':
+                config.raw_zlib = true;
+                break;
+            default:
+                throw std::invalid_argument("unknown option");
+        }
+    }
+
+    if (!has_server || optind != argc) {
+        throw std::invalid_argument("--srv is required");
+    }
+
+    if (config.clients == 0 || config.rate <= 0.0 || config.duration_sec == 0 || config.max_backlog == 0) {
+        throw std::invalid_argument("--clients, --rate, --duration and --backlog must be positive");
+    }
+
+    return config;
+}
+}
+
+int main(int argc, char* argv[]) {
+    LoadConfig config;
+
+    try {
+        config = ParseArguments(argc, argv);
+    } catch (const std::invalid_argument& ex) {
+        std::cerr << ex.what() << '\n';
+        PrintUsage();
+
+        return 1;
+    }
+
+    try {
+        LoadGenerator generator(config);
+        generator.Run();
+    } catch (const std::exception& ex) {
+        std::cerr << ex.what() << '\n';
+
+        return 1;
+    }
+
+    return 0;
+}
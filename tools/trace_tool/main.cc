@@ -0,0 +1,168 @@
+#include <array>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+
+#include "trace_format.h"
+
+namespace {
+/**
+ * @brief Этап пути кадра: разность двух отметок TraceRecord
+ */
+struct Stage {
+    const char* name;            ///< Название для вывода
+    uint64_t TraceRecord::*from; ///< Начало этапа
+    uint64_t TraceRecord::*to;   ///< Конец этапа
+};
+
+const std::array<Stage, 7> STAGES{{
+    {"capture+encode", &TraceRecord::capture_start_us, &TraceRecord::encode_done_us},
+    {"client prepare", &TraceRecord::encode_done_us, &TraceRecord::send_start_us},
+    {"network",        &TraceRecord::send_start_us, &TraceRecord::recv_done_us},
+    {"server buffer",  &TraceRecord::recv_done_us, &TraceRecord::handle_us},
+    {"save screen",    &TraceRecord::handle_us, &TraceRecord::submitted_us},
+    {"storage",        &TraceRecord::submitted_us, &TraceRecord::stored_us},
+    {"total",          &TraceRecord::capture_start_us, &TraceRecord::stored_us},
+}};
+
+void PrintUsage() {
+    std::cerr << "Usage:\n"
+              << "  trace_tool stats <trace.bin> [hostname/username]\n"
+              << "  trace_tool dump <trace.bin>\n";
+}
+
+/**
+ * @brief Прочитать все записи файла трассировки
+ * @param path Путь к файлу
+ * @param filter Ключ клиента (пусто - все клиенты)
+ * @param[out] clients Ключи клиентов в порядке записей
+ * @return Записи
+ */
+std::vector<TraceRecord> ReadTrace(const std::string& path, const std::string& filter, std::vector<std::string>& clients) {
+    std::ifstream in(path, std::ios::binary);
+
+    if (!in) {
+        throw std::runtime_error("cannot open " + path);
+    }
+
+    TraceFileHeader header{};
+
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, Trace::FILE_MAGIC, sizeof(header.magic)) != 0) {
+        throw std::runtime_error("not a trace file: " + path);
+    }
+
+    std::vector<TraceRecord> records;
+    TraceRecord record{};
+
+    // Недописанная последняя запись (обрыв при записи) игнорируется
+    while (in.read(reinterpret_cast<char*>(&record), sizeof(record))) {
+        std::string client(record.client_len, '\0');
+
+        if (!in.read(client.data(), record.client_len)) {
+            break;
+        }
+
+        if (!filter.empty() && client != filter) {
+            continue;
+        }
+
+        records.push_back(record);
+        clients.push_back(std::move(client));
+    }
+
+    return records;
+}
+
+double Percentile(const std::vector<int64_t>& sorted, double p) {
+    size_t index{static_cast<size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5)};
+
+    return static_cast<double>(sorted[index]) / 1000.0;
+}
+
+void PrintStats(const std::string& path, const std::string& filter) {
+    std::vector<std::string> clients;
+    std::vector<TraceRecord> records{ReadTrace(path, filter, clients)};
+
+    std::printf("%zu frames\n", records.size());
+    std::printf("%-16s %8s %10s %10s %10s %10s\n", "stage (ms)", "count", "p50", "p90", "p99", "max");
+
+    for (const auto& stage : STAGES) {
+        std::vector<int64_t> values;
+        values.reserve(records.size());
+
+        for (const auto& r : records) {
+            if (r.*stage.from == 0 || r.*stage.to == 0) {
+                continue;
+            }
+
+            values.push_back(static_cast<int64_t>(r.*stage.to - r.*stage.from));
+        }
+
+        if (values.empty()) {
+            std::printf("%-16s %8d %10s %10s %10s %10s\n", stage.name, 0, "-", "-", "-", "-");
+
+            continue;
+        }
+
+        std::sort(values.begin(), values.end());
+
+        std::printf(
+            "%-16s %8zu %10.3f %10.3f %10.3f %10.3f\n",
+            stage.name, values.size(),
+            Percentile(values, 0.50), Percentile(values, 0.90), Percentile(values, 0.99),
+            static_cast<double>(values.back()) / 1000.0
+        );
+    }
+
+    std::printf("network includes clock offset between client and server hosts\n");
+}
+
+void DumpTrace(const std::string& path) {
+    std::vector<std::string> clients;
+    std::vector<TraceRecord> records{ReadTrace(path, "", clients)};
+
+    for (size_t i{0}; i < records.size(); ++i) {
+        const TraceRecord& r{records[i]};
+
+        std::cout << clients[i] << '\t' << r.seq << '\t' << r.length;
+
+        for (const auto& stage : STAGES) {
+            if (r.*stage.from == 0 || r.*stage.to == 0) {
+                std::cout << "\t-";
+            } else {
+                std::cout << '\t' << static_cast<int64_t>(r.*stage.to - r.*stage.from);
+            }
+        }
+
+        std::cout << '\n';
+    }
+}
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        std::string command{argc > 1 ? argv[1] : ""};
+
+        if (command == "stats" && (argc == 3 || argc == 4)) {
+            PrintStats(argv[2], argc == 4 ? argv[3] : "");
+        } else if (command == "dump" && argc == 3) {
+            DumpTrace(argv[2]);
+        } else {
+            PrintUsage();
+
+            return 1;
+        }
+    } catch (const std::exception& ex) {
+        std::cerr << ex.what() << '\n';
+
+        return 1;
+    }
+
+    return 0;
+}